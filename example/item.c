@@ -28,26 +28,59 @@
 
 #include "item.h"
 #include "basic_contexts.h"
+#include "json_scan.h"
 
 
 
-void freeItem3 (item_root* root)
+/**********************************  ITEM ARENA  *********************/
+
+#define ARENA_CHUNK_SIZE    65536
+#define ARENA_ALIGNMENT     sizeof(long long)
+
+struct item_arena_chunk {
+    item_arena_chunk*   previous;
+    long long           data[];
+};
+
+
+void init_item_arena (item_arena* arena)
 {
-    int i;
-    item_container* ic;
-    switch (root->item_type)
+    arena->chunks = NULL;
+    arena->next = arena->end = NULL;
+}
+
+
+void* item_arena_allocate (item_arena* arena, size_t size)
+{
+    size = (size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+    if ((size_t)(arena->end - arena->next) < size)
     {
-        case ITEM_MAP:
-        case ITEM_ARRAY:
-            ic = (item_container*)root;
-            for (i=0; i < ic->count; i++)
-            {
-                freeItem3(ic->items[i]);
-            }
+        size_t chunk_size = size > ARENA_CHUNK_SIZE / 4 ? size : ARENA_CHUNK_SIZE;
+        item_arena_chunk* chunk = malloc (sizeof(item_arena_chunk) + chunk_size);
+        if (!chunk)
+            return NULL;
+        chunk->previous = arena->chunks;
+        arena->chunks = chunk;
+        if (chunk_size != ARENA_CHUNK_SIZE)
+            return chunk->data;    /* large items get a chunk of their own, the current one goes on */
+        arena->next = (char*)chunk->data;
+        arena->end = arena->next + chunk_size;
+    }
+    void* result = arena->next;
+    arena->next += size;
+    return result;
+}
 
-        default:
-            free(root);
+
+void free_item_arena (item_arena* arena)
+{
+    while (arena->chunks)
+    {
+        item_arena_chunk* chunk = arena->chunks;
+        arena->chunks = chunk->previous;
+        free (chunk);
     }
+    arena->next = arena->end = NULL;
 }
 
 /**********************************  ITEM-TREE  to  JSON FILE  *********************/
@@ -59,6 +92,7 @@ static void item32jsonFile (FILE* file, item_root* item)
     int    i,j = 0;
     item_container* jc;
     char* cp;
+    char* ce;
     char c;
     unsigned u, ti;
     static unsigned tabs = 0;
@@ -133,10 +167,17 @@ static void item32jsonFile (FILE* file, item_root* item)
         case ITEM_STRING:
             fprintf (file, "\"");
             cp = ((item_string*)item)->string;
-            while ((c = *cp++))
+            ce = cp + ((item_string*)item)->length;
+            while (cp < ce)
             {
-                if (c & 0x80) { /* unicode, codepoint at most 16 bits */
-                    if (c & 0x20)
+                c = *cp++;
+                if (c & 0x80) { /* unicode, beyond 16 bits as a surrogate pair */
+                    if ((c & 0xf0) == 0xf0)
+                    {
+                        u = c & 0x07;
+                        j = 3;
+                    }
+                    else if (c & 0x20)
                     {
                         u = c & 0x0f;
                         j = 2;
@@ -146,10 +187,13 @@ static void item32jsonFile (FILE* file, item_root* item)
                         u = c & 0x1f;
                         j = 1;
                     }
-                    for (i=0; i < j; i++) {
+                    for (i=0; i < j && cp < ce; i++) {
                         u = (u << 6) | (*cp++ & 0x3f);
                     }
-                    fprintf (file, "\\u%04x", u);
+                    if (u >= 0x10000)
+                        fprintf (file, "\\u%04x\\u%04x", 0xd800 + ((u - 0x10000) >> 10), 0xdc00 + (u & 0x3ff));
+                    else
+                        fprintf (file, "\\u%04x", u);
                 }
                 else
                     switch (c) {
@@ -183,16 +227,33 @@ void item32JsonFile (FILE* file, item_root* item)
 
 
 /**********************************  JSON FILE  to  ITEM-TREE  *********************/
-/* correct JSON is assumed. No error checks whatsoever!!! */
+/* correct JSON is assumed. Apart from UTF-8 validation, no error checks whatsoever!!! */
+
+static const char* jsonEnd;
 
-#define scanSpace while (**ptr == ' ' || **ptr == '\n' || **ptr == '\t') (*ptr)++
+#define scanSpace *ptr = (const char*)json_skip_white_space ((const uint8_t*)*ptr, (const uint8_t*)jsonEnd)
 
 #define  allocate_item(typ, typeMark, extra) \
-malloc (sizeof(typ) + extra); \
+item_arena_allocate (arena, sizeof(typ) + extra); \
 result->item_type = typeMark
 
 
-static item_container*  allocate_container(item_types type, int cnt)
+/* Children of the open containers, until a container is complete and gets its own copy */
+static item_root** pending;
+static int pendingCount, pendingCapacity;
+
+static void push_pending (item_root* item)
+{
+    if (pendingCount == pendingCapacity)
+    {
+        pendingCapacity = pendingCapacity ? 2 * pendingCapacity : 256;
+        pending = realloc (pending, pendingCapacity * sizeof(item_root*));
+    }
+    pending[pendingCount++] = item;
+}
+
+
+static item_container*  allocate_container(item_arena* arena, item_types type, int cnt)
 {
     item_container* result = allocate_item(item_container, type, cnt*sizeof(void*));
     result->count = cnt;
@@ -200,125 +261,83 @@ static item_container*  allocate_container(item_types type, int cnt)
 }
 
 
-static item_root* jsonString2item3 (const char** ptr); /* prototype */
+static item_root* jsonString2item3 (const char** ptr, item_arena* arena); /* prototype */
 
-static item_container* pullMapPair (const char** ptr, int count)
+/* The opening bracket is passed; pulls the items up to the closing one */
+static item_container* pullContainer (const char** ptr, item_arena* arena, item_types type)
 {
-    item_container* result;
-    scanSpace;
-    item_root*  it1 = jsonString2item3(ptr);
-    scanSpace;
-    (*ptr)++; /* ':' */
-    scanSpace;
-    item_root*  it2 = jsonString2item3(ptr);
+    int base = pendingCount;
     scanSpace;
-    char c = *(*ptr)++;
-    if (c == ',')
-        result = pullMapPair (ptr, count + 2);
-    else
-        result = allocate_container (ITEM_MAP, count + 2);
-    result->items[count] = it1;
-    result->items[count+1] = it2;
-    return result;
-}
+    while (**ptr != '}' && **ptr != ']')
+    {
+        push_pending (jsonString2item3 (ptr, arena));
+        scanSpace;
+        if (**ptr == ':' || **ptr == ',')
+            (*ptr)++;
+        scanSpace;
+    }
+    (*ptr)++;
 
-static item_container* pullArray (const char** ptr, int count)
-{
-    item_container* result;
-    scanSpace;
-    item_root* it = jsonString2item3 (ptr);
-    scanSpace;
-    char c = *(*ptr)++;
-    if (c == ',')
-        result = pullArray (ptr, count + 1);
-    else
-        result = allocate_container (ITEM_ARRAY, count + 1);
-    result->items[count] = it;
+    item_container* result = allocate_container (arena, type, pendingCount - base);
+    memcpy (result->items, pending + base, (pendingCount - base) * sizeof(item_root*));
+    pendingCount = base;
     return result;
 }
 
-static item_string* pullString (const char** ptr, int length)
+/* The opening quote is passed */
+static item_string* pullString (const char** ptr, item_arena* arena)
 {
+    const uint8_t* p = (const uint8_t*)*ptr;
+    const uint8_t* end = (const uint8_t*)jsonEnd;
+    const uint8_t* q = p;
+    bool non_ascii = false;
     item_string* result;
-    char c = *(*ptr)++;
-    if (c != '"')
+    int length = 0;
+
+    /* find the closing quote, the string is never longer than its JSON */
+    for (;;)
     {
-        int cl = 0;
-        unsigned mask = 0;
-        unsigned codepoint = (uint8_t)c;
-        if (c == '\\')
-        {
-            c = *(*ptr)++;
-            switch (c) {
-                case '\\': codepoint = '\\'; break;
-                case '/': codepoint = '/';  break;
-                case '"': codepoint = '"';  break;
-                case 'b': codepoint = '\b'; break;
-                case 't': codepoint = '\t'; break;
-                case 'n': codepoint = '\n'; break;
-                case 'f': codepoint = '\f'; break;
-                case 'r': codepoint = '\r'; break;
-                case 'u':
-                    sscanf(*ptr,"%4x",&codepoint);
-                    *ptr += 4;
-                    if (codepoint & 0xff80)
-                    {
-                        if (codepoint & 0xf800)
-                        {
-                            cl = 2;
-                            mask = 0xe0;
-                        }
-                        else
-                        {
-                            cl = 1;
-                            mask = 0xc0;
-                        }
-                    }
+        q = json_scan_string (q, end, &non_ascii);
+        if (q + 1 < end && *q == '\\')
+            q += 2;
+        else
+            break;
+    }
+    result = allocate_item(item_string, ITEM_STRING, q - p);
 
-                default:
-                    break;
-            }
-        }
-        result = pullString (ptr, length + cl + 1);
-        for (;cl > 0;cl--)
+    while (p < q)
+    {
+        const uint8_t* run = p;
+        p = json_scan_string (p, q, &non_ascii);
+        memcpy (result->string + length, run, p - run);
+        length += (int)(p - run);
+        if (p < q && *p == '\\')
         {
-            result->string[length+cl] = (codepoint & 0x3F) | 0x80;
-            codepoint >>= 6;
+            int n;
+            int l = json_unescape (p + 1, end, (uint8_t*)result->string + length, &n);
+            if (l < 0)
+                l = n = 0;
+            length += n;
+            p += 1 + l;
         }
-        result->string[length] = (char)(codepoint | mask);
-    }
-    else
-    {
-        result = allocate_item(item_string,ITEM_STRING,length + 1);
-        result->string[length] = 0;
+        else
+            break;
     }
+    result->length = length;
+    *ptr = (const char*)(q < end ? q + 1 : q);
     return result;
 }
 
-static item_root* jsonString2item3 (const char** ptr)
+static item_root* jsonString2item3 (const char** ptr, item_arena* arena)
 {
     scanSpace;
     item_root* result = NULL;
 
     char c = *(*ptr)++;
     switch (c) {
-        case '{':
-            scanSpace;
-            if (**ptr == '}')
-                result = (item_root*)allocate_container (ITEM_MAP, 0);
-            else
-                result = (item_root*)pullMapPair (ptr, 0);
-            break;
-
-        case '[':
-            scanSpace;
-            if (**ptr == ']')
-                result = (item_root*)allocate_container (ITEM_ARRAY, 0);
-            else
-                result = (item_root*)pullArray (ptr, 0);
-            break;
-
-        case '"':   result = (item_root*)pullString (ptr, 0);break;
+        case '{':   result = (item_root*)pullContainer (ptr, arena, ITEM_MAP); break;
+        case '[':   result = (item_root*)pullContainer (ptr, arena, ITEM_ARRAY); break;
+        case '"':   result = (item_root*)pullString (ptr, arena);break;
         case 'n':   result = allocate_item(item_root,ITEM_NIL,0); *ptr+=3;break;
         case 't':   result = allocate_item(item_root,ITEM_TRUE,0); *ptr+=3;break;
         case 'f':   result = allocate_item(item_root,ITEM_FALSE,0); *ptr+=4;break;
@@ -326,32 +345,28 @@ static item_root* jsonString2item3 (const char** ptr)
         case '-':
         case '0': case '1': case '2': case '3': case '4': case '5': case '6': case '7': case '8': case '9':
         {
-            char buffer[100];
-            int i = 0;
-            bool real = false;;
-            buffer[i++] = c;
+            const char* start = *ptr - 1;
+            bool real = false;
             c = **ptr;
             while (c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E' || (('0' <= c) && (c <= '9')))
             {
-                buffer[i++] = c;
                 if (c == '.' || c == 'e' || c == 'E')
                     real = true;
                 c = *++*ptr;
             }
-            buffer[i++] = 0;
             if (real)
             {
                 result = (item_root*)allocate_item(item_real,ITEM_REAL,0);
-                double d;
-                sscanf(buffer,"%lg",&d);
-                ((item_real*)result)->value = d;
+                ((item_real*)result)->value = strtod (start, NULL);
             }
             else
             {
+                unsigned long long value = 0;
+                const char* p = *start == '-' ? start + 1 : start;
+                while (p < *ptr)
+                    value = 10 * value + (unsigned long long)(*p++ - '0');
                 result = (item_root*)allocate_item(item_integer,ITEM_INTEGER,0);
-                long d;
-                sscanf(buffer,"%ld",&d);
-                ((item_integer*)result)->value = d;
+                ((item_integer*)result)->value = *start == '-' ? -(long long)value : (long long)value;
             }
         }
             break;
@@ -364,18 +379,26 @@ static item_root* jsonString2item3 (const char** ptr)
 }
 
 
-item_root* jsonFile2item3 (FILE* file)
+item_root* jsonFile2item3 (FILE* file, item_arena* arena)
 {
     fseek (file, 0, SEEK_END);
     long length = ftell(file);
     char* buffer = malloc (length+1);
 
     fseek (file, 0l, SEEK_SET);
-    fread (buffer, 1, length, file);
+    length = (long)fread (buffer, 1, length, file);
     buffer[length] = 0;
-    const char* ptr = buffer;
-    item_root* result = jsonString2item3(&ptr);
+    item_root* result = NULL;
+    if (json_valid_utf8 ((const uint8_t*)buffer, (unsigned long)length))
+    {
+        const char* ptr = buffer;
+        jsonEnd = buffer + length;
+        result = jsonString2item3(&ptr, arena);
+    }
     free(buffer);
+    free(pending);
+    pending = NULL;
+    pendingCount = pendingCapacity = 0;
     return result;
 }
 
@@ -386,7 +409,7 @@ static void item32packContext(cw_pack_context* pc, item_root* item)
 {
     int    i;
     item_container* ic;
-    char* cp;
+    item_string* is;
 
     switch (item->item_type)
     {
@@ -425,8 +448,8 @@ static void item32packContext(cw_pack_context* pc, item_root* item)
             break;
 
         case ITEM_STRING:
-            cp = ((item_string*)item)->string;
-            cw_pack_str(pc, cp, (unsigned)strlen(cp));
+            is = (item_string*)item;
+            cw_pack_str(pc, is->string, (unsigned)is->length);
             break;
 
         default:    break;
@@ -444,7 +467,7 @@ void item32cwpackFile (FILE* file, item_root* item)
 
 /**********************************  CWPACK FILE  to  ITEM-TREE  *********************/
 
-static item_root* packContext2item3 (cw_unpack_context* uc)
+static item_root* packContext2item3 (cw_unpack_context* uc, item_arena* arena)
 {
     int i,dim;
     item_root* result;
@@ -486,27 +509,27 @@ static item_root* packContext2item3 (cw_unpack_context* uc)
             break;
 
         case CWP_ITEM_STR:
-            result = (item_root*)allocate_item(item_string,ITEM_STRING,uc->item.as.str.length + 1);
-            strncpy(((item_string*)result)->string, (const char*)uc->item.as.str.start, uc->item.as.str.length);
-            ((item_string*)result)->string[uc->item.as.str.length] = 0;
+            result = (item_root*)allocate_item(item_string,ITEM_STRING,uc->item.as.str.length);
+            ((item_string*)result)->length = (int)uc->item.as.str.length;
+            memcpy(((item_string*)result)->string, uc->item.as.str.start, uc->item.as.str.length);
             break;
 
         case CWP_ITEM_MAP:
             dim = 2 * uc->item.as.map.size;
-            ic = allocate_container(ITEM_MAP, dim);
+            ic = allocate_container(arena, ITEM_MAP, dim);
             for (i=0; i<dim; i++)
             {
-                ic->items[i] = packContext2item3 (uc);
+                ic->items[i] = packContext2item3 (uc, arena);
             }
             result = (item_root*)ic;
             break;
 
         case CWP_ITEM_ARRAY:
             dim = uc->item.as.array.size;
-            ic = allocate_container(ITEM_ARRAY, dim);
+            ic = allocate_container(arena, ITEM_ARRAY, dim);
             for (i=0; i<dim; i++)
             {
-                ic->items[i] = packContext2item3 (uc);
+                ic->items[i] = packContext2item3 (uc, arena);
             }
             result = (item_root*)ic;
             break;
@@ -518,11 +541,11 @@ static item_root* packContext2item3 (cw_unpack_context* uc)
     return result;
 }
 
-item_root* cwpackFile2item3 (FILE* file)
+item_root* cwpackFile2item3 (FILE* file, item_arena* arena)
 {
     stream_unpack_context suc;
     init_stream_unpack_context(&suc, 0, file);
-    item_root* result = packContext2item3(&suc.uc);
+    item_root* result = packContext2item3(&suc.uc, arena);
     terminate_stream_unpack_context(&suc);
     return result;
 }
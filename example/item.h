@@ -62,11 +62,30 @@
 
     typedef struct {
         item_types     item_type;
-        char           string[];
+        int            length;
+        char           string[];    /* not NUL terminated */
     } item_string;
 
 
-    void freeItem3 (item_root* root);
+
+    /**************  ITEM ARENA  **********************/
+
+    /* Items are bump allocated in chunks and all released at once with the arena */
+
+    typedef struct item_arena_chunk item_arena_chunk;
+
+    typedef struct {
+        item_arena_chunk*   chunks;
+        char*               next;
+        char*               end;
+    } item_arena;
+
+
+    void init_item_arena (item_arena* arena);
+
+    void* item_arena_allocate (item_arena* arena, size_t size);
+
+    void free_item_arena (item_arena* arena);
 
 
 
@@ -74,11 +93,11 @@
 
     void item32JsonFile (FILE* file, item_root* item);
 
-    item_root* jsonFile2item3 (FILE* file);
+    item_root* jsonFile2item3 (FILE* file, item_arena* arena);
 
     void item32cwpackFile (FILE* file, item_root* item);
 
-    item_root* cwpackFile2item3 (FILE* file);
+    item_root* cwpackFile2item3 (FILE* file, item_arena* arena);
 
 
 
@@ -42,26 +42,33 @@ int main(int argc, const char * argv[])
     FILE* jsonFileOut;
     FILE* cwpackFileIn;
     FILE* cwpackFileOut;
+    item_arena arena;
 
+    init_item_arena (&arena);
     jsonFileIn = fopen (filename, "r");
-    item_root* root = jsonFile2item3 (jsonFileIn);
+    item_root* root = jsonFile2item3 (jsonFileIn, &arena);
     fclose(jsonFileIn);
+    if (!root)
+    {
+        printf("%s isn't valid UTF-8\n", filename);
+        return 1;
+    }
 
     strcat (filename, ".msgpack");
     cwpackFileOut = fopen (filename, "w");
     item32cwpackFile (cwpackFileOut, root);
     fclose(cwpackFileOut);
-    freeItem3(root);
+    free_item_arena(&arena);
 
     cwpackFileIn = fopen (filename, "r");
-    root = cwpackFile2item3 (cwpackFileIn);
+    root = cwpackFile2item3 (cwpackFileIn, &arena);
     fclose(cwpackFileIn);
 
     strcat (filename, ".json");
     jsonFileOut = fopen (filename, "w");
     item32JsonFile (jsonFileOut, root);
     fclose(jsonFileOut);
-    freeItem3(root);
+    free_item_arena(&arena);
 
     return 0;
 }
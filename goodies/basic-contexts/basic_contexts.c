@@ -20,11 +20,28 @@
  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 
+#ifdef __linux__
+#define _GNU_SOURCE     /* memfd_create, copy_file_range, O_DIRECT */
+#include <sys/sendfile.h>
+#endif
 
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+#if defined(__linux__) && defined(MSG_ZEROCOPY)
+#include <linux/errqueue.h>
+#define CAN_ZEROCOPY
+#endif
 
 #include "basic_contexts.h"
 
@@ -312,6 +329,131 @@ void file_pack_context_release_barrier (file_pack_context* fpc)
 }
 
 
+void file_pack_context_blob_chunk (file_pack_context* fpc, const void* v, uint32_t l)
+{
+    cw_pack_context* pc = (cw_pack_context*)fpc;
+    if (pc->return_code)
+        return;
+
+    if (fpc->barrier || l < (unsigned long)(pc->end - pc->start))
+    {
+        cw_pack_blob_chunk (pc, v, l);
+        return;
+    }
+
+    int rc = flush_file_pack_context(pc);
+    const uint8_t *src = (const uint8_t*)v;
+    while (rc == CWP_RC_OK && l)
+    {
+        long written = write (fpc->fileDescriptor, src, l);
+        if (written <= 0)
+        {
+            pc->err_no = errno;
+            rc = CWP_RC_ERROR_IN_HANDLER;
+        }
+        else
+        {
+            src += written;
+            l -= (uint32_t)written;
+        }
+    }
+    pc->return_code = rc;
+}
+
+
+/*
+ * The header goes through the buffer, which is then flushed so the payload can follow it
+ * directly in the file. copy_file_range works between regular files, sendfile to any
+ * output such as pipes and sockets. If the kernel can't do it, the buffer is used as
+ * bounce buffer.
+ */
+void file_pack_context_bin_from_fd (file_pack_context* fpc, int fd, off_t offset, uint32_t l)
+{
+    cw_pack_context* pc = (cw_pack_context*)fpc;
+    if (pc->return_code)
+        return;
+
+    if (fpc->barrier)
+    {
+        pc->return_code = CWP_RC_ILLEGAL_CALL;
+        return;
+    }
+
+    cw_pack_bin_begin (pc, l);
+    if (pc->return_code)
+        return;
+
+    int rc = flush_file_pack_context(pc);
+    if (rc != CWP_RC_OK)
+    {
+        pc->return_code = rc;
+        return;
+    }
+
+#ifdef __linux__
+    bool use_copy_file_range = true;
+    bool use_sendfile = true;
+#endif
+    while (l)
+    {
+        long moved = -1;
+#ifdef __linux__
+        if (use_copy_file_range)
+        {
+            moved = copy_file_range (fd, &offset, fpc->fileDescriptor, NULL, l, 0);
+            if (moved < 0 && errno != EINTR)
+                use_copy_file_range = false;
+        }
+        else if (use_sendfile)
+        {
+            moved = sendfile (fpc->fileDescriptor, fd, &offset, l);
+            if (moved < 0 && errno != EINTR)
+                use_sendfile = false;
+        }
+        else
+#endif
+        {
+            unsigned long bounce = (unsigned long)(pc->end - pc->start);
+            moved = pread (fd, pc->start, l < bounce ? l : bounce, offset);
+            if (moved < 0 && errno == EINTR)
+                continue;
+            if (moved > 0)
+            {
+                long written = 0;
+                while (written < moved)             /* pipes and sockets take part at a time */
+                {
+                    long n = write (fpc->fileDescriptor, pc->start + written, (unsigned long)(moved - written));
+                    if (n < 0 && errno == EINTR)
+                        continue;
+                    if (n <= 0)
+                    {
+                        pc->err_no = n ? errno : 0;
+                        pc->return_code = CWP_RC_ERROR_IN_HANDLER;
+                        return;
+                    }
+                    written += n;
+                }
+                offset += moved;
+            }
+            else
+            {
+                pc->err_no = moved ? errno : 0;
+                pc->return_code = CWP_RC_ERROR_IN_HANDLER;     /* source shorter than l */
+                return;
+            }
+        }
+        if (moved == 0)
+        {
+            pc->err_no = 0;
+            pc->return_code = CWP_RC_ERROR_IN_HANDLER;     /* source shorter than l */
+            return;
+        }
+        if (moved > 0)
+            l -= (uint32_t)moved;
+    }
+}
+
+
 void terminate_file_pack_context(file_pack_context* fpc)
 {
     fpc->barrier = NULL;
@@ -363,6 +505,8 @@ static int handle_file_unpack_underflow(struct cw_unpack_context* uc, unsigned l
         }
         if (l < 0)
         {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return CWP_RC_WOULD_BLOCK;
             auc->uc.err_no = errno;
             return CWP_RC_ERROR_IN_HANDLER;
         }
@@ -407,6 +551,40 @@ void file_unpack_context_release_barrier (file_unpack_context* fuc)
 }
 
 
+void file_unpack_context_blob_read (file_unpack_context* fuc, void* dst, unsigned long n)
+{
+    cw_unpack_context* uc = (cw_unpack_context*)fuc;
+    if (uc->return_code)
+        return;
+
+    if (fuc->barrier || n < fuc->buffer_length)
+    {
+        cw_unpack_blob_read (uc, dst, n);
+        return;
+    }
+
+    uint8_t *d = (uint8_t*)dst;
+    unsigned long buffered = (unsigned long)(uc->end - uc->current);
+    memcpy (d, uc->current, buffered);
+    uc->current = uc->end;
+    d += buffered;
+    n -= buffered;
+    while (n)
+    {
+        long l = read (fuc->fileDescriptor, d, n);
+        if (l <= 0)
+        {
+            uc->err_no = errno;
+            uc->return_code = l ? CWP_RC_ERROR_IN_HANDLER : CWP_RC_BUFFER_UNDERFLOW;
+            uc->item.type = CWP_NOT_AN_ITEM;
+            return;
+        }
+        d += l;
+        n -= (unsigned long)l;
+    }
+}
+
+
 void terminate_file_unpack_context(file_unpack_context* fuc)
 {
     if (fuc->uc.return_code != CWP_RC_MALLOC_ERROR)
@@ -415,3 +593,1134 @@ void terminate_file_unpack_context(file_unpack_context* fuc)
 }
 
 
+
+/*****************************************  TAIL FILE UNPACK CONTEXT  ***************************/
+
+/*
+ * At end of file the handler waits for the file to grow and then reads on, so an item
+ * that is only partly written is simply completed. On Linux the wait is an inotify watch
+ * on the descriptor, elsewhere (or if inotify is unavailable) the file is polled.
+ */
+
+#define TAIL_POLL_INTERVAL  100     /* ms */
+
+static long milliseconds_now (void)
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return (long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+/* A file that is unlinked, renamed away or truncated below what is read will not grow,
+   and neither will a pipe or socket at end of file */
+static bool tail_file_is_gone (tail_file_unpack_context* tfuc)
+{
+    struct stat st;
+    if (!tfuc->regular || tfuc->renamed || fstat (tfuc->fuc.fileDescriptor, &st) || st.st_nlink == 0)
+        return true;
+    return st.st_size < lseek (tfuc->fuc.fileDescriptor, 0, SEEK_CUR);
+}
+
+
+/* Returns CWP_RC_OK when the file may have grown or CWP_RC_WOULD_BLOCK at timeout */
+static int wait_for_growth (tail_file_unpack_context* tfuc, int timeout)
+{
+#ifdef __linux__
+    if (tfuc->inotifyDescriptor >= 0)
+    {
+        struct pollfd pfd;
+        pfd.fd = tfuc->inotifyDescriptor;
+        pfd.events = POLLIN;
+        int n = poll (&pfd, 1, timeout);
+        if (n < 0 && errno != EINTR)
+            return CWP_RC_ERROR_IN_HANDLER;
+        if (n <= 0)
+            return n ? CWP_RC_OK : CWP_RC_WOULD_BLOCK;
+
+        char events[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+        long l = read (tfuc->inotifyDescriptor, events, sizeof(events));
+        char *p;
+        for (p = events; l > 0 && p < events + l; p += sizeof(struct inotify_event) + ((struct inotify_event*)p)->len)
+            if (((struct inotify_event*)p)->mask & (IN_MOVE_SELF | IN_DELETE_SELF | IN_IGNORED))
+                tfuc->renamed = true;
+        return CWP_RC_OK;
+    }
+#endif
+    struct timespec ts;
+    if (timeout < 0 || timeout > TAIL_POLL_INTERVAL)
+        timeout = TAIL_POLL_INTERVAL;
+    ts.tv_sec = 0;
+    ts.tv_nsec = (long)timeout * 1000000;
+    nanosleep (&ts, NULL);
+    return CWP_RC_OK;
+}
+
+
+static int handle_tail_file_unpack_underflow(struct cw_unpack_context* uc, unsigned long more)
+{
+    tail_file_unpack_context* tfuc = (tail_file_unpack_context*)uc;
+    long deadline = tfuc->timeout >= 0 ? milliseconds_now() + tfuc->timeout : 0;
+
+    for (;;)
+    {
+        int rc = handle_file_unpack_underflow (uc, more);
+        if (rc != CWP_RC_END_OF_INPUT)
+            return rc;
+        if (tail_file_is_gone (tfuc))
+        {
+            /* read what was written before it went */
+            return handle_file_unpack_underflow (uc, more);
+        }
+
+        int timeout = -1;
+        if (tfuc->timeout >= 0)
+        {
+            long left = deadline - milliseconds_now();
+            if (left <= 0)
+                return CWP_RC_WOULD_BLOCK;
+            timeout = (int)left;
+        }
+        rc = wait_for_growth (tfuc, timeout);
+        if (rc == CWP_RC_ERROR_IN_HANDLER)
+            uc->err_no = errno;
+        if (rc != CWP_RC_OK)
+            return rc;
+    }
+}
+
+
+void init_tail_file_unpack_context (tail_file_unpack_context* tfuc, unsigned long initial_buffer_length, int fileDescriptor, int timeout)
+{
+    init_file_unpack_context ((file_unpack_context*)tfuc, initial_buffer_length, fileDescriptor);
+    if (tfuc->fuc.uc.return_code == CWP_RC_MALLOC_ERROR)
+        return;
+    tfuc->fuc.uc.handle_unpack_underflow = &handle_tail_file_unpack_underflow;
+    tfuc->timeout = timeout;
+    tfuc->renamed = false;
+    tfuc->inotifyDescriptor = -1;
+
+    struct stat st;
+    tfuc->regular = !fstat (fileDescriptor, &st) && S_ISREG(st.st_mode);
+    if (!tfuc->regular)
+        return;
+
+#ifdef __linux__
+    /* the /proc link follows the descriptor, whatever the file is called now */
+    char path[40];
+    snprintf (path, sizeof(path), "/proc/self/fd/%d", fileDescriptor);
+    tfuc->inotifyDescriptor = inotify_init1 (IN_CLOEXEC | IN_NONBLOCK);
+    if (tfuc->inotifyDescriptor >= 0 &&
+        inotify_add_watch (tfuc->inotifyDescriptor, path, IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF) < 0)
+    {
+        close (tfuc->inotifyDescriptor);
+        tfuc->inotifyDescriptor = -1;
+    }
+#endif
+}
+
+
+void tail_file_unpack_context_resume (tail_file_unpack_context* tfuc)
+{
+    if (tfuc->fuc.uc.return_code != CWP_RC_WOULD_BLOCK)
+        return;
+
+    tfuc->fuc.uc.return_code = CWP_RC_OK;
+    if (tfuc->fuc.barrier)
+        tfuc->fuc.uc.current = tfuc->fuc.barrier;
+}
+
+
+void terminate_tail_file_unpack_context (tail_file_unpack_context* tfuc)
+{
+    if (tfuc->inotifyDescriptor >= 0)
+        close (tfuc->inotifyDescriptor);
+    tfuc->inotifyDescriptor = -1;
+    terminate_file_unpack_context ((file_unpack_context*)tfuc);
+}
+
+
+
+/*****************************************  RING BUFFER UNPACK CONTEXT  **************************/
+
+/*
+ * The ring is a memory file mapped twice back-to-back. A window [current, end) that
+ * starts in the first mapping and is at most one ring long is always contiguous, so
+ * items straddling the physical end of the ring need no copying.
+ */
+
+static uint8_t* map_ring (unsigned long ring_length)
+{
+    int fd;
+#ifdef __linux__
+    fd = memfd_create ("cwpack_ring", MFD_CLOEXEC);
+#else
+    char name[] = "/tmp/cwpack_ring_XXXXXX";
+    fd = mkstemp (name);
+    if (fd >= 0)
+        unlink (name);
+#endif
+    if (fd < 0)
+        return NULL;
+
+    uint8_t *ring = NULL;
+    if (!ftruncate (fd, (off_t)ring_length))
+    {
+        void *area = mmap (NULL, 2 * ring_length, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (area != MAP_FAILED)
+        {
+            ring = (uint8_t*)area;
+            if (mmap (ring, ring_length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ||
+                mmap (ring + ring_length, ring_length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED)
+            {
+                munmap (area, 2 * ring_length);
+                ring = NULL;
+            }
+        }
+    }
+    close (fd);
+    return ring;
+}
+
+
+static int handle_ring_buffer_unpack_underflow(struct cw_unpack_context* uc, unsigned long more)
+{
+    ring_buffer_unpack_context* rbuc = (ring_buffer_unpack_context*)uc;
+    unsigned long remains = (unsigned long)(uc->end - uc->current);
+
+    if (rbuc->ring_length < more)
+    {
+        unsigned long ring_length = rbuc->ring_length;
+        while (ring_length < more)
+            ring_length = 2 * ring_length;
+
+        uint8_t *ring = map_ring (ring_length);
+        if (!ring)
+            return CWP_RC_BUFFER_UNDERFLOW;
+
+        memcpy (ring, uc->current, remains);
+        munmap (rbuc->ring, 2 * rbuc->ring_length);
+        rbuc->ring = ring;
+        rbuc->ring_length = ring_length;
+        uc->start = uc->current = ring;
+        uc->end = ring + remains;
+    }
+    else if (uc->current >= rbuc->ring + rbuc->ring_length)
+    {
+        uc->current -= rbuc->ring_length;
+        uc->end -= rbuc->ring_length;
+    }
+
+    while ((unsigned long)(uc->end - uc->current) < more)
+    {
+        unsigned long space = rbuc->ring_length - (unsigned long)(uc->end - uc->current);
+        long l = read (rbuc->fileDescriptor, uc->end, space);
+        if (l == 0)
+        {
+            return CWP_RC_END_OF_INPUT;
+        }
+        if (l < 0)
+        {
+            rbuc->uc.err_no = errno;
+            return CWP_RC_ERROR_IN_HANDLER;
+        }
+        uc->end += l;
+    }
+
+    return CWP_RC_OK;
+}
+
+
+void init_ring_buffer_unpack_context (ring_buffer_unpack_context* rbuc, unsigned long ring_length, int fileDescriptor)
+{
+    unsigned long page_size = (unsigned long)sysconf (_SC_PAGESIZE);
+    if (!ring_length)
+        ring_length = 65536;
+    ring_length = (ring_length + page_size - 1) / page_size * page_size;
+
+    rbuc->ring = map_ring (ring_length);
+    if (!rbuc->ring)
+    {
+        rbuc->uc.return_code = CWP_RC_MALLOC_ERROR;
+        return;
+    }
+    rbuc->fileDescriptor = fileDescriptor;
+    rbuc->ring_length = ring_length;
+
+    cw_unpack_context_init((cw_unpack_context*)rbuc, rbuc->ring, 0, &handle_ring_buffer_unpack_underflow);
+}
+
+
+void terminate_ring_buffer_unpack_context(ring_buffer_unpack_context* rbuc)
+{
+    if (rbuc->uc.return_code != CWP_RC_MALLOC_ERROR)
+        munmap (rbuc->ring, 2 * rbuc->ring_length);
+    rbuc->uc.start = 0;
+}
+
+
+
+/*****************************************  SCATTER UNPACK CONTEXT  ******************************/
+
+/*
+ * Items inside a fragment are decoded in place. Only an item that straddles a fragment
+ * boundary is stitched together in the side buffer, and just the bytes it asks for are
+ * copied so decoding returns to the fragments as soon as the side buffer is consumed.
+ */
+
+static int handle_scatter_unpack_underflow(struct cw_unpack_context* uc, unsigned long more)
+{
+    scatter_unpack_context* suc = (scatter_unpack_context*)uc;
+    unsigned long remains = (unsigned long)(uc->end - uc->current);
+
+    if (!remains)
+    {
+        while (suc->next_fragment < suc->fragment_count &&
+               suc->fragments[suc->next_fragment].iov_len == suc->next_offset)
+        {
+            suc->next_fragment++;
+            suc->next_offset = 0;
+        }
+        if (suc->next_fragment == suc->fragment_count)
+            return CWP_RC_END_OF_INPUT;
+
+        const struct iovec *fragment = suc->fragments + suc->next_fragment++;
+        uc->start = (uint8_t*)fragment->iov_base;
+        uc->current = uc->start + suc->next_offset;
+        uc->end = uc->start + fragment->iov_len;
+        suc->next_offset = 0;
+        remains = (unsigned long)(uc->end - uc->current);
+        if (remains >= more)
+            return CWP_RC_OK;
+    }
+
+    if (suc->side_buffer_length < more)
+    {
+        unsigned long buffer_length = suc->side_buffer_length ? suc->side_buffer_length : 64;
+        while (buffer_length < more)
+            buffer_length = 2 * buffer_length;
+
+        uint8_t *new_buffer = (uint8_t*)malloc (buffer_length);
+        if (!new_buffer)
+            return CWP_RC_BUFFER_UNDERFLOW;
+
+        memcpy (new_buffer, uc->current, remains);
+        free (suc->side_buffer);
+        suc->side_buffer = new_buffer;
+        suc->side_buffer_length = buffer_length;
+    }
+    else
+    {
+        memmove (suc->side_buffer, uc->current, remains);
+    }
+
+    uc->start = uc->current = suc->side_buffer;
+    uc->end = uc->start + remains;
+    while ((unsigned long)(uc->end - uc->current) < more)
+    {
+        if (suc->next_fragment == suc->fragment_count)
+            return CWP_RC_END_OF_INPUT;
+
+        const struct iovec *fragment = suc->fragments + suc->next_fragment;
+        unsigned long available = (unsigned long)fragment->iov_len - suc->next_offset;
+        unsigned long needed = more - (unsigned long)(uc->end - uc->current);
+        unsigned long l = available < needed ? available : needed;
+
+        memcpy (uc->end, (uint8_t*)fragment->iov_base + suc->next_offset, l);
+        uc->end += l;
+        suc->next_offset += l;
+        if (suc->next_offset == fragment->iov_len)
+        {
+            suc->next_fragment++;
+            suc->next_offset = 0;
+        }
+    }
+
+    return CWP_RC_OK;
+}
+
+
+void init_scatter_unpack_context (scatter_unpack_context* suc, const struct iovec* fragments, int fragment_count)
+{
+    suc->fragments = fragments;
+    suc->fragment_count = fragment_count;
+    suc->next_fragment = fragment_count ? 1 : 0;
+    suc->next_offset = 0;
+    suc->side_buffer = NULL;
+    suc->side_buffer_length = 0;
+
+    if (fragment_count)
+        cw_unpack_context_init((cw_unpack_context*)suc, fragments->iov_base, (unsigned long)fragments->iov_len, &handle_scatter_unpack_underflow);
+    else
+        cw_unpack_context_init((cw_unpack_context*)suc, &suc->side_buffer, 0, &handle_scatter_unpack_underflow);
+}
+
+
+void terminate_scatter_unpack_context(scatter_unpack_context* suc)
+{
+    free (suc->side_buffer);
+    suc->side_buffer = NULL;
+}
+
+
+
+/*****************************************  SOCKET PACK CONTEXT  *********************************/
+
+/*
+ * Filled buffers are queued as chunks and sent together with one sendmsg, so many small
+ * messages cost one system call. When the socket would block the chunks just stay queued
+ * and packing goes on in a new chunk; the flush reports CWP_RC_WOULD_BLOCK and is retried
+ * when the socket is writable. Chunks sent with MSG_ZEROCOPY are kept until the kernel
+ * reports them completed.
+ */
+
+#define SOCKET_PACK_MAX_IOV 64
+
+
+static bool append_chunk (socket_chunk** chunks, int* count, int* capacity, socket_chunk* chunk)
+{
+    if (*count == *capacity)
+    {
+        int new_capacity = *capacity ? 2 * *capacity : 16;
+        socket_chunk *new_chunks = (socket_chunk*)realloc (*chunks, (unsigned long)new_capacity * sizeof(socket_chunk));
+        if (!new_chunks)
+            return false;
+        *chunks = new_chunks;
+        *capacity = new_capacity;
+    }
+    (*chunks)[(*count)++] = *chunk;
+    return true;
+}
+
+
+static void release_chunk_buffer (socket_pack_context* spc, socket_chunk* chunk)
+{
+    if (!spc->spare && chunk->capacity == spc->chunk_length)
+        spc->spare = chunk->buffer;
+    else
+        free (chunk->buffer);
+}
+
+
+static void reap_zerocopy_completions (socket_pack_context* spc)
+{
+#ifdef CAN_ZEROCOPY
+    char control[128];
+    while (spc->retired_count)
+    {
+        struct msghdr msg;
+        memset (&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg (spc->socket, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+            break;
+
+        struct cmsghdr *cm;
+        for (cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm))
+        {
+            struct sock_extended_err *serr = (struct sock_extended_err*)CMSG_DATA(cm);
+            if (serr->ee_errno == 0 && serr->ee_origin == SO_EE_ORIGIN_ZEROCOPY &&
+                serr->ee_data + 1 - spc->zerocopy_done < 0x80000000UL)
+                spc->zerocopy_done = serr->ee_data + 1;
+        }
+    }
+
+    int i, kept = 0;
+    for (i = 0; i < spc->retired_count; i++)
+    {
+        if (spc->retired[i].zerocopy_id - spc->zerocopy_done >= 0x80000000UL)
+            release_chunk_buffer (spc, spc->retired + i);
+        else
+            spc->retired[kept++] = spc->retired[i];
+    }
+    spc->retired_count = kept;
+#else
+    (void)spc;
+#endif
+}
+
+
+static uint8_t* new_chunk_buffer (socket_pack_context* spc, unsigned long more)
+{
+    if (more <= spc->chunk_length && spc->spare)
+    {
+        uint8_t *buffer = spc->spare;
+        spc->spare = NULL;
+        return buffer;
+    }
+    return (uint8_t*)malloc (more > spc->chunk_length ? more : spc->chunk_length);
+}
+
+
+static int queue_socket_pack_buffer (socket_pack_context* spc, unsigned long more)
+{
+    cw_pack_context* pc = (cw_pack_context*)spc;
+    socket_chunk chunk;
+    chunk.buffer = pc->start;
+    chunk.length = (unsigned long)(pc->current - pc->start);
+    chunk.capacity = (unsigned long)(pc->end - pc->start);
+    chunk.zerocopy_used = false;
+    if (!chunk.length && chunk.capacity >= more)
+        return CWP_RC_OK;
+
+    uint8_t *buffer = new_chunk_buffer (spc, more);
+    if (!buffer)
+        return CWP_RC_BUFFER_OVERFLOW;
+
+    if (chunk.length)
+    {
+        if (!append_chunk (&spc->chunks, &spc->chunk_count, &spc->chunk_capacity, &chunk))
+        {
+            free (buffer);
+            return CWP_RC_BUFFER_OVERFLOW;
+        }
+        spc->pending += chunk.length;
+    }
+    else
+        release_chunk_buffer (spc, &chunk);
+
+    pc->start = pc->current = buffer;
+    pc->end = buffer + (more > spc->chunk_length ? more : spc->chunk_length);
+    return CWP_RC_OK;
+}
+
+
+static int send_socket_chunks (socket_pack_context* spc)
+{
+    while (spc->chunk_count)
+    {
+        struct iovec iov[SOCKET_PACK_MAX_IOV];
+        struct msghdr msg;
+        int i, n = spc->chunk_count < SOCKET_PACK_MAX_IOV ? spc->chunk_count : SOCKET_PACK_MAX_IOV;
+        unsigned long total = 0;
+        for (i = 0; i < n; i++)
+        {
+            iov[i].iov_base = spc->chunks[i].buffer;
+            iov[i].iov_len = spc->chunks[i].length;
+            total += spc->chunks[i].length;
+        }
+        iov[0].iov_base = spc->chunks[0].buffer + spc->sent;
+        iov[0].iov_len -= spc->sent;
+        total -= spc->sent;
+
+        memset (&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = (size_t)n;
+        int flags = MSG_NOSIGNAL;
+        bool zerocopy = false;
+#ifdef CAN_ZEROCOPY
+        if (spc->zerocopy_threshold && total >= spc->zerocopy_threshold)
+        {
+            flags |= MSG_ZEROCOPY;
+            zerocopy = true;
+        }
+#endif
+        long l = sendmsg (spc->socket, &msg, flags);
+        if (l < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return CWP_RC_WOULD_BLOCK;
+            if (zerocopy && errno == ENOBUFS)
+            {
+                spc->zerocopy_threshold = 0;    /* out of optmem, go on copying */
+                continue;
+            }
+            spc->pc.err_no = errno;
+            return CWP_RC_ERROR_IN_HANDLER;
+        }
+
+        uint32_t zerocopy_id = spc->zerocopy_next_id;
+        if (zerocopy)
+            spc->zerocopy_next_id++;
+        spc->pending -= (unsigned long)l;
+        l += (long)spc->sent;
+        for (i = 0; i < n; i++)
+        {
+            socket_chunk *chunk = spc->chunks + i;
+            if (zerocopy)
+            {
+                chunk->zerocopy_used = true;
+                chunk->zerocopy_id = zerocopy_id;
+            }
+            if ((unsigned long)l < chunk->length)
+                break;
+            l -= (long)chunk->length;
+            if (!chunk->zerocopy_used)
+                release_chunk_buffer (spc, chunk);
+            else if (!append_chunk (&spc->retired, &spc->retired_count, &spc->retired_capacity, chunk))
+                return CWP_RC_BUFFER_OVERFLOW;
+        }
+        spc->sent = (unsigned long)l;
+        spc->chunk_count -= i;
+        memmove (spc->chunks, spc->chunks + i, (unsigned long)spc->chunk_count * sizeof(socket_chunk));
+        if (spc->retired_count)
+            reap_zerocopy_completions (spc);
+    }
+    return CWP_RC_OK;
+}
+
+
+/* Stops with CWP_RC_WOULD_BLOCK at max_pending; nothing of the item that didn't fit is packed */
+static int handle_socket_pack_overflow(struct cw_pack_context* pc, unsigned long more)
+{
+    socket_pack_context* spc = (socket_pack_context*)pc;
+    unsigned long length = (unsigned long)(pc->current - pc->start);
+    int rc;
+    if (spc->max_pending && spc->pending + length > spc->max_pending)
+    {
+        rc = send_socket_chunks (spc);
+        if (rc != CWP_RC_OK && rc != CWP_RC_WOULD_BLOCK)
+            return rc;
+        if (spc->pending + length > spc->max_pending)
+            return CWP_RC_WOULD_BLOCK;
+    }
+
+    rc = queue_socket_pack_buffer (spc, more);
+    if (rc != CWP_RC_OK)
+        return rc;
+
+    rc = send_socket_chunks (spc);
+    return rc == CWP_RC_WOULD_BLOCK ? CWP_RC_OK : rc;
+}
+
+
+static int flush_socket_pack_context(struct cw_pack_context* pc)
+{
+    int rc = socket_pack_context_flush ((socket_pack_context*)pc);
+    return rc == CWP_RC_WOULD_BLOCK ? CWP_RC_OK : rc;
+}
+
+
+void init_socket_pack_context (socket_pack_context* spc, unsigned long chunk_length, int socket)
+{
+    spc->chunk_length = (chunk_length > 32 ? chunk_length : 65536);
+    void *buffer = malloc (spc->chunk_length);
+    if (!buffer)
+    {
+        spc->pc.return_code = CWP_RC_MALLOC_ERROR;
+        return;
+    }
+    spc->socket = socket;
+    spc->max_pending = 0;
+    spc->pending = 0;
+    spc->sent = 0;
+    spc->chunks = NULL;
+    spc->chunk_count = spc->chunk_capacity = 0;
+    spc->retired = NULL;
+    spc->retired_count = spc->retired_capacity = 0;
+    spc->spare = NULL;
+    spc->zerocopy_threshold = 0;
+    spc->zerocopy_next_id = 0;
+    spc->zerocopy_done = 0;
+
+    cw_pack_context_init((cw_pack_context*)spc, buffer, spc->chunk_length, &handle_socket_pack_overflow);
+    cw_pack_set_flush_handler((cw_pack_context*)spc, &flush_socket_pack_context);
+}
+
+
+void socket_pack_context_set_max_pending (socket_pack_context* spc, unsigned long max_pending)
+{
+    spc->max_pending = max_pending;
+}
+
+
+void socket_pack_context_set_zerocopy (socket_pack_context* spc, unsigned long threshold)
+{
+#ifdef CAN_ZEROCOPY
+    int one = 1;
+    if (threshold && setsockopt (spc->socket, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)))
+        threshold = 0;                          /* not supported by this socket */
+    spc->zerocopy_threshold = threshold;
+#else
+    (void)spc; (void)threshold;
+#endif
+}
+
+
+/* Also resumes a context stopped at max_pending once the queue is below the limit */
+int socket_pack_context_flush (socket_pack_context* spc)
+{
+    if (spc->pc.return_code && spc->pc.return_code != CWP_RC_WOULD_BLOCK)
+        return spc->pc.return_code;
+
+    int rc = queue_socket_pack_buffer (spc, 0);
+    if (rc == CWP_RC_OK)
+        rc = send_socket_chunks (spc);
+    if (rc != CWP_RC_OK && rc != CWP_RC_WOULD_BLOCK)
+        spc->pc.return_code = rc;
+    else if (spc->pc.return_code == CWP_RC_WOULD_BLOCK && (rc == CWP_RC_OK || spc->pending < spc->max_pending))
+        spc->pc.return_code = CWP_RC_OK;
+    return rc;
+}
+
+
+void terminate_socket_pack_context(socket_pack_context* spc)
+{
+    cw_pack_context* pc = (cw_pack_context*)spc;
+    if (pc->return_code == CWP_RC_MALLOC_ERROR)
+        return;
+
+    cw_pack_flush(pc);
+    int i, tries = 0;
+    while (spc->retired_count && tries++ < 10)
+    {
+        struct pollfd pfd;
+        pfd.fd = spc->socket;
+        pfd.events = 0;
+        poll (&pfd, 1, 100);
+        reap_zerocopy_completions (spc);
+    }
+
+    for (i = 0; i < spc->chunk_count; i++)
+        free (spc->chunks[i].buffer);
+    for (i = 0; i < spc->retired_count; i++)
+        free (spc->retired[i].buffer);
+    free (spc->chunks);
+    free (spc->retired);
+    free (spc->spare);
+    free (pc->start);
+}
+
+
+
+/*****************************************  SOCKET UNPACK CONTEXT  *******************************/
+
+/*
+ * A socket unpack context is a file unpack context; on a non-blocking socket its handler
+ * returns CWP_RC_WOULD_BLOCK with the received bytes kept. Set the barrier at the start of
+ * each message and resume, which rescans from the barrier, when the socket is readable.
+ */
+
+void init_socket_unpack_context (socket_unpack_context* suc, unsigned long initial_buffer_length, int socket)
+{
+    init_file_unpack_context (suc, initial_buffer_length, socket);
+}
+
+
+void socket_unpack_context_resume (socket_unpack_context* suc)
+{
+    if (suc->uc.return_code != CWP_RC_WOULD_BLOCK)
+        return;
+
+    suc->uc.return_code = CWP_RC_OK;
+    if (suc->barrier)
+        suc->uc.current = suc->barrier;
+}
+
+
+
+/*****************************************  DIRECT FILE PACK/UNPACK CONTEXTS  *******************/
+
+/*
+ * The direct contexts bypass the page cache. Buffers, transfer lengths and file offsets
+ * are all multiples of DIRECT_IO_ALIGNMENT. If the file system refuses O_DIRECT the
+ * contexts still work, with ordinary buffered I/O.
+ */
+
+#define align_down(n)   ((n) & ~(unsigned long)(DIRECT_IO_ALIGNMENT - 1))
+#define align_up(n)     align_down((n) + DIRECT_IO_ALIGNMENT - 1)
+
+/* Returns the file status flags to restore */
+static int set_direct_io (int fileDescriptor)
+{
+    int flags = fcntl (fileDescriptor, F_GETFL);
+#if defined(O_DIRECT)
+    if (flags >= 0 && !(flags & O_DIRECT))
+        fcntl (fileDescriptor, F_SETFL, flags | O_DIRECT);
+#elif defined(F_NOCACHE)
+    fcntl (fileDescriptor, F_NOCACHE, 1);
+#endif
+    return flags;
+}
+
+
+static void reset_direct_io (int fileDescriptor, int flags)
+{
+    if (flags < 0)
+        return;
+#if defined(F_NOCACHE) && !defined(O_DIRECT)
+    fcntl (fileDescriptor, F_NOCACHE, 0);
+#endif
+    fcntl (fileDescriptor, F_SETFL, flags);
+}
+
+
+static uint8_t* new_aligned_buffer (unsigned long buffer_length)
+{
+    void *buffer;
+    if (posix_memalign (&buffer, DIRECT_IO_ALIGNMENT, buffer_length))
+        return NULL;
+    return (uint8_t*)buffer;
+}
+
+
+/* Writes the whole blocks before the barrier/current and moves the rest to the buffer start */
+static int write_direct_blocks (direct_file_pack_context* dfpc)
+{
+    cw_pack_context* pc = (cw_pack_context*)dfpc;
+    uint8_t *bStart = dfpc->barrier ? dfpc->barrier : pc->current;
+    unsigned long blocks = align_down((unsigned long)(bStart - pc->start));
+    if (!blocks)
+        return CWP_RC_OK;
+
+    if (pwrite (dfpc->fileDescriptor, pc->start, blocks, dfpc->file_offset) != (long)blocks)
+    {
+        pc->err_no = errno;
+        return CWP_RC_ERROR_IN_HANDLER;
+    }
+    dfpc->file_offset += (off_t)blocks;
+    unsigned long kept = (unsigned long)(pc->current - pc->start) - blocks;
+    if (kept)
+        memmove (pc->start, pc->start + blocks, kept);
+    if (dfpc->barrier)
+        dfpc->barrier -= blocks;
+    pc->current = pc->start + kept;
+    return CWP_RC_OK;
+}
+
+
+/* The partial last block is written padded, the file is cut to size and the block is kept */
+static int flush_direct_file_pack_context(struct cw_pack_context* pc)
+{
+    direct_file_pack_context* dfpc = (direct_file_pack_context*)pc;
+    int rc = write_direct_blocks (dfpc);
+    if (rc != CWP_RC_OK)
+        return rc;
+
+    uint8_t *bStart = dfpc->barrier ? dfpc->barrier : pc->current;
+    unsigned long tail = (unsigned long)(bStart - pc->start);
+    if (tail)
+    {
+        if (pwrite (dfpc->fileDescriptor, pc->start, DIRECT_IO_ALIGNMENT, dfpc->file_offset) != DIRECT_IO_ALIGNMENT ||
+            ftruncate (dfpc->fileDescriptor, dfpc->file_offset + (off_t)tail))
+        {
+            pc->err_no = errno;
+            return CWP_RC_ERROR_IN_HANDLER;
+        }
+    }
+    return CWP_RC_OK;
+}
+
+
+static int handle_direct_file_pack_overflow(struct cw_pack_context* pc, unsigned long more)
+{
+    direct_file_pack_context* dfpc = (direct_file_pack_context*)pc;
+    int rc = write_direct_blocks (dfpc);
+    if (rc != CWP_RC_OK)
+        return rc;
+
+    unsigned long kept = (unsigned long)(pc->current - pc->start);
+    unsigned long buffer_length = (unsigned long)(pc->end - pc->start);
+    if (buffer_length < more + kept)
+    {
+        while (buffer_length < more + kept)
+            buffer_length = 2 * buffer_length;
+
+        uint8_t *new_buffer = new_aligned_buffer (buffer_length);
+        if (!new_buffer)
+            return CWP_RC_BUFFER_OVERFLOW;
+        if (kept)
+            memcpy (new_buffer, pc->start, kept);
+        if (dfpc->barrier)
+            dfpc->barrier = new_buffer + (dfpc->barrier - pc->start);
+        free (pc->start);
+        pc->start = new_buffer;
+        pc->current = new_buffer + kept;
+        pc->end = new_buffer + buffer_length;
+    }
+    return CWP_RC_OK;
+}
+
+
+void init_direct_file_pack_context (direct_file_pack_context* dfpc, unsigned long initial_buffer_length, int fileDescriptor)
+{
+    unsigned long buffer_length = align_up(initial_buffer_length > DIRECT_IO_ALIGNMENT ? initial_buffer_length : 16 * DIRECT_IO_ALIGNMENT);
+    uint8_t *buffer = new_aligned_buffer (buffer_length);
+    if (!buffer)
+    {
+        dfpc->pc.return_code = CWP_RC_MALLOC_ERROR;
+        return;
+    }
+
+    dfpc->fileDescriptor = fileDescriptor;
+    dfpc->barrier = NULL;
+    cw_pack_context_init((cw_pack_context*)dfpc, buffer, buffer_length, &handle_direct_file_pack_overflow);
+    cw_pack_set_flush_handler((cw_pack_context*)dfpc, &flush_direct_file_pack_context);
+
+    /* continue in the middle of a block: start with the head of that block in the buffer */
+    off_t position = lseek (fileDescriptor, 0, SEEK_CUR);
+    unsigned long head = position > 0 ? (unsigned long)position % DIRECT_IO_ALIGNMENT : 0;
+    dfpc->file_offset = position > 0 ? position - (off_t)head : 0;
+    dfpc->file_flags = set_direct_io (fileDescriptor);
+    if (head)
+    {
+        if (pread (fileDescriptor, buffer, DIRECT_IO_ALIGNMENT, dfpc->file_offset) < (long)head)
+        {
+            dfpc->pc.err_no = errno;
+            dfpc->pc.return_code = CWP_RC_ERROR_IN_HANDLER;
+            return;
+        }
+        dfpc->pc.current = buffer + head;
+    }
+}
+
+
+void direct_file_pack_context_set_barrier (direct_file_pack_context* dfpc)
+{
+    dfpc->barrier = dfpc->pc.current;
+}
+
+
+void direct_file_pack_context_release_barrier (direct_file_pack_context* dfpc)
+{
+    dfpc->barrier = NULL;
+}
+
+
+void terminate_direct_file_pack_context (direct_file_pack_context* dfpc)
+{
+    dfpc->barrier = NULL;
+    cw_pack_context* pc = (cw_pack_context*)dfpc;
+    cw_pack_flush(pc);
+    if (pc->return_code == CWP_RC_MALLOC_ERROR)
+        return;
+
+    lseek (dfpc->fileDescriptor, dfpc->file_offset + (pc->current - pc->start), SEEK_SET);
+    reset_direct_io (dfpc->fileDescriptor, dfpc->file_flags);
+    free(pc->start);
+}
+
+
+/*
+ * Reads go to an aligned address, so the bytes kept at underflow are moved to end at a
+ * block boundary. A short read means end of file; the file offset is no longer aligned
+ * after that, so no more reads are made.
+ */
+
+static int handle_direct_file_unpack_underflow(struct cw_unpack_context* uc, unsigned long more)
+{
+    direct_file_unpack_context* dfuc = (direct_file_unpack_context*)uc;
+    uint8_t *bStart = dfuc->barrier ? dfuc->barrier : uc->current;
+    unsigned long kept = (unsigned long)(uc->current - bStart);
+    unsigned long remains = (unsigned long)(uc->end - bStart);
+    unsigned long pad = align_up(remains) - remains;
+    if (dfuc->at_end)
+        return CWP_RC_END_OF_INPUT;
+
+    if (dfuc->buffer_length < align_up(pad + kept + more))
+    {
+        unsigned long buffer_length = dfuc->buffer_length;
+        while (buffer_length < align_up(pad + kept + more))
+            buffer_length = 2 * buffer_length;
+
+        uint8_t *new_buffer = new_aligned_buffer (buffer_length);
+        if (!new_buffer)
+            return CWP_RC_BUFFER_UNDERFLOW;
+        if (remains)
+            memcpy (new_buffer + pad, bStart, remains);
+        free (dfuc->buffer);
+        dfuc->buffer = new_buffer;
+        dfuc->buffer_length = buffer_length;
+    }
+    else if (remains)
+        memmove (dfuc->buffer + pad, bStart, remains);
+
+    uc->start = dfuc->buffer + pad;
+    uc->current = uc->start + kept;
+    uc->end = uc->start + remains;
+    if (dfuc->barrier)
+        dfuc->barrier = uc->start;
+
+    while ((unsigned long)(uc->end - uc->current) < more)
+    {
+        unsigned long room = align_down(dfuc->buffer_length - (unsigned long)(uc->end - dfuc->buffer));
+        long l = read (dfuc->fileDescriptor, uc->end, room);
+        if (l < 0)
+        {
+            uc->err_no = errno;
+            return CWP_RC_ERROR_IN_HANDLER;
+        }
+        uc->end += l;
+        if ((unsigned long)l < room && align_down((unsigned long)l) != (unsigned long)l)
+            dfuc->at_end = true;
+        if (l == 0 || (dfuc->at_end && (unsigned long)(uc->end - uc->current) < more))
+        {
+            dfuc->at_end = true;
+            return CWP_RC_END_OF_INPUT;
+        }
+    }
+    return CWP_RC_OK;
+}
+
+
+void init_direct_file_unpack_context (direct_file_unpack_context* dfuc, unsigned long initial_buffer_length, int fileDescriptor)
+{
+    unsigned long buffer_length = align_up(initial_buffer_length > DIRECT_IO_ALIGNMENT ? initial_buffer_length : 16 * DIRECT_IO_ALIGNMENT);
+    uint8_t *buffer = new_aligned_buffer (buffer_length);
+    if (!buffer)
+    {
+        dfuc->uc.return_code = CWP_RC_MALLOC_ERROR;
+        return;
+    }
+    dfuc->fileDescriptor = fileDescriptor;
+    dfuc->barrier = NULL;
+    dfuc->buffer = buffer;
+    dfuc->buffer_length = buffer_length;
+    dfuc->at_end = false;
+    cw_unpack_context_init((cw_unpack_context*)dfuc, buffer, 0, &handle_direct_file_unpack_underflow);
+
+    /* start in the middle of a block: read from the block start and skip the head */
+    off_t position = lseek (fileDescriptor, 0, SEEK_CUR);
+    unsigned long head = position > 0 ? (unsigned long)position % DIRECT_IO_ALIGNMENT : 0;
+    dfuc->file_flags = set_direct_io (fileDescriptor);
+    if (head)
+    {
+        lseek (fileDescriptor, position - (off_t)head, SEEK_SET);
+        if (handle_direct_file_unpack_underflow ((cw_unpack_context*)dfuc, head) != CWP_RC_OK)
+        {
+            dfuc->uc.return_code = CWP_RC_END_OF_INPUT;
+            return;
+        }
+        dfuc->uc.current += head;
+    }
+}
+
+
+void direct_file_unpack_context_set_barrier (direct_file_unpack_context* dfuc)
+{
+    dfuc->barrier = dfuc->uc.current;
+}
+
+
+void direct_file_unpack_context_rescan_from_barrier (direct_file_unpack_context* dfuc)
+{
+    dfuc->uc.current = dfuc->barrier;
+}
+
+
+void direct_file_unpack_context_release_barrier (direct_file_unpack_context* dfuc)
+{
+    dfuc->barrier = NULL;
+}
+
+
+void terminate_direct_file_unpack_context (direct_file_unpack_context* dfuc)
+{
+    if (dfuc->uc.return_code == CWP_RC_MALLOC_ERROR)
+        return;
+
+    reset_direct_io (dfuc->fileDescriptor, dfuc->file_flags);
+    free (dfuc->buffer);
+    dfuc->buffer = NULL;
+    dfuc->uc.start = NULL;
+}
+
+
+
+/*****************************************  SHARED FILE PACK CONTEXT  ***************************/
+
+/*
+ * Several threads write to one file, each through its own context. Only complete records
+ * are written: a context reserves a file range with an atomic add on the writer's offset
+ * and writes its records there with pwrite, so records are never interleaved and no lock
+ * is taken. The record in progress is carried over in the buffer.
+ */
+
+void init_shared_file_writer (shared_file_writer* sfw, int fileDescriptor)
+{
+    off_t end = lseek (fileDescriptor, 0, SEEK_END);
+    sfw->fileDescriptor = fileDescriptor;
+    sfw->next_offset = end > 0 ? (uint64_t)end : 0;
+}
+
+
+static int flush_shared_file_pack_context(struct cw_pack_context* pc)
+{
+    shared_file_pack_context* sfpc = (shared_file_pack_context*)pc;
+    unsigned long contains = (unsigned long)(sfpc->record_start - pc->start);
+    if (!contains)
+        return CWP_RC_OK;
+
+    uint64_t offset = __atomic_fetch_add (&sfpc->writer->next_offset, (uint64_t)contains, __ATOMIC_RELAXED);
+    uint8_t *p = pc->start;
+    unsigned long remains = contains;
+    while (remains)
+    {
+        long rc = pwrite (sfpc->writer->fileDescriptor, p, remains, (off_t)offset);
+        if (rc <= 0)
+        {
+            pc->err_no = errno;
+            return CWP_RC_ERROR_IN_HANDLER;
+        }
+        p += rc;
+        offset += (uint64_t)rc;
+        remains -= (unsigned long)rc;
+    }
+
+    unsigned long kept = (unsigned long)(pc->current - sfpc->record_start);
+    if (kept)
+        memmove (pc->start, sfpc->record_start, kept);
+    sfpc->record_start = pc->start;
+    pc->current = pc->start + kept;
+    return CWP_RC_OK;
+}
+
+
+static int handle_shared_file_pack_overflow(struct cw_pack_context* pc, unsigned long more)
+{
+    shared_file_pack_context* sfpc = (shared_file_pack_context*)pc;
+    int rc = flush_shared_file_pack_context(pc);
+    if (rc != CWP_RC_OK)
+        return rc;
+
+    unsigned long kept = (unsigned long)(pc->current - pc->start);
+    unsigned long buffer_length = (unsigned long)(pc->end - pc->start);
+    if (buffer_length < more + kept)
+    {
+        while (buffer_length < more + kept)
+            buffer_length = 2 * buffer_length;
+
+        uint8_t *new_buffer = realloc (pc->start, buffer_length);
+        if (!new_buffer)
+            return CWP_RC_BUFFER_OVERFLOW;
+        pc->start = sfpc->record_start = new_buffer;
+        pc->current = new_buffer + kept;
+        pc->end = new_buffer + buffer_length;
+    }
+    return CWP_RC_OK;
+}
+
+
+void init_shared_file_pack_context (shared_file_pack_context* sfpc, unsigned long initial_buffer_length, shared_file_writer* sfw)
+{
+    unsigned long buffer_length = (initial_buffer_length > 32 ? initial_buffer_length : 65536);
+    void *buffer = malloc (buffer_length);
+    if (!buffer)
+    {
+        sfpc->pc.return_code = CWP_RC_MALLOC_ERROR;
+        return;
+    }
+
+    sfpc->writer = sfw;
+    sfpc->record_start = (uint8_t*)buffer;
+    cw_pack_context_init((cw_pack_context*)sfpc, buffer, buffer_length, &handle_shared_file_pack_overflow);
+    cw_pack_set_flush_handler((cw_pack_context*)sfpc, &flush_shared_file_pack_context);
+}
+
+
+void shared_file_pack_context_end_record (shared_file_pack_context* sfpc)
+{
+    sfpc->record_start = sfpc->pc.current;
+}
+
+
+void terminate_shared_file_pack_context (shared_file_pack_context* sfpc)
+{
+    cw_pack_context* pc = (cw_pack_context*)sfpc;
+    cw_pack_flush(pc);
+
+    if (pc->return_code != CWP_RC_MALLOC_ERROR)
+        free(pc->start);
+}
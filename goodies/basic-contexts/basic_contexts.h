@@ -24,6 +24,8 @@
 #define basic_contexts_h
 
 #include <stdio.h>
+#include <sys/types.h>
+#include <sys/uio.h>
 #include "cwpack.h"
 
 
@@ -87,6 +89,12 @@ void init_file_pack_context (file_pack_context* spc, unsigned long initial_buffe
 void file_pack_context_set_barrier (file_pack_context* spc);
 void file_pack_context_release_barrier (file_pack_context* spc);
 
+/* As cw_pack_blob_chunk, but chunks larger than the buffer are written directly */
+void file_pack_context_blob_chunk (file_pack_context* fpc, const void* v, uint32_t l);
+
+/* Packs a bin item whose payload is l bytes at offset in the file fd, copied in the kernel when possible */
+void file_pack_context_bin_from_fd (file_pack_context* fpc, int fd, off_t offset, uint32_t l);
+
 void terminate_file_pack_context(file_pack_context* spc);
 
 
@@ -108,10 +116,216 @@ void file_unpack_context_set_barrier (file_unpack_context* suc);
 void file_unpack_context_rescan_from_barrier (file_unpack_context* suc);
 void file_unpack_context_release_barrier (file_unpack_context* suc);
 
+/* As cw_unpack_blob_read, but reads larger than the buffer go directly to dst */
+void file_unpack_context_blob_read (file_unpack_context* fuc, void* dst, unsigned long n);
+
 void terminate_file_unpack_context(file_unpack_context* suc);
 
 
 
+/*****************************************  TAIL FILE UNPACK CONTEXT  *************************/
+
+/*
+ * Unpacks a file that is still being written, like tail -f. At end of file the handler
+ * waits for the file to grow instead of ending the input, so a partly written item is
+ * completed when the rest arrives. Timeout is in ms, -1 waits forever. At timeout the
+ * context stops with CWP_RC_WOULD_BLOCK; set the barrier at the start of each item and
+ * resume, which rescans from the barrier. The input ends when the file is removed,
+ * renamed or truncated. A descriptor that isn't a regular file, e.g. a pipe, ends at
+ * end of file as usual.
+ */
+
+typedef struct
+{
+    file_unpack_context     fuc;
+    int                     timeout;
+    int                     inotifyDescriptor;
+    bool                    renamed;
+    bool                    regular;            /* else end of file is final */
+} tail_file_unpack_context;
+
+
+void init_tail_file_unpack_context (tail_file_unpack_context* tfuc, unsigned long initial_buffer_length, int fileDescriptor, int timeout);
+
+void tail_file_unpack_context_resume (tail_file_unpack_context* tfuc);
+
+void terminate_tail_file_unpack_context (tail_file_unpack_context* tfuc);
+
+
+
+/*****************************************  RING BUFFER UNPACK CONTEXT  ************************/
+
+typedef struct
+{
+    cw_unpack_context   uc;
+    unsigned long       ring_length;
+    int                 fileDescriptor;
+    uint8_t             *ring;
+} ring_buffer_unpack_context;
+
+
+void init_ring_buffer_unpack_context (ring_buffer_unpack_context* rbuc, unsigned long ring_length, int fileDescriptor);
+
+void terminate_ring_buffer_unpack_context(ring_buffer_unpack_context* rbuc);
+
+
+
+/*****************************************  SCATTER UNPACK CONTEXT  ****************************/
+
+typedef struct
+{
+    cw_unpack_context   uc;
+    const struct iovec  *fragments;
+    int                 fragment_count;
+    int                 next_fragment;
+    unsigned long       next_offset;         /* where to resume in next_fragment */
+    uint8_t             *side_buffer;
+    unsigned long       side_buffer_length;
+} scatter_unpack_context;
+
+
+void init_scatter_unpack_context (scatter_unpack_context* suc, const struct iovec* fragments, int fragment_count);
+
+void terminate_scatter_unpack_context(scatter_unpack_context* suc);
+
+
+
+/*****************************************  SOCKET PACK CONTEXT  *******************************/
+
+typedef struct
+{
+    uint8_t         *buffer;
+    unsigned long   length;             /* bytes to send */
+    unsigned long   capacity;
+    uint32_t        zerocopy_id;        /* last MSG_ZEROCOPY send referencing the buffer */
+    bool            zerocopy_used;
+} socket_chunk;
+
+typedef struct
+{
+    cw_pack_context pc;
+    int             socket;
+    unsigned long   chunk_length;
+    unsigned long   max_pending;        /* 0 = no limit */
+    unsigned long   pending;
+    unsigned long   sent;               /* bytes of chunks[0] already sent */
+    socket_chunk    *chunks;            /* waiting to be sent */
+    int             chunk_count;
+    int             chunk_capacity;
+    socket_chunk    *retired;           /* sent with MSG_ZEROCOPY, waiting for completion */
+    int             retired_count;
+    int             retired_capacity;
+    uint8_t         *spare;
+    unsigned long   zerocopy_threshold; /* 0 = off */
+    uint32_t        zerocopy_next_id;
+    uint32_t        zerocopy_done;      /* sends below this id are completed */
+} socket_pack_context;
+
+
+void init_socket_pack_context (socket_pack_context* spc, unsigned long chunk_length, int socket);
+
+/*
+ * When max_pending bytes are queued, the context stops with CWP_RC_WOULD_BLOCK before the
+ * item that didn't fit. Call socket_pack_context_flush when the socket is writable; when it
+ * has made room the context is resumed and the item can be packed again.
+ */
+void socket_pack_context_set_max_pending (socket_pack_context* spc, unsigned long max_pending);
+void socket_pack_context_set_zerocopy (socket_pack_context* spc, unsigned long threshold);
+int socket_pack_context_flush (socket_pack_context* spc);
+
+void terminate_socket_pack_context(socket_pack_context* spc);
+
+
+
+/*****************************************  SOCKET UNPACK CONTEXT  *****************************/
+
+typedef file_unpack_context socket_unpack_context;
+
+
+void init_socket_unpack_context (socket_unpack_context* suc, unsigned long initial_buffer_length, int socket);
+
+void socket_unpack_context_resume (socket_unpack_context* suc);
+
+#define socket_unpack_context_set_barrier       file_unpack_context_set_barrier
+#define socket_unpack_context_release_barrier   file_unpack_context_release_barrier
+#define terminate_socket_unpack_context         terminate_file_unpack_context
+
+
+
+/*****************************************  DIRECT FILE PACK CONTEXT  **************************/
+
+#define DIRECT_IO_ALIGNMENT     4096
+
+typedef struct
+{
+    cw_pack_context pc;
+    int             fileDescriptor;
+    uint8_t         *barrier;
+    off_t           file_offset;            /* of the buffer start, aligned */
+    int             file_flags;             /* restored at terminate */
+} direct_file_pack_context;
+
+
+void init_direct_file_pack_context (direct_file_pack_context* dfpc, unsigned long initial_buffer_length, int fileDescriptor);
+
+void direct_file_pack_context_set_barrier (direct_file_pack_context* dfpc);
+void direct_file_pack_context_release_barrier (direct_file_pack_context* dfpc);
+
+void terminate_direct_file_pack_context (direct_file_pack_context* dfpc);
+
+
+
+/*****************************************  DIRECT FILE UNPACK CONTEXT  ************************/
+
+typedef struct
+{
+    cw_unpack_context   uc;
+    unsigned long       buffer_length;
+    int                 fileDescriptor;
+    uint8_t             *barrier;
+    uint8_t             *buffer;
+    bool                at_end;
+    int                 file_flags;         /* restored at terminate */
+} direct_file_unpack_context;
+
+
+void init_direct_file_unpack_context (direct_file_unpack_context* dfuc, unsigned long initial_buffer_length, int fileDescriptor);
+
+void direct_file_unpack_context_set_barrier (direct_file_unpack_context* dfuc);
+void direct_file_unpack_context_rescan_from_barrier (direct_file_unpack_context* dfuc);
+void direct_file_unpack_context_release_barrier (direct_file_unpack_context* dfuc);
+
+void terminate_direct_file_unpack_context (direct_file_unpack_context* dfuc);
+
+
+
+/*****************************************  SHARED FILE PACK CONTEXT  **************************/
+
+typedef struct
+{
+    int             fileDescriptor;
+    uint64_t        next_offset;            /* reserved atomically by the contexts */
+} shared_file_writer;
+
+typedef struct
+{
+    cw_pack_context     pc;
+    shared_file_writer  *writer;
+    uint8_t             *record_start;      /* bytes before are complete records */
+} shared_file_pack_context;
+
+
+void init_shared_file_writer (shared_file_writer* sfw, int fileDescriptor);
+
+/* One context per thread */
+void init_shared_file_pack_context (shared_file_pack_context* sfpc, unsigned long initial_buffer_length, shared_file_writer* sfw);
+
+void shared_file_pack_context_end_record (shared_file_pack_context* sfpc);
+
+void terminate_shared_file_pack_context (shared_file_pack_context* sfpc);
+
+
+
 /*****************************************  E P I L O G U E  **********************************/
 
 
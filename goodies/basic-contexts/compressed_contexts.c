@@ -0,0 +1,946 @@
+/*      CWPack/goodies - compressed_contexts.c   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#ifdef CWP_USE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef CWP_USE_LZ4
+#include <lz4.h>
+#endif
+
+#include "compressed_contexts.h"
+
+
+static uint32_t get_be32 (const uint8_t* p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+
+static void put_be32 (uint8_t* p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+
+
+/*****************************************  LZ CODEC  *****************************************/
+
+/*
+ * A byte oriented LZ77 codec in the spirit of LZ4. A block is a sequence of
+ *
+ *      token  [literal length bytes]  literals  offset(2, little endian)  [match length bytes]
+ *
+ * where the token holds the literal length and the match length - 4 in 4 bits each; 15
+ * means more length bytes follow, each adding up to 255. The last sequence has only
+ * literals. Matches are found with a hash table of 4 byte sequences and may overlap.
+ */
+
+#define LZ_HASH_BITS    14
+#define LZ_MIN_MATCH    4
+#define LZ_MAX_OFFSET   65535
+
+static uint32_t read32 (const uint8_t* p)
+{
+    uint32_t v;
+    memcpy (&v, p, 4);
+    return v;
+}
+
+
+static uint32_t lz_hash (uint32_t sequence)
+{
+    return (sequence * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+
+static uint8_t* put_length (uint8_t* op, unsigned long length)
+{
+    for (; length >= 255; length -= 255)
+        *op++ = 255;
+    *op++ = (uint8_t)length;
+    return op;
+}
+
+
+/*
+ * A prefix, e.g. a dictionary, is history in front of src that matches may refer to.
+ * Positions in the hash table count from the start of the prefix; the table must hold
+ * the prefix positions (or be zeroed when there is no prefix).
+ */
+
+#define lz_byte(i)      ((i) < prefix_length ? prefix[i] : src[(i) - prefix_length])
+
+static long lz_compress_prefixed (const uint8_t* prefix, unsigned long prefix_length, uint32_t* table,
+                                  const uint8_t* src, unsigned long src_length, uint8_t* dst, unsigned long dst_capacity)
+{
+    unsigned long ip = prefix_length, anchor = prefix_length, iend = prefix_length + src_length;
+    unsigned long mflimit = src_length > 12 ? iend - 12 : prefix_length;
+    uint8_t *op = dst, *oend = dst + dst_capacity;
+
+    while (ip < mflimit)
+    {
+        uint32_t sequence = read32 (src + ip - prefix_length);
+        uint32_t h = lz_hash (sequence);
+        unsigned long ref = table[h];
+        table[h] = (uint32_t)ip;
+        uint32_t candidate = 0;
+        if (ref < ip && ip - ref <= LZ_MAX_OFFSET)
+        {
+            if (ref >= prefix_length)
+                candidate = read32 (src + ref - prefix_length);
+            else if (ref + 4 <= prefix_length)
+                candidate = read32 (prefix + ref);
+            else
+            {
+                uint8_t b[4];
+                int k;
+                for (k = 0; k < 4; k++)
+                    b[k] = lz_byte(ref + (unsigned long)k);
+                candidate = read32 (b);
+            }
+        }
+        if (ref >= ip || ip - ref > LZ_MAX_OFFSET || candidate != sequence)
+        {
+            ip += 1 + ((ip - anchor) >> 6);     /* move faster through incompressible data */
+            continue;
+        }
+
+        unsigned long match = LZ_MIN_MATCH;
+        if (ref >= prefix_length)
+        {
+            const uint8_t *r = src + ref - prefix_length, *i = src + ip - prefix_length;
+            while (ip + match < iend - 5 && r[match] == i[match])
+                match++;
+        }
+        else
+            while (ip + match < iend - 5 && lz_byte(ref + match) == src[ip + match - prefix_length])
+                match++;
+        unsigned long literals = ip - anchor;
+        if ((unsigned long)(oend - op) < literals + literals / 255 + match / 255 + 8)
+            return -1;
+
+        uint8_t *token = op++;
+        *token = (uint8_t)((literals < 15 ? literals : 15) << 4);
+        if (literals >= 15)
+            op = put_length (op, literals - 15);
+        memcpy (op, src + anchor - prefix_length, literals);
+        op += literals;
+        unsigned long offset = ip - ref;
+        *op++ = (uint8_t)offset;
+        *op++ = (uint8_t)(offset >> 8);
+        *token |= (uint8_t)(match - LZ_MIN_MATCH < 15 ? match - LZ_MIN_MATCH : 15);
+        if (match - LZ_MIN_MATCH >= 15)
+            op = put_length (op, match - LZ_MIN_MATCH - 15);
+
+        ip += match;
+        anchor = ip;
+    }
+
+    unsigned long literals = iend - anchor;
+    if ((unsigned long)(oend - op) < literals + literals / 255 + 2)
+        return -1;
+    *op++ = (uint8_t)((literals < 15 ? literals : 15) << 4);
+    if (literals >= 15)
+        op = put_length (op, literals - 15);
+    memcpy (op, src + anchor - prefix_length, literals);
+    op += literals;
+    return (long)(op - dst);
+}
+
+
+static long lz_decompress_prefixed (const uint8_t* prefix, unsigned long prefix_length,
+                                    const uint8_t* src, unsigned long src_length, uint8_t* dst, unsigned long dst_capacity)
+{
+    const uint8_t *ip = src, *iend = src + src_length;
+    uint8_t *op = dst, *oend = dst + dst_capacity;
+
+    while (ip < iend)
+    {
+        unsigned int token = *ip++;
+        unsigned long literals = token >> 4;
+        if (literals == 15)
+        {
+            unsigned int b;
+            do
+            {
+                if (ip == iend)
+                    return -1;
+                b = *ip++;
+                literals += b;
+            } while (b == 255);
+        }
+        if (literals > (unsigned long)(iend - ip) || literals > (unsigned long)(oend - op))
+            return -1;
+        memcpy (op, ip, literals);
+        ip += literals;
+        op += literals;
+        if (ip == iend)
+            break;
+
+        if (iend - ip < 2)
+            return -1;
+        unsigned long offset = ip[0] | (unsigned long)ip[1] << 8;
+        ip += 2;
+        if (!offset || offset > (unsigned long)(op - dst) + prefix_length)
+            return -1;
+        unsigned long match = token & 15;
+        if (match == 15)
+        {
+            unsigned int b;
+            do
+            {
+                if (ip == iend)
+                    return -1;
+                b = *ip++;
+                match += b;
+            } while (b == 255);
+        }
+        match += LZ_MIN_MATCH;
+        if (match > (unsigned long)(oend - op))
+            return -1;
+
+        if (offset > (unsigned long)(op - dst))
+        {
+            /* starts in the prefix */
+            const uint8_t *ref = prefix + prefix_length - (offset - (unsigned long)(op - dst));
+            unsigned long from_prefix = (unsigned long)(prefix + prefix_length - ref);
+            if (from_prefix > match)
+                from_prefix = match;
+            memcpy (op, ref, from_prefix);
+            op += from_prefix;
+            match -= from_prefix;
+        }
+        const uint8_t *ref = op - offset;
+        if (offset >= match)
+            memcpy (op, ref, match);
+        else
+        {
+            unsigned long i;
+            for (i = 0; i < match; i++)
+                op[i] = ref[i];
+        }
+        op += match;
+    }
+    return (long)(op - dst);
+}
+
+
+static long lz_compress (const cw_block_codec* codec, const uint8_t* src, unsigned long src_length, uint8_t* dst, unsigned long dst_capacity)
+{
+    uint32_t table[1 << LZ_HASH_BITS];
+    (void)codec;
+    memset (table, 0, sizeof(table));
+    return lz_compress_prefixed (NULL, 0, table, src, src_length, dst, dst_capacity);
+}
+
+
+static long lz_decompress (const cw_block_codec* codec, const uint8_t* src, unsigned long src_length, uint8_t* dst, unsigned long dst_capacity)
+{
+    (void)codec;
+    return lz_decompress_prefixed (NULL, 0, src, src_length, dst, dst_capacity);
+}
+
+
+const cw_block_codec cw_lz_codec = {CW_CODEC_LZ, lz_compress, lz_decompress, 0};
+
+
+
+/*****************************************  OPTIONAL CODECS  **********************************/
+
+#ifdef CWP_USE_ZSTD
+static long zstd_compress (const cw_block_codec* codec, const uint8_t* src, unsigned long src_length, uint8_t* dst, unsigned long dst_capacity)
+{
+    size_t l = ZSTD_compress (dst, dst_capacity, src, src_length, codec->level ? codec->level : 3);
+    return ZSTD_isError (l) ? -1 : (long)l;
+}
+
+static long zstd_decompress (const cw_block_codec* codec, const uint8_t* src, unsigned long src_length, uint8_t* dst, unsigned long dst_capacity)
+{
+    size_t l = ZSTD_decompress (dst, dst_capacity, src, src_length);
+    (void)codec;
+    return ZSTD_isError (l) ? -1 : (long)l;
+}
+
+const cw_block_codec cw_zstd_codec = {CW_CODEC_ZSTD, zstd_compress, zstd_decompress, 3};
+#endif
+
+
+#ifdef CWP_USE_LZ4
+static long lz4_compress (const cw_block_codec* codec, const uint8_t* src, unsigned long src_length, uint8_t* dst, unsigned long dst_capacity)
+{
+    int l = LZ4_compress_default ((const char*)src, (char*)dst, (int)src_length, (int)dst_capacity);
+    (void)codec;
+    return l > 0 ? l : -1;
+}
+
+static long lz4_decompress (const cw_block_codec* codec, const uint8_t* src, unsigned long src_length, uint8_t* dst, unsigned long dst_capacity)
+{
+    int l = LZ4_decompress_safe ((const char*)src, (char*)dst, (int)src_length, (int)dst_capacity);
+    (void)codec;
+    return l >= 0 ? l : -1;
+}
+
+const cw_block_codec cw_lz4_codec = {CW_CODEC_LZ4, lz4_compress, lz4_decompress, 0};
+#endif
+
+
+const cw_block_codec* cw_block_codec_for_id (uint8_t id)
+{
+    switch (id)
+    {
+        case CW_CODEC_LZ:
+            return &cw_lz_codec;
+#ifdef CWP_USE_ZSTD
+        case CW_CODEC_ZSTD:
+            return &cw_zstd_codec;
+#endif
+#ifdef CWP_USE_LZ4
+        case CW_CODEC_LZ4:
+            return &cw_lz4_codec;
+#endif
+        default:
+            return NULL;
+    }
+}
+
+
+long compressed_block_decode (const cw_block_codec* codec, const uint8_t* block, unsigned long block_length, uint8_t* dst, unsigned long dst_capacity)
+{
+    if (block_length < COMPRESSED_BLOCK_HEADER)
+        return -1;
+    uint32_t raw_length = get_be32 (block + 1);
+    uint32_t stored_length = get_be32 (block + 5);
+    if (block_length - COMPRESSED_BLOCK_HEADER < stored_length || dst_capacity < raw_length)
+        return -1;
+
+    const uint8_t *stored = block + COMPRESSED_BLOCK_HEADER;
+    if (block[0] == CW_CODEC_STORED)
+    {
+        if (stored_length != raw_length)
+            return -1;
+        memcpy (dst, stored, raw_length);
+        return (long)raw_length;
+    }
+    if (!codec || codec->id != block[0])
+        codec = cw_block_codec_for_id (block[0]);
+    if (!codec || codec->decompress (codec, stored, stored_length, dst, raw_length) != (long)raw_length)
+        return -1;
+    return (long)raw_length;
+}
+
+
+
+/*****************************************  COMPRESSED FILE PACK CONTEXT  **********************/
+
+
+static int write_all (int fd, const uint8_t* p, unsigned long length)
+{
+    while (length)
+    {
+        long l = write (fd, p, length);
+        if (l <= 0)
+            return -1;
+        p += l;
+        length -= (unsigned long)l;
+    }
+    return 0;
+}
+
+
+static int flush_compressed_file_pack_context(struct cw_pack_context* pc)
+{
+    compressed_file_pack_context* cfpc = (compressed_file_pack_context*)pc;
+    unsigned long raw_length = (unsigned long)(pc->current - pc->start);
+    if (!raw_length)
+        return CWP_RC_OK;
+
+    /* a block that doesn't shrink is stored */
+    if (cfpc->block_capacity < COMPRESSED_BLOCK_HEADER + raw_length)
+    {
+        uint8_t *block = realloc (cfpc->block, COMPRESSED_BLOCK_HEADER + raw_length);
+        if (!block)
+            return CWP_RC_BUFFER_OVERFLOW;
+        cfpc->block = block;
+        cfpc->block_capacity = COMPRESSED_BLOCK_HEADER + raw_length;
+    }
+
+    long stored_length = -1;
+    if (cfpc->codec)
+        stored_length = cfpc->codec->compress (cfpc->codec, pc->start, raw_length, cfpc->block + COMPRESSED_BLOCK_HEADER, raw_length - 1);
+    const uint8_t *stored = cfpc->block + COMPRESSED_BLOCK_HEADER;
+    cfpc->block[0] = cfpc->codec ? cfpc->codec->id : CW_CODEC_STORED;
+    if (stored_length < 0)
+    {
+        stored_length = (long)raw_length;
+        stored = pc->start;
+        cfpc->block[0] = CW_CODEC_STORED;
+    }
+    put_be32 (cfpc->block + 1, (uint32_t)raw_length);
+    put_be32 (cfpc->block + 5, (uint32_t)stored_length);
+
+    if (stored == pc->start ? write_all (cfpc->fileDescriptor, cfpc->block, COMPRESSED_BLOCK_HEADER) ||
+                              write_all (cfpc->fileDescriptor, stored, (unsigned long)stored_length)
+                            : write_all (cfpc->fileDescriptor, cfpc->block, COMPRESSED_BLOCK_HEADER + (unsigned long)stored_length))
+    {
+        pc->err_no = errno;
+        return CWP_RC_ERROR_IN_HANDLER;
+    }
+    pc->current = pc->start;
+    return CWP_RC_OK;
+}
+
+
+static int handle_compressed_file_pack_overflow(struct cw_pack_context* pc, unsigned long more)
+{
+    int rc = flush_compressed_file_pack_context(pc);
+    if (rc != CWP_RC_OK)
+        return rc;
+
+    unsigned long buffer_length = (unsigned long)(pc->end - pc->start);
+    if (buffer_length < more)
+    {
+        while (buffer_length < more)
+            buffer_length = 2 * buffer_length;
+
+        uint8_t *buffer = realloc (pc->start, buffer_length);
+        if (!buffer)
+            return CWP_RC_BUFFER_OVERFLOW;
+        pc->start = pc->current = buffer;
+        pc->end = buffer + buffer_length;
+    }
+    return CWP_RC_OK;
+}
+
+
+void init_compressed_file_pack_context (compressed_file_pack_context* cfpc, unsigned long block_length, int fileDescriptor, const cw_block_codec* codec)
+{
+    unsigned long buffer_length = (block_length > 32 ? block_length : 65536);
+    void *buffer = malloc (buffer_length);
+    if (!buffer)
+    {
+        cfpc->pc.return_code = CWP_RC_MALLOC_ERROR;
+        return;
+    }
+
+    cfpc->fileDescriptor = fileDescriptor;
+    cfpc->codec = codec;
+    cfpc->block = NULL;
+    cfpc->block_capacity = 0;
+    cw_pack_context_init((cw_pack_context*)cfpc, buffer, buffer_length, &handle_compressed_file_pack_overflow);
+    cw_pack_set_flush_handler((cw_pack_context*)cfpc, &flush_compressed_file_pack_context);
+}
+
+
+void terminate_compressed_file_pack_context (compressed_file_pack_context* cfpc)
+{
+    cw_pack_context* pc = (cw_pack_context*)cfpc;
+    cw_pack_flush(pc);
+
+    if (pc->return_code != CWP_RC_MALLOC_ERROR)
+        free(pc->start);
+    free (cfpc->block);
+    cfpc->block = NULL;
+}
+
+
+
+/*****************************************  COMPRESSED FILE UNPACK CONTEXT  ********************/
+
+
+/* Returns bytes read, less than length only at end of file */
+static long read_all (int fd, uint8_t* p, unsigned long length)
+{
+    unsigned long done = 0;
+    while (done < length)
+    {
+        long l = read (fd, p + done, length - done);
+        if (l < 0)
+            return -1;
+        if (l == 0)
+            break;
+        done += (unsigned long)l;
+    }
+    return (long)done;
+}
+
+
+static int handle_compressed_file_unpack_underflow(struct cw_unpack_context* uc, unsigned long more)
+{
+    compressed_file_unpack_context* cfuc = (compressed_file_unpack_context*)uc;
+    unsigned long remains = (unsigned long)(uc->end - uc->current);
+    if (remains)
+        memmove (uc->start, uc->current, remains);
+    uc->current = uc->start;
+    uc->end = uc->start + remains;
+
+    while ((unsigned long)(uc->end - uc->current) < more)
+    {
+        long l = read_all (cfuc->fileDescriptor, cfuc->block, COMPRESSED_BLOCK_HEADER);
+        if (l == 0)
+            return CWP_RC_END_OF_INPUT;
+        if (l < 0)
+        {
+            uc->err_no = errno;
+            return CWP_RC_ERROR_IN_HANDLER;
+        }
+        if (l != COMPRESSED_BLOCK_HEADER)
+            return CWP_RC_MALFORMED_INPUT;
+
+        unsigned long raw_length = get_be32 (cfuc->block + 1);
+        unsigned long stored_length = get_be32 (cfuc->block + 5);
+        if (cfuc->block_capacity < COMPRESSED_BLOCK_HEADER + stored_length)
+        {
+            uint8_t *block = realloc (cfuc->block, COMPRESSED_BLOCK_HEADER + stored_length);
+            if (!block)
+                return CWP_RC_BUFFER_UNDERFLOW;
+            cfuc->block = block;
+            cfuc->block_capacity = COMPRESSED_BLOCK_HEADER + stored_length;
+        }
+        unsigned long contains = (unsigned long)(uc->end - uc->start);
+        if (cfuc->buffer_length < contains + raw_length)
+        {
+            unsigned long buffer_length = cfuc->buffer_length;
+            while (buffer_length < contains + raw_length)
+                buffer_length = 2 * buffer_length;
+            uint8_t *buffer = realloc (uc->start, buffer_length);
+            if (!buffer)
+                return CWP_RC_BUFFER_UNDERFLOW;
+            uc->start = uc->current = buffer;
+            uc->end = buffer + contains;
+            cfuc->buffer_length = buffer_length;
+        }
+
+        l = read_all (cfuc->fileDescriptor, cfuc->block + COMPRESSED_BLOCK_HEADER, stored_length);
+        if (l < 0)
+        {
+            uc->err_no = errno;
+            return CWP_RC_ERROR_IN_HANDLER;
+        }
+        if (compressed_block_decode (cfuc->codec, cfuc->block, COMPRESSED_BLOCK_HEADER + (unsigned long)l, uc->end, raw_length) < 0)
+            return CWP_RC_MALFORMED_INPUT;
+        uc->end += raw_length;
+    }
+    return CWP_RC_OK;
+}
+
+
+void init_compressed_file_unpack_context (compressed_file_unpack_context* cfuc, int fileDescriptor, const cw_block_codec* codec)
+{
+    unsigned long buffer_length = 65536;
+    void *buffer = malloc (buffer_length);
+    uint8_t *block = malloc (COMPRESSED_BLOCK_HEADER + buffer_length);
+    if (!buffer || !block)
+    {
+        free (buffer);
+        free (block);
+        cfuc->uc.return_code = CWP_RC_MALLOC_ERROR;
+        return;
+    }
+    cfuc->fileDescriptor = fileDescriptor;
+    cfuc->codec = codec;
+    cfuc->buffer_length = buffer_length;
+    cfuc->block = block;
+    cfuc->block_capacity = COMPRESSED_BLOCK_HEADER + buffer_length;
+
+    cw_unpack_context_init((cw_unpack_context*)cfuc, buffer, 0, &handle_compressed_file_unpack_underflow);
+}
+
+
+void terminate_compressed_file_unpack_context (compressed_file_unpack_context* cfuc)
+{
+    if (cfuc->uc.return_code == CWP_RC_MALLOC_ERROR)
+        return;
+    free (cfuc->uc.start);
+    free (cfuc->block);
+    cfuc->uc.start = NULL;
+    cfuc->block = NULL;
+}
+
+
+
+/*****************************************  DICTIONARY COMPRESSION  ***************************/
+
+#define TRAIN_GRAM          6
+#define TRAIN_SEGMENT       48
+#define TRAIN_HASH_BITS     16
+
+
+static uint32_t gram_hash (const uint8_t* p)
+{
+    uint64_t v = read32 (p) | (uint64_t)p[4] << 32 | (uint64_t)p[5] << 40;
+    return (uint32_t)((v * 0x9E3779B185EBCA87ULL) >> (64 - TRAIN_HASH_BITS));
+}
+
+
+int cw_dictionary_init (cw_dictionary* dictionary, uint32_t id, const uint8_t* content, unsigned long length)
+{
+    if (length > CW_DICTIONARY_MAX_LENGTH)
+    {
+        content += length - CW_DICTIONARY_MAX_LENGTH;   /* the end is closest to the messages */
+        length = CW_DICTIONARY_MAX_LENGTH;
+    }
+    dictionary->content = malloc (length ? length : 1);
+    dictionary->table = calloc (1 << LZ_HASH_BITS, sizeof(uint32_t));
+    if (!dictionary->content || !dictionary->table)
+    {
+        free (dictionary->content);
+        free (dictionary->table);
+        dictionary->content = NULL;
+        dictionary->table = NULL;
+        return CWP_RC_MALLOC_ERROR;
+    }
+    memcpy (dictionary->content, content, length);
+    dictionary->length = length;
+
+    unsigned long i;
+    for (i = 0; i + 4 <= length; i++)
+        dictionary->table[lz_hash (read32 (content + i))] = (uint32_t)i;
+
+    if (!id)
+    {
+        id = 2166136261U;                               /* FNV-1a */
+        for (i = 0; i < length; i++)
+            id = (id ^ content[i]) * 16777619U;
+        id |= 1;
+    }
+    dictionary->id = id;
+    return CWP_RC_OK;
+}
+
+
+int cw_dictionary_train (cw_dictionary* dictionary, uint32_t id, const uint8_t* samples,
+                         const unsigned long* sample_lengths, unsigned count, unsigned long capacity)
+{
+    unsigned long total = 0, i;
+    unsigned s;
+    for (s = 0; s < count; s++)
+        total += sample_lengths[s];
+    if (capacity > CW_DICTIONARY_MAX_LENGTH)
+        capacity = CW_DICTIONARY_MAX_LENGTH;
+    if (total <= capacity)
+        return cw_dictionary_init (dictionary, id, samples, total);
+
+    uint32_t *frequency = calloc (1 << TRAIN_HASH_BITS, sizeof(uint32_t));
+    uint32_t *last_sample = calloc (1 << TRAIN_HASH_BITS, sizeof(uint32_t));
+    uint8_t *content = malloc (capacity);
+    if (!frequency || !last_sample || !content)
+    {
+        free (frequency);
+        free (last_sample);
+        free (content);
+        return CWP_RC_MALLOC_ERROR;
+    }
+
+    /* in how many samples each gram occurs */
+    const uint8_t *sample = samples;
+    for (s = 0; s < count; sample += sample_lengths[s++])
+        for (i = 0; i + TRAIN_GRAM <= sample_lengths[s]; i++)
+        {
+            uint32_t h = gram_hash (sample + i);
+            if (last_sample[h] != s + 1)
+            {
+                last_sample[h] = s + 1;
+                frequency[h]++;
+            }
+        }
+
+    /*
+     * The samples are split in epochs and the best segment of each epoch is taken, after
+     * which its grams count for nothing. This spreads the dictionary over the samples
+     * without repeating itself.
+     */
+    unsigned long epochs = capacity / TRAIN_SEGMENT;
+    if (!epochs)
+        epochs = 1;
+    if (total / epochs < 4 * TRAIN_SEGMENT)
+        epochs = total / (4 * TRAIN_SEGMENT) + 1;
+    unsigned long epoch_length = total / epochs + 1;
+    unsigned long position = capacity, epoch, idle = 0;
+
+    for (epoch = 0; position && idle < epochs; epoch = (epoch + 1) % epochs)
+    {
+        unsigned long from = epoch * epoch_length, to = from + epoch_length;
+        unsigned long best = 0, best_start = 0, best_length = 0, start = 0;
+        if (to > total)
+            to = total;
+
+        for (s = 0; s < count && start < to; start += sample_lengths[s++])
+        {
+            unsigned long a = (from > start ? from : start), b = start + sample_lengths[s];
+            if (b > to)
+                b = to;
+            if (b < a + TRAIN_GRAM)
+                continue;
+
+            /* slide a segment over [a, b) and sum the frequencies of its grams */
+            unsigned long grams = b - a - TRAIN_GRAM + 1, window = TRAIN_SEGMENT - TRAIN_GRAM + 1, score = 0;
+            if (window > grams)
+                window = grams;
+            for (i = 0; i < grams; i++)
+            {
+                score += frequency[gram_hash (samples + a + i)];
+                if (i >= window)
+                    score -= frequency[gram_hash (samples + a + i - window)];
+                if (i + 1 >= window && score > best)
+                {
+                    best = score;
+                    best_start = a + i + 1 - window;
+                    best_length = window + TRAIN_GRAM - 1;
+                }
+            }
+        }
+        if (best <= count / 16 + 1)     /* nothing common left here */
+        {
+            idle++;
+            continue;
+        }
+        idle = 0;
+
+        for (i = 0; i + TRAIN_GRAM <= best_length; i++)
+            frequency[gram_hash (samples + best_start + i)] = 0;
+        if (best_length > position)
+        {
+            best_start += best_length - position;
+            best_length = position;
+        }
+        position -= best_length;
+        memcpy (content + position, samples + best_start, best_length);
+    }
+
+    int rc = cw_dictionary_init (dictionary, id, content + position, capacity - position);
+    free (frequency);
+    free (last_sample);
+    free (content);
+    return rc;
+}
+
+
+void cw_dictionary_free (cw_dictionary* dictionary)
+{
+    free (dictionary->content);
+    free (dictionary->table);
+    dictionary->content = NULL;
+    dictionary->table = NULL;
+}
+
+
+
+/*****************************************  DICTIONARY PACK CONTEXT  **************************/
+
+
+static int handle_dictionary_pack_overflow(struct cw_pack_context* pc, unsigned long more)
+{
+    unsigned long contains = (unsigned long)(pc->current - pc->start);
+    unsigned long buffer_length = (unsigned long)(pc->end - pc->start);
+    while (buffer_length < contains + more)
+        buffer_length = 2 * buffer_length;
+
+    uint8_t *buffer = realloc (pc->start, buffer_length);
+    if (!buffer)
+        return CWP_RC_BUFFER_OVERFLOW;
+    pc->start = buffer;
+    pc->current = buffer + contains;
+    pc->end = buffer + buffer_length;
+    return CWP_RC_OK;
+}
+
+
+void init_dictionary_pack_context (dictionary_pack_context* dpc, unsigned long initial_buffer_length, const cw_dictionary* dictionary)
+{
+    unsigned long buffer_length = (initial_buffer_length > 0 ? initial_buffer_length : 1024);
+    void *buffer = malloc (buffer_length);
+    if (!buffer)
+    {
+        dpc->pc.return_code = CWP_RC_MALLOC_ERROR;
+        return;
+    }
+
+    dpc->dictionary = dictionary;
+    dpc->message = NULL;
+    dpc->message_length = 0;
+    dpc->frame = NULL;
+    dpc->frame_capacity = 0;
+    dpc->table = NULL;
+    cw_pack_context_init((cw_pack_context*)dpc, buffer, buffer_length, &handle_dictionary_pack_overflow);
+}
+
+
+void dictionary_pack_context_reset (dictionary_pack_context* dpc)
+{
+    dpc->pc.current = dpc->pc.start;
+    dpc->pc.return_code = CWP_RC_OK;
+    dpc->message = NULL;
+    dpc->message_length = 0;
+}
+
+
+int dictionary_pack_context_finish (dictionary_pack_context* dpc)
+{
+    cw_pack_context* pc = (cw_pack_context*)dpc;
+    if (pc->return_code != CWP_RC_OK)
+        return pc->return_code;
+
+    unsigned long raw_length = (unsigned long)(pc->current - pc->start);
+    dpc->message = pc->start;
+    dpc->message_length = raw_length;
+    if (!dpc->dictionary || raw_length < 16)
+        return CWP_RC_OK;
+
+    if (dpc->frame_capacity < raw_length)
+    {
+        uint8_t *frame = realloc (dpc->frame, raw_length);
+        if (!frame)
+            return CWP_RC_OK;       /* plain is always fine */
+        dpc->frame = frame;
+        dpc->frame_capacity = raw_length;
+    }
+
+    uint8_t *p = dpc->frame;
+    *p++ = CW_DICTIONARY_MARKER;
+    put_be32 (p, dpc->dictionary->id);
+    p += 4;
+    unsigned long l = raw_length;
+    for (; l >= 0x80; l >>= 7)
+        *p++ = (uint8_t)(l | 0x80);
+    *p++ = (uint8_t)l;
+
+    const cw_dictionary *d = dpc->dictionary;
+    if (!dpc->table)
+    {
+        dpc->table = malloc (sizeof(uint32_t) << LZ_HASH_BITS);
+        if (!dpc->table)
+            return CWP_RC_OK;
+        memcpy (dpc->table, d->table, sizeof(uint32_t) << LZ_HASH_BITS);
+    }
+    unsigned long header_length = (unsigned long)(p - dpc->frame);
+    long payload_length = lz_compress_prefixed (d->content, d->length, dpc->table, pc->start, raw_length,
+                                                p, raw_length - header_length - 1);
+
+    /* The compressor only stores the positions it hashes; put back what they replaced */
+    unsigned long i;
+    for (i = 0; i + 12 < raw_length; i++)
+    {
+        uint32_t h = lz_hash (read32 (pc->start + i));
+        dpc->table[h] = d->table[h];
+    }
+    if (payload_length >= 0)
+    {
+        dpc->message = dpc->frame;
+        dpc->message_length = header_length + (unsigned long)payload_length;
+    }
+    return CWP_RC_OK;
+}
+
+
+void terminate_dictionary_pack_context (dictionary_pack_context* dpc)
+{
+    if (dpc->pc.return_code != CWP_RC_MALLOC_ERROR)
+        free(dpc->pc.start);
+    free (dpc->frame);
+    dpc->frame = NULL;
+    free (dpc->table);
+    dpc->table = NULL;
+}
+
+
+
+/*****************************************  DICTIONARY UNPACK CONTEXT  ************************/
+
+
+void init_dictionary_unpack_context (dictionary_unpack_context* duc, const cw_dictionary* dictionaries, unsigned dictionary_count)
+{
+    duc->dictionaries = dictionaries;
+    duc->dictionary_count = dictionary_count;
+    duc->buffer = NULL;
+    duc->buffer_capacity = 0;
+    cw_unpack_context_init((cw_unpack_context*)duc, NULL, 0, NULL);
+}
+
+
+int dictionary_unpack_context_set_message (dictionary_unpack_context* duc, const uint8_t* message, unsigned long length)
+{
+    cw_unpack_context* uc = (cw_unpack_context*)duc;
+    if (!length || message[0] != CW_DICTIONARY_MARKER)
+    {
+        cw_unpack_context_init(uc, message, length, NULL);
+        return CWP_RC_OK;
+    }
+
+    const uint8_t *p = message + 1, *end = message + length;
+    const cw_dictionary *d = NULL;
+    unsigned long raw_length = 0;
+    unsigned i, shift = 0;
+    if (end - p < 5)
+        goto malformed;
+    uint32_t id = get_be32 (p);
+    p += 4;
+    for (i = 0; i < duc->dictionary_count; i++)
+        if (duc->dictionaries[i].id == id)
+            d = duc->dictionaries + i;
+    for (;; shift += 7)
+    {
+        if (p == end || shift > 28)
+            goto malformed;
+        raw_length |= (unsigned long)(*p & 0x7f) << shift;
+        if (!(*p++ & 0x80))
+            break;
+    }
+    if (!d || raw_length / 256 > length)     /* LZ can't expand more than that */
+        goto malformed;
+
+    if (duc->buffer_capacity < raw_length)
+    {
+        uint8_t *buffer = realloc (duc->buffer, raw_length);
+        if (!buffer)
+        {
+            uc->return_code = CWP_RC_MALLOC_ERROR;
+            return uc->return_code;
+        }
+        duc->buffer = buffer;
+        duc->buffer_capacity = raw_length;
+    }
+    if (lz_decompress_prefixed (d->content, d->length, p, (unsigned long)(end - p), duc->buffer, raw_length) != (long)raw_length)
+        goto malformed;
+    cw_unpack_context_init(uc, duc->buffer, raw_length, NULL);
+    return CWP_RC_OK;
+
+malformed:
+    cw_unpack_context_init(uc, NULL, 0, NULL);
+    uc->return_code = CWP_RC_MALFORMED_INPUT;
+    return uc->return_code;
+}
+
+
+void terminate_dictionary_unpack_context (dictionary_unpack_context* duc)
+{
+    free (duc->buffer);
+    duc->buffer = NULL;
+    duc->buffer_capacity = 0;
+}
@@ -0,0 +1,200 @@
+/*      CWPack/goodies - compressed_contexts.h   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef compressed_contexts_h
+#define compressed_contexts_h
+
+#include "cwpack.h"
+
+
+/*****************************************  BLOCK CODECS  *************************************/
+
+/*
+ * A compressed stream is a sequence of independently decodable blocks:
+ *
+ *      codec id(1)  raw length(4)  stored length(4)  stored bytes
+ *
+ * Lengths are big endian. Codec id 0 means the bytes are stored uncompressed, which is
+ * used whenever compression doesn't pay.
+ */
+
+#define COMPRESSED_BLOCK_HEADER     9
+
+#define CW_CODEC_STORED     0
+#define CW_CODEC_LZ         1
+#define CW_CODEC_ZSTD       2
+#define CW_CODEC_LZ4        3
+
+typedef struct cw_block_codec
+{
+    uint8_t     id;
+    /* Return the compressed/decompressed length, or -1 if dst is too small or src is malformed */
+    long        (*compress)(const struct cw_block_codec* codec, const uint8_t* src, unsigned long src_length, uint8_t* dst, unsigned long dst_capacity);
+    long        (*decompress)(const struct cw_block_codec* codec, const uint8_t* src, unsigned long src_length, uint8_t* dst, unsigned long dst_capacity);
+    int         level;                      /* for codecs that have one */
+} cw_block_codec;
+
+
+extern const cw_block_codec cw_lz_codec;    /* built-in, no dependencies */
+#ifdef CWP_USE_ZSTD
+extern const cw_block_codec cw_zstd_codec;
+#endif
+#ifdef CWP_USE_LZ4
+extern const cw_block_codec cw_lz4_codec;
+#endif
+
+/* The built-in codec with the id, NULL if not compiled in */
+const cw_block_codec* cw_block_codec_for_id (uint8_t id);
+
+/* Decodes one block, header included, e.g. in a worker thread. Returns the raw length or -1 */
+long compressed_block_decode (const cw_block_codec* codec, const uint8_t* block, unsigned long block_length, uint8_t* dst, unsigned long dst_capacity);
+
+
+
+/*****************************************  COMPRESSED FILE PACK CONTEXT  **********************/
+
+typedef struct
+{
+    cw_pack_context         pc;
+    int                     fileDescriptor;
+    const cw_block_codec    *codec;
+    uint8_t                 *block;         /* header + compressed bytes */
+    unsigned long           block_capacity;
+} compressed_file_pack_context;
+
+
+void init_compressed_file_pack_context (compressed_file_pack_context* cfpc, unsigned long block_length, int fileDescriptor, const cw_block_codec* codec);
+
+void terminate_compressed_file_pack_context (compressed_file_pack_context* cfpc);
+
+
+
+/*****************************************  COMPRESSED FILE UNPACK CONTEXT  ********************/
+
+typedef struct
+{
+    cw_unpack_context       uc;
+    int                     fileDescriptor;
+    const cw_block_codec    *codec;         /* used for its id, before the built-in ones */
+    unsigned long           buffer_length;
+    uint8_t                 *block;
+    unsigned long           block_capacity;
+} compressed_file_unpack_context;
+
+
+void init_compressed_file_unpack_context (compressed_file_unpack_context* cfuc, int fileDescriptor, const cw_block_codec* codec);
+
+void terminate_compressed_file_unpack_context (compressed_file_unpack_context* cfuc);
+
+
+
+/*****************************************  DICTIONARY COMPRESSION  ***************************/
+
+/*
+ * Small messages are too short to compress on their own. With a shared dictionary, built
+ * from sample messages, the LZ codec can refer to the dictionary as history in front of
+ * each message. A compressed message is framed as
+ *
+ *      0xc1  dictionary id(4)  raw length(varint)  LZ payload
+ *
+ * 0xc1 is never used by msgpack, so a message that doesn't shrink is sent plain and the
+ * receiver passes it through.
+ */
+
+#define CW_DICTIONARY_MARKER        0xc1
+#define CW_DICTIONARY_MAX_LENGTH    65535
+
+typedef struct
+{
+    uint32_t        id;
+    uint8_t         *content;
+    unsigned long   length;
+    uint32_t        *table;         /* LZ hash table prefilled with the content */
+} cw_dictionary;
+
+
+/* Id 0 means an id is computed from the content. Returns CWP_RC_OK or CWP_RC_MALLOC_ERROR */
+int cw_dictionary_init (cw_dictionary* dictionary, uint32_t id, const uint8_t* content, unsigned long length);
+
+/*
+ * Builds a dictionary of at most capacity bytes from count samples, stored back to back in
+ * samples. The segments that occur in most samples are chosen; the best ones are put last,
+ * closest to the message.
+ */
+int cw_dictionary_train (cw_dictionary* dictionary, uint32_t id, const uint8_t* samples,
+                         const unsigned long* sample_lengths, unsigned count, unsigned long capacity);
+
+void cw_dictionary_free (cw_dictionary* dictionary);
+
+
+
+/*****************************************  DICTIONARY PACK CONTEXT  **************************/
+
+typedef struct
+{
+    cw_pack_context         pc;
+    const cw_dictionary     *dictionary;
+    const uint8_t           *message;       /* set by finish */
+    unsigned long           message_length;
+    uint8_t                 *frame;
+    unsigned long           frame_capacity;
+    uint32_t                *table;         /* copy of the dictionary table, restored after each message */
+} dictionary_pack_context;
+
+
+void init_dictionary_pack_context (dictionary_pack_context* dpc, unsigned long initial_buffer_length, const cw_dictionary* dictionary);
+
+/* Starts a new message */
+void dictionary_pack_context_reset (dictionary_pack_context* dpc);
+
+/* Compresses the packed message; message/message_length is valid until the next reset */
+int dictionary_pack_context_finish (dictionary_pack_context* dpc);
+
+void terminate_dictionary_pack_context (dictionary_pack_context* dpc);
+
+
+
+/*****************************************  DICTIONARY UNPACK CONTEXT  ************************/
+
+typedef struct
+{
+    cw_unpack_context       uc;
+    const cw_dictionary     *dictionaries;
+    unsigned                dictionary_count;
+    uint8_t                 *buffer;
+    unsigned long           buffer_capacity;
+} dictionary_unpack_context;
+
+
+void init_dictionary_unpack_context (dictionary_unpack_context* duc, const cw_dictionary* dictionaries, unsigned dictionary_count);
+
+/* Sets the message to unpack. A message with an unknown dictionary id is CWP_RC_MALFORMED_INPUT */
+int dictionary_unpack_context_set_message (dictionary_unpack_context* duc, const uint8_t* message, unsigned long length);
+
+void terminate_dictionary_unpack_context (dictionary_unpack_context* duc);
+
+
+
+/*****************************************  E P I L O G U E  **********************************/
+
+
+#endif /* compressed_contexts_h */
@@ -0,0 +1,442 @@
+/*      CWPack/goodies - channel_file.c   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "channel_file.h"
+
+
+#define DIRECTORY_MAGIC         "CWCH"
+#define DIRECTORY_VERSION       1
+#define DIRECTORY_ENTRY_LENGTH  14
+#define TRAILER_LENGTH          18
+
+
+static uint64_t get_be (const uint8_t* p, int n)
+{
+    uint64_t v = 0;
+    while (n--)
+        v = v << 8 | *p++;
+    return v;
+}
+
+
+static void put_be (uint8_t* p, uint64_t v, int n)
+{
+    while (n--)
+    {
+        p[n] = (uint8_t)v;
+        v >>= 8;
+    }
+}
+
+
+static int pwrite_all (int fd, const uint8_t* p, unsigned long length, uint64_t offset)
+{
+    while (length)
+    {
+        long l = pwrite (fd, p, length, (off_t)offset);
+        if (l <= 0)
+            return -1;
+        p += l;
+        offset += (uint64_t)l;
+        length -= (unsigned long)l;
+    }
+    return 0;
+}
+
+
+/* Returns bytes read, less than length only at end of file */
+static long pread_all (int fd, uint8_t* p, unsigned long length, uint64_t offset)
+{
+    unsigned long done = 0;
+    while (done < length)
+    {
+        long l = pread (fd, p + done, length - done, (off_t)(offset + done));
+        if (l < 0)
+            return -1;
+        if (l == 0)
+            break;
+        done += (unsigned long)l;
+    }
+    return (long)done;
+}
+
+
+static int append_entry (channel_chunk_entry** entries, unsigned long* count, unsigned long* capacity, channel_chunk_entry entry)
+{
+    if (*count == *capacity)
+    {
+        unsigned long new_capacity = *capacity ? 2 * *capacity : 64;
+        channel_chunk_entry *new_entries = realloc (*entries, new_capacity * sizeof(channel_chunk_entry));
+        if (!new_entries)
+            return CWP_RC_MALLOC_ERROR;
+        *entries = new_entries;
+        *capacity = new_capacity;
+    }
+    (*entries)[(*count)++] = entry;
+    return CWP_RC_OK;
+}
+
+
+
+/*****************************************  CHANNEL FILE WRITER  ******************************/
+
+
+void init_channel_file_writer (channel_file_writer* cfw, int fileDescriptor)
+{
+    off_t position = lseek (fileDescriptor, 0, SEEK_CUR);
+    cfw->fileDescriptor = fileDescriptor;
+    cfw->offset = position > 0 ? (uint64_t)position : 0;
+    cfw->entries = NULL;
+    cfw->entry_count = 0;
+    cfw->entry_capacity = 0;
+    cfw->return_code = CWP_RC_OK;
+    cfw->err_no = 0;
+}
+
+
+int terminate_channel_file_writer (channel_file_writer* cfw)
+{
+    if (cfw->return_code == CWP_RC_OK)
+    {
+        unsigned long block_length = cfw->entry_count * DIRECTORY_ENTRY_LENGTH;
+        unsigned long length = block_length + 6 + TRAILER_LENGTH;
+        uint8_t *block = malloc (block_length + 1);
+        uint8_t *footer = malloc (length);
+        if (!block || !footer || block_length > 0xffffffffUL)
+            cfw->return_code = CWP_RC_MALLOC_ERROR;
+        else
+        {
+            unsigned long i;
+            for (i = 0; i < cfw->entry_count; i++)
+            {
+                put_be (block + i * DIRECTORY_ENTRY_LENGTH, cfw->entries[i].channel, 2);
+                put_be (block + i * DIRECTORY_ENTRY_LENGTH + 2, cfw->entries[i].offset, 8);
+                put_be (block + i * DIRECTORY_ENTRY_LENGTH + 10, cfw->entries[i].length, 4);
+            }
+            uint8_t trailer[16];
+            memcpy (trailer, DIRECTORY_MAGIC, 4);
+            put_be (trailer + 4, DIRECTORY_VERSION, 4);
+            put_be (trailer + 8, cfw->offset, 8);
+
+            cw_pack_context pc;
+            cw_pack_context_init (&pc, footer, length, 0);
+            cw_pack_ext (&pc, CHANNEL_FILE_DIRECTORY_TYPE, block, (uint32_t)block_length);
+            cw_pack_ext (&pc, CHANNEL_FILE_DIRECTORY_TYPE, trailer, 16);
+            if (pwrite_all (cfw->fileDescriptor, footer, (unsigned long)(pc.current - pc.start), cfw->offset))
+            {
+                cfw->err_no = errno;
+                cfw->return_code = CWP_RC_ERROR_IN_HANDLER;
+            }
+            else
+                lseek (cfw->fileDescriptor, (off_t)cfw->offset + (pc.current - pc.start), SEEK_SET);
+        }
+        free (block);
+        free (footer);
+    }
+    free (cfw->entries);
+    cfw->entries = NULL;
+    return cfw->return_code;
+}
+
+
+
+/*****************************************  CHANNEL PACK CONTEXT  *****************************/
+
+/*
+ * The buffer has room for the chunk header in front of pc->start, so a chunk is written
+ * with one pwrite. Items may straddle chunks; the reader joins the chunks of a channel.
+ */
+
+static int write_chunk (channel_pack_context* cpc)
+{
+    cw_pack_context* pc = (cw_pack_context*)cpc;
+    channel_file_writer *cfw = cpc->writer;
+    unsigned long length = (unsigned long)(pc->current - pc->start);
+    if (!length)
+        return CWP_RC_OK;
+    if (cfw->return_code)
+        return cfw->return_code;
+
+    uint8_t *header = pc->start - CHANNEL_FILE_CHUNK_HEADER;
+    header[0] = 0xc9;
+    put_be (header + 1, length + 2, 4);
+    header[5] = CHANNEL_FILE_CHUNK_TYPE;
+    put_be (header + 6, cpc->channel, 2);
+    if (pwrite_all (cfw->fileDescriptor, header, length + CHANNEL_FILE_CHUNK_HEADER, cfw->offset))
+    {
+        pc->err_no = cfw->err_no = errno;
+        return cfw->return_code = CWP_RC_ERROR_IN_HANDLER;
+    }
+
+    channel_chunk_entry entry;
+    entry.channel = cpc->channel;
+    entry.offset = cfw->offset + CHANNEL_FILE_CHUNK_HEADER;
+    entry.length = (uint32_t)length;
+    if (append_entry (&cfw->entries, &cfw->entry_count, &cfw->entry_capacity, entry))
+        return cfw->return_code = CWP_RC_MALLOC_ERROR;
+    cfw->offset += length + CHANNEL_FILE_CHUNK_HEADER;
+    pc->current = pc->start;
+    return CWP_RC_OK;
+}
+
+
+static int flush_channel_pack_context(struct cw_pack_context* pc)
+{
+    return write_chunk ((channel_pack_context*)pc);
+}
+
+
+static int handle_channel_pack_overflow(struct cw_pack_context* pc, unsigned long more)
+{
+    int rc = write_chunk ((channel_pack_context*)pc);
+    if (rc != CWP_RC_OK)
+        return rc;
+
+    unsigned long buffer_length = (unsigned long)(pc->end - pc->start);
+    if (buffer_length < more)
+    {
+        while (buffer_length < more)
+            buffer_length = 2 * buffer_length;
+
+        uint8_t *buffer = realloc (pc->start - CHANNEL_FILE_CHUNK_HEADER, buffer_length + CHANNEL_FILE_CHUNK_HEADER);
+        if (!buffer)
+            return CWP_RC_BUFFER_OVERFLOW;
+        pc->start = pc->current = buffer + CHANNEL_FILE_CHUNK_HEADER;
+        pc->end = pc->start + buffer_length;
+    }
+    return CWP_RC_OK;
+}
+
+
+void init_channel_pack_context (channel_pack_context* cpc, unsigned long chunk_length, channel_file_writer* cfw, uint16_t channel)
+{
+    unsigned long buffer_length = (chunk_length > 32 ? chunk_length : 65536);
+    uint8_t *buffer = malloc (buffer_length + CHANNEL_FILE_CHUNK_HEADER);
+    if (!buffer)
+    {
+        cpc->pc.return_code = CWP_RC_MALLOC_ERROR;
+        return;
+    }
+
+    cpc->writer = cfw;
+    cpc->channel = channel;
+    cw_pack_context_init((cw_pack_context*)cpc, buffer + CHANNEL_FILE_CHUNK_HEADER, buffer_length, &handle_channel_pack_overflow);
+    cw_pack_set_flush_handler((cw_pack_context*)cpc, &flush_channel_pack_context);
+}
+
+
+void terminate_channel_pack_context (channel_pack_context* cpc)
+{
+    cw_pack_context* pc = (cw_pack_context*)cpc;
+    cw_pack_flush(pc);
+
+    if (pc->return_code != CWP_RC_MALLOC_ERROR)
+        free(pc->start - CHANNEL_FILE_CHUNK_HEADER);
+}
+
+
+
+/*****************************************  CHANNEL DIRECTORY  ********************************/
+
+
+static int read_directory (channel_directory* cd, int fd, uint64_t file_length)
+{
+    uint8_t trailer[TRAILER_LENGTH];
+    if (file_length < TRAILER_LENGTH || pread_all (fd, trailer, TRAILER_LENGTH, file_length - TRAILER_LENGTH) != TRAILER_LENGTH ||
+        trailer[0] != 0xd8 || trailer[1] != CHANNEL_FILE_DIRECTORY_TYPE || memcmp (trailer + 2, DIRECTORY_MAGIC, 4) ||
+        get_be (trailer + 6, 4) != DIRECTORY_VERSION)
+        return CWP_RC_MALFORMED_INPUT;
+
+    uint64_t directory_offset = get_be (trailer + 10, 8);
+    if (directory_offset > file_length - TRAILER_LENGTH)
+        return CWP_RC_MALFORMED_INPUT;
+    unsigned long length = (unsigned long)(file_length - TRAILER_LENGTH - directory_offset);
+    uint8_t *block = malloc (length + 1);
+    if (!block)
+        return CWP_RC_MALLOC_ERROR;
+
+    int rc = CWP_RC_MALFORMED_INPUT;
+    cw_unpack_context uc;
+    cw_unpack_context_init (&uc, block, length, 0);
+    if (pread_all (fd, block, length, directory_offset) == (long)length)
+        cw_unpack_next (&uc);
+    else
+        uc.return_code = CWP_RC_MALFORMED_INPUT;
+    if (!uc.return_code && uc.item.type == CHANNEL_FILE_DIRECTORY_TYPE && uc.current == uc.end &&
+        uc.item.as.ext.length % DIRECTORY_ENTRY_LENGTH == 0)
+    {
+        const uint8_t *p = (const uint8_t*)uc.item.as.ext.start;
+        cd->entry_count = uc.item.as.ext.length / DIRECTORY_ENTRY_LENGTH;
+        cd->entries = malloc (cd->entry_count * sizeof(channel_chunk_entry) + 1);
+        rc = cd->entries ? CWP_RC_OK : CWP_RC_MALLOC_ERROR;
+        unsigned long i;
+        for (i = 0; cd->entries && i < cd->entry_count; i++, p += DIRECTORY_ENTRY_LENGTH)
+        {
+            cd->entries[i].channel = (uint16_t)get_be (p, 2);
+            cd->entries[i].offset = get_be (p + 2, 8);
+            cd->entries[i].length = (uint32_t)get_be (p + 10, 4);
+        }
+    }
+    free (block);
+    return rc;
+}
+
+
+/* Without a directory, e.g. after a crash, the chunk headers are read and the payloads skipped */
+static int scan_chunks (channel_directory* cd, int fd, uint64_t file_length)
+{
+    unsigned long capacity = 0;
+    uint64_t offset = 0;
+    uint8_t header[CHANNEL_FILE_CHUNK_HEADER];
+    while (offset + CHANNEL_FILE_CHUNK_HEADER <= file_length)
+    {
+        long l = pread_all (fd, header, CHANNEL_FILE_CHUNK_HEADER, offset);
+        if (l < 0)
+        {
+            cd->err_no = errno;
+            return CWP_RC_ERROR_IN_HANDLER;
+        }
+        uint64_t length = get_be (header + 1, 4);
+        if (l != CHANNEL_FILE_CHUNK_HEADER || header[0] != 0xc9 || header[5] != CHANNEL_FILE_CHUNK_TYPE ||
+            length < 2 || offset + CHANNEL_FILE_CHUNK_HEADER + length - 2 > file_length)
+            break;
+
+        channel_chunk_entry entry;
+        entry.channel = (uint16_t)get_be (header + 6, 2);
+        entry.offset = offset + CHANNEL_FILE_CHUNK_HEADER;
+        entry.length = (uint32_t)(length - 2);
+        if (append_entry (&cd->entries, &cd->entry_count, &capacity, entry))
+            return CWP_RC_MALLOC_ERROR;
+        offset = entry.offset + entry.length;
+    }
+    return CWP_RC_OK;
+}
+
+
+int channel_file_load_directory (channel_directory* cd, int fileDescriptor)
+{
+    struct stat st;
+    cd->entries = NULL;
+    cd->entry_count = 0;
+    cd->err_no = 0;
+    if (fstat (fileDescriptor, &st))
+    {
+        cd->err_no = errno;
+        return CWP_RC_ERROR_IN_HANDLER;
+    }
+
+    int rc = read_directory (cd, fileDescriptor, (uint64_t)st.st_size);
+    if (rc == CWP_RC_MALFORMED_INPUT)
+        rc = scan_chunks (cd, fileDescriptor, (uint64_t)st.st_size);
+    return rc;
+}
+
+
+void channel_directory_free (channel_directory* cd)
+{
+    free (cd->entries);
+    cd->entries = NULL;
+    cd->entry_count = 0;
+}
+
+
+
+/*****************************************  CHANNEL UNPACK CONTEXT  ***************************/
+
+
+static int handle_channel_unpack_underflow(struct cw_unpack_context* uc, unsigned long more)
+{
+    channel_unpack_context* cuc = (channel_unpack_context*)uc;
+    const channel_directory *cd = cuc->directory;
+    unsigned long remains = (unsigned long)(uc->end - uc->current);
+    if (remains)
+        memmove (uc->start, uc->current, remains);
+    uc->current = uc->start;
+    uc->end = uc->start + remains;
+
+    while ((unsigned long)(uc->end - uc->current) < more)
+    {
+        while (cuc->next_entry < cd->entry_count && cd->entries[cuc->next_entry].channel != cuc->channel)
+            cuc->next_entry++;
+        if (cuc->next_entry == cd->entry_count)
+            return CWP_RC_END_OF_INPUT;
+
+        const channel_chunk_entry *entry = cd->entries + cuc->next_entry;
+        unsigned long contains = (unsigned long)(uc->end - uc->start);
+        if (cuc->buffer_length < contains + entry->length)
+        {
+            unsigned long buffer_length = cuc->buffer_length;
+            while (buffer_length < contains + entry->length)
+                buffer_length = 2 * buffer_length;
+            uint8_t *buffer = realloc (uc->start, buffer_length);
+            if (!buffer)
+                return CWP_RC_BUFFER_UNDERFLOW;
+            uc->start = uc->current = buffer;
+            uc->end = buffer + contains;
+            cuc->buffer_length = buffer_length;
+        }
+
+        long l = pread_all (cuc->fileDescriptor, uc->end, entry->length, entry->offset);
+        if (l < 0)
+        {
+            uc->err_no = errno;
+            return CWP_RC_ERROR_IN_HANDLER;
+        }
+        if (l != (long)entry->length)
+            return CWP_RC_END_OF_INPUT;
+        uc->end += l;
+        cuc->next_entry++;
+    }
+    return CWP_RC_OK;
+}
+
+
+void init_channel_unpack_context (channel_unpack_context* cuc, const channel_directory* cd, int fileDescriptor, uint16_t channel)
+{
+    unsigned long buffer_length = 4096;
+    void *buffer = malloc (buffer_length);
+    if (!buffer)
+    {
+        cuc->uc.return_code = CWP_RC_MALLOC_ERROR;
+        return;
+    }
+    cuc->fileDescriptor = fileDescriptor;
+    cuc->directory = cd;
+    cuc->channel = channel;
+    cuc->next_entry = 0;
+    cuc->buffer_length = buffer_length;
+
+    cw_unpack_context_init((cw_unpack_context*)cuc, buffer, 0, &handle_channel_unpack_underflow);
+}
+
+
+void terminate_channel_unpack_context (channel_unpack_context* cuc)
+{
+    if (cuc->uc.return_code != CWP_RC_MALLOC_ERROR)
+        free(cuc->uc.start);
+    cuc->uc.start = 0;
+}
@@ -0,0 +1,131 @@
+/*      CWPack/goodies - channel_file.h   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef channel_file_h
+#define channel_file_h
+
+#include "cwpack.h"
+
+
+/*
+ * A channel file interleaves the streams of several channels in one file. Each stream is
+ * cut into chunks, written as
+ *
+ *      chunk           ext32 (CHANNEL_FILE_CHUNK_TYPE): channel(2) stream bytes
+ *
+ * and when the file is closed a directory of all chunks is appended:
+ *
+ *      directory       ext (CHANNEL_FILE_DIRECTORY_TYPE): per chunk channel(2) offset(8) length(4)
+ *      trailer         fixext16 (CHANNEL_FILE_DIRECTORY_TYPE): "CWCH" version(4) directory_offset(8)
+ *
+ * All numbers are big endian; offset is where the stream bytes of the chunk start.
+ */
+
+#define CHANNEL_FILE_CHUNK_TYPE         0x4b
+#define CHANNEL_FILE_DIRECTORY_TYPE     0x44
+#define CHANNEL_FILE_CHUNK_HEADER       8
+
+typedef struct
+{
+    uint16_t        channel;
+    uint64_t        offset;
+    uint32_t        length;
+} channel_chunk_entry;
+
+
+
+/*****************************************  CHANNEL FILE WRITER  ******************************/
+
+typedef struct
+{
+    int                 fileDescriptor;
+    uint64_t            offset;             /* where the next chunk goes */
+    channel_chunk_entry *entries;
+    unsigned long       entry_count;
+    unsigned long       entry_capacity;
+    int                 return_code;
+    int                 err_no;
+} channel_file_writer;
+
+
+void init_channel_file_writer (channel_file_writer* cfw, int fileDescriptor);
+
+/* Writes the directory. Terminate the channel pack contexts first */
+int terminate_channel_file_writer (channel_file_writer* cfw);
+
+
+
+/*****************************************  CHANNEL PACK CONTEXT  *****************************/
+
+typedef struct
+{
+    cw_pack_context     pc;
+    channel_file_writer *writer;
+    uint16_t            channel;
+} channel_pack_context;
+
+
+void init_channel_pack_context (channel_pack_context* cpc, unsigned long chunk_length, channel_file_writer* cfw, uint16_t channel);
+
+void terminate_channel_pack_context (channel_pack_context* cpc);
+
+
+
+/*****************************************  CHANNEL DIRECTORY  ********************************/
+
+typedef struct
+{
+    channel_chunk_entry *entries;
+    unsigned long       entry_count;
+    int                 err_no;
+} channel_directory;
+
+
+/* Reads the directory, or rebuilds it from the chunk headers when the file has none */
+int channel_file_load_directory (channel_directory* cd, int fileDescriptor);
+void channel_directory_free (channel_directory* cd);
+
+
+
+/*****************************************  CHANNEL UNPACK CONTEXT  ***************************/
+
+typedef struct
+{
+    cw_unpack_context       uc;
+    int                     fileDescriptor;
+    const channel_directory *directory;
+    uint16_t                channel;
+    unsigned long           next_entry;
+    unsigned long           buffer_length;
+} channel_unpack_context;
+
+
+void init_channel_unpack_context (channel_unpack_context* cuc, const channel_directory* cd, int fileDescriptor, uint16_t channel);
+
+void terminate_channel_unpack_context (channel_unpack_context* cuc);
+
+
+
+/*****************************************  E P I L O G U E  **********************************/
+
+
+#endif /* channel_file_h */
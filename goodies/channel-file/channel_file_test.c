@@ -0,0 +1,155 @@
+/*      CWPack/goodies - channel_file_test.c   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cwpack.h"
+#include "channel_file.h"
+
+
+#define CHANNELS    3
+#define ITEMS       3000
+
+char TEST_area[70000];
+int error_count;
+
+static void ERROR(const char* msg)
+{
+    error_count++;
+    printf("ERROR: %s\n", msg);
+}
+
+
+static void ERROR1(const char* msg, int i)
+{
+    error_count++;
+    printf("ERROR: %s%d\n", msg, i);
+}
+
+
+/* item i of channel c is [c, i, bin]; every 500:th bin is larger than a chunk */
+static uint32_t blob_length (int c, int i)
+{
+    return (uint32_t)(i % 500 == 499 ? 60000 : (i * (c + 3)) % 300);
+}
+
+
+static void check_channel (const channel_directory* cd, int fd, int c)
+{
+    channel_unpack_context cuc;
+    int i;
+    init_channel_unpack_context (&cuc, cd, fd, (uint16_t)(c + 10));
+    for (i = 0; i < ITEMS; i++)
+    {
+        cw_unpack_next (&cuc.uc);
+        cw_unpack_next (&cuc.uc);
+        uint64_t channel = cuc.uc.item.as.u64;
+        cw_unpack_next (&cuc.uc);
+        uint64_t n = cuc.uc.item.as.u64;
+        cw_unpack_next (&cuc.uc);
+        if (cuc.uc.return_code || channel != (uint64_t)c || n != (uint64_t)i || cuc.uc.item.as.bin.length != blob_length (c, i) ||
+            memcmp (cuc.uc.item.as.bin.start, TEST_area + i, cuc.uc.item.as.bin.length))
+        {
+            ERROR1("Wrong item in channel ", c);
+            break;
+        }
+    }
+    cw_unpack_next (&cuc.uc);
+    if (cuc.uc.return_code != CWP_RC_END_OF_INPUT)
+        ERROR1("Expected end of channel ", c);
+    terminate_channel_unpack_context (&cuc);
+}
+
+
+int main(int argc, const char * argv[])
+{
+    channel_file_writer cfw;
+    channel_pack_context cpc[CHANNELS];
+    channel_directory cd;
+    int c, i;
+    (void)argc; (void)argv;
+    printf("CWPack channel file test started.\n");
+    error_count = 0;
+    for (i = 0; i < 70000; i++)
+        TEST_area[i] = (char)(i & 0x7f);
+
+    char name[] = "/tmp/cwpack_channel_file_XXXXXX";
+    int fd = mkstemp (name);
+    unlink (name);
+
+    init_channel_file_writer (&cfw, fd);
+    for (c = 0; c < CHANNELS; c++)
+        init_channel_pack_context (cpc + c, (unsigned long)(200 + 300 * c), &cfw, (uint16_t)(c + 10));
+    for (i = 0; i < ITEMS; i++)
+        for (c = 0; c < CHANNELS; c++)
+        {
+            cw_pack_array_size (&cpc[c].pc, 3);
+            cw_pack_unsigned (&cpc[c].pc, (uint64_t)c);
+            cw_pack_unsigned (&cpc[c].pc, (uint64_t)i);
+            cw_pack_bin (&cpc[c].pc, TEST_area + i, blob_length (c, i));
+        }
+    for (c = 0; c < CHANNELS; c++)
+    {
+        if (cpc[c].pc.return_code)
+            ERROR1("Channel pack rc: ", cpc[c].pc.return_code);
+        terminate_channel_pack_context (cpc + c);
+    }
+    if (terminate_channel_file_writer (&cfw))
+        ERROR("Terminate writer");
+
+    off_t length = lseek (fd, 0, SEEK_END);
+    if (channel_file_load_directory (&cd, fd) || cd.entry_count < 100)
+        ERROR("Load directory");
+    for (c = 0; c < CHANNELS; c++)
+        check_channel (&cd, fd, c);
+    unsigned long entry_count = cd.entry_count;
+    channel_directory_free (&cd);
+
+    /* without the footer the directory is rebuilt from the chunk headers */
+    ftruncate (fd, length - 5);
+    if (channel_file_load_directory (&cd, fd) || cd.entry_count != entry_count)
+        ERROR("Rebuild directory");
+    for (c = 0; c < CHANNELS; c++)
+        check_channel (&cd, fd, c);
+    channel_directory_free (&cd);
+    close (fd);
+
+    printf("CWPack channel file test completed, ");
+    switch (error_count)
+    {
+        case 0:
+            printf("no errors detected\n");
+            break;
+
+        case 1:
+            printf("1 error detected\n");
+            break;
+
+        default:
+            printf("%d errors detected\n", error_count);
+            break;
+    }
+
+    return error_count;
+}
@@ -0,0 +1,3 @@
+clang -I ../../src/ -o channelFileTest *.c ../../src/cwpack.c
+./channelFileTest
+rm -f *.o channelFileTest
@@ -0,0 +1,333 @@
+/*      CWPack/goodies - codegen_test.c   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cwpack.h"
+#include "cwpack_utils.h"
+#include "basic_contexts.h"
+#include "codegen_test_records.h"   /* generated from codegen_test.schema */
+
+
+#define ORDERS 2000
+
+int error_count;
+
+static void ERROR(const char* msg)
+{
+    error_count++;
+    printf("ERROR: %s\n", msg);
+}
+
+
+static void ERROR1(const char* msg, int i)
+{
+    error_count++;
+    printf("ERROR: %s%d\n", msg, i);
+}
+
+
+static void make_order (order* o, int i)
+{
+    memset (o, 0, sizeof(order));
+    o->id = -1000000000000LL - i;
+    sprintf (o->customer, "customer %d", i % 1000);
+    o->has_note = i % 2;
+    strcpy (o->note, "leave at the door");
+    o->price = i + 0.25;
+    o->paid = i % 3 == 0;
+    o->lines_count = (uint32_t)i % 5;
+    for (uint32_t l = 0; l < o->lines_count; l++)
+    {
+        o->lines[l].x = l;
+        o->lines[l].y = -(double)l;
+    }
+    o->has_where = i % 2 == 0;
+    o->where.x = 59.3;
+    o->where.y = 18.1;
+    o->tags_count = 2;
+    strcpy (o->tags[0], "fragile");
+    strcpy (o->tags[1], "");
+    o->digest_length = 3;
+    memcpy (o->digest, "\x01\x02\xff", 3);
+    o->flags = 255;
+    o->level = -128;
+    o->qty = 65535;
+    o->delta = -32768;
+    o->store = 4000000000u;
+    o->offset = -2000000000;
+    o->serial = UINT64_MAX;
+    o->ratio = 0.5f;
+    o->created = 1600000000.5;
+    o->has_discount = i % 4 == 1;
+    o->discount = -5;
+}
+
+
+static bool same_order (const order* a, const order* b)
+{
+    uint32_t l;
+    if (a->id != b->id || strcmp (a->customer, b->customer) || a->has_note != b->has_note ||
+        (a->has_note && strcmp (a->note, b->note)) || a->price != b->price || a->paid != b->paid ||
+        a->lines_count != b->lines_count || a->has_where != b->has_where ||
+        (a->has_where && (a->where.x != b->where.x || a->where.y != b->where.y)) ||
+        a->tags_count != b->tags_count || strcmp (a->tags[0], b->tags[0]) || strcmp (a->tags[1], b->tags[1]) ||
+        a->digest_length != b->digest_length || memcmp (a->digest, b->digest, a->digest_length) ||
+        a->flags != b->flags || a->level != b->level || a->qty != b->qty || a->delta != b->delta ||
+        a->store != b->store || a->offset != b->offset || a->serial != b->serial || a->ratio != b->ratio ||
+        a->created != b->created || a->has_discount != b->has_discount || (a->has_discount && a->discount != b->discount))
+        return false;
+    for (l = 0; l < a->lines_count; l++)
+        if (a->lines[l].x != b->lines[l].x || a->lines[l].y != b->lines[l].y)
+            return false;
+    return true;
+}
+
+
+/* The required fields of an order, packed by hand in another order, with the extra fields first */
+static void pack_minimal_order (cw_pack_context* pc, int extra, const char* skip, void (*pack_extra)(cw_pack_context*))
+{
+    static const char *keys[] = {"serial", "ratio", "created", "id", "customer", "price", "paid", "lines", "tags",
+                                 "digest", "flags", "level", "qty", "delta", "store", "offset", NULL};
+    int i;
+    cw_pack_map_size (pc, (uint32_t)(16 + extra - (skip != NULL)));
+    if (pack_extra)
+        pack_extra (pc);
+    for (i = 0; keys[i]; i++)
+    {
+        if (skip && !strcmp (skip, keys[i]))
+            continue;
+        cw_pack_cstr (pc, keys[i]);
+        if (!strcmp (keys[i], "customer"))
+            cw_pack_cstr (pc, "c");
+        else if (!strcmp (keys[i], "lines") || !strcmp (keys[i], "tags"))
+            cw_pack_array_size (pc, 0);
+        else if (!strcmp (keys[i], "digest"))
+            cw_pack_bin (pc, "", 0);
+        else if (!strcmp (keys[i], "paid"))
+            cw_pack_false (pc);
+        else if (!strcmp (keys[i], "created"))
+            cw_pack_time (pc, 7, 0);
+        else
+            cw_pack_unsigned (pc, 7);
+    }
+}
+
+static void pack_unknown_keys (cw_pack_context* pc)
+{
+    cw_pack_cstr (pc, "new_field");
+    cw_pack_map_size (pc, 1);
+    cw_pack_cstr (pc, "id");
+    cw_pack_unsigned (pc, 99);
+    cw_pack_cstr (pc, "idx");
+    cw_pack_array_size (pc, 2);
+    cw_pack_nil (pc);
+    cw_pack_cstr (pc, "id");
+    cw_pack_array_size (pc, 1);         /* a container key */
+    cw_pack_cstr (pc, "id");
+    cw_pack_unsigned (pc, 98);
+    cw_pack_unsigned (pc, 1);           /* an integer key */
+    cw_pack_unsigned (pc, 97);
+    cw_pack_cstr (pc, "");
+    cw_pack_unsigned (pc, 96);
+    cw_pack_cstr (pc, "note");
+    cw_pack_nil (pc);
+    cw_pack_cstr (pc, "discount");
+    cw_pack_signed (pc, -3);
+}
+
+static void pack_long_customer (cw_pack_context* pc) { cw_pack_cstr (pc, "customer"); cw_pack_cstr (pc, "0123456789abcdef"); }
+static void pack_string_flags (cw_pack_context* pc) { cw_pack_cstr (pc, "flags"); cw_pack_cstr (pc, "7"); }
+static void pack_big_flags (cw_pack_context* pc) { cw_pack_cstr (pc, "flags"); cw_pack_unsigned (pc, 256); }
+static void pack_many_tags (cw_pack_context* pc)
+{
+    cw_pack_cstr (pc, "tags");
+    cw_pack_array_size (pc, 4);
+    for (int i = 0; i < 4; i++)
+        cw_pack_cstr (pc, "t");
+}
+static void pack_bad_point (cw_pack_context* pc)
+{
+    cw_pack_cstr (pc, "where");
+    cw_pack_map_size (pc, 1);
+    cw_pack_cstr (pc, "x");
+    cw_pack_double (pc, 1);
+}
+
+
+static int unpack_minimal_order (int extra, const char* skip, void (*pack_extra)(cw_pack_context*), order* o)
+{
+    static uint8_t buffer[1000];
+    cw_pack_context pc;
+    cw_unpack_context uc;
+    cw_pack_context_init (&pc, buffer, sizeof(buffer), 0);
+    pack_minimal_order (&pc, extra, skip, pack_extra);
+    cw_unpack_context_init (&uc, buffer, (unsigned long)(pc.current - pc.start), 0);
+    memset (o, 0x55, sizeof(order));
+    return unpack_order (&uc, o);
+}
+
+
+int main(int argc, const char * argv[])
+{
+    (void)argc; (void)argv;
+    printf("CWPack codegen test started.\n");
+    error_count = 0;
+
+    static uint8_t buffer[10000], expected[100];
+    cw_pack_context pc;
+    cw_unpack_context uc;
+    order o, o2;
+    int i;
+
+    /* the packed keys and map headers */
+    point p = {1.5, -2};
+    cw_pack_context_init (&pc, buffer, sizeof(buffer), 0);
+    pack_point (&pc, &p);
+    cw_pack_context pc2;
+    cw_pack_context_init (&pc2, expected, sizeof(expected), 0);
+    cw_pack_map_size (&pc2, 2);
+    cw_pack_cstr (&pc2, "x");
+    cw_pack_double (&pc2, 1.5);
+    cw_pack_cstr (&pc2, "y");
+    cw_pack_double (&pc2, -2);
+    if (pc.return_code || pc.current - pc.start != pc2.current - pc2.start || memcmp (buffer, expected, (size_t)(pc.current - pc.start)))
+        ERROR("Packed point");
+
+    /* round trips */
+    for (i = 0; i < 8; i++)
+    {
+        make_order (&o, i);
+        cw_pack_context_init (&pc, buffer, sizeof(buffer), 0);
+        pack_order (&pc, &o);
+        cw_unpack_context_init (&uc, buffer, (unsigned long)(pc.current - pc.start), 0);
+        memset (&o2, 0x55, sizeof(order));
+        if (pc.return_code || unpack_order (&uc, &o2) || !same_order (&o, &o2))
+            ERROR1("Round trip ", i);
+        cw_unpack_next (&uc);
+        if (uc.return_code != CWP_RC_END_OF_INPUT)
+            ERROR1("Not at end after order ", i);
+    }
+
+    twins t = {1, 2, 3}, t2;
+    cw_pack_context_init (&pc, buffer, sizeof(buffer), 0);
+    pack_twins (&pc, &t);
+    cw_pack_map_size (&pc, 3);
+    cw_pack_cstr (&pc, "axyxb");        /* hashes like the twins with the quick hash */
+    cw_pack_unsigned (&pc, 5);
+    cw_pack_cstr (&pc, "ayxzb");
+    cw_pack_unsigned (&pc, 6);
+    cw_pack_cstr (&pc, "axxxb");
+    cw_pack_unsigned (&pc, 6);
+    cw_unpack_context_init (&uc, buffer, (unsigned long)(pc.current - pc.start), 0);
+    if (unpack_twins (&uc, &t2) || t2.axxxb != 1 || t2.ayxzb != 2 || t2.a != 3)
+        ERROR("Twins");
+    if (unpack_twins (&uc, &t2) != CWP_RC_VALUE_ERROR)
+        ERROR("Twins without a");
+
+    /* unknown keys, nil and missing optionals */
+    if (unpack_minimal_order (7, NULL, pack_unknown_keys, &o) || o.id != 7 || strcmp (o.customer, "c") || o.has_note ||
+        o.has_where || !o.has_discount || o.discount != -3 || o.lines_count || o.tags_count || o.digest_length || o.paid)
+        ERROR("Unknown keys");
+    if (unpack_minimal_order (0, "price", NULL, &o) != CWP_RC_VALUE_ERROR)
+        ERROR("Missing required field");
+    if (unpack_minimal_order (1, "customer", pack_long_customer, &o) != CWP_RC_VALUE_ERROR)
+        ERROR("String too long");
+    if (unpack_minimal_order (1, "flags", pack_string_flags, &o) != CWP_RC_TYPE_ERROR)
+        ERROR("Type error");
+    if (unpack_minimal_order (1, "flags", pack_big_flags, &o) != CWP_RC_VALUE_ERROR)
+        ERROR("Value out of range");
+    if (unpack_minimal_order (1, "tags", pack_many_tags, &o) != CWP_RC_VALUE_ERROR)
+        ERROR("Array too long");
+    if (unpack_minimal_order (1, NULL, pack_bad_point, &o) != CWP_RC_VALUE_ERROR)
+        ERROR("Nested record without a required field");
+
+    /* values that can't be packed */
+    make_order (&o, 1);
+    memset (o.customer, 'x', sizeof(o.customer));
+    cw_pack_context_init (&pc, buffer, sizeof(buffer), 0);
+    pack_order (&pc, &o);
+    if (pc.return_code != CWP_RC_VALUE_ERROR)
+        ERROR("Unterminated string");
+    make_order (&o, 1);
+    o.lines_count = 5;
+    cw_pack_context_init (&pc, buffer, sizeof(buffer), 0);
+    pack_order (&pc, &o);
+    if (pc.return_code != CWP_RC_VALUE_ERROR)
+        ERROR("Count too large");
+    make_order (&o, 1);
+    o.digest_length = 9;
+    cw_pack_context_init (&pc, buffer, sizeof(buffer), 0);
+    pack_order (&pc, &o);
+    if (pc.return_code != CWP_RC_VALUE_ERROR)
+        ERROR("Bin too long");
+
+    /* streaming through files */
+    {
+        char path[] = "/tmp/cwpack_codegen_XXXXXX";
+        int fd = mkstemp (path);
+        unlink (path);
+        file_pack_context fpc;
+        file_unpack_context fuc;
+
+        init_file_pack_context (&fpc, 64, fd);
+        for (i = 0; i < ORDERS; i++)
+        {
+            make_order (&o, i);
+            pack_order (&fpc.pc, &o);
+        }
+        terminate_file_pack_context (&fpc);
+        lseek (fd, 0, SEEK_SET);
+
+        init_file_unpack_context (&fuc, 32, fd);
+        for (i = 0; !unpack_order (&fuc.uc, &o2); i++)
+        {
+            make_order (&o, i);
+            if (!same_order (&o, &o2))
+                ERROR1("Streamed order ", i);
+        }
+        if (i != ORDERS || fuc.uc.return_code != CWP_RC_END_OF_INPUT)
+            ERROR1("Streamed orders ", i);
+        terminate_file_unpack_context (&fuc);
+        close (fd);
+    }
+
+    printf("CWPack codegen test completed, ");
+    switch (error_count)
+    {
+        case 0:
+            printf("no errors detected\n");
+            break;
+
+        case 1:
+            printf("1 error detected\n");
+            break;
+
+        default:
+            printf("%d errors detected\n", error_count);
+            break;
+    }
+
+    return error_count;
+}
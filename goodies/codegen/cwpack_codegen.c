@@ -0,0 +1,711 @@
+/*      CWPack/goodies - cwpack_codegen.c   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#define MAX_RECORDS 256
+#define MAX_FIELDS 64                   /* the fields of a record found by unpack are a 64 bit mask */
+#define MAX_NAME 255                    /* keys are packed as str 8 at most */
+
+
+typedef enum
+{
+    T_BOOL, T_INT8, T_INT16, T_INT32, T_INT64, T_UINT8, T_UINT16, T_UINT32, T_UINT64,
+    T_FLOAT, T_DOUBLE, T_TIME, T_STRING, T_BIN, T_RECORD
+} field_type;
+
+static const struct
+{
+    const char  *name;
+    const char  *c_type;
+    const char  *pack;
+    const char  *unpack;
+} types[] =
+{
+    {"bool",    "bool",     "cw_pack_boolean",          "cw_unpack_next_boolean"},
+    {"int8",    "int8_t",   "cw_pack_signed",           "cw_unpack_next_signed8"},
+    {"int16",   "int16_t",  "cw_pack_signed",           "cw_unpack_next_signed16"},
+    {"int32",   "int32_t",  "cw_pack_signed",           "cw_unpack_next_signed32"},
+    {"int64",   "int64_t",  "cw_pack_signed",           "cw_unpack_next_signed64"},
+    {"uint8",   "uint8_t",  "cw_pack_unsigned",         "cw_unpack_next_unsigned8"},
+    {"uint16",  "uint16_t", "cw_pack_unsigned",         "cw_unpack_next_unsigned16"},
+    {"uint32",  "uint32_t", "cw_pack_unsigned",         "cw_unpack_next_unsigned32"},
+    {"uint64",  "uint64_t", "cw_pack_unsigned",         "cw_unpack_next_unsigned64"},
+    {"float",   "float",    "cw_pack_float",            "cw_unpack_next_float"},
+    {"double",  "double",   "cw_pack_double",           "cw_unpack_next_double"},
+    {"time",    "double",   "cw_pack_time_interval",    "cw_unpack_next_time_interval"},
+    {"string",  "char",     NULL,                       NULL},
+    {"bin",     "uint8_t",  NULL,                       NULL},
+    {NULL,      NULL,       NULL,                       NULL}
+};
+
+typedef struct
+{
+    char        name[MAX_NAME + 1];
+    field_type  type;
+    int         record;                 /* T_RECORD */
+    unsigned    size;                   /* T_STRING, T_BIN */
+    unsigned    count;                  /* array capacity, 0 = not an array */
+    bool        optional;
+} field;
+
+typedef struct
+{
+    char        name[MAX_NAME + 1];
+    field       fields[MAX_FIELDS];
+    int         field_count;
+    bool        hash_all;               /* hash all bytes of the keys */
+    uint32_t    seed;
+    int         bits;                   /* the hash table has 2^bits slots */
+} record;
+
+record records[MAX_RECORDS];
+int record_count;
+
+const char *schema_name;
+const char *input, *input_end;
+int line = 1;
+
+
+static void fail (const char* msg, const char* name)
+{
+    fprintf (stderr, "%s:%d: %s%s\n", schema_name, line, msg, name ? name : "");
+    exit (1);
+}
+
+
+/*******************************   P A R S E   ********************************/
+
+
+/* Skips blanks and comments, from # to end of line */
+static void skip_space (void)
+{
+    while (input < input_end)
+    {
+        if (*input == '#')
+            while (input < input_end && *input != '\n')
+                input++;
+        else if (isspace ((unsigned char)*input))
+        {
+            if (*input == '\n')
+                line++;
+            input++;
+        }
+        else
+            break;
+    }
+}
+
+
+static void expect (char c)
+{
+    char msg[] = "Expected 'x'";
+    skip_space ();
+    if (input == input_end || *input != c)
+    {
+        msg[10] = c;
+        fail (msg, NULL);
+    }
+    input++;
+}
+
+
+static bool accept (char c)
+{
+    skip_space ();
+    if (input < input_end && *input == c)
+    {
+        input++;
+        return true;
+    }
+    return false;
+}
+
+
+static void name (char* buffer)
+{
+    const char *start;
+    skip_space ();
+    start = input;
+    if (input < input_end && (isalpha ((unsigned char)*input) || *input == '_'))
+        while (input < input_end && (isalnum ((unsigned char)*input) || *input == '_'))
+            input++;
+    if (input == start)
+        fail ("Expected a name", NULL);
+    if (input - start > MAX_NAME)
+        fail ("Name too long", NULL);
+    memcpy (buffer, start, (size_t)(input - start));
+    buffer[input - start] = 0;
+}
+
+
+static unsigned number (void)
+{
+    unsigned long n = 0;
+    skip_space ();
+    if (input == input_end || !isdigit ((unsigned char)*input))
+        fail ("Expected a number", NULL);
+    while (input < input_end && isdigit ((unsigned char)*input))
+    {
+        n = 10 * n + (unsigned long)(*input++ - '0');
+        if (n > UINT32_MAX)
+            fail ("Number too large", NULL);
+    }
+    if (!n)
+        fail ("Expected a number > 0", NULL);
+    return (unsigned)n;
+}
+
+
+static void parse_field (record* r)
+{
+    char word[MAX_NAME + 1];
+    field *f;
+    int i;
+
+    if (r->field_count == MAX_FIELDS)
+        fail ("Too many fields in ", r->name);
+    f = r->fields + r->field_count;
+    memset (f, 0, sizeof(field));
+    name (word);
+    if (!strcmp (word, "optional"))
+    {
+        f->optional = true;
+        name (word);
+    }
+    for (i = 0; types[i].name && strcmp (types[i].name, word); i++);
+    f->type = (field_type)i;
+    if (!types[i].name)
+    {
+        for (f->record = 0; f->record < record_count && strcmp (records[f->record].name, word); f->record++);
+        if (f->record == record_count)
+            fail ("Unknown type ", word);
+    }
+    if (f->type == T_STRING || f->type == T_BIN)
+    {
+        expect ('(');
+        f->size = number ();
+        expect (')');
+    }
+    name (f->name);
+    if (accept ('['))
+    {
+        f->count = number ();
+        expect (']');
+        if (f->type == T_BIN)
+            fail ("Arrays of bin aren't supported: ", f->name);
+    }
+    expect (';');
+    for (i = 0; i < r->field_count; i++)
+        if (!strcmp (r->fields[i].name, f->name))
+            fail ("Duplicate field ", f->name);
+    r->field_count++;
+}
+
+
+static void parse_schema (void)
+{
+    char word[MAX_NAME + 1];
+    int i;
+    for (skip_space (); input < input_end; skip_space ())
+    {
+        name (word);
+        if (strcmp (word, "record"))
+            fail ("Expected record", NULL);
+        if (record_count == MAX_RECORDS)
+            fail ("Too many records", NULL);
+        record *r = records + record_count;
+        name (r->name);
+        for (i = 0; types[i].name; i++)
+            if (!strcmp (types[i].name, r->name))
+                fail ("Record with a type name: ", r->name);
+        for (i = 0; i < record_count; i++)
+            if (!strcmp (records[i].name, r->name))
+                fail ("Duplicate record ", r->name);
+        expect ('{');
+        while (!accept ('}'))
+            parse_field (r);
+        if (!r->field_count)
+            fail ("No fields in ", r->name);
+        record_count++;
+    }
+    if (!record_count)
+        fail ("No records", NULL);
+}
+
+
+/****************************   K E Y   H A S H   *****************************/
+
+/* The hashes must be the same as in the generated code */
+
+static uint32_t key_hash (const uint8_t* key, uint32_t length, uint32_t seed)
+{
+    return (length * 0x9e3779b1u ^ key[0] * 0x85ebca6bu ^ key[length / 2] * 0xc2b2ae35u ^ key[length - 1] * 0x27d4eb2fu) * seed;
+}
+
+static uint32_t key_hash_all (const uint8_t* key, uint32_t length, uint32_t seed)
+{
+    uint32_t h = 2166136261u ^ length;
+    while (length--)
+        h = (h ^ *key++) * 16777619u;
+    return h * seed;
+}
+
+
+static uint32_t slot (const char* key, bool hash_all, uint32_t seed, int bits)
+{
+    uint32_t length = (uint32_t)strlen (key);
+    uint32_t h = hash_all ? key_hash_all ((const uint8_t*)key, length, seed) : key_hash ((const uint8_t*)key, length, seed);
+    return h >> (32 - bits);
+}
+
+
+/*
+ * Finds a seed that gives each key of the record its own slot, in a table of at most 8
+ * times the number of fields. The quick hash looks at the length and three bytes; if no
+ * seed separates the keys with it, all bytes are hashed.
+ */
+static void find_perfect_hash (record* r)
+{
+    int bits, min_bits = 1, i, j;
+    uint32_t seed;
+    while ((1 << min_bits) < r->field_count)
+        min_bits++;
+
+    for (r->hash_all = false; ; r->hash_all = true)
+    {
+        for (bits = min_bits; bits <= min_bits + 3; bits++)
+        {
+            for (seed = 1; seed < 200000; seed += 2)
+            {
+                bool used[MAX_FIELDS * 8] = {false};
+                for (i = 0; i < r->field_count; i++)
+                {
+                    j = (int)slot (r->fields[i].name, r->hash_all, seed, bits);
+                    if (used[j])
+                        break;
+                    used[j] = true;
+                }
+                if (i == r->field_count)
+                {
+                    r->seed = seed;
+                    r->bits = bits;
+                    return;
+                }
+            }
+        }
+        if (r->hash_all)
+            fail ("No perfect hash for the fields of ", r->name);
+    }
+}
+
+
+/*******************************   W R I T E   ********************************/
+
+FILE *out;
+
+
+/* The packed key as a C string literal: the str header, then the name */
+static int write_key (const char* key)
+{
+    size_t length = strlen (key);
+    if (length < 32)
+        fprintf (out, "\"\\x%02x\" \"%s\"", (unsigned)(0xa0 | length), key);
+    else
+        fprintf (out, "\"\\xd9\\x%02x\" \"%s\"", (unsigned)length, key);
+    return (int)length + (length < 32 ? 1 : 2);
+}
+
+
+static void write_header (const char* base, const char* guard)
+{
+    int i, j;
+    fprintf (out, "/*      %s.h, generated by cwpack_codegen from %s. Do not edit.   */\n\n", base, schema_name);
+    fprintf (out, "#ifndef %s_h\n#define %s_h\n\n#include \"cwpack.h\"\n\n", guard, guard);
+    for (i = 0; i < record_count; i++)
+    {
+        const record *r = records + i;
+        fprintf (out, "\ntypedef struct\n{\n");
+        for (j = 0; j < r->field_count; j++)
+        {
+            const field *f = r->fields + j;
+            if (f->optional)
+                fprintf (out, "    bool            has_%s;\n", f->name);
+            fprintf (out, "    %-15s %s", f->type == T_RECORD ? records[f->record].name : types[f->type].c_type, f->name);
+            if (f->count)
+                fprintf (out, "[%u]", f->count);
+            if (f->size)
+                fprintf (out, "[%u]", f->size);
+            fprintf (out, ";\n");
+            if (f->count)
+                fprintf (out, "    uint32_t        %s_count;\n", f->name);
+            if (f->type == T_BIN)
+                fprintf (out, "    uint32_t        %s_length;\n", f->name);
+        }
+        fprintf (out, "} %s;\n\n", r->name);
+        fprintf (out, "void pack_%s (cw_pack_context* pc, const %s* r);\n", r->name, r->name);
+        fprintf (out, "int unpack_%s (cw_unpack_context* uc, %s* r);\n\n", r->name, r->name);
+    }
+    fprintf (out, "\n#endif /* %s_h */\n", guard);
+}
+
+
+static const char helpers[] =
+"\n"
+"/* Perfect hashes of the field names; the generator has picked seeds without collisions */\n"
+"static inline uint32_t gen_key_hash (const uint8_t* key, uint32_t length, uint32_t seed)\n"
+"{\n"
+"    return (length * 0x9e3779b1u ^ key[0] * 0x85ebca6bu ^ key[length / 2] * 0xc2b2ae35u ^ key[length - 1] * 0x27d4eb2fu) * seed;\n"
+"}\n"
+"\n"
+"static inline uint32_t gen_key_hash_all (const uint8_t* key, uint32_t length, uint32_t seed)\n"
+"{\n"
+"    uint32_t h = 2166136261u ^ length;\n"
+"    while (length--)\n"
+"        h = (h ^ *key++) * 16777619u;\n"
+"    return h * seed;\n"
+"}\n"
+"\n"
+"\n"
+"static inline void gen_pack_key (cw_pack_context* pc, const char* key, uint32_t length)\n"
+"{\n"
+"    if (!pc->return_code)\n"
+"        cw_pack_insert (pc, key, length);\n"
+"}\n"
+"\n"
+"static inline void gen_pack_string (cw_pack_context* pc, const char* s, size_t size)\n"
+"{\n"
+"    const char *end = memchr (s, 0, size);\n"
+"    size_t length = end ? (size_t)(end - s) : size;\n"
+"    if (!end && !pc->return_code)\n"
+"        pc->return_code = CWP_RC_VALUE_ERROR;\n"
+"    cw_pack_str (pc, s, (uint32_t)length);\n"
+"}\n"
+"\n"
+"static inline void gen_pack_bin (cw_pack_context* pc, const uint8_t* b, uint32_t length, size_t size)\n"
+"{\n"
+"    if (length > size && !pc->return_code)\n"
+"        pc->return_code = CWP_RC_VALUE_ERROR;\n"
+"    cw_pack_bin (pc, b, length);\n"
+"}\n"
+"\n"
+"static inline bool gen_pack_count (cw_pack_context* pc, uint32_t count, uint32_t capacity)\n"
+"{\n"
+"    if (count > capacity && !pc->return_code)\n"
+"        pc->return_code = CWP_RC_VALUE_ERROR;\n"
+"    cw_pack_array_size (pc, count);\n"
+"    return !pc->return_code;\n"
+"}\n"
+"\n"
+"\n"
+"static inline void gen_unpack_string (cw_unpack_context* uc, char* s, size_t size)\n"
+"{\n"
+"    unsigned int length = cw_unpack_next_str_lengh (uc);\n"
+"    if (uc->return_code)\n"
+"        return;\n"
+"    if (length >= size)\n"
+"    {\n"
+"        uc->return_code = CWP_RC_VALUE_ERROR;\n"
+"        return;\n"
+"    }\n"
+"    memcpy (s, uc->item.as.str.start, length);\n"
+"    s[length] = 0;\n"
+"}\n"
+"\n"
+"static inline uint32_t gen_unpack_bin (cw_unpack_context* uc, uint8_t* b, size_t size)\n"
+"{\n"
+"    unsigned int length = cw_unpack_next_bin_lengh (uc);\n"
+"    if (uc->return_code)\n"
+"        return 0;\n"
+"    if (length > size)\n"
+"    {\n"
+"        uc->return_code = CWP_RC_VALUE_ERROR;\n"
+"        return 0;\n"
+"    }\n"
+"    memcpy (b, uc->item.as.bin.start, length);\n"
+"    return length;\n"
+"}\n"
+"\n"
+"static inline uint32_t gen_unpack_count (cw_unpack_context* uc, uint32_t capacity)\n"
+"{\n"
+"    uint32_t count = cw_unpack_next_array_size (uc);\n"
+"    if (count > capacity && !uc->return_code)\n"
+"        uc->return_code = CWP_RC_VALUE_ERROR;\n"
+"    return uc->return_code ? 0 : count;\n"
+"}\n"
+"\n"
+"/* True if the next item is nil, which is skipped */\n"
+"static inline bool gen_skip_nil (cw_unpack_context* uc)\n"
+"{\n"
+"    if (cw_look_ahead (uc) != CWP_ITEM_NIL)\n"
+"        return false;\n"
+"    cw_skip_items (uc, 1);\n"
+"    return true;\n"
+"}\n"
+"\n"
+"/* Skips the value of an unknown key, and the key's children if it is a container */\n"
+"static inline void gen_skip_entry (cw_unpack_context* uc)\n"
+"{\n"
+"    if (uc->item.type == CWP_ITEM_ARRAY)\n"
+"        cw_skip_items (uc, (long)uc->item.as.array.size);\n"
+"    else if (uc->item.type == CWP_ITEM_MAP)\n"
+"        cw_skip_items (uc, 2 * (long)uc->item.as.map.size);\n"
+"    cw_skip_items (uc, 1);\n"
+"}\n";
+
+
+/* Writes the statement(s) for one value; element is "" or "[i]" */
+static void write_pack_value (const field* f, const char* element, const char* indent)
+{
+    if (f->type == T_RECORD)
+        fprintf (out, "%spack_%s (pc, &r->%s%s);\n", indent, records[f->record].name, f->name, element);
+    else if (f->type == T_STRING)
+        fprintf (out, "%sgen_pack_string (pc, r->%s%s, sizeof(r->%s%s));\n", indent, f->name, element, f->name, element);
+    else if (f->type == T_BIN)
+        fprintf (out, "%sgen_pack_bin (pc, r->%s, r->%s_length, sizeof(r->%s));\n", indent, f->name, f->name, f->name);
+    else
+        fprintf (out, "%s%s (pc, r->%s%s);\n", indent, types[f->type].pack, f->name, element);
+}
+
+
+static void write_unpack_value (const field* f, const char* element, const char* indent)
+{
+    if (f->type == T_RECORD)
+        fprintf (out, "%sunpack_%s (uc, &r->%s%s);\n", indent, records[f->record].name, f->name, element);
+    else if (f->type == T_STRING)
+        fprintf (out, "%sgen_unpack_string (uc, r->%s%s, sizeof(r->%s%s));\n", indent, f->name, element, f->name, element);
+    else if (f->type == T_BIN)
+        fprintf (out, "%sr->%s_length = gen_unpack_bin (uc, r->%s, sizeof(r->%s));\n", indent, f->name, f->name, f->name);
+    else
+        fprintf (out, "%sr->%s%s = %s (uc);\n", indent, f->name, element, types[f->type].unpack);
+}
+
+
+static void write_pack (const record* r)
+{
+    int i, optionals = 0, length;
+    bool arrays = false;
+    for (i = 0; i < r->field_count; i++)
+    {
+        optionals += r->fields[i].optional;
+        arrays |= r->fields[i].count > 0;
+    }
+
+    fprintf (out, "\nvoid pack_%s (cw_pack_context* pc, const %s* r)\n{\n", r->name, r->name);
+    if (arrays)
+        fprintf (out, "    uint32_t i;\n");
+    /* with a fixed number of fields the map header is packed with the first key */
+    bool header_in_key = !optionals && r->field_count < 16;
+    if (!header_in_key)
+    {
+        fprintf (out, "    cw_pack_map_size (pc, %d", r->field_count - optionals);
+        for (i = 0; i < r->field_count; i++)
+            if (r->fields[i].optional)
+                fprintf (out, " + r->has_%s", r->fields[i].name);
+        fprintf (out, ");\n");
+    }
+    for (i = 0; i < r->field_count; i++)
+    {
+        const field *f = r->fields + i;
+        const char *indent = f->optional ? "        " : "    ";
+        if (f->optional)
+            fprintf (out, "    if (r->has_%s)\n    {\n", f->name);
+        fprintf (out, "%sgen_pack_key (pc, ", indent);
+        if (!i && header_in_key)
+            fprintf (out, "\"\\x%02x\" ", (unsigned)(0x80 | r->field_count));
+        length = write_key (f->name) + (!i && header_in_key);
+        fprintf (out, ", %d);\n", length);
+        if (f->count)
+        {
+            fprintf (out, "%sif (gen_pack_count (pc, r->%s_count, %u))\n", indent, f->name, f->count);
+            fprintf (out, "%s    for (i = 0; i < r->%s_count; i++)\n", indent, f->name);
+            write_pack_value (f, "[i]", f->optional ? "                " : "            ");
+        }
+        else
+            write_pack_value (f, "", indent);
+        if (f->optional)
+            fprintf (out, "    }\n");
+    }
+    fprintf (out, "}\n\n");
+}
+
+
+static void write_unpack (const record* r)
+{
+    int i;
+    uint64_t required = 0;
+    bool arrays = false;
+    for (i = 0; i < r->field_count; i++)
+    {
+        if (!r->fields[i].optional)
+            required |= 1ull << i;
+        arrays |= r->fields[i].count > 0;
+    }
+
+    /* key dispatch */
+    fprintf (out, "\n/* The field of a key, -1 if none */\n");
+    fprintf (out, "static int gen_field_%s (const char* key, uint32_t length)\n{\n", r->name);
+    fprintf (out, "    if (!length)\n        return -1;\n");
+    fprintf (out, "    switch (%s ((const uint8_t*)key, length, %uu) >> %d)\n    {\n",
+             r->hash_all ? "gen_key_hash_all" : "gen_key_hash", r->seed, 32 - r->bits);
+    for (i = 0; i < r->field_count; i++)
+    {
+        const char *name = r->fields[i].name;
+        char label[16];
+        sprintf (label, "case %u:", slot (name, r->hash_all, r->seed, r->bits));
+        fprintf (out, "        %-10s return length == %d && !memcmp (key, \"%s\", %d) ? %d : -1;\n",
+                 label, (int)strlen (name), name, (int)strlen (name), i);
+    }
+    fprintf (out, "        default:   return -1;\n    }\n}\n\n");
+
+    fprintf (out, "int unpack_%s (cw_unpack_context* uc, %s* r)\n{\n", r->name, r->name);
+    fprintf (out, "    uint64_t found = 0;\n");
+    if (arrays)
+        fprintf (out, "    uint32_t i;\n");
+    fprintf (out, "    uint32_t n = cw_unpack_next_map_size (uc);\n");
+    for (i = 0; i < r->field_count; i++)
+        if (r->fields[i].optional)
+            fprintf (out, "    r->has_%s = false;\n", r->fields[i].name);
+    fprintf (out, "    while (n-- && !uc->return_code)\n    {\n");
+    fprintf (out, "        cw_unpack_next (uc);\n");
+    fprintf (out, "        if (uc->return_code)\n            break;\n");
+    fprintf (out, "        int f = uc->item.type == CWP_ITEM_STR ? gen_field_%s ((const char*)uc->item.as.str.start, uc->item.as.str.length) : -1;\n", r->name);
+    fprintf (out, "        switch (f)\n        {\n");
+    for (i = 0; i < r->field_count; i++)
+    {
+        const field *f = r->fields + i;
+        fprintf (out, "            case %d:\n", i);
+        if (f->optional)
+        {
+            fprintf (out, "                if (gen_skip_nil (uc))\n                    break;\n");
+            fprintf (out, "                r->has_%s = true;\n", f->name);
+        }
+        if (f->count)
+        {
+            fprintf (out, "                r->%s_count = gen_unpack_count (uc, %u);\n", f->name, f->count);
+            fprintf (out, "                for (i = 0; i < r->%s_count; i++)\n", f->name);
+            write_unpack_value (f, "[i]", "                    ");
+        }
+        else
+            write_unpack_value (f, "", "                ");
+        fprintf (out, "                break;\n\n");
+    }
+    fprintf (out, "            default:\n                gen_skip_entry (uc);\n                continue;\n        }\n");
+    fprintf (out, "        found |= 1ull << f;\n    }\n");
+    fprintf (out, "    if (!uc->return_code && (found & 0x%llxull) != 0x%llxull)\n", (unsigned long long)required, (unsigned long long)required);
+    fprintf (out, "        uc->return_code = CWP_RC_VALUE_ERROR;\n");
+    fprintf (out, "    return uc->return_code;\n}\n\n");
+}
+
+
+static void write_source (const char* base, const char* header)
+{
+    int i;
+    fprintf (out, "/*      %s.c, generated by cwpack_codegen from %s. Do not edit.   */\n\n", base, schema_name);
+    fprintf (out, "#include <string.h>\n\n#include \"cwpack_utils.h\"\n#include \"%s\"\n\n", header);
+    fprintf (out, "%s\n", helpers);
+    for (i = 0; i < record_count; i++)
+    {
+        fprintf (out, "\n/*******************************   %s   ********************************/\n", records[i].name);
+        write_pack (records + i);
+        write_unpack (records + i);
+    }
+}
+
+
+/*******************************   M A I N   **********************************/
+
+
+static FILE* open_output (const char* path)
+{
+    FILE *f = fopen (path, "w");
+    if (!f)
+    {
+        perror (path);
+        exit (1);
+    }
+    return f;
+}
+
+
+int main(int argc, const char * argv[])
+{
+    if (argc == 2 && (!strcmp (argv[1], "-v") || !strcmp (argv[1], "--version")))
+    {
+        printf ("cwpack_codegen version = 1.0\n");
+        exit (0);
+    }
+    if (argc != 3)
+    {
+        printf ("cwpack_codegen [-h] [-v] schemaFile outputBase\n");
+        printf ("Writes the records of the schema as structs with pack and unpack functions to\n");
+        printf ("outputBase.h and outputBase.c\n");
+        printf ("-h Help\n-v Version\n");
+        exit (argc == 2 && !strcmp (argv[1], "-h") ? 0 : 1);
+    }
+
+    /* read the schema */
+    schema_name = argv[1];
+    FILE *f = fopen (schema_name, "rb");
+    if (!f)
+    {
+        perror (schema_name);
+        exit (1);
+    }
+    static char text[1 << 20];
+    size_t length = fread (text, 1, sizeof(text), f);
+    fclose (f);
+    if (length == sizeof(text))
+        fail ("Schema too large", NULL);
+    input = text;
+    input_end = text + length;
+    parse_schema ();
+    for (int i = 0; i < record_count; i++)
+        find_perfect_hash (records + i);
+
+    /* the header guard and include are named after the file part of outputBase */
+    const char *base = strrchr (argv[2], '/') ? strrchr (argv[2], '/') + 1 : argv[2];
+    char path[4096], header[1024], guard[1024];
+    if (strlen (argv[2]) + 3 > sizeof(path) || strlen (base) + 3 > sizeof(header))
+        fail ("Output name too long", NULL);
+    sprintf (header, "%s.h", base);
+    for (length = 0; base[length]; length++)
+        guard[length] = isalnum ((unsigned char)base[length]) ? base[length] : '_';
+    guard[length] = 0;
+
+    sprintf (path, "%s.h", argv[2]);
+    out = open_output (path);
+    write_header (base, guard);
+    fclose (out);
+
+    sprintf (path, "%s.c", argv[2]);
+    out = open_output (path);
+    write_source (base, header);
+    fclose (out);
+    return 0;
+}
@@ -0,0 +1,5 @@
+clang -I ../../src/ -o cwpack_codegen cwpack_codegen.c
+./cwpack_codegen codegen_test.schema codegen_test_records
+clang -I ../../src/ -I ../basic-contexts/ -I ../utils/ -o codegenTest codegen_test.c codegen_test_records.c ../../src/cwpack.c ../basic-contexts/basic_contexts.c ../utils/cwpack_utils.c
+./codegenTest
+rm -f *.o cwpack_codegen codegenTest codegen_test_records.h codegen_test_records.c
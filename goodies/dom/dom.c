@@ -0,0 +1,516 @@
+/*      CWPack/goodies - dom.c   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "dom.h"
+
+
+/*****************************************  PARSE  ********************************************/
+
+typedef struct
+{
+    unsigned long   entry;
+    uint64_t        remains;                /* children not yet decoded */
+} open_container;
+
+
+static void drop_key_indexes (dom_document* dom);
+
+void dom_set_entry (dom_document* dom, long index, const cwpack_item* item)
+{
+    dom_entry *entry = dom->tape + index;
+    if (dom->key_index_count)
+        drop_key_indexes (dom);
+    entry->type = item->type;
+    entry->size = 0;
+    entry->as.u64 = 0;
+    switch (item->type)
+    {
+        case CWP_ITEM_NIL:
+            break;
+
+        case CWP_ITEM_BOOLEAN:
+            entry->as.boolean = item->as.boolean;
+            break;
+
+        case CWP_ITEM_POSITIVE_INTEGER:
+        case CWP_ITEM_NEGATIVE_INTEGER:
+            entry->as.u64 = item->as.u64;
+            break;
+
+        case CWP_ITEM_FLOAT:
+            entry->as.real = item->as.real;
+            break;
+
+        case CWP_ITEM_DOUBLE:
+            entry->as.long_real = item->as.long_real;
+            break;
+
+        case CWP_ITEM_TIMESTAMP:
+            entry->as.tv_sec = item->as.time.tv_sec;
+            entry->size = item->as.time.tv_nsec;
+            break;
+
+        case CWP_ITEM_ARRAY:
+            entry->size = item->as.array.size;
+            break;
+
+        case CWP_ITEM_MAP:
+            entry->size = item->as.map.size;
+            break;
+
+        default:    /* str, bin and ext share the layout */
+            entry->as.offset = (uint64_t)((const uint8_t*)item->as.str.start - dom->data);
+            entry->size = item->as.str.length;
+    }
+}
+
+
+int dom_parse (dom_document* dom, const void* data, unsigned long length)
+{
+    cw_unpack_context uc;
+    open_container *stack = NULL;
+    unsigned long depth = 0, stack_capacity = 0;
+    unsigned long capacity = length / 8 + 64;
+
+    memset (dom, 0, sizeof(dom_document));
+    dom->tape = malloc (capacity * sizeof(dom_entry));
+    if (!dom->tape)
+        return CWP_RC_MALLOC_ERROR;
+    dom->data = (const uint8_t*)data;
+    dom->length = length;
+
+    cw_unpack_context_init (&uc, data, length, 0);
+    while (uc.current < uc.end)
+    {
+        cw_unpack_next (&uc);
+        if (uc.return_code)
+            break;
+
+        if (dom->entry_count == capacity)
+        {
+            dom_entry *tape = realloc (dom->tape, 2 * capacity * sizeof(dom_entry));
+            if (!tape)
+            {
+                uc.return_code = CWP_RC_MALLOC_ERROR;
+                break;
+            }
+            dom->tape = tape;
+            capacity *= 2;
+        }
+        unsigned long i = dom->entry_count++;
+        cwpack_item *item = &uc.item;
+        dom_set_entry (dom, (long)i, item);
+        uint64_t children = item->type == CWP_ITEM_ARRAY ? item->as.array.size :
+                            item->type == CWP_ITEM_MAP ? 2 * (uint64_t)item->as.map.size : 0;
+
+        if (children)
+        {
+            if (depth == stack_capacity)
+            {
+                stack_capacity = stack_capacity ? 2 * stack_capacity : 64;
+                open_container *s = realloc (stack, stack_capacity * sizeof(open_container));
+                if (!s)
+                {
+                    uc.return_code = CWP_RC_MALLOC_ERROR;
+                    break;
+                }
+                stack = s;
+            }
+            stack[depth].entry = i;
+            stack[depth++].remains = children;
+            continue;
+        }
+        if (item->type == CWP_ITEM_ARRAY || item->type == CWP_ITEM_MAP)
+            dom->tape[i].as.next = i + 1;
+
+        /* a leaf closes every container it completes */
+        while (depth && --stack[depth - 1].remains == 0)
+            dom->tape[stack[--depth].entry].as.next = dom->entry_count;
+    }
+    free (stack);
+
+    if (uc.return_code == CWP_RC_OK && depth)
+        uc.return_code = CWP_RC_END_OF_INPUT;
+    if (uc.return_code != CWP_RC_OK)
+    {
+        dom_free (dom);
+        return uc.return_code;
+    }
+    return CWP_RC_OK;
+}
+
+
+void dom_free (dom_document* dom)
+{
+    drop_key_indexes (dom);
+    free (dom->key_indexes);
+    dom->key_indexes = NULL;
+    dom->key_index_capacity = 0;
+    free (dom->tape);
+    dom->tape = NULL;
+    dom->entry_count = 0;
+}
+
+
+
+/*****************************************  NAVIGATION  ***************************************/
+
+
+long dom_skip (const dom_document* dom, long entry)
+{
+    if (entry < 0 || (unsigned long)entry >= dom->entry_count)
+        return -1;
+    const dom_entry *e = dom->tape + entry;
+    if (e->type == CWP_ITEM_ARRAY || e->type == CWP_ITEM_MAP)
+        return (long)e->as.next;
+    return entry + 1;
+}
+
+
+static bool has_data (int32_t type)
+{
+    return type == CWP_ITEM_STR || type == CWP_ITEM_BIN ||
+           (type >= CWP_ITEM_MIN_RESERVED_EXT && type <= CWP_ITEM_MAX_USER_EXT && type != CWP_ITEM_TIMESTAMP);
+}
+
+
+/* Items are contiguous in preorder, so an entry starts where the closest str/bin/ext before it ends */
+uint64_t dom_offset (const dom_document* dom, long entry)
+{
+    if (entry <= 0)
+        return 0;
+    if ((unsigned long)entry >= dom->entry_count)
+        return dom->length;
+
+    long j = entry - 1;
+    while (j >= 0 && !has_data (dom->tape[j].type))
+        j--;
+    uint64_t offset = j < 0 ? 0 : dom->tape[j].as.offset + dom->tape[j].size;
+
+    cw_unpack_context uc;
+    cw_unpack_context_init (&uc, dom->data + offset, (unsigned long)(dom->length - offset), 0);
+    for (j++; j < entry; j++)
+        cw_unpack_next (&uc);
+    return (uint64_t)(uc.current - dom->data);
+}
+
+
+long dom_child (const dom_document* dom, long container, uint32_t n)
+{
+    if (container < 0 || (unsigned long)container >= dom->entry_count)
+        return -1;
+    const dom_entry *e = dom->tape + container;
+    uint64_t children = e->type == CWP_ITEM_MAP ? 2 * (uint64_t)e->size :
+                        e->type == CWP_ITEM_ARRAY ? e->size : 0;
+    if (n >= children)
+        return -1;
+
+    long child = container + 1;
+    while (n--)
+        child = dom_skip (dom, child);
+    return child;
+}
+
+
+long dom_map_find (const dom_document* dom, long map, const char* key, uint32_t key_length)
+{
+    dom_iterator it;
+    long k, v;
+    if (map < 0 || (unsigned long)map >= dom->entry_count || dom->tape[map].type != CWP_ITEM_MAP)
+        return -1;
+
+    dom_iterator_init (&it, dom, map);
+    while (dom_map_next (&it, &k, &v))
+    {
+        const dom_entry *e = dom->tape + k;
+        if (e->type == CWP_ITEM_STR && e->size == key_length && !memcmp (dom->data + e->as.offset, key, key_length))
+            return v;
+    }
+    return -1;
+}
+
+
+long dom_path (const dom_document* dom, long entry, const char* path)
+{
+    const char *p = path;
+    if (*p == '$')
+        p++;
+    while (*p && entry >= 0)
+    {
+        if (*p == '.')
+        {
+            const char *key = ++p;
+            while (*p && *p != '.' && *p != '[')
+                p++;
+            entry = dom_map_find (dom, entry, key, (uint32_t)(p - key));
+        }
+        else if (*p == '[' && p[1] >= '0' && p[1] <= '9')
+        {
+            char *end;
+            unsigned long n = strtoul (p + 1, &end, 10);
+            if (*end != ']' || n > UINT32_MAX || (unsigned long)entry >= dom->entry_count ||
+                dom->tape[entry].type != CWP_ITEM_ARRAY)
+                return -1;
+            entry = dom_child (dom, entry, (uint32_t)n);
+            p = end + 1;
+        }
+        else
+            return -1;
+    }
+    return entry;
+}
+
+
+void dom_item (const dom_document* dom, long entry, cwpack_item* item)
+{
+    if (entry < 0 || (unsigned long)entry >= dom->entry_count)
+    {
+        item->type = CWP_NOT_AN_ITEM;
+        return;
+    }
+    const dom_entry *e = dom->tape + entry;
+    item->type = (cwpack_item_types)e->type;
+    switch (e->type)
+    {
+        case CWP_ITEM_NIL:
+            break;
+
+        case CWP_ITEM_BOOLEAN:
+            item->as.boolean = e->as.boolean;
+            break;
+
+        case CWP_ITEM_POSITIVE_INTEGER:
+        case CWP_ITEM_NEGATIVE_INTEGER:
+            item->as.u64 = e->as.u64;
+            break;
+
+        case CWP_ITEM_FLOAT:
+            item->as.real = e->as.real;
+            break;
+
+        case CWP_ITEM_DOUBLE:
+            item->as.long_real = e->as.long_real;
+            break;
+
+        case CWP_ITEM_TIMESTAMP:
+            item->as.time.tv_sec = e->as.tv_sec;
+            item->as.time.tv_nsec = e->size;
+            break;
+
+        case CWP_ITEM_ARRAY:
+            item->as.array.size = e->size;
+            break;
+
+        case CWP_ITEM_MAP:
+            item->as.map.size = e->size;
+            break;
+
+        default:
+            item->as.str.start = dom->data + e->as.offset;
+            item->as.str.length = e->size;
+    }
+}
+
+
+void dom_iterator_init (dom_iterator* it, const dom_document* dom, long container)
+{
+    it->dom = dom;
+    it->entry = container + 1;
+    it->remains = 0;
+    if (container >= 0 && (unsigned long)container < dom->entry_count &&
+        (dom->tape[container].type == CWP_ITEM_ARRAY || dom->tape[container].type == CWP_ITEM_MAP))
+        it->remains = dom->tape[container].size;
+}
+
+
+long dom_array_next (dom_iterator* it)
+{
+    if (!it->remains)
+        return -1;
+    it->remains--;
+    long element = it->entry;
+    it->entry = dom_skip (it->dom, element);
+    return element;
+}
+
+
+bool dom_map_next (dom_iterator* it, long* key, long* value)
+{
+    if (!it->remains)
+        return false;
+    it->remains--;
+    *key = it->entry;
+    *value = dom_skip (it->dom, *key);
+    it->entry = dom_skip (it->dom, *value);
+    return true;
+}
+
+
+
+/*****************************************  KEY INDEX  ****************************************/
+
+/*
+ * Open addressing over the string keys of one map, with at most half of the slots used.
+ * A slot holds the hash and the key entry relative to the map; 0 marks an empty slot.
+ */
+
+typedef struct
+{
+    uint32_t    hash;
+    uint32_t    key;
+} key_slot;
+
+struct dom_key_index
+{
+    long        map;
+    uint32_t    mask;
+    key_slot    slots[1];
+};
+
+
+static uint32_t hash_key (const void* key, uint32_t length)
+{
+    const uint8_t *p = (const uint8_t*)key;
+    uint32_t h = 2166136261U;
+    while (length--)
+        h = (h ^ *p++) * 16777619U;
+    return h;
+}
+
+
+static bool same_key (const dom_document* dom, long entry, const void* key, uint32_t key_length)
+{
+    const dom_entry *e = dom->tape + entry;
+    return e->size == key_length && !memcmp (dom->data + e->as.offset, key, key_length);
+}
+
+
+static dom_key_index* build_key_index (const dom_document* dom, long map)
+{
+    uint32_t capacity = 32;
+    while (capacity < 2 * dom->tape[map].size)
+        capacity *= 2;
+    dom_key_index *index = calloc (1, sizeof(dom_key_index) + (capacity - 1) * sizeof(key_slot));
+    if (!index)
+        return NULL;
+    index->map = map;
+    index->mask = capacity - 1;
+
+    dom_iterator it;
+    long key, value;
+    dom_iterator_init (&it, dom, map);
+    while (dom_map_next (&it, &key, &value))
+    {
+        const dom_entry *e = dom->tape + key;
+        if (e->type != CWP_ITEM_STR)
+            continue;
+        uint32_t h = hash_key (dom->data + e->as.offset, e->size);
+        uint32_t i = h & index->mask;
+        while (index->slots[i].key &&
+               (index->slots[i].hash != h || !same_key (dom, map + index->slots[i].key, dom->data + e->as.offset, e->size)))
+            i = (i + 1) & index->mask;
+        if (!index->slots[i].key)           /* the first of duplicate keys wins, as in dom_map_find */
+        {
+            index->slots[i].hash = h;
+            index->slots[i].key = (uint32_t)(key - map);
+        }
+    }
+    return index;
+}
+
+
+/* The index of the map, built if there is none. NULL if it can't be allocated */
+static dom_key_index* key_index (dom_document* dom, long map)
+{
+    unsigned long i;
+    if (dom->key_index_capacity)
+    {
+        for (i = (unsigned long)map & (dom->key_index_capacity - 1); dom->key_indexes[i];
+             i = (i + 1) & (dom->key_index_capacity - 1))
+            if (dom->key_indexes[i]->map == map)
+                return dom->key_indexes[i];
+    }
+
+    if (2 * (dom->key_index_count + 1) > dom->key_index_capacity)
+    {
+        unsigned long capacity = dom->key_index_capacity ? 2 * dom->key_index_capacity : 16;
+        dom_key_index **indexes = calloc (capacity, sizeof(dom_key_index*));
+        if (!indexes)
+            return NULL;
+        for (i = 0; i < dom->key_index_capacity; i++)
+        {
+            dom_key_index *index = dom->key_indexes[i];
+            if (index)
+            {
+                unsigned long j = (unsigned long)index->map & (capacity - 1);
+                while (indexes[j])
+                    j = (j + 1) & (capacity - 1);
+                indexes[j] = index;
+            }
+        }
+        free (dom->key_indexes);
+        dom->key_indexes = indexes;
+        dom->key_index_capacity = capacity;
+    }
+
+    dom_key_index *index = build_key_index (dom, map);
+    if (!index)
+        return NULL;
+    for (i = (unsigned long)map & (dom->key_index_capacity - 1); dom->key_indexes[i];
+         i = (i + 1) & (dom->key_index_capacity - 1));
+    dom->key_indexes[i] = index;
+    dom->key_index_count++;
+    return index;
+}
+
+
+static void drop_key_indexes (dom_document* dom)
+{
+    unsigned long i;
+    for (i = 0; i < dom->key_index_capacity; i++)
+    {
+        free (dom->key_indexes[i]);
+        dom->key_indexes[i] = NULL;
+    }
+    dom->key_index_count = 0;
+}
+
+
+long dom_map_lookup (dom_document* dom, long map, const char* key, uint32_t key_length)
+{
+    if (map < 0 || (unsigned long)map >= dom->entry_count || dom->tape[map].type != CWP_ITEM_MAP)
+        return -1;
+    dom_key_index *index = dom->tape[map].size > DOM_KEY_INDEX_MIN ? key_index (dom, map) : NULL;
+    if (!index)
+        return dom_map_find (dom, map, key, key_length);
+
+    uint32_t h = hash_key (key, key_length);
+    uint32_t i;
+    for (i = h & index->mask; index->slots[i].key; i = (i + 1) & index->mask)
+    {
+        if (index->slots[i].hash == h && same_key (dom, map + index->slots[i].key, key, key_length))
+            return map + index->slots[i].key + 1;
+    }
+    return -1;
+}
@@ -0,0 +1,129 @@
+/*      CWPack/goodies - dom.h   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef dom_h
+#define dom_h
+
+#include "cwpack.h"
+
+
+/*****************************************  DOCUMENT  *****************************************/
+
+/*
+ * A read-only DOM of a msgpack document. The items are decoded in preorder to a tape of
+ * 16 byte entries. Strings, bin and ext data are not copied; entries refer to them in the
+ * document, which must stay in place while the DOM is used.
+ */
+
+typedef struct
+{
+    int32_t         type;               /* cwpack_item_types, ext types included */
+    uint32_t        size;               /* array/map size, str/bin/ext length, timestamp nanoseconds */
+    union
+    {
+        bool        boolean;
+        uint64_t    u64;
+        int64_t     i64;
+        float       real;
+        double      long_real;
+        int64_t     tv_sec;
+        uint64_t    offset;             /* of str/bin/ext data in the document */
+        uint64_t    next;               /* array/map: the entry after the subtree */
+    } as;
+} dom_entry;
+
+typedef struct dom_key_index dom_key_index;
+
+typedef struct
+{
+    dom_entry       *tape;
+    unsigned long   entry_count;
+    const uint8_t   *data;
+    unsigned long   length;
+    dom_key_index   **key_indexes;      /* built by dom_map_lookup, by map entry */
+    unsigned long   key_index_count;
+    unsigned long   key_index_capacity;
+} dom_document;
+
+
+/* Decodes all top level items of the document */
+int dom_parse (dom_document* dom, const void* data, unsigned long length);
+
+void dom_free (dom_document* dom);
+
+/* Sets the entry from an item decoded from the document, for a leaf changed in place. Drops the key indexes */
+void dom_set_entry (dom_document* dom, long entry, const cwpack_item* item);
+
+
+
+/*****************************************  NAVIGATION  ***************************************/
+
+/* Entries are identified by their index on the tape, -1 = not found. The first item is 0 */
+
+/* The entry after the subtree of entry */
+long dom_skip (const dom_document* dom, long entry);
+
+long dom_child (const dom_document* dom, long container, uint32_t n);
+long dom_map_find (const dom_document* dom, long map, const char* key, uint32_t key_length);
+
+/*
+ * As dom_map_find, but for maps with more than DOM_KEY_INDEX_MIN pairs a hash index of the
+ * keys is built at the first lookup and kept with the DOM. Lookups that build an index
+ * must not run concurrently with other lookups.
+ */
+#define DOM_KEY_INDEX_MIN   16
+long dom_map_lookup (dom_document* dom, long map, const char* key, uint32_t key_length);
+
+/* Keys and array indexes from entry, like "$.users[3].name". Keys can't contain '.' or '[' */
+long dom_path (const dom_document* dom, long entry, const char* path);
+
+/*
+ * Where the item of entry starts in the document, the document length for entry_count.
+ * Found by decoding the items after the closest str, bin or ext before it.
+ */
+uint64_t dom_offset (const dom_document* dom, long entry);
+
+/* The entry as an unpacked item, with str/bin/ext pointing into the document */
+void dom_item (const dom_document* dom, long entry, cwpack_item* item);
+
+
+typedef struct
+{
+    const dom_document  *dom;
+    long                entry;          /* the next child */
+    uint32_t            remains;        /* elements or pairs */
+} dom_iterator;
+
+void dom_iterator_init (dom_iterator* it, const dom_document* dom, long container);
+
+/* The next array element, -1 at the end */
+long dom_array_next (dom_iterator* it);
+
+/* The next map pair, false at the end */
+bool dom_map_next (dom_iterator* it, long* key, long* value);
+
+
+
+/*****************************************  E P I L O G U E  **********************************/
+
+
+#endif /* dom_h */
@@ -0,0 +1,342 @@
+/*      CWPack/goodies - dom_patch.c   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "dom_patch.h"
+
+
+#define COPY_CHUNK  65536
+
+struct dom_splice
+{
+    uint64_t        start;              /* the replaced bytes of the document */
+    uint64_t        end;
+    unsigned long   value;              /* the replacement in values */
+    unsigned long   length;
+    long            entry;              /* set: the replaced entry, header: the container, else -1 */
+    long            delta;              /* header: change of the child count */
+    long            container;          /* insert: the container inserted into, else -1 */
+    bool            header;
+    unsigned long   sequence;
+};
+
+
+static bool is_container (const dom_document* dom, long entry)
+{
+    return entry >= 0 && (unsigned long)entry < dom->entry_count &&
+           (dom->tape[entry].type == CWP_ITEM_ARRAY || dom->tape[entry].type == CWP_ITEM_MAP);
+}
+
+
+/* True if [p, p+length) holds exactly n packed items */
+static bool holds_items (const void* p, unsigned long length, long n)
+{
+    cw_unpack_context uc;
+    cw_unpack_context_init (&uc, p, length, 0);
+    cw_skip_items (&uc, n);
+    return uc.return_code == CWP_RC_OK && uc.current == uc.end;
+}
+
+
+static dom_splice* add_splice (dom_patch* patch, uint64_t start, uint64_t end, const void* value, unsigned long length)
+{
+    if (patch->splice_count == patch->splice_capacity)
+    {
+        unsigned long capacity = patch->splice_capacity ? 2 * patch->splice_capacity : 16;
+        dom_splice *splices = realloc (patch->splices, capacity * sizeof(dom_splice));
+        if (!splices)
+            return NULL;
+        patch->splices = splices;
+        patch->splice_capacity = capacity;
+    }
+    if (patch->values_length + length > patch->values_capacity)
+    {
+        unsigned long capacity = patch->values_capacity ? 2 * patch->values_capacity : 4096;
+        while (capacity < patch->values_length + length)
+            capacity *= 2;
+        uint8_t *values = realloc (patch->values, capacity);
+        if (!values)
+            return NULL;
+        patch->values = values;
+        patch->values_capacity = capacity;
+    }
+
+    dom_splice *splice = patch->splices + patch->splice_count;
+    splice->start = start;
+    splice->end = end;
+    splice->value = patch->values_length;
+    splice->length = length;
+    splice->entry = -1;
+    splice->delta = 0;
+    splice->container = -1;
+    splice->header = false;
+    splice->sequence = patch->splice_count++;
+    if (length)
+        memcpy (patch->values + patch->values_length, value, length);
+    patch->values_length += length;
+    return splice;
+}
+
+
+/* The header of the container is packed again with delta more children */
+static int change_count (dom_patch* patch, long container, long delta)
+{
+    unsigned long i;
+    for (i = 0; i < patch->splice_count; i++)
+    {
+        if (patch->splices[i].header && patch->splices[i].entry == container)
+        {
+            patch->splices[i].delta += delta;
+            return CWP_RC_OK;
+        }
+    }
+
+    const dom_document *dom = patch->dom;
+    dom_splice *splice = add_splice (patch, dom_offset (dom, container), dom_offset (dom, container + 1), NULL, 0);
+    if (!splice)
+        return CWP_RC_MALLOC_ERROR;
+    splice->header = true;
+    splice->entry = container;
+    splice->delta = delta;
+    return CWP_RC_OK;
+}
+
+
+/* The child of container that is child or, in a map, the key of the pair child is in */
+static long find_child (const dom_document* dom, long container, long child)
+{
+    dom_iterator it;
+    long key, value;
+    dom_iterator_init (&it, dom, container);
+    if (dom->tape[container].type == CWP_ITEM_ARRAY)
+    {
+        while ((value = dom_array_next (&it)) >= 0)
+            if (value == child)
+                return value;
+    }
+    else
+    {
+        while (dom_map_next (&it, &key, &value))
+            if (key == child || value == child)
+                return key;
+    }
+    return -1;
+}
+
+
+
+/*****************************************  EDITS  ********************************************/
+
+
+void init_dom_patch (dom_patch* patch, dom_document* dom)
+{
+    memset (patch, 0, sizeof(dom_patch));
+    patch->dom = dom;
+}
+
+
+int dom_patch_set (dom_patch* patch, long entry, const void* item, unsigned long length)
+{
+    const dom_document *dom = patch->dom;
+    if (entry < 0 || (unsigned long)entry >= dom->entry_count)
+        return CWP_RC_VALUE_ERROR;
+    if (!holds_items (item, length, 1))
+        return CWP_RC_MALFORMED_INPUT;
+
+    dom_splice *splice = add_splice (patch, dom_offset (dom, entry), dom_offset (dom, dom_skip (dom, entry)), item, length);
+    if (!splice)
+        return CWP_RC_MALLOC_ERROR;
+    splice->entry = entry;
+    return CWP_RC_OK;
+}
+
+
+int dom_patch_insert (dom_patch* patch, long container, long before, const void* items, unsigned long length)
+{
+    const dom_document *dom = patch->dom;
+    if (!is_container (dom, container) || (before >= 0 && find_child (dom, container, before) != before))
+        return CWP_RC_VALUE_ERROR;
+    if (!holds_items (items, length, dom->tape[container].type == CWP_ITEM_MAP ? 2 : 1))
+        return CWP_RC_MALFORMED_INPUT;
+
+    uint64_t at = dom_offset (dom, before >= 0 ? before : dom_skip (dom, container));
+    dom_splice *splice = add_splice (patch, at, at, items, length);
+    if (!splice)
+        return CWP_RC_MALLOC_ERROR;
+    splice->container = container;
+    return change_count (patch, container, 1);
+}
+
+
+int dom_patch_delete (dom_patch* patch, long container, long child)
+{
+    const dom_document *dom = patch->dom;
+    if (!is_container (dom, container))
+        return CWP_RC_VALUE_ERROR;
+    long first = find_child (dom, container, child);
+    if (first < 0)
+        return CWP_RC_VALUE_ERROR;
+
+    long last = dom->tape[container].type == CWP_ITEM_MAP ? dom_skip (dom, first) : first;
+    if (!add_splice (patch, dom_offset (dom, first), dom_offset (dom, dom_skip (dom, last)), NULL, 0))
+        return CWP_RC_MALLOC_ERROR;
+    return change_count (patch, container, -1);
+}
+
+
+void dom_patch_reset (dom_patch* patch)
+{
+    patch->splice_count = 0;
+    patch->values_length = 0;
+}
+
+
+void terminate_dom_patch (dom_patch* patch)
+{
+    free (patch->splices);
+    free (patch->values);
+    patch->splices = NULL;
+    patch->values = NULL;
+    patch->splice_count = patch->splice_capacity = 0;
+    patch->values_length = patch->values_capacity = 0;
+}
+
+
+
+/*****************************************  WRITE  ********************************************/
+
+
+/*
+ * In document order; an insert goes before a replacement that starts where it is. Inserts
+ * at the same place go to containers nested in each other, and in preorder the inner
+ * container comes later on the tape, so inserts into it go first.
+ */
+static int compare_splices (const void* a, const void* b)
+{
+    const dom_splice *x = (const dom_splice*)a;
+    const dom_splice *y = (const dom_splice*)b;
+    if (x->start != y->start)
+        return x->start < y->start ? -1 : 1;
+    if ((x->end == x->start) != (y->end == y->start))
+        return x->end == x->start ? -1 : 1;
+    if (x->container != y->container)
+        return x->container > y->container ? -1 : 1;
+    return x->sequence < y->sequence ? -1 : x->sequence > y->sequence;
+}
+
+
+/* Sorts the splices and checks that they don't overlap */
+static int order_splices (dom_patch* patch)
+{
+    unsigned long i;
+    qsort (patch->splices, patch->splice_count, sizeof(dom_splice), compare_splices);
+    for (i = 1; i < patch->splice_count; i++)
+    {
+        if (patch->splices[i].start < patch->splices[i - 1].end)
+            return CWP_RC_ILLEGAL_CALL;
+    }
+    return CWP_RC_OK;
+}
+
+
+/* In chunks, so a file context doesn't have to grow its buffer */
+static void copy_range (cw_pack_context* pc, const uint8_t* p, uint64_t length)
+{
+    while (length)
+    {
+        uint32_t l = length > COPY_CHUNK ? COPY_CHUNK : (uint32_t)length;
+        cw_pack_insert (pc, p, l);
+        p += l;
+        length -= l;
+    }
+}
+
+
+int dom_patch_write (dom_patch* patch, cw_pack_context* pc)
+{
+    const dom_document *dom = patch->dom;
+    uint64_t position = 0;
+    unsigned long i;
+    int rc = order_splices (patch);
+    if (rc)
+        return rc;
+
+    for (i = 0; i < patch->splice_count && !pc->return_code; i++)
+    {
+        const dom_splice *splice = patch->splices + i;
+        copy_range (pc, dom->data + position, splice->start - position);
+        if (splice->header)
+        {
+            const dom_entry *container = dom->tape + splice->entry;
+            uint32_t size = (uint32_t)((long)container->size + splice->delta);
+            if (container->type == CWP_ITEM_ARRAY)
+                cw_pack_array_size (pc, size);
+            else
+                cw_pack_map_size (pc, size);
+        }
+        else
+            copy_range (pc, patch->values + splice->value, splice->length);
+        position = splice->end;
+    }
+    copy_range (pc, dom->data + position, dom->length - position);
+    return pc->return_code;
+}
+
+
+int dom_patch_apply (dom_patch* patch, void* data)
+{
+    dom_document *dom = patch->dom;
+    unsigned long i;
+    if ((const uint8_t*)data != dom->data)
+        return CWP_RC_ILLEGAL_CALL;
+    int rc = order_splices (patch);
+    if (rc)
+        return rc;
+
+    for (i = 0; i < patch->splice_count; i++)
+    {
+        const dom_splice *splice = patch->splices + i;
+        if (splice->header || splice->entry < 0 || is_container (dom, splice->entry) ||
+            splice->end - splice->start != splice->length)
+            return CWP_RC_VALUE_ERROR;
+        cw_unpack_context uc;
+        cw_unpack_context_init (&uc, patch->values + splice->value, splice->length, 0);
+        cw_unpack_next (&uc);
+        if (uc.item.type == CWP_ITEM_ARRAY || uc.item.type == CWP_ITEM_MAP)
+            return CWP_RC_VALUE_ERROR;
+    }
+
+    for (i = 0; i < patch->splice_count; i++)
+    {
+        const dom_splice *splice = patch->splices + i;
+        uint8_t *p = (uint8_t*)data + splice->start;
+        memcpy (p, patch->values + splice->value, splice->length);
+
+        cw_unpack_context uc;
+        cw_unpack_context_init (&uc, p, splice->length, 0);
+        cw_unpack_next (&uc);
+        dom_set_entry (dom, splice->entry, &uc.item);
+    }
+    dom_patch_reset (patch);
+    return CWP_RC_OK;
+}
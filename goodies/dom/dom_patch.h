@@ -0,0 +1,85 @@
+/*      CWPack/goodies - dom_patch.h   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef dom_patch_h
+#define dom_patch_h
+
+#include "cwpack.h"
+#include "dom.h"
+
+
+/*
+ * Edits of a document parsed to a DOM. The edits are recorded as replacements of byte
+ * ranges of the document. Writing the patched document copies everything else verbatim
+ * and packs new headers only for containers that get or lose children, so the work
+ * besides copying is proportional to the edits, not to the document.
+ *
+ * Values are given packed. Edits must not overlap: an edited item can't be inside
+ * another edited or deleted item.
+ */
+
+typedef struct dom_splice dom_splice;
+
+typedef struct
+{
+    dom_document    *dom;
+    dom_splice      *splices;
+    unsigned long   splice_count;
+    unsigned long   splice_capacity;
+    uint8_t         *values;
+    unsigned long   values_length;
+    unsigned long   values_capacity;
+} dom_patch;
+
+
+void init_dom_patch (dom_patch* patch, dom_document* dom);
+
+/* Replaces the item of entry with one packed item */
+int dom_patch_set (dom_patch* patch, long entry, const void* item, unsigned long length);
+
+/* Inserts one item in an array, or a key and a value in a map, before child (-1 = last) */
+int dom_patch_insert (dom_patch* patch, long container, long before, const void* items, unsigned long length);
+
+/* Deletes an array element, or the pair of a map key or value */
+int dom_patch_delete (dom_patch* patch, long container, long child);
+
+/* Packs the patched document */
+int dom_patch_write (dom_patch* patch, cw_pack_context* pc);
+
+/*
+ * Patches the document in place when every edit replaces a scalar or string with one of
+ * the same packed length, and updates the DOM. Returns CWP_RC_VALUE_ERROR, and changes
+ * nothing, otherwise. data is the document the DOM was parsed from.
+ */
+int dom_patch_apply (dom_patch* patch, void* data);
+
+/* Forgets the edits */
+void dom_patch_reset (dom_patch* patch);
+
+void terminate_dom_patch (dom_patch* patch);
+
+
+
+/*****************************************  E P I L O G U E  **********************************/
+
+
+#endif /* dom_patch_h */
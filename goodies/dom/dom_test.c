@@ -0,0 +1,518 @@
+/*      CWPack/goodies - dom_test.c   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cwpack.h"
+#include "dom.h"
+#include "dom_patch.h"
+
+
+#define RECORDS 2000
+
+int error_count;
+
+static void ERROR(const char* msg)
+{
+    error_count++;
+    printf("ERROR: %s\n", msg);
+}
+
+
+static void ERROR1(const char* msg, int i)
+{
+    error_count++;
+    printf("ERROR: %s%d\n", msg, i);
+}
+
+
+static void ERROR2(const char* msg, int i, int j)
+{
+    error_count++;
+    printf("ERROR: %s%d, %d\n", msg, i, j);
+}
+
+
+/* [{"id": i, "tags": [0 .. i%5-1], "nested": {"a": {"b": -i}}}, ...] */
+static unsigned long pack_document (uint8_t* buffer, unsigned long length)
+{
+    cw_pack_context pc;
+    int i, k;
+    cw_pack_context_init (&pc, buffer, length, 0);
+    cw_pack_array_size (&pc, RECORDS);
+    for (i = 0; i < RECORDS; i++)
+    {
+        cw_pack_map_size (&pc, 3);
+        cw_pack_str (&pc, "id", 2);
+        cw_pack_unsigned (&pc, (uint64_t)i);
+        cw_pack_str (&pc, "tags", 4);
+        cw_pack_array_size (&pc, (uint32_t)(i % 5));
+        for (k = 0; k < i % 5; k++)
+            cw_pack_unsigned (&pc, (uint64_t)k);
+        cw_pack_str (&pc, "nested", 6);
+        cw_pack_map_size (&pc, 1);
+        cw_pack_str (&pc, "a", 1);
+        cw_pack_map_size (&pc, 1);
+        cw_pack_str (&pc, "b", 1);
+        cw_pack_signed (&pc, -i);
+    }
+    return pc.return_code ? 0 : (unsigned long)(pc.current - pc.start);
+}
+
+
+/* Compares the tape with what cw_unpack_next gives */
+static void check_items (const dom_document* dom)
+{
+    cw_unpack_context uc;
+    cwpack_item item;
+    unsigned long i;
+    cw_unpack_context_init (&uc, dom->data, dom->length, 0);
+    for (i = 0; i < dom->entry_count; i++)
+    {
+        cw_unpack_next (&uc);
+        dom_item (dom, (long)i, &item);
+        if (uc.return_code || item.type != uc.item.type)
+        {
+            ERROR1("Item type ", (int)i);
+            return;
+        }
+        switch (item.type)
+        {
+            case CWP_ITEM_NIL:
+                break;
+
+            case CWP_ITEM_BOOLEAN:
+                if (item.as.boolean != uc.item.as.boolean)
+                    ERROR1("Boolean ", (int)i);
+                break;
+
+            case CWP_ITEM_POSITIVE_INTEGER:
+            case CWP_ITEM_NEGATIVE_INTEGER:
+                if (item.as.u64 != uc.item.as.u64)
+                    ERROR1("Integer ", (int)i);
+                break;
+
+            case CWP_ITEM_FLOAT:
+                if (memcmp (&item.as.real, &uc.item.as.real, 4))
+                    ERROR1("Float ", (int)i);
+                break;
+
+            case CWP_ITEM_DOUBLE:
+                if (memcmp (&item.as.long_real, &uc.item.as.long_real, 8))
+                    ERROR1("Double ", (int)i);
+                break;
+
+            case CWP_ITEM_TIMESTAMP:
+                if (item.as.time.tv_sec != uc.item.as.time.tv_sec || item.as.time.tv_nsec != uc.item.as.time.tv_nsec)
+                    ERROR1("Timestamp ", (int)i);
+                break;
+
+            case CWP_ITEM_ARRAY:
+            case CWP_ITEM_MAP:
+                if (item.as.array.size != uc.item.as.array.size)
+                    ERROR1("Container size ", (int)i);
+                break;
+
+            default:
+                if (item.as.str.start != uc.item.as.str.start || item.as.str.length != uc.item.as.str.length)
+                    ERROR1("Zero copy data ", (int)i);
+        }
+    }
+    cw_unpack_next (&uc);
+    if (uc.return_code != CWP_RC_END_OF_INPUT)
+        ERROR("Entry count");
+}
+
+
+static void check_offsets (const dom_document* dom)
+{
+    cw_unpack_context uc;
+    unsigned long i;
+    cw_unpack_context_init (&uc, dom->data, dom->length, 0);
+    for (i = 0; i < dom->entry_count; i++)
+    {
+        if ((i % 7 == 0 || i < 100) && dom_offset (dom, (long)i) != (uint64_t)(uc.current - (uint8_t*)dom->data))
+            ERROR1("Offset ", (int)i);
+        cw_unpack_next (&uc);
+    }
+    if (dom_offset (dom, (long)i) != dom->length)
+        ERROR("Offset at end");
+}
+
+
+static void check_queries (const dom_document* dom)
+{
+    int i;
+    for (i = 0; i < RECORDS; i += 7)
+    {
+        long record = dom_child (dom, 0, (uint32_t)i);
+        long id = dom_map_find (dom, record, "id", 2);
+        if (id < 0 || dom->tape[id].type != CWP_ITEM_POSITIVE_INTEGER || dom->tape[id].as.u64 != (uint64_t)i)
+            ERROR1("Find id ", i);
+
+        long tags = dom_map_find (dom, record, "tags", 4);
+        if (tags < 0 || dom->tape[tags].size != (uint32_t)(i % 5) || dom_child (dom, tags, (uint32_t)(i % 5)) != -1)
+            ERROR1("Find tags ", i);
+
+        long b = dom_map_find (dom, dom_map_find (dom, dom_map_find (dom, record, "nested", 6), "a", 1), "b", 1);
+        if (b < 0 || dom->tape[b].as.i64 != -i)
+            ERROR1("Find nested ", i);
+
+        if (dom_map_find (dom, record, "idx", 3) != -1)
+            ERROR1("Find missing key ", i);
+    }
+
+    dom_iterator records, pairs, tags;
+    long record, key, value, tag;
+    i = 0;
+    dom_iterator_init (&records, dom, 0);
+    while ((record = dom_array_next (&records)) >= 0)
+    {
+        int n = 0;
+        dom_iterator_init (&pairs, dom, record);
+        while (dom_map_next (&pairs, &key, &value))
+        {
+            if (dom->tape[key].type != CWP_ITEM_STR || value != key + 1)
+                ERROR1("Iterate map ", i);
+            if (dom->tape[key].size == 4)
+            {
+                long k = 0;
+                dom_iterator_init (&tags, dom, value);
+                while ((tag = dom_array_next (&tags)) >= 0)
+                    if (dom->tape[tag].as.u64 != (uint64_t)k++)
+                        ERROR1("Iterate tags ", i);
+                if (k != i % 5)
+                    ERROR1("Tag count ", i);
+            }
+            n++;
+        }
+        if (n != 3 || dom_skip (dom, record) != pairs.entry)
+            ERROR1("Iterate records ", i);
+        i++;
+    }
+    if (i != RECORDS || records.entry != (long)dom->entry_count)
+        ERROR("Iterate document");
+}
+
+
+/* The document of pack_document with the edits of check_patch */
+static unsigned long pack_patched (uint8_t* buffer, unsigned long length)
+{
+    cw_pack_context pc;
+    int i, k;
+    cw_pack_context_init (&pc, buffer, length, 0);
+    cw_pack_array_size (&pc, RECORDS - 1);
+    for (i = 0; i < RECORDS; i++)
+    {
+        if (i == 11)
+            continue;
+        cw_pack_map_size (&pc, i == 8 ? 2 : i == 10 ? 4 : 3);
+        cw_pack_str (&pc, "id", 2);
+        cw_pack_unsigned (&pc, i == 5 ? 500000 : (uint64_t)i);
+        cw_pack_str (&pc, "tags", 4);
+        cw_pack_array_size (&pc, (uint32_t)(i % 5 + (i == 9) - (i == 7)));
+        if (i == 9)
+            cw_pack_str (&pc, "new", 3);
+        for (k = 0; k < i % 5; k++)
+            if (i != 7 || k != 1)
+                cw_pack_unsigned (&pc, (uint64_t)k);
+        if (i == 10)
+        {
+            cw_pack_str (&pc, "extra", 5);
+            cw_pack_true (&pc);
+        }
+        if (i == 8)
+            continue;
+        cw_pack_str (&pc, "nested", 6);
+        cw_pack_map_size (&pc, 1);
+        cw_pack_str (&pc, "a", 1);
+        cw_pack_map_size (&pc, 1);
+        cw_pack_str (&pc, "b", 1);
+        cw_pack_signed (&pc, -i);
+    }
+    return pc.return_code ? 0 : (unsigned long)(pc.current - pc.start);
+}
+
+
+static void check_patch (dom_document* dom)
+{
+    static uint8_t output[200000], expected[200000];
+    uint8_t value[32];
+    cw_pack_context pc, vc;
+    dom_patch patch;
+    init_dom_patch (&patch, dom);
+
+    cw_pack_context_init (&vc, value, sizeof(value), 0);
+    cw_pack_unsigned (&vc, 500000);
+    if (dom_patch_set (&patch, dom_path (dom, 0, "$[5].id"), value, (unsigned long)(vc.current - vc.start)))
+        ERROR("Patch set");
+    if (dom_patch_delete (&patch, dom_path (dom, 0, "[7].tags"), dom_path (dom, 0, "[7].tags[1]")))
+        ERROR("Patch delete element");
+    if (dom_patch_delete (&patch, dom_path (dom, 0, "[8]"), dom_path (dom, 0, "[8].nested")))
+        ERROR("Patch delete pair");
+    if (dom_patch_insert (&patch, dom_path (dom, 0, "[9].tags"), dom_path (dom, 0, "[9].tags[0]"), "\xa3new", 4))
+        ERROR("Patch insert element");
+    if (dom_patch_insert (&patch, dom_path (dom, 0, "[10]"), dom_path (dom, 0, "[10].nested") - 1, "\xa5" "extra\xc3", 7))
+        ERROR("Patch insert pair");
+    if (dom_patch_delete (&patch, 0, dom_child (dom, 0, 11)))
+        ERROR("Patch delete record");
+
+    if (dom_patch_insert (&patch, dom_path (dom, 0, "[9].tags"), -1, "\x01\x02", 2) != CWP_RC_MALFORMED_INPUT ||
+        dom_patch_insert (&patch, dom_path (dom, 0, "[10]"), -1, "\x01", 1) != CWP_RC_MALFORMED_INPUT ||
+        dom_patch_insert (&patch, dom_path (dom, 0, "[9].id"), -1, "\x01", 1) != CWP_RC_VALUE_ERROR ||
+        dom_patch_delete (&patch, dom_path (dom, 0, "[9]"), dom_path (dom, 0, "[10].id")) != CWP_RC_VALUE_ERROR)
+        ERROR("Patch argument checks");
+
+    cw_pack_context_init (&pc, output, sizeof(output), 0);
+    unsigned long length = pack_patched (expected, sizeof(expected));
+    if (dom_patch_write (&patch, &pc) || (unsigned long)(pc.current - pc.start) != length || memcmp (output, expected, length))
+        ERROR("Patched document");
+
+    /* edits inside a deleted item */
+    if (dom_patch_set (&patch, dom_path (dom, 0, "[11].id"), value, (unsigned long)(vc.current - vc.start)))
+        ERROR("Patch set in deleted");
+    cw_pack_context_init (&pc, output, sizeof(output), 0);
+    if (dom_patch_write (&patch, &pc) != CWP_RC_ILLEGAL_CALL)
+        ERROR("Overlapping edits");
+    dom_patch_reset (&patch);
+
+    /* in place */
+    uint8_t *data = (uint8_t*)dom->data;
+    uint8_t copy[200000];
+    memcpy (copy, data, dom->length);
+    cw_pack_context_init (&vc, value, sizeof(value), 0);
+    cw_pack_unsigned (&vc, 9);
+    dom_patch_set (&patch, dom_path (dom, 0, "[3].id"), value, 1);
+    dom_patch_set (&patch, dom_path (dom, 0, "[4].tags") - 1, "\xa4tagz", 5);
+    dom_patch_set (&patch, dom_path (dom, 0, "[1].tags"), "\x91\x00", 2);
+    if (dom_patch_apply (&patch, data) != CWP_RC_VALUE_ERROR || memcmp (copy, data, dom->length))
+        ERROR("In place with container");
+    dom_patch_reset (&patch);
+    dom_patch_set (&patch, dom_path (dom, 0, "[3].id"), value, 1);
+    dom_patch_set (&patch, dom_path (dom, 0, "[4].tags") - 1, "\xa4tagz", 5);
+    dom_patch_set (&patch, dom_path (dom, 0, "[5].id"), "\xcd\x01\x00", 3);
+    if (dom_patch_apply (&patch, data) != CWP_RC_VALUE_ERROR || memcmp (copy, data, dom->length))
+        ERROR("In place with other length");
+    dom_patch_reset (&patch);
+    dom_patch_set (&patch, dom_path (dom, 0, "[3].id"), value, 1);
+    dom_patch_set (&patch, dom_path (dom, 0, "[4].tags") - 1, "\xa4tagz", 5);
+    if (dom_patch_apply (&patch, data) || dom->tape[dom_path (dom, 0, "[3].id")].as.u64 != 9 ||
+        dom_path (dom, 0, "[4].tagz") < 0 || dom_path (dom, 0, "[4].tags") >= 0 ||
+        patch.splice_count || memcmp (copy, data, dom_offset (dom, dom_path (dom, 0, "[3].id"))))
+        ERROR("In place");
+    memcpy (data, copy, dom->length);
+    terminate_dom_patch (&patch);
+}
+
+
+/* Inserts at the same place into nested containers, made outer first */
+static void check_nested_inserts (void)
+{
+    static const struct
+    {
+        const char  *document;
+        long        before;                 /* the outer insert's position */
+        const char  *expected;
+    } cases[] =
+    {
+        {"\x91\x91\x01", -1, "\x92\x92\x01\x03\x02"},                 /* [[1]] -> [[1,3],2] */
+        {"\x92\x91\x01\x04", 3, "\x93\x92\x01\x03\x02\x04"},         /* [[1],4] -> [[1,3],2,4] */
+    };
+    uint8_t output[16];
+    unsigned i;
+    for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        dom_document dom;
+        dom_patch patch;
+        cw_pack_context pc;
+        unsigned long length = strlen (cases[i].expected);
+        if (dom_parse (&dom, cases[i].document, strlen (cases[i].document)))
+        {
+            ERROR1("Nested insert document ", (int)i);
+            continue;
+        }
+        init_dom_patch (&patch, &dom);
+        cw_pack_context_init (&pc, output, sizeof(output), 0);
+        if (dom_patch_insert (&patch, 0, cases[i].before, "\x02", 1) || dom_patch_insert (&patch, 1, -1, "\x03", 1) ||
+            dom_patch_write (&patch, &pc) || (unsigned long)(pc.current - pc.start) != length || memcmp (output, cases[i].expected, length))
+            ERROR1("Nested inserts ", (int)i);
+        terminate_dom_patch (&patch);
+        dom_free (&dom);
+    }
+}
+
+
+/* [{"k0": 0, ..., "k599": 599, 7: nil, "k5": -1}, ...] with maps of growing size */
+static void check_key_index (void)
+{
+    static uint8_t document[300000];
+    cw_pack_context pc;
+    dom_document dom;
+    char key[16];
+    int i, m;
+    cw_pack_context_init (&pc, document, sizeof(document), 0);
+    cw_pack_array_size (&pc, 40);
+    for (m = 0; m < 40; m++)
+    {
+        int size = m * 15;
+        cw_pack_map_size (&pc, (uint32_t)size + 2);
+        for (i = 0; i < size; i++)
+        {
+            cw_pack_str (&pc, key, (uint32_t)sprintf (key, "k%d", i));
+            cw_pack_signed (&pc, i);
+        }
+        cw_pack_unsigned (&pc, 7);
+        cw_pack_nil (&pc);
+        cw_pack_str (&pc, "k5", 2);
+        cw_pack_signed (&pc, -1);
+    }
+    if (pc.return_code || dom_parse (&dom, document, (unsigned long)(pc.current - pc.start)))
+    {
+        ERROR("Key index document");
+        return;
+    }
+
+    for (m = 0; m < 40; m++)
+    {
+        long map = dom_child (&dom, 0, (uint32_t)m);
+        for (i = 0; i < m * 15 + 10; i++)
+        {
+            int n = sprintf (key, "k%d", i);
+            long found = dom_map_lookup (&dom, map, key, (uint32_t)n);
+            if (found != dom_map_find (&dom, map, key, (uint32_t)n) ||
+                (i < m * 15 && (found < 0 || dom.tape[found].as.i64 != i)) || (i >= m * 15 && i != 5 && found >= 0))
+                ERROR2("Key lookup ", m, i);
+        }
+        if (dom_map_lookup (&dom, map, "", 0) != -1 || dom_map_lookup (&dom, map, "k", 1) != -1)
+            ERROR1("Missing key lookup ", m);
+    }
+    if (dom.key_index_count != 39)          /* all maps but the first have more than 16 pairs */
+        ERROR1("Key index count ", (int)dom.key_index_count);
+    if (dom_map_lookup (&dom, 1, "k0", 2) != -1 || dom_map_lookup (&dom, 100000000, "k0", 2) != -1)
+        ERROR("Lookup in non-map");
+
+    /* a changed key drops the indexes */
+    dom_patch patch;
+    long map = dom_child (&dom, 0, 30);
+    init_dom_patch (&patch, &dom);
+    dom_patch_set (&patch, dom_map_lookup (&dom, map, "k42", 3) - 1, "\xa3kXY", 4);
+    if (dom_patch_apply (&patch, document) || dom.key_index_count ||
+        dom_map_lookup (&dom, map, "k42", 3) != -1 || dom.tape[dom_map_lookup (&dom, map, "kXY", 3)].as.i64 != 42)
+        ERROR("Key index after patch");
+    terminate_dom_patch (&patch);
+    dom_free (&dom);
+}
+
+
+int main(int argc, const char * argv[])
+{
+    static uint8_t document[200000];
+    cw_pack_context pc;
+    dom_document dom;
+    cwpack_item item;
+    (void)argc; (void)argv;
+    printf("CWPack dom test started.\n");
+    error_count = 0;
+
+    unsigned long length = pack_document (document, sizeof(document));
+    if (dom_parse (&dom, document, length) || dom.entry_count != 1 + RECORDS * 11 + RECORDS / 5 * 10 ||
+        dom.tape[0].as.next != dom.entry_count)
+        ERROR("Parse document");
+    check_items (&dom);
+    check_queries (&dom);
+    if (dom_path (&dom, 0, "$[12].nested.a.b") < 0 || dom.tape[dom_path (&dom, 0, "$[12].nested.a.b")].as.i64 != -12 ||
+        dom_path (&dom, 0, "[2000]") != -1 || dom_path (&dom, 0, "[x]") != -1 || dom_path (&dom, 0, ".id") != -1 ||
+        dom_path (&dom, 0, "[3].tags[") != -1 || dom_path (&dom, 0, "") != 0)
+        ERROR("Paths");
+    check_offsets (&dom);
+    check_patch (&dom);
+    check_nested_inserts ();
+    dom_free (&dom);
+
+    if (dom_parse (&dom, document, length - 1) == CWP_RC_OK)
+        ERROR("Parse truncated document");
+
+    /* all types, several top level items */
+    cw_pack_context_init (&pc, document, sizeof(document), 0);
+    cw_pack_array_size (&pc, 14);
+    cw_pack_nil (&pc);
+    cw_pack_true (&pc);
+    cw_pack_unsigned (&pc, 18446744073709551615ULL);
+    cw_pack_signed (&pc, INT64_MIN);
+    cw_pack_float (&pc, 0.1f);
+    cw_pack_double (&pc, 0.1);
+    cw_pack_str (&pc, "text", 4);
+    cw_pack_bin (&pc, "\0\1\2", 3);
+    cw_pack_ext (&pc, 42, "ext", 3);
+    cw_pack_ext (&pc, -100, "", 0);
+    cw_pack_time (&pc, -1234567890123LL, 999999999);
+    cw_pack_array_size (&pc, 0);
+    cw_pack_map_size (&pc, 0);
+    cw_pack_map_size (&pc, 1);
+    cw_pack_array_size (&pc, 1);
+    cw_pack_nil (&pc);
+    cw_pack_str (&pc, "key is an array", 15);
+    cw_pack_unsigned (&pc, 7);
+    cw_pack_str (&pc, "", 0);
+    length = (unsigned long)(pc.current - pc.start);
+    if (dom_parse (&dom, document, length) || dom.entry_count != 20)
+        ERROR("Parse all types");
+    check_items (&dom);
+    check_offsets (&dom);
+    if (dom.tape[3].type != CWP_ITEM_POSITIVE_INTEGER || dom.tape[3].as.u64 != 18446744073709551615ULL ||
+        dom.tape[5].type != CWP_ITEM_FLOAT || dom.tape[5].as.real != 0.1f ||
+        dom.tape[9].type != 42 || dom.tape[9].size != 3 || dom.tape[10].type != -100 ||
+        dom.tape[12].as.next != 13 || dom.tape[13].as.next != 14 || dom.tape[14].as.next != 18)
+        ERROR("Type fidelity");
+    if (dom_skip (&dom, 0) != 18 || dom_skip (&dom, 18) != 19 || dom_skip (&dom, 19) != 20 || dom_skip (&dom, 20) != -1)
+        ERROR("Top level items");
+    if (dom_child (&dom, 14, 1) != 17 || dom_child (&dom, 14, 2) != -1 || dom_child (&dom, 7, 0) != -1)
+        ERROR("Child of map");
+    dom_item (&dom, 8, &item);
+    if (item.type != CWP_ITEM_BIN || item.as.bin.length != 3 || memcmp (item.as.bin.start, "\0\1\2", 3))
+        ERROR("Bin item");
+    dom_item (&dom, 20, &item);
+    if (item.type != CWP_NOT_AN_ITEM)
+        ERROR("Item out of range");
+    dom_free (&dom);
+
+    check_key_index ();
+
+    printf("CWPack dom test completed, ");
+    switch (error_count)
+    {
+        case 0:
+            printf("no errors detected\n");
+            break;
+
+        case 1:
+            printf("1 error detected\n");
+            break;
+
+        default:
+            printf("%d errors detected\n", error_count);
+            break;
+    }
+
+    return error_count;
+}
@@ -0,0 +1,3 @@
+clang -I ../../src/ -o domTest *.c ../../src/cwpack.c
+./domTest
+rm -f *.o domTest
@@ -32,7 +32,12 @@
 char tabString[21] = "                     ";
 bool recognizeObjects = false;
 
-#define NEW_LINE(tablevel) {printf ("\n%6x %6ld  ",(unsigned)(context->current - context->start),(context->current - context->start)); for (ti=0; ti<tablevel; ti++) printf ("%s",tabString);}
+tail_file_unpack_context input;     /* a plain file unpack context unless following */
+unsigned long inputBase = 0;        /* file offset of the barrier */
+
+#define INPUT_OFFSET (inputBase + (unsigned long)(context->current - input.fuc.barrier))
+
+#define NEW_LINE(tablevel) {printf ("\n%6x %6ld  ",(unsigned)INPUT_OFFSET,(long)INPUT_OFFSET); for (ti=0; ti<tablevel; ti++) printf ("%s",tabString);}
 #define CHECK_NEW_LINE if(*tabString) NEW_LINE(tabLevel) else if (i) printf(" ")
 
 /*******************************   DUMP NEXT ITEM   **********************************/
@@ -255,6 +260,7 @@ int main(int argc, const char * argv[])
 {
     int i;
     int t = 0;
+    bool follow = false;
     for (i = 1; i < argc; i++)
     {
         if (!strcmp(argv[i],"-t") && (i++ < argc))
@@ -274,9 +280,14 @@ int main(int argc, const char * argv[])
         {
             recognizeObjects = true;
         }
+        else if (!strcmp(argv[i],"-f"))
+        {
+            follow = true;
+        }
         else
         {
-            printf("cwpack_dump [-t 9] [-r] [-v] [-h]\n");
+            printf("cwpack_dump [-t 9] [-r] [-f] [-v] [-h]\n");
+            printf("-f   Follow, wait for the file to grow at end of file\n");
             printf("-h   Help\n");
             printf("-r   Recognize records\n");
             printf("-t 9 Tab size\n");
@@ -288,15 +299,24 @@ int main(int argc, const char * argv[])
     }
     tabString[t] = 0;
 
-    file_unpack_context fuc;
-    cw_unpack_context *context = (cw_unpack_context*)&fuc;
+    cw_unpack_context *context = (cw_unpack_context*)&input;
 
-    init_file_unpack_context (&fuc, 4096, STDIN_FILENO);
-    file_unpack_context_set_barrier (&fuc); /* keep whole file in memory buffer to simplify offset calculation */
+    if (follow)
+        init_tail_file_unpack_context (&input, 4096, STDIN_FILENO, -1);
+    else
+        init_file_unpack_context (&input.fuc, 4096, STDIN_FILENO);
+    file_unpack_context_set_barrier (&input.fuc); /* keep whole file in memory buffer to simplify offset calculation */
 
     while (!context->return_code)
     {
         int ti;
+        if (follow)
+        {
+            /* only the current item is kept in the buffer */
+            inputBase = INPUT_OFFSET;
+            file_unpack_context_set_barrier (&input.fuc);
+            fflush (stdout);
+        }
         NEW_LINE(0);
         dump_next_item(context,0);
     }
@@ -304,6 +324,9 @@ int main(int argc, const char * argv[])
     if (context->return_code != CWP_RC_END_OF_INPUT)
         printf("\nERROR RC = %d\n",context->return_code);
 
-    terminate_file_unpack_context (&fuc);
+    if (follow)
+        terminate_tail_file_unpack_context (&input);
+    else
+        terminate_file_unpack_context (&input.fuc);
 }
 
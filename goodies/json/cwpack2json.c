@@ -0,0 +1,827 @@
+/*      CWPack/goodies - cwpack2json.c   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "cwpack2json.h"
+#include "json_scan.h"
+
+
+struct json_writer_level
+{
+    uint32_t    index;          /* items started */
+    uint32_t    total;          /* items, keys and values counted separately in a map */
+    bool        is_map;
+};
+
+
+
+/*****************************************  OUTPUT  *******************************************/
+
+
+int json_writer_flush (json_writer* jw)
+{
+    if (jw->return_code || jw->fileDescriptor < 0)
+        return jw->return_code;
+
+    const uint8_t *p = jw->buffer;
+    const uint8_t *end = jw->buffer + jw->length;
+    while (p < end)
+    {
+        long l = write (jw->fileDescriptor, p, (unsigned long)(end - p));
+        if (l <= 0)
+        {
+            jw->err_no = errno;
+            return jw->return_code = CWP_RC_ERROR_IN_HANDLER;
+        }
+        p += l;
+    }
+    jw->length = 0;
+    return CWP_RC_OK;
+}
+
+
+/* Room for n more bytes. The buffer grows while no_flush is set or without a file */
+static bool reserve (json_writer* jw, unsigned long n)
+{
+    if (jw->length + n <= jw->capacity)
+        return true;
+    if (jw->return_code)
+        return false;
+    if (!jw->no_flush && jw->fileDescriptor >= 0)
+    {
+        if (json_writer_flush (jw))
+            return false;
+        if (n <= jw->capacity)
+            return true;
+    }
+
+    unsigned long capacity = 2 * jw->capacity;
+    if (capacity < jw->length + n)
+        capacity = jw->length + n;
+    uint8_t *buffer = realloc (jw->buffer, capacity);
+    if (!buffer)
+    {
+        jw->return_code = CWP_RC_MALLOC_ERROR;
+        return false;
+    }
+    jw->buffer = buffer;
+    jw->capacity = capacity;
+    return true;
+}
+
+
+static void append (json_writer* jw, const void* p, unsigned long n)
+{
+    if (reserve (jw, n))
+    {
+        memcpy (jw->buffer + jw->length, p, n);
+        jw->length += n;
+    }
+}
+
+
+static void append_byte (json_writer* jw, uint8_t c)
+{
+    if (reserve (jw, 1))
+        jw->buffer[jw->length++] = c;
+}
+
+
+
+/*****************************************  INTEGERS  *****************************************/
+
+
+static const char digit_pairs[201] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+
+/* Returns the length, at most 20 */
+static int format_u64 (uint64_t u, char* buffer)
+{
+    char digits[20];
+    char *p = digits + 20;
+    while (u >= 100)
+    {
+        unsigned i = (unsigned)(u % 100) * 2;
+        u /= 100;
+        *--p = digit_pairs[i + 1];
+        *--p = digit_pairs[i];
+    }
+    if (u >= 10)
+    {
+        *--p = digit_pairs[u * 2 + 1];
+        *--p = digit_pairs[u * 2];
+    }
+    else
+        *--p = (char)('0' + u);
+
+    int length = (int)(digits + 20 - p);
+    memcpy (buffer, p, (unsigned long)length);
+    return length;
+}
+
+
+static void write_integer (json_writer* jw, uint64_t u, bool negative)
+{
+    if (!reserve (jw, 21))
+        return;
+    char *p = (char*)jw->buffer + jw->length;
+    if (negative)
+        *p++ = '-';
+    jw->length += (unsigned long)(negative + format_u64 (u, p));
+}
+
+
+
+/*****************************************  DOUBLES  ******************************************/
+
+/*
+ * Grisu2 (Florian Loitsch, "Printing Floating-Point Numbers Quickly and Accurately with
+ * Integers") with the output format of Milo Yip's implementation. The digits always read
+ * back to the same value and are the shortest such digits for all but a small fraction
+ * of values. The boundaries are computed from the significand and exponent, so floats
+ * get their own shortest form.
+ */
+
+typedef struct
+{
+    uint64_t    f;
+    int         e;
+} diy_fp;
+
+
+static const diy_fp cached_powers[] = {
+    {0xfa8fd5a0081c0288ULL, -1220}, {0xbaaee17fa23ebf76ULL, -1193}, {0x8b16fb203055ac76ULL, -1166},
+    {0xcf42894a5dce35eaULL, -1140}, {0x9a6bb0aa55653b2dULL, -1113}, {0xe61acf033d1a45dfULL, -1087},
+    {0xab70fe17c79ac6caULL, -1060}, {0xff77b1fcbebcdc4fULL, -1034}, {0xbe5691ef416bd60cULL, -1007},
+    {0x8dd01fad907ffc3cULL,  -980}, {0xd3515c2831559a83ULL,  -954}, {0x9d71ac8fada6c9b5ULL,  -927},
+    {0xea9c227723ee8bcbULL,  -901}, {0xaecc49914078536dULL,  -874}, {0x823c12795db6ce57ULL,  -847},
+    {0xc21094364dfb5637ULL,  -821}, {0x9096ea6f3848984fULL,  -794}, {0xd77485cb25823ac7ULL,  -768},
+    {0xa086cfcd97bf97f4ULL,  -741}, {0xef340a98172aace5ULL,  -715}, {0xb23867fb2a35b28eULL,  -688},
+    {0x84c8d4dfd2c63f3bULL,  -661}, {0xc5dd44271ad3cdbaULL,  -635}, {0x936b9fcebb25c996ULL,  -608},
+    {0xdbac6c247d62a584ULL,  -582}, {0xa3ab66580d5fdaf6ULL,  -555}, {0xf3e2f893dec3f126ULL,  -529},
+    {0xb5b5ada8aaff80b8ULL,  -502}, {0x87625f056c7c4a8bULL,  -475}, {0xc9bcff6034c13053ULL,  -449},
+    {0x964e858c91ba2655ULL,  -422}, {0xdff9772470297ebdULL,  -396}, {0xa6dfbd9fb8e5b88fULL,  -369},
+    {0xf8a95fcf88747d94ULL,  -343}, {0xb94470938fa89bcfULL,  -316}, {0x8a08f0f8bf0f156bULL,  -289},
+    {0xcdb02555653131b6ULL,  -263}, {0x993fe2c6d07b7facULL,  -236}, {0xe45c10c42a2b3b06ULL,  -210},
+    {0xaa242499697392d3ULL,  -183}, {0xfd87b5f28300ca0eULL,  -157}, {0xbce5086492111aebULL,  -130},
+    {0x8cbccc096f5088ccULL,  -103}, {0xd1b71758e219652cULL,   -77}, {0x9c40000000000000ULL,   -50},
+    {0xe8d4a51000000000ULL,   -24}, {0xad78ebc5ac620000ULL,     3}, {0x813f3978f8940984ULL,    30},
+    {0xc097ce7bc90715b3ULL,    56}, {0x8f7e32ce7bea5c70ULL,    83}, {0xd5d238a4abe98068ULL,   109},
+    {0x9f4f2726179a2245ULL,   136}, {0xed63a231d4c4fb27ULL,   162}, {0xb0de65388cc8ada8ULL,   189},
+    {0x83c7088e1aab65dbULL,   216}, {0xc45d1df942711d9aULL,   242}, {0x924d692ca61be758ULL,   269},
+    {0xda01ee641a708deaULL,   295}, {0xa26da3999aef774aULL,   322}, {0xf209787bb47d6b85ULL,   348},
+    {0xb454e4a179dd1877ULL,   375}, {0x865b86925b9bc5c2ULL,   402}, {0xc83553c5c8965d3dULL,   428},
+    {0x952ab45cfa97a0b3ULL,   455}, {0xde469fbd99a05fe3ULL,   481}, {0xa59bc234db398c25ULL,   508},
+    {0xf6c69a72a3989f5cULL,   534}, {0xb7dcbf5354e9beceULL,   561}, {0x88fcf317f22241e2ULL,   588},
+    {0xcc20ce9bd35c78a5ULL,   614}, {0x98165af37b2153dfULL,   641}, {0xe2a0b5dc971f303aULL,   667},
+    {0xa8d9d1535ce3b396ULL,   694}, {0xfb9b7cd9a4a7443cULL,   720}, {0xbb764c4ca7a44410ULL,   747},
+    {0x8bab8eefb6409c1aULL,   774}, {0xd01fef10a657842cULL,   800}, {0x9b10a4e5e9913129ULL,   827},
+    {0xe7109bfba19c0c9dULL,   853}, {0xac2820d9623bf429ULL,   880}, {0x80444b5e7aa7cf85ULL,   907},
+    {0xbf21e44003acdd2dULL,   933}, {0x8e679c2f5e44ff8fULL,   960}, {0xd433179d9c8cb841ULL,   986},
+    {0x9e19db92b4e31ba9ULL,  1013}, {0xeb96bf6ebadf77d9ULL,  1039}, {0xaf87023b9bf0ee6bULL,  1066}
+};
+
+static const uint64_t powers_of_10[] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL,
+    1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+    100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL,
+    1000000000000000000ULL, 10000000000000000000ULL};
+
+
+static diy_fp diy_multiply (diy_fp x, diy_fp y)
+{
+    diy_fp r;
+#ifdef __SIZEOF_INT128__
+    unsigned __int128 p = (unsigned __int128)x.f * y.f;
+    r.f = (uint64_t)(p >> 64) + (((uint64_t)p >> 63) & 1);
+#else
+    const uint64_t M32 = 0xFFFFFFFF;
+    uint64_t a = x.f >> 32, b = x.f & M32;
+    uint64_t c = y.f >> 32, d = y.f & M32;
+    uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+    uint64_t tmp = (bd >> 32) + (ad & M32) + (bc & M32);
+    tmp += 1U << 31;    /* round */
+    r.f = ac + (ad >> 32) + (bc >> 32) + (tmp >> 32);
+#endif
+    r.e = x.e + y.e + 64;
+    return r;
+}
+
+
+static diy_fp diy_normalize (diy_fp x)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    int s = __builtin_clzll (x.f);
+    x.f <<= s;
+    x.e -= s;
+#else
+    while (!(x.f & 0x8000000000000000ULL))
+    {
+        x.f <<= 1;
+        x.e--;
+    }
+#endif
+    return x;
+}
+
+
+/* A cached power c = 10^-K with the product of c and a value with exponent e in [-60, -32] */
+static diy_fp cached_power (int e, int* K)
+{
+    double dk = (-61 - e) * 0.30102999566398114 + 347;
+    int k = (int)dk;
+    if (dk - k > 0.0)
+        k++;
+    unsigned index = (unsigned)((k >> 3) + 1);
+    *K = -(-348 + (int)(index << 3));
+    return cached_powers[index];
+}
+
+
+static void grisu_round (char* buffer, int length, uint64_t delta, uint64_t rest, uint64_t ten_kappa, uint64_t wp_w)
+{
+    while (rest < wp_w && delta - rest >= ten_kappa &&
+           (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w))
+    {
+        buffer[length - 1]--;
+        rest += ten_kappa;
+    }
+}
+
+
+static int digit_gen (diy_fp W, diy_fp Mp, uint64_t delta, char* buffer, int* K)
+{
+    const int shift = -Mp.e;
+    const uint64_t one = 1ULL << shift;
+    const uint64_t wp_w = Mp.f - W.f;
+    uint32_t p1 = (uint32_t)(Mp.f >> shift);
+    uint64_t p2 = Mp.f & (one - 1);
+    int length = 0;
+
+    int kappa = 1;
+    while (kappa < 10 && p1 >= powers_of_10[kappa])
+        kappa++;
+
+    while (kappa > 0)
+    {
+        uint32_t divisor = (uint32_t)powers_of_10[kappa - 1];
+        uint32_t d = p1 / divisor;
+        p1 %= divisor;
+        if (d || length)
+            buffer[length++] = (char)('0' + d);
+        kappa--;
+        uint64_t rest = ((uint64_t)p1 << shift) + p2;
+        if (rest <= delta)
+        {
+            *K += kappa;
+            grisu_round (buffer, length, delta, rest, powers_of_10[kappa] << shift, wp_w);
+            return length;
+        }
+    }
+
+    for (;;)
+    {
+        p2 *= 10;
+        delta *= 10;
+        char d = (char)(p2 >> shift);
+        if (d || length)
+            buffer[length++] = (char)('0' + d);
+        p2 &= one - 1;
+        kappa--;
+        if (p2 < delta)
+        {
+            *K += kappa;
+            int index = -kappa;
+            grisu_round (buffer, length, delta, p2, one, wp_w * (index < 20 ? powers_of_10[index] : 0));
+            return length;
+        }
+    }
+}
+
+
+/* Digits of the positive value f * 2^e, scaled by 10^K */
+static int grisu2 (uint64_t f, int e, bool lower_closer, char* buffer, int* K)
+{
+    diy_fp v = {f, e};
+    diy_fp w = diy_normalize (v);
+    diy_fp plus = {(f << 1) + 1, e - 1};
+    plus = diy_normalize (plus);
+    diy_fp minus;
+    if (lower_closer)
+    {
+        minus.f = (f << 2) - 1;
+        minus.e = e - 2;
+    }
+    else
+    {
+        minus.f = (f << 1) - 1;
+        minus.e = e - 1;
+    }
+    minus.f <<= minus.e - plus.e;
+    minus.e = plus.e;
+
+    diy_fp c = cached_power (plus.e, K);
+    diy_fp W = diy_multiply (w, c);
+    diy_fp Wp = diy_multiply (plus, c);
+    diy_fp Wm = diy_multiply (minus, c);
+    Wm.f++;
+    Wp.f--;
+    return digit_gen (W, Wp, Wp.f - Wm.f, buffer, K);
+}
+
+
+static char* write_exponent (int K, char* p)
+{
+    if (K < 0)
+    {
+        *p++ = '-';
+        K = -K;
+    }
+    return p + format_u64 ((uint64_t)K, p);
+}
+
+
+/* The digits as a JSON number, like 1.0, 0.001234, 12.34 or 1.234e-7 */
+static char* prettify (char* buffer, int length, int k)
+{
+    const int kk = length + k;     /* 10^(kk-1) <= v < 10^kk */
+    int i;
+
+    if (0 <= k && kk <= 21)
+    {
+        for (i = length; i < kk; i++)
+            buffer[i] = '0';
+        buffer[kk] = '.';
+        buffer[kk + 1] = '0';
+        return buffer + kk + 2;
+    }
+    if (0 < kk && kk <= 21)
+    {
+        memmove (buffer + kk + 1, buffer + kk, (unsigned long)(length - kk));
+        buffer[kk] = '.';
+        return buffer + length + 1;
+    }
+    if (-6 < kk && kk <= 0)
+    {
+        const int offset = 2 - kk;
+        memmove (buffer + offset, buffer, (unsigned long)length);
+        buffer[0] = '0';
+        buffer[1] = '.';
+        for (i = 2; i < offset; i++)
+            buffer[i] = '0';
+        return buffer + length + offset;
+    }
+    if (length == 1)
+    {
+        buffer[1] = 'e';
+        return write_exponent (kk - 1, buffer + 2);
+    }
+    memmove (buffer + 2, buffer + 1, (unsigned long)(length - 1));
+    buffer[1] = '.';
+    buffer[length + 1] = 'e';
+    return write_exponent (kk - 1, buffer + length + 2);
+}
+
+
+static int format_binary (uint64_t fraction, int biased_exponent, int fraction_bits, int bias, bool negative, char* buffer)
+{
+    char *p = buffer;
+    if (biased_exponent == 2 * bias + 1)
+    {
+        memcpy (buffer, "null", 4);        /* NaN and Infinity aren't JSON */
+        return 4;
+    }
+    if (negative)
+        *p++ = '-';
+    if (!biased_exponent && !fraction)
+    {
+        memcpy (p, "0.0", 3);
+        return (int)(p - buffer) + 3;
+    }
+
+    uint64_t f = fraction;
+    int e = 1 - bias - fraction_bits;
+    if (biased_exponent)
+    {
+        f |= 1ULL << fraction_bits;
+        e = biased_exponent - bias - fraction_bits;
+    }
+    int K;
+    int length = grisu2 (f, e, !fraction && biased_exponent > 1, p, &K);
+    return (int)(prettify (p, length, K) - buffer);
+}
+
+
+int json_format_double (double d, char* buffer)
+{
+    uint64_t bits;
+    memcpy (&bits, &d, 8);
+    return format_binary (bits & 0xFFFFFFFFFFFFFULL, (int)(bits >> 52) & 0x7FF, 52, 1023, bits >> 63, buffer);
+}
+
+
+int json_format_float (float f, char* buffer)
+{
+    uint32_t bits;
+    memcpy (&bits, &f, 4);
+    return format_binary (bits & 0x7FFFFF, (int)(bits >> 23) & 0xFF, 23, 127, bits >> 31, buffer);
+}
+
+
+
+/*****************************************  STRINGS  ******************************************/
+
+
+static const char hex_digits[] = "0123456789abcdef";
+
+
+/* Copies UTF-8, replacing each byte that doesn't start a valid sequence with U+FFFD */
+static void append_repaired (json_writer* jw, const uint8_t* p, const uint8_t* end)
+{
+    while (p < end)
+    {
+        const uint8_t *run = p;
+        while (p < end && *p < 0x80)
+            p++;
+        append (jw, run, (unsigned long)(p - run));
+        if (p == end)
+            return;
+
+        unsigned long n = *p >= 0xF0 ? 4 : *p >= 0xE0 ? 3 : 2;
+        if (n <= (unsigned long)(end - p) && json_valid_utf8 (p, n))
+        {
+            append (jw, p, n);
+            p += n;
+        }
+        else
+        {
+            append (jw, "\xEF\xBF\xBD", 3);
+            p++;
+        }
+    }
+}
+
+
+static void write_string (json_writer* jw, const uint8_t* p, unsigned long length)
+{
+    const uint8_t *end = p + length;
+    append_byte (jw, '"');
+    for (;;)
+    {
+        bool non_ascii = false;
+        const uint8_t *run = json_scan_string (p, end, &non_ascii);
+        if (non_ascii && !json_valid_utf8 (p, (unsigned long)(run - p)))
+            append_repaired (jw, p, run);
+        else
+            append (jw, p, (unsigned long)(run - p));
+        if (run == end)
+            break;
+
+        uint8_t escape[6] = {'\\', *run, '0', '0', 0, 0};
+        unsigned long n = 2;
+        switch (*run)
+        {
+            case '"':
+            case '\\':  break;
+            case '\b':  escape[1] = 'b'; break;
+            case '\f':  escape[1] = 'f'; break;
+            case '\n':  escape[1] = 'n'; break;
+            case '\r':  escape[1] = 'r'; break;
+            case '\t':  escape[1] = 't'; break;
+            default:
+                escape[1] = 'u';
+                escape[4] = (uint8_t)hex_digits[*run >> 4];
+                escape[5] = (uint8_t)hex_digits[*run & 15];
+                n = 6;
+        }
+        append (jw, escape, n);
+        p = run + 1;
+    }
+    append_byte (jw, '"');
+}
+
+
+static void write_base64 (json_writer* jw, const uint8_t* p, unsigned long length)
+{
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    if (!reserve (jw, (length + 2) / 3 * 4 + 2))
+        return;
+
+    uint8_t *out = jw->buffer + jw->length;
+    const uint8_t *end = p + length;
+    *out++ = '"';
+    for (; end - p >= 3; p += 3)
+    {
+        uint32_t v = (uint32_t)p[0] << 16 | (uint32_t)p[1] << 8 | p[2];
+        *out++ = (uint8_t)alphabet[v >> 18];
+        *out++ = (uint8_t)alphabet[(v >> 12) & 63];
+        *out++ = (uint8_t)alphabet[(v >> 6) & 63];
+        *out++ = (uint8_t)alphabet[v & 63];
+    }
+    if (p < end)
+    {
+        uint32_t v = (uint32_t)p[0] << 16 | (end - p == 2 ? (uint32_t)p[1] << 8 : 0);
+        *out++ = (uint8_t)alphabet[v >> 18];
+        *out++ = (uint8_t)alphabet[(v >> 12) & 63];
+        *out++ = end - p == 2 ? (uint8_t)alphabet[(v >> 6) & 63] : '=';
+        *out++ = '=';
+    }
+    *out++ = '"';
+    jw->length = (unsigned long)(out - jw->buffer);
+}
+
+
+/* ISO 8601 in UTC, with the fraction of a second when there is one */
+static void write_timestamp (json_writer* jw, int64_t tv_sec, uint32_t tv_nsec)
+{
+    int64_t days = tv_sec / 86400;
+    int64_t seconds = tv_sec % 86400;
+    if (seconds < 0)
+    {
+        seconds += 86400;
+        days--;
+    }
+
+    /* civil from days, Howard Hinnant */
+    days += 719468;
+    int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    int64_t doe = days - era * 146097;
+    int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int64_t mp = (5 * doy + 2) / 153;
+    int day = (int)(doy - (153 * mp + 2) / 5 + 1);
+    int month = (int)(mp < 10 ? mp + 3 : mp - 9);
+    int64_t year = yoe + era * 400 + (month <= 2);
+
+    char text[64];
+    int n = snprintf (text, sizeof(text), "\"%04lld-%02d-%02dT%02d:%02d:%02d", (long long)year, month, day,
+                      (int)(seconds / 3600), (int)(seconds / 60 % 60), (int)(seconds % 60));
+    if (tv_nsec)
+    {
+        n += snprintf (text + n, sizeof(text) - (unsigned long)n, ".%09u", (unsigned)tv_nsec);
+        while (text[n - 1] == '0')
+            n--;
+    }
+    text[n++] = 'Z';
+    text[n++] = '"';
+    append (jw, text, (unsigned long)n);
+}
+
+
+
+/*****************************************  WRITER  *******************************************/
+
+
+static void write_scalar (json_writer* jw, cwpack_item* item)
+{
+    char number[32];
+    switch (item->type)
+    {
+        case CWP_ITEM_NIL:
+            append (jw, "null", 4);
+            break;
+
+        case CWP_ITEM_BOOLEAN:
+            if (item->as.boolean)
+                append (jw, "true", 4);
+            else
+                append (jw, "false", 5);
+            break;
+
+        case CWP_ITEM_POSITIVE_INTEGER:
+            write_integer (jw, item->as.u64, false);
+            break;
+
+        case CWP_ITEM_NEGATIVE_INTEGER:
+            write_integer (jw, (uint64_t)-(item->as.i64 + 1) + 1, true);
+            break;
+
+        case CWP_ITEM_FLOAT:
+            append (jw, number, (unsigned long)json_format_float (item->as.real, number));
+            break;
+
+        case CWP_ITEM_DOUBLE:
+            append (jw, number, (unsigned long)json_format_double (item->as.long_real, number));
+            break;
+
+        case CWP_ITEM_STR:
+            write_string (jw, item->as.str.start, item->as.str.length);
+            break;
+
+        case CWP_ITEM_BIN:
+            write_base64 (jw, item->as.bin.start, item->as.bin.length);
+            break;
+
+        case CWP_ITEM_TIMESTAMP:
+            write_timestamp (jw, item->as.time.tv_sec, item->as.time.tv_nsec);
+            break;
+
+        default:
+            if (item->type >= CWP_ITEM_MIN_RESERVED_EXT && item->type <= CWP_ITEM_MAX_USER_EXT)
+            {
+                append (jw, "{\"ext\":", 7);
+                write_integer (jw, (uint64_t)(item->type < 0 ? -item->type : item->type), item->type < 0);
+                append (jw, ",\"data\":", 8);
+                write_base64 (jw, item->as.ext.start, item->as.ext.length);
+                append_byte (jw, '}');
+            }
+            else
+                jw->return_code = CWP_RC_TYPE_ERROR;
+    }
+}
+
+
+static json_writer_level* push_level (json_writer* jw, uint32_t total, bool is_map)
+{
+    if (jw->depth == jw->stack_capacity)
+    {
+        unsigned capacity = 2 * jw->stack_capacity;
+        json_writer_level *stack = realloc (jw->stack, capacity * sizeof(json_writer_level));
+        if (!stack)
+        {
+            jw->return_code = CWP_RC_MALLOC_ERROR;
+            return NULL;
+        }
+        jw->stack = stack;
+        jw->stack_capacity = capacity;
+    }
+    json_writer_level *level = jw->stack + jw->depth++;
+    level->index = 0;
+    level->total = total;
+    level->is_map = is_map;
+    return level;
+}
+
+
+static int write_key (json_writer* jw, cw_unpack_context* uc);
+
+/* Writes the item in uc->item and, for a container, its content */
+static int write_tree (json_writer* jw, cw_unpack_context* uc)
+{
+    const unsigned base = jw->depth;
+    bool key = false;
+
+    for (;;)
+    {
+        cwpack_item *item = &uc->item;
+        if (key && item->type != CWP_ITEM_STR && item->type != CWP_ITEM_BIN && item->type != CWP_ITEM_TIMESTAMP)
+            write_key (jw, uc);
+        else if (item->type == CWP_ITEM_ARRAY)
+        {
+            append_byte (jw, '[');
+            if (!item->as.array.size)
+                append_byte (jw, ']');
+            else
+                push_level (jw, item->as.array.size, false);
+        }
+        else if (item->type == CWP_ITEM_MAP)
+        {
+            append_byte (jw, '{');
+            if (!item->as.map.size)
+                append_byte (jw, '}');
+            else
+                push_level (jw, 2 * item->as.map.size, true);
+        }
+        else
+            write_scalar (jw, item);
+        if (jw->return_code)
+            return jw->return_code;
+
+        json_writer_level *level;
+        for (;;)
+        {
+            if (jw->depth == base)
+                return CWP_RC_OK;
+            level = jw->stack + jw->depth - 1;
+            if (level->index < level->total)
+                break;
+            append_byte (jw, level->is_map ? '}' : ']');
+            jw->depth--;
+        }
+
+        key = level->is_map && !(level->index & 1);
+        if (level->is_map && !key)
+            append_byte (jw, ':');
+        else if (level->index)
+            append_byte (jw, ',');
+        level->index++;
+
+        cw_unpack_next (uc);
+        if (uc->return_code)
+            return jw->return_code = uc->return_code == CWP_RC_END_OF_INPUT ? CWP_RC_MALFORMED_INPUT : uc->return_code;
+    }
+}
+
+
+/* A key that isn't a string is written as its JSON, quoted */
+static int write_key (json_writer* jw, cw_unpack_context* uc)
+{
+    unsigned long start = jw->length;
+    jw->no_flush++;
+    write_tree (jw, uc);
+    unsigned long quotes = 0;
+    unsigned long i;
+    for (i = start; i < jw->length; i++)
+        quotes += jw->buffer[i] == '"' || jw->buffer[i] == '\\';
+    reserve (jw, quotes + 2);
+    jw->no_flush--;
+    if (jw->return_code)
+        return jw->return_code;
+
+    uint8_t *from = jw->buffer + jw->length;
+    uint8_t *to = from + quotes + 2;
+    jw->length += quotes + 2;
+    *--to = '"';
+    while (from > jw->buffer + start)
+    {
+        uint8_t c = *--from;
+        *--to = c;
+        if (c == '"' || c == '\\')
+            *--to = '\\';
+    }
+    *--to = '"';
+    return CWP_RC_OK;
+}
+
+
+void init_json_writer (json_writer* jw, int fileDescriptor, unsigned long buffer_length)
+{
+    if (buffer_length < 64)
+        buffer_length = 65536;
+    jw->buffer = malloc (buffer_length);
+    jw->stack = malloc (16 * sizeof(json_writer_level));
+    jw->return_code = CWP_RC_OK;
+    if (!jw->buffer || !jw->stack)
+    {
+        free (jw->buffer);
+        free (jw->stack);
+        jw->buffer = NULL;
+        jw->stack = NULL;
+        jw->return_code = CWP_RC_MALLOC_ERROR;
+        return;
+    }
+
+    jw->length = 0;
+    jw->capacity = buffer_length;
+    jw->fileDescriptor = fileDescriptor;
+    jw->no_flush = 0;
+    jw->depth = 0;
+    jw->stack_capacity = 16;
+    jw->err_no = 0;
+}
+
+
+int json_write_item (json_writer* jw, cw_unpack_context* uc)
+{
+    if (jw->return_code)
+        return jw->return_code;
+
+    cw_unpack_next (uc);
+    if (uc->return_code)
+    {
+        if (uc->return_code != CWP_RC_END_OF_INPUT)
+            jw->return_code = uc->return_code;
+        return uc->return_code;
+    }
+    if (!write_tree (jw, uc))
+        append_byte (jw, '\n');
+    return jw->return_code;
+}
+
+
+void terminate_json_writer (json_writer* jw)
+{
+    if (!jw->buffer)
+        return;
+    json_writer_flush (jw);
+    free (jw->buffer);
+    free (jw->stack);
+    jw->buffer = NULL;
+    jw->stack = NULL;
+}
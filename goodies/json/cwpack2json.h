@@ -0,0 +1,78 @@
+/*      CWPack/goodies - cwpack2json.h   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef cwpack2json_h
+#define cwpack2json_h
+
+#include "cwpack.h"
+
+
+/*
+ * Writes msgpack items as JSON, appending to a large output buffer that is written to a
+ * file descriptor when full. Doubles are written with Grisu2 in a form that reads back
+ * to the same value, shortest in almost all cases. Types JSON lacks are mapped:
+ *
+ *      bin             "base64"
+ *      timestamp       "2020-05-20T18:40:00.5Z"
+ *      ext             {"ext":type,"data":"base64"}
+ *      NaN, Infinity   null
+ *      non-string key  the JSON of the key, as a string
+ */
+
+typedef struct json_writer_level json_writer_level;
+
+typedef struct
+{
+    uint8_t             *buffer;
+    unsigned long       length;
+    unsigned long       capacity;
+    int                 fileDescriptor;     /* -1: all output stays in the buffer */
+    int                 no_flush;
+    json_writer_level   *stack;
+    unsigned            depth;
+    unsigned            stack_capacity;
+    int                 return_code;
+    int                 err_no;
+} json_writer;
+
+
+void init_json_writer (json_writer* jw, int fileDescriptor, unsigned long buffer_length);
+
+/* Writes the next item of uc as a line of JSON */
+int json_write_item (json_writer* jw, cw_unpack_context* uc);
+
+int json_writer_flush (json_writer* jw);
+
+/* Flushes the output */
+void terminate_json_writer (json_writer* jw);
+
+
+/* Round-trip formatting, shortest in almost all cases. Buffers need 32 bytes; returns the length */
+int json_format_double (double d, char* buffer);
+int json_format_float (float f, char* buffer);
+
+
+
+/*****************************************  E P I L O G U E  **********************************/
+
+
+#endif /* cwpack2json_h */
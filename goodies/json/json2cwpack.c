@@ -0,0 +1,606 @@
+/*      CWPack/goodies - json2cwpack.c   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include "json2cwpack.h"
+#include "json_scan.h"
+
+
+#define JSON_MAX_NUMBER     400
+
+struct json_open_container
+{
+    unsigned long   header_offset;      /* output offset of the 5 byte header */
+    uint32_t        count;              /* values, or pairs in a map */
+    bool            is_map;
+};
+
+
+static int malformed (json_transcoder* jt)
+{
+    if (!jt->return_code)
+    {
+        jt->return_code = CWP_RC_MALFORMED_INPUT;
+        jt->error_offset = jt->input_offset - (unsigned long)(jt->in_end - jt->in);
+    }
+    return jt->return_code;
+}
+
+
+
+/*****************************************  OUTPUT  *******************************************/
+
+
+static int flush_json_output(struct cw_pack_context* pc)
+{
+    json_transcoder* jt = (json_transcoder*)pc;
+    if (jt->outputDescriptor < 0)
+        return CWP_RC_OK;
+
+    const uint8_t *p = pc->start;
+    while (p < pc->current)
+    {
+        long l = write (jt->outputDescriptor, p, (unsigned long)(pc->current - p));
+        if (l <= 0)
+        {
+            pc->err_no = errno;
+            return CWP_RC_ERROR_IN_HANDLER;
+        }
+        p += l;
+    }
+    jt->flushed += (unsigned long)(pc->current - pc->start);
+    pc->current = pc->start;
+    return CWP_RC_OK;
+}
+
+
+static int handle_json_output_overflow(struct cw_pack_context* pc, unsigned long more)
+{
+    int rc = flush_json_output (pc);
+    if (rc != CWP_RC_OK)
+        return rc;
+
+    unsigned long contains = (unsigned long)(pc->current - pc->start);
+    unsigned long buffer_length = (unsigned long)(pc->end - pc->start);
+    if (buffer_length - contains < more)
+    {
+        while (buffer_length - contains < more)
+            buffer_length = 2 * buffer_length;
+
+        uint8_t *buffer = realloc (pc->start, buffer_length);
+        if (!buffer)
+            return CWP_RC_BUFFER_OVERFLOW;
+        pc->start = buffer;
+        pc->current = buffer + contains;
+        pc->end = buffer + buffer_length;
+    }
+    return CWP_RC_OK;
+}
+
+
+static void open_container (json_transcoder* jt, json_open_container* oc, bool is_map)
+{
+    static const uint8_t placeholder[2][5] = {{0xdd, 0, 0, 0, 0}, {0xdf, 0, 0, 0, 0}};
+    cw_pack_insert (&jt->pc, placeholder[is_map], 5);
+    oc->header_offset = jt->flushed + (unsigned long)(jt->pc.current - jt->pc.start) - 5;
+    oc->count = 0;
+    oc->is_map = is_map;
+}
+
+
+/* Writes the real header, the shortest one if it is still in the buffer */
+static int close_container (json_transcoder* jt, json_open_container* oc)
+{
+    cw_pack_context *pc = &jt->pc;
+    uint8_t header[5];
+    unsigned long header_length = 5;
+    uint32_t count = oc->count;
+
+    header[0] = oc->is_map ? 0xdf : 0xdd;
+    header[1] = (uint8_t)(count >> 24);
+    header[2] = (uint8_t)(count >> 16);
+    header[3] = (uint8_t)(count >> 8);
+    header[4] = (uint8_t)count;
+
+    if (oc->header_offset < jt->flushed)
+    {
+        if (pwrite (jt->outputDescriptor, header, 5, (off_t)oc->header_offset) != 5)
+        {
+            jt->err_no = errno;
+            return jt->return_code = CWP_RC_ERROR_IN_HANDLER;
+        }
+        return CWP_RC_OK;
+    }
+
+    if (count < 16)
+    {
+        header[0] = (uint8_t)((oc->is_map ? 0x80 : 0x90) | count);
+        header_length = 1;
+    }
+    else if (count < 65536)
+    {
+        header[0] = oc->is_map ? 0xde : 0xdc;
+        header[1] = header[3];
+        header[2] = header[4];
+        header_length = 3;
+    }
+    uint8_t *p = pc->start + (oc->header_offset - jt->flushed);
+    if (header_length < 5)
+    {
+        memmove (p + header_length, p + 5, (unsigned long)(pc->current - p) - 5);
+        pc->current -= 5 - header_length;
+    }
+    memcpy (p, header, header_length);
+    return CWP_RC_OK;
+}
+
+
+
+/*****************************************  INPUT  ********************************************/
+
+
+/* Returns false at end of input or at a read error */
+static bool refill (json_transcoder* jt)
+{
+    if (jt->inputDescriptor < 0 || jt->return_code)
+        return false;
+
+    long l;
+    do
+        l = read (jt->inputDescriptor, jt->input_buffer, jt->input_buffer_length);
+    while (l < 0 && errno == EINTR);
+    if (l < 0)
+    {
+        jt->err_no = errno;
+        jt->return_code = CWP_RC_ERROR_IN_HANDLER;
+        return false;
+    }
+    if (l == 0)
+        return false;
+    jt->in = jt->input_buffer;
+    jt->in_end = jt->input_buffer + l;
+    jt->input_offset += (unsigned long)l;
+    return true;
+}
+
+
+/* Makes at least n bytes available at in, unless the input ends first */
+static void ensure_input (json_transcoder* jt, unsigned long n)
+{
+    unsigned long remains = (unsigned long)(jt->in_end - jt->in);
+    if (remains >= n || jt->inputDescriptor < 0 || jt->return_code)
+        return;
+
+    memmove (jt->input_buffer, jt->in, remains);
+    jt->in = jt->input_buffer;
+    jt->in_end = jt->input_buffer + remains;
+    while (remains < n)
+    {
+        long l = read (jt->inputDescriptor, jt->input_buffer + remains, jt->input_buffer_length - remains);
+        if (l < 0 && errno == EINTR)
+            continue;
+        if (l < 0)
+        {
+            jt->err_no = errno;
+            jt->return_code = CWP_RC_ERROR_IN_HANDLER;
+        }
+        if (l <= 0)
+            return;
+        remains += (unsigned long)l;
+        jt->in_end += l;
+        jt->input_offset += (unsigned long)l;
+    }
+}
+
+
+/* The next byte that isn't white space, not consumed, or -1 at end of input */
+static int skip_space (json_transcoder* jt)
+{
+    for (;;)
+    {
+        jt->in = json_skip_white_space (jt->in, jt->in_end);
+        if (jt->in < jt->in_end)
+            return *jt->in;
+        if (!refill (jt))
+            return -1;
+    }
+}
+
+
+/* Consumes the next byte, -1 at end of input */
+static int next_byte (json_transcoder* jt)
+{
+    if (jt->in == jt->in_end && !refill (jt))
+        return -1;
+    return *jt->in++;
+}
+
+
+static bool append_string (json_transcoder* jt, unsigned long* length, const void* p, unsigned long n)
+{
+    if (jt->string_capacity - *length < n)
+    {
+        unsigned long capacity = jt->string_capacity;
+        while (capacity - *length < n)
+            capacity = 2 * capacity;
+        char *string = realloc (jt->string, capacity);
+        if (!string)
+        {
+            jt->return_code = CWP_RC_MALLOC_ERROR;
+            return false;
+        }
+        jt->string = string;
+        jt->string_capacity = capacity;
+    }
+    memcpy (jt->string + *length, p, n);
+    *length += n;
+    return true;
+}
+
+
+/* The opening quote is consumed; packs the string */
+static int pack_string (json_transcoder* jt)
+{
+    unsigned long length = 0;
+    bool non_ascii = false;
+    for (;;)
+    {
+        if (jt->in == jt->in_end && !refill (jt))
+            return malformed (jt);
+
+        const uint8_t *run = jt->in;
+        jt->in = json_scan_string (jt->in, jt->in_end, &non_ascii);
+        if (jt->in == jt->in_end)
+        {
+            /* the string goes on in the next chunk */
+            if (!append_string (jt, &length, run, (unsigned long)(jt->in - run)))
+                return jt->return_code;
+            continue;
+        }
+        if (*jt->in == '"' && !length)
+        {
+            /* the usual case: no escapes, all in the input buffer */
+            jt->in++;
+            if (non_ascii && !json_valid_utf8 (run, (unsigned long)(jt->in - run - 1)))
+                return malformed (jt);
+            cw_pack_str (&jt->pc, (const char*)run, (uint32_t)(jt->in - run - 1));
+            return CWP_RC_OK;
+        }
+        if (!append_string (jt, &length, run, (unsigned long)(jt->in - run)))
+            return jt->return_code;
+
+        int c = *jt->in++;
+        if (c == '"')
+            break;
+        if (c != '\\')
+        {
+            jt->in--;
+            return malformed (jt);  /* control character */
+        }
+
+        uint8_t utf8[4];
+        int n;
+        ensure_input (jt, 11);
+        int l = json_unescape (jt->in, jt->in_end, utf8, &n);
+        if (l < 0)
+            return malformed (jt);
+        jt->in += l;
+        if (!append_string (jt, &length, utf8, (unsigned long)n))
+            return jt->return_code;
+    }
+
+    if (non_ascii && !json_valid_utf8 ((const uint8_t*)jt->string, length))
+        return malformed (jt);
+    cw_pack_str (&jt->pc, jt->string, (uint32_t)length);
+    return jt->return_code;
+}
+
+
+/* -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)? */
+static bool valid_number (const char* p, bool* integer)
+{
+    *integer = true;
+    if (*p == '-')
+        p++;
+    if (*p == '0')
+        p++;
+    else if ('1' <= *p && *p <= '9')
+        while ('0' <= *p && *p <= '9')
+            p++;
+    else
+        return false;
+    if (*p == '.')
+    {
+        *integer = false;
+        if (!('0' <= *++p && *p <= '9'))
+            return false;
+        while ('0' <= *p && *p <= '9')
+            p++;
+    }
+    if (*p == 'e' || *p == 'E')
+    {
+        *integer = false;
+        if (*++p == '+' || *p == '-')
+            p++;
+        if (!('0' <= *p && *p <= '9'))
+            return false;
+        while ('0' <= *p && *p <= '9')
+            p++;
+    }
+    return !*p;
+}
+
+
+static int pack_number (json_transcoder* jt)
+{
+    char number[JSON_MAX_NUMBER + 1];
+    unsigned long length = 0;
+    bool integer;
+
+    for (;;)
+    {
+        if (jt->in == jt->in_end && !refill (jt))
+            break;
+        uint8_t c = *jt->in;
+        if (!(('0' <= c && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E'))
+            break;
+        if (length == JSON_MAX_NUMBER)
+            return malformed (jt);
+        number[length++] = (char)c;
+        jt->in++;
+    }
+    number[length] = 0;
+    if (jt->return_code)
+        return jt->return_code;
+    if (!valid_number (number, &integer))
+        return malformed (jt);
+
+    if (integer)
+    {
+        errno = 0;
+        if (*number == '-')
+        {
+            long long i = strtoll (number, NULL, 10);
+            if (errno != ERANGE)
+            {
+                cw_pack_signed (&jt->pc, i);
+                return CWP_RC_OK;
+            }
+        }
+        else
+        {
+            unsigned long long u = strtoull (number, NULL, 10);
+            if (errno != ERANGE)
+            {
+                cw_pack_unsigned (&jt->pc, u);
+                return CWP_RC_OK;
+            }
+        }
+    }
+    cw_pack_double (&jt->pc, strtod (number, NULL));
+    return CWP_RC_OK;
+}
+
+
+static int pack_literal (json_transcoder* jt)
+{
+    static const char* literals[] = {"true", "false", "null"};
+    const char *literal = literals[*jt->in == 't' ? 0 : *jt->in == 'f' ? 1 : 2];
+    const char *p;
+    for (p = literal; *p; p++)
+        if (next_byte (jt) != *p)
+            return malformed (jt);
+
+    if (*literal == 'n')
+        cw_pack_nil (&jt->pc);
+    else
+        cw_pack_boolean (&jt->pc, *literal == 't');
+    return CWP_RC_OK;
+}
+
+
+
+/*****************************************  TRANSCODER  ***************************************/
+
+
+void init_json_transcoder (json_transcoder* jt, int inputDescriptor, int outputDescriptor, unsigned long buffer_length)
+{
+    /* headers are patched at absolute offsets, which pwrite ignores for O_APPEND */
+    off_t start = 0;
+    int rc = CWP_RC_OK;
+    if (outputDescriptor >= 0)
+    {
+        int flags = fcntl (outputDescriptor, F_GETFL);
+        if (flags >= 0 && (flags & O_APPEND))
+            rc = CWP_RC_ILLEGAL_CALL;
+        start = lseek (outputDescriptor, 0, SEEK_CUR);
+        if (start < 0)
+            start = 0;                  /* not seekable, fine as long as no header is patched */
+    }
+
+    if (buffer_length < 32)
+        buffer_length = 65536;
+    uint8_t *output = rc ? NULL : malloc (buffer_length);
+    jt->input_buffer = !rc && inputDescriptor >= 0 ? malloc (buffer_length) : NULL;
+    jt->string = rc ? NULL : malloc (256);
+    jt->stack = rc ? NULL : malloc (16 * sizeof(json_open_container));
+    jt->return_code = CWP_RC_OK;
+    if (rc || !output || (inputDescriptor >= 0 && !jt->input_buffer) || !jt->string || !jt->stack)
+    {
+        free (output);
+        free (jt->input_buffer);
+        free (jt->string);
+        free (jt->stack);
+        jt->pc.start = jt->input_buffer = NULL;
+        jt->string = NULL;
+        jt->stack = NULL;
+        jt->pc.return_code = jt->return_code = rc ? rc : CWP_RC_MALLOC_ERROR;
+        return;
+    }
+
+    cw_pack_context_init (&jt->pc, output, buffer_length, &handle_json_output_overflow);
+    cw_pack_set_flush_handler (&jt->pc, &flush_json_output);
+    jt->outputDescriptor = outputDescriptor;
+    jt->flushed = (unsigned long)start;
+    jt->inputDescriptor = inputDescriptor;
+    jt->in = jt->in_end = jt->input_buffer;
+    jt->input_buffer_length = buffer_length;
+    jt->input_offset = 0;
+    jt->string_capacity = 256;
+    jt->stack_capacity = 16;
+    jt->err_no = 0;
+    jt->error_offset = 0;
+}
+
+
+void json_transcoder_set_input (json_transcoder* jt, const void* json, unsigned long length)
+{
+    jt->in = (const uint8_t*)json;
+    jt->in_end = jt->in + length;
+    jt->input_offset = length;
+    if (jt->return_code == CWP_RC_END_OF_INPUT)
+        jt->return_code = CWP_RC_OK;
+}
+
+
+int json_transcode_next (json_transcoder* jt)
+{
+    unsigned depth = 0;
+    bool expect_key = false;
+    if (jt->return_code)
+        return jt->return_code;
+
+    int c = skip_space (jt);
+    if (c < 0)
+        return jt->return_code ? jt->return_code : (jt->return_code = CWP_RC_END_OF_INPUT);
+
+    for (;;)
+    {
+        /* c is the first byte of a value, or of a key in a map */
+        if (expect_key)
+        {
+            if (c != '"')
+                return malformed (jt);
+            jt->in++;
+            if (pack_string (jt) || skip_space (jt) != ':')
+                return malformed (jt);
+            jt->in++;
+            c = skip_space (jt);
+        }
+
+        switch (c)
+        {
+            case '{':
+            case '[':
+                jt->in++;
+                if (depth == jt->stack_capacity)
+                {
+                    json_open_container *stack = realloc (jt->stack, 2 * depth * sizeof(json_open_container));
+                    if (!stack)
+                        return jt->return_code = CWP_RC_MALLOC_ERROR;
+                    jt->stack = stack;
+                    jt->stack_capacity = 2 * depth;
+                }
+                open_container (jt, jt->stack + depth++, c == '{');
+                if (jt->pc.return_code)
+                    break;
+                c = skip_space (jt);
+                if (c != (jt->stack[depth - 1].is_map ? '}' : ']'))
+                {
+                    expect_key = jt->stack[depth - 1].is_map;
+                    continue;
+                }
+                jt->in++;
+                if (close_container (jt, jt->stack + --depth))
+                    return jt->return_code;
+                break;
+
+            case '"':
+                jt->in++;
+                if (pack_string (jt))
+                    return jt->return_code;
+                break;
+
+            case 't':
+            case 'f':
+            case 'n':
+                if (pack_literal (jt))
+                    return jt->return_code;
+                break;
+
+            default:
+                if (c != '-' && !('0' <= c && c <= '9'))
+                    return malformed (jt);
+                if (pack_number (jt))
+                    return jt->return_code;
+                break;
+        }
+
+        /* a value is complete */
+        for (;;)
+        {
+            if (jt->pc.return_code)
+            {
+                jt->err_no = jt->pc.err_no;
+                return jt->return_code = jt->pc.return_code;
+            }
+            if (!depth)
+                return CWP_RC_OK;
+
+            json_open_container *oc = jt->stack + depth - 1;
+            oc->count++;
+            c = skip_space (jt);
+            if (c == ',')
+            {
+                jt->in++;
+                c = skip_space (jt);
+                expect_key = oc->is_map;
+                break;
+            }
+            if (c != (oc->is_map ? '}' : ']'))
+                return malformed (jt);
+            jt->in++;
+            depth--;
+            if (close_container (jt, oc))
+                return jt->return_code;
+        }
+    }
+}
+
+
+void terminate_json_transcoder (json_transcoder* jt)
+{
+    if (!jt->stack)
+        return;
+    cw_pack_flush (&jt->pc);
+    free (jt->pc.start);
+    free (jt->input_buffer);
+    free (jt->string);
+    free (jt->stack);
+    jt->pc.start = jt->input_buffer = NULL;
+    jt->string = NULL;
+    jt->stack = NULL;
+}
@@ -0,0 +1,88 @@
+/*      CWPack/goodies - json2cwpack.h   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef json2cwpack_h
+#define json2cwpack_h
+
+#include "cwpack.h"
+
+
+/*
+ * Transcodes JSON to msgpack in one streaming pass, without building a tree. Input is read
+ * in chunks from a file descriptor, or taken from memory, and memory use is bounded by the
+ * buffers, the longest string and the nesting depth.
+ *
+ * Container sizes aren't known when the container starts, so a 5 byte array32/map32 header
+ * is written first. When the container ends while its header is still in the output buffer,
+ * the header is shrunk to the shortest form; otherwise the count is patched in the file
+ * with pwrite, so an output file descriptor must be seekable. Output starts at the current
+ * offset of the descriptor, so it can follow earlier content. A descriptor opened with
+ * O_APPEND gives CWP_RC_ILLEGAL_CALL, as pwrite doesn't patch at an offset then.
+ */
+
+typedef struct json_open_container json_open_container;
+
+typedef struct
+{
+    cw_pack_context         pc;                 /* msgpack output */
+    int                     outputDescriptor;   /* -1: the output stays in memory, pc.start to pc.current */
+    unsigned long           flushed;            /* output file offset of pc.start */
+
+    int                     inputDescriptor;    /* -1: input from memory */
+    const uint8_t           *in;
+    const uint8_t           *in_end;
+    uint8_t                 *input_buffer;
+    unsigned long           input_buffer_length;
+    unsigned long           input_offset;       /* of in_end */
+
+    char                    *string;
+    unsigned long           string_capacity;
+    json_open_container     *stack;
+    unsigned                stack_capacity;
+
+    int                     return_code;
+    int                     err_no;
+    unsigned long           error_offset;       /* input offset of a malformed byte */
+} json_transcoder;
+
+
+void init_json_transcoder (json_transcoder* jt, int inputDescriptor, int outputDescriptor, unsigned long buffer_length);
+
+/* Input from memory, for a transcoder initialized with inputDescriptor -1 */
+void json_transcoder_set_input (json_transcoder* jt, const void* json, unsigned long length);
+
+/*
+ * Transcodes the next JSON text, so a sequence of texts (e.g. NDJSON) gives a sequence of
+ * msgpack items. Returns CWP_RC_OK, CWP_RC_END_OF_INPUT when only white space remains, or
+ * an error; CWP_RC_MALFORMED_INPUT sets error_offset.
+ */
+int json_transcode_next (json_transcoder* jt);
+
+/* Flushes the output */
+void terminate_json_transcoder (json_transcoder* jt);
+
+
+
+/*****************************************  E P I L O G U E  **********************************/
+
+
+#endif /* json2cwpack_h */
@@ -0,0 +1,356 @@
+/*      CWPack/goodies - json_scan.c   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <string.h>
+
+#include "json_scan.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define JSON_SCAN_X86
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define JSON_SCAN_NEON
+#endif
+
+
+
+/*****************************************  STRING SCAN  **************************************/
+
+
+static const uint8_t* scan_string_bytes (const uint8_t* p, const uint8_t* end, bool* non_ascii)
+{
+    for (; p < end; p++)
+    {
+        if (*p == '"' || *p == '\\' || *p < 0x20)
+            break;
+        if (*p & 0x80)
+            *non_ascii = true;
+    }
+    return p;
+}
+
+#ifdef JSON_SCAN_X86
+static const uint8_t* scan_string_sse2 (const uint8_t* p, const uint8_t* end, bool* non_ascii)
+{
+    const __m128i quote = _mm_set1_epi8 ('"');
+    const __m128i backslash = _mm_set1_epi8 ('\\');
+    const __m128i control = _mm_set1_epi8 (0x1f);
+    for (; end - p >= 16; p += 16)
+    {
+        __m128i v = _mm_loadu_si128 ((const __m128i*)p);
+        __m128i stop = _mm_or_si128 (_mm_or_si128 (_mm_cmpeq_epi8 (v, quote), _mm_cmpeq_epi8 (v, backslash)),
+                                     _mm_cmpeq_epi8 (_mm_min_epu8 (v, control), v));
+        unsigned mask = (unsigned)_mm_movemask_epi8 (stop);
+        unsigned high = (unsigned)_mm_movemask_epi8 (v);
+        if (mask)
+        {
+            unsigned i = (unsigned)__builtin_ctz (mask);
+            if (high & ((1u << i) - 1))
+                *non_ascii = true;
+            return p + i;
+        }
+        if (high)
+            *non_ascii = true;
+    }
+    return scan_string_bytes (p, end, non_ascii);
+}
+
+__attribute__((target("avx2")))
+static const uint8_t* scan_string_avx2 (const uint8_t* p, const uint8_t* end, bool* non_ascii)
+{
+    const __m256i quote = _mm256_set1_epi8 ('"');
+    const __m256i backslash = _mm256_set1_epi8 ('\\');
+    const __m256i control = _mm256_set1_epi8 (0x1f);
+    for (; end - p >= 32; p += 32)
+    {
+        __m256i v = _mm256_loadu_si256 ((const __m256i*)p);
+        __m256i stop = _mm256_or_si256 (_mm256_or_si256 (_mm256_cmpeq_epi8 (v, quote), _mm256_cmpeq_epi8 (v, backslash)),
+                                        _mm256_cmpeq_epi8 (_mm256_min_epu8 (v, control), v));
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8 (stop);
+        uint32_t high = (uint32_t)_mm256_movemask_epi8 (v);
+        if (mask)
+        {
+            unsigned i = (unsigned)__builtin_ctz (mask);
+            if (high & ((1u << i) - 1))
+                *non_ascii = true;
+            return p + i;
+        }
+        if (high)
+            *non_ascii = true;
+    }
+    return scan_string_sse2 (p, end, non_ascii);
+}
+#endif
+
+#ifdef JSON_SCAN_NEON
+/* One bit per byte, as movemask */
+static uint64_t neon_mask (uint8x16_t v)
+{
+    uint8x8_t narrowed = vshrn_n_u16 (vreinterpretq_u16_u8 (v), 4);
+    return vget_lane_u64 (vreinterpret_u64_u8 (narrowed), 0);     /* 4 bits per byte */
+}
+
+static const uint8_t* scan_string_neon (const uint8_t* p, const uint8_t* end, bool* non_ascii)
+{
+    for (; end - p >= 16; p += 16)
+    {
+        uint8x16_t v = vld1q_u8 (p);
+        uint8x16_t stop = vorrq_u8 (vorrq_u8 (vceqq_u8 (v, vdupq_n_u8 ('"')), vceqq_u8 (v, vdupq_n_u8 ('\\'))),
+                                    vcltq_u8 (v, vdupq_n_u8 (0x20)));
+        uint64_t mask = neon_mask (stop);
+        uint64_t high = neon_mask (vcgeq_u8 (v, vdupq_n_u8 (0x80)));
+        if (mask)
+        {
+            unsigned i = (unsigned)__builtin_ctzll (mask) >> 2;
+            if (high & ((1ull << (4 * i)) - 1))
+                *non_ascii = true;
+            return p + i;
+        }
+        if (high)
+            *non_ascii = true;
+    }
+    return scan_string_bytes (p, end, non_ascii);
+}
+#endif
+
+static const uint8_t* scan_string_select (const uint8_t* p, const uint8_t* end, bool* non_ascii);
+static const uint8_t* (*scan_string)(const uint8_t* p, const uint8_t* end, bool* non_ascii) = scan_string_select;
+
+static const uint8_t* scan_string_select (const uint8_t* p, const uint8_t* end, bool* non_ascii)
+{
+    scan_string = scan_string_bytes;
+#ifdef JSON_SCAN_X86
+    scan_string = scan_string_sse2;
+    if (__builtin_cpu_supports ("avx2"))
+        scan_string = scan_string_avx2;
+#endif
+#ifdef JSON_SCAN_NEON
+    scan_string = scan_string_neon;
+#endif
+    return scan_string (p, end, non_ascii);
+}
+
+
+const uint8_t* json_scan_string (const uint8_t* p, const uint8_t* end, bool* non_ascii)
+{
+    /* most strings are short, keys in particular */
+    const uint8_t *q = p + 8 < end ? p + 8 : end;
+    for (; p < q; p++)
+    {
+        if (*p == '"' || *p == '\\' || *p < 0x20)
+            return p;
+        if (*p & 0x80)
+            break;
+    }
+    return scan_string (p, end, non_ascii);
+}
+
+
+
+/*****************************************  WHITE SPACE  **************************************/
+
+
+#define is_white_space(c)   ((c) == ' ' || (c) == '\n' || (c) == '\r' || (c) == '\t')
+
+const uint8_t* json_skip_white_space (const uint8_t* p, const uint8_t* end)
+{
+    /* usually none or a single space; indentation makes runs */
+    if (p < end && !is_white_space (*p))
+        return p;
+    if (p + 1 < end && !is_white_space (p[1]))
+        return p + 1;
+#ifdef JSON_SCAN_X86
+    for (; end - p >= 16; p += 16)
+    {
+        __m128i v = _mm_loadu_si128 ((const __m128i*)p);
+        __m128i space = _mm_or_si128 (_mm_or_si128 (_mm_cmpeq_epi8 (v, _mm_set1_epi8 (' ')), _mm_cmpeq_epi8 (v, _mm_set1_epi8 ('\n'))),
+                                      _mm_or_si128 (_mm_cmpeq_epi8 (v, _mm_set1_epi8 ('\r')), _mm_cmpeq_epi8 (v, _mm_set1_epi8 ('\t'))));
+        unsigned mask = (unsigned)_mm_movemask_epi8 (space) ^ 0xffff;
+        if (mask)
+            return p + __builtin_ctz (mask);
+    }
+#endif
+#ifdef JSON_SCAN_NEON
+    for (; end - p >= 16; p += 16)
+    {
+        uint8x16_t v = vld1q_u8 (p);
+        uint8x16_t space = vorrq_u8 (vorrq_u8 (vceqq_u8 (v, vdupq_n_u8 (' ')), vceqq_u8 (v, vdupq_n_u8 ('\n'))),
+                                     vorrq_u8 (vceqq_u8 (v, vdupq_n_u8 ('\r')), vceqq_u8 (v, vdupq_n_u8 ('\t'))));
+        uint64_t mask = ~neon_mask (space);
+        if (mask)
+            return p + (__builtin_ctzll (mask) >> 2);
+    }
+#endif
+    while (p < end && is_white_space (*p))
+        p++;
+    return p;
+}
+
+
+
+/*****************************************  UTF-8  ********************************************/
+
+
+static bool ascii_block (const uint8_t* p)
+{
+#ifdef JSON_SCAN_X86
+    return !_mm_movemask_epi8 (_mm_loadu_si128 ((const __m128i*)p));
+#else
+    uint64_t a, b;
+    memcpy (&a, p, 8);
+    memcpy (&b, p + 8, 8);
+    return !((a | b) & 0x8080808080808080ULL);
+#endif
+}
+
+
+/* Well-formed UTF-8 as in RFC 3629: shortest form, no surrogates, at most U+10FFFF */
+bool json_valid_utf8 (const uint8_t* p, unsigned long length)
+{
+    const uint8_t *end = p + length;
+    while (p < end)
+    {
+        if (end - p >= 16 && ascii_block (p))
+        {
+            p += 16;
+            continue;
+        }
+        uint8_t c = *p++;
+        if (c < 0x80)
+            continue;
+
+        int n;
+        uint8_t low = 0x80, high = 0xbf;     /* range of the second byte */
+        if (0xc2 <= c && c <= 0xdf)
+            n = 1;
+        else if (0xe0 <= c && c <= 0xef)
+        {
+            n = 2;
+            if (c == 0xe0)
+                low = 0xa0;
+            else if (c == 0xed)
+                high = 0x9f;
+        }
+        else if (0xf0 <= c && c <= 0xf4)
+        {
+            n = 3;
+            if (c == 0xf0)
+                low = 0x90;
+            else if (c == 0xf4)
+                high = 0x8f;
+        }
+        else
+            return false;
+
+        if (end - p < n || *p < low || *p > high)
+            return false;
+        for (p++; --n; p++)
+            if ((*p & 0xc0) != 0x80)
+                return false;
+    }
+    return true;
+}
+
+
+
+/*****************************************  ESCAPES  ******************************************/
+
+
+long json_hex4 (const uint8_t* p)
+{
+    long v = 0;
+    int i;
+    for (i = 0; i < 4; i++)
+    {
+        int c = p[i];
+        if ('0' <= c && c <= '9')
+            v = v << 4 | (c - '0');
+        else if ('a' <= (c | 0x20) && (c | 0x20) <= 'f')
+            v = v << 4 | ((c | 0x20) - 'a' + 10);
+        else
+            return -1;
+    }
+    return v;
+}
+
+
+int json_utf8_encode (uint32_t codepoint, uint8_t* utf8)
+{
+    if (codepoint < 0x80)
+    {
+        utf8[0] = (uint8_t)codepoint;
+        return 1;
+    }
+    if (codepoint < 0x800)
+    {
+        utf8[0] = (uint8_t)(0xc0 | codepoint >> 6);
+        utf8[1] = (uint8_t)(0x80 | (codepoint & 0x3f));
+        return 2;
+    }
+    if (codepoint < 0x10000)
+    {
+        utf8[0] = (uint8_t)(0xe0 | codepoint >> 12);
+        utf8[1] = (uint8_t)(0x80 | ((codepoint >> 6) & 0x3f));
+        utf8[2] = (uint8_t)(0x80 | (codepoint & 0x3f));
+        return 3;
+    }
+    utf8[0] = (uint8_t)(0xf0 | codepoint >> 18);
+    utf8[1] = (uint8_t)(0x80 | ((codepoint >> 12) & 0x3f));
+    utf8[2] = (uint8_t)(0x80 | ((codepoint >> 6) & 0x3f));
+    utf8[3] = (uint8_t)(0x80 | (codepoint & 0x3f));
+    return 4;
+}
+
+
+int json_unescape (const uint8_t* p, const uint8_t* end, uint8_t* utf8, int* utf8_length)
+{
+    long codepoint, low;
+    if (p == end)
+        return -1;
+
+    *utf8_length = 1;
+    switch (*p)
+    {
+        case '"': case '\\': case '/':
+            utf8[0] = *p;       return 1;
+        case 'b': utf8[0] = '\b';   return 1;
+        case 'f': utf8[0] = '\f';   return 1;
+        case 'n': utf8[0] = '\n';   return 1;
+        case 'r': utf8[0] = '\r';   return 1;
+        case 't': utf8[0] = '\t';   return 1;
+        case 'u':
+            if (end - p < 5 || (codepoint = json_hex4 (p + 1)) < 0)
+                return -1;
+            if (codepoint < 0xd800 || codepoint >= 0xe000)
+            {
+                *utf8_length = json_utf8_encode ((uint32_t)codepoint, utf8);
+                return 5;
+            }
+            if (codepoint >= 0xdc00 || end - p < 11 || p[5] != '\\' || p[6] != 'u' ||
+                (low = json_hex4 (p + 7)) < 0xdc00 || low > 0xdfff)
+                return -1;
+            *utf8_length = json_utf8_encode ((uint32_t)(0x10000 + ((codepoint - 0xd800) << 10) + (low - 0xdc00)), utf8);
+            return 11;
+        default:
+            return -1;
+    }
+}
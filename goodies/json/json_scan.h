@@ -0,0 +1,64 @@
+/*      CWPack/goodies - json_scan.h   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef json_scan_h
+#define json_scan_h
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+/*
+ * Vectorized scanning primitives for JSON parsers. They look at 16 (SSE2, NEON) or
+ * 32 (AVX2, chosen at run time) bytes at a time and never read outside [p, end).
+ */
+
+/*
+ * The first byte in [p, end) that is a quote, a backslash or a control character, end if
+ * there is none. *non_ascii is set if a byte >= 0x80 was passed; the run then needs
+ * json_valid_utf8.
+ */
+const uint8_t* json_scan_string (const uint8_t* p, const uint8_t* end, bool* non_ascii);
+
+/* The first byte in [p, end) that isn't JSON white space, end if there is none */
+const uint8_t* json_skip_white_space (const uint8_t* p, const uint8_t* end);
+
+bool json_valid_utf8 (const uint8_t* p, unsigned long length);
+
+/* The value of 4 hex digits, -1 if they aren't */
+long json_hex4 (const uint8_t* p);
+
+/* Encodes a code point, returns its length, 1 to 4 */
+int json_utf8_encode (uint32_t codepoint, uint8_t* utf8);
+
+/*
+ * Decodes the escape sequence after a backslash, surrogate pairs included, to UTF-8.
+ * Returns the bytes consumed (after the backslash) or -1 if malformed or incomplete.
+ */
+int json_unescape (const uint8_t* p, const uint8_t* end, uint8_t* utf8, int* utf8_length);
+
+
+
+/*****************************************  E P I L O G U E  **********************************/
+
+
+#endif /* json_scan_h */
@@ -0,0 +1,551 @@
+/*      CWPack/goodies - json_test.c   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <math.h>
+
+#include "cwpack.h"
+#include "json2cwpack.h"
+#include "cwpack2json.h"
+#include "json_scan.h"
+
+
+char TEST_area[200000];
+int error_count;
+
+static void ERROR(const char* msg)
+{
+    error_count++;
+    printf("ERROR: %s\n", msg);
+}
+
+
+static void ERROR1(const char* msg, int i)
+{
+    error_count++;
+    printf("ERROR: %s%d\n", msg, i);
+}
+
+
+static int temp_file (void)
+{
+    char name[] = "/tmp/cwpack_json_XXXXXX";
+    int fd = mkstemp (name);
+    if (fd < 0)
+    {
+        ERROR("Couldn't create temp file");
+        exit(1);
+    }
+    unlink (name);
+    return fd;
+}
+
+
+/* Transcodes one text in memory and compares with the expected msgpack */
+static void check_transcode (const char* json, const void* expected, unsigned long expected_length)
+{
+    json_transcoder jt;
+    init_json_transcoder (&jt, -1, -1, 64);
+    json_transcoder_set_input (&jt, json, strlen (json));
+    int rc = json_transcode_next (&jt);
+    if (rc)
+        printf("ERROR: rc = %d for %s\n", rc, json), error_count++;
+    else if ((unsigned long)(jt.pc.current - jt.pc.start) != expected_length || memcmp (jt.pc.start, expected, expected_length))
+        printf("ERROR: wrong msgpack for %s\n", json), error_count++;
+    else if (json_transcode_next (&jt) != CWP_RC_END_OF_INPUT)
+        printf("ERROR: expected end of input after %s\n", json), error_count++;
+    terminate_json_transcoder (&jt);
+}
+
+
+static void check_malformed (const char* json, unsigned long error_offset)
+{
+    json_transcoder jt;
+    init_json_transcoder (&jt, -1, -1, 64);
+    json_transcoder_set_input (&jt, json, strlen (json));
+    if (json_transcode_next (&jt) != CWP_RC_MALFORMED_INPUT || jt.error_offset != error_offset)
+        printf("ERROR: %s not malformed at %lu (rc = %d at %lu)\n", json, error_offset, jt.return_code, jt.error_offset), error_count++;
+    terminate_json_transcoder (&jt);
+}
+
+
+/* Compares the vectorized scans with byte by byte ones at every start and end */
+static void check_scan (const uint8_t* area, unsigned long length)
+{
+    unsigned long from, to;
+    for (from = 0; from < 70 && from < length; from++)
+        for (to = from; to <= length; to += (to < from + 100 ? 1 : 37))
+        {
+            const uint8_t *p = area + from, *end = area + to, *r;
+            bool non_ascii = false, expected_non_ascii = false;
+            for (r = p; r < end && *r != '"' && *r != '\\' && *r >= 0x20; r++)
+                if (*r & 0x80)
+                    expected_non_ascii = true;
+            if (json_scan_string (p, end, &non_ascii) != r || non_ascii != expected_non_ascii)
+            {
+                ERROR1("String scan from ", (int)from);
+                return;
+            }
+            for (r = p; r < end && (*r == ' ' || *r == '\n' || *r == '\r' || *r == '\t'); r++)
+                ;
+            if (json_skip_white_space (p, end) != r)
+            {
+                ERROR1("White space scan from ", (int)from);
+                return;
+            }
+        }
+}
+
+
+static void check_utf8 (const char* s, bool valid)
+{
+    char padded[64];
+    unsigned long length = strlen (s);
+    memset (padded, 'a', 40);
+    memcpy (padded + 40 - length, s, length);   /* also after an ASCII block */
+    if (json_valid_utf8 ((const uint8_t*)s, length) != valid || json_valid_utf8 ((const uint8_t*)padded, 40) != valid)
+        printf("ERROR: UTF-8 validation of %s\n", s), error_count++;
+}
+
+
+#define FILE_ITEMS  5000
+
+/* Writes the msgpack in [TEST_area, end) and compares with the expected JSON */
+static void check_json (const uint8_t* end, const char* expected)
+{
+    cw_unpack_context uc;
+    json_writer jw;
+    cw_unpack_context_init (&uc, TEST_area, (unsigned long)(end - (uint8_t*)TEST_area), NULL);
+    init_json_writer (&jw, -1, 64);
+    while (!json_write_item (&jw, &uc));
+    if (uc.return_code != CWP_RC_END_OF_INPUT || jw.return_code)
+        printf("ERROR: rc = %d, %d for %s\n", uc.return_code, jw.return_code, expected), error_count++;
+    else if (jw.length != strlen (expected) || memcmp (jw.buffer, expected, jw.length))
+        printf("ERROR: got %.*s expected %s\n", (int)jw.length, jw.buffer, expected), error_count++;
+    terminate_json_writer (&jw);
+}
+
+
+/* Formats the double and checks that it reads back and how short it is compared to %.*g */
+static bool check_double (double d)
+{
+    char text[32], shortest[400];
+    int n = json_format_double (d, text);
+    text[n] = 0;
+    if (strtod (text, NULL) != d)
+    {
+        printf("ERROR: %s doesn't read back as %.17g\n", text, d);
+        error_count++;
+        return false;
+    }
+
+    int precision = 1;
+    do
+        snprintf (shortest, sizeof(shortest), "%.*g", precision++, d);
+    while (strtod (shortest, NULL) != d);
+    char digits[32];
+    int first = 0, last = 0;
+    const char *p;
+    for (p = text; *p && *p != 'e'; p++)
+        if (*p >= '0' && *p <= '9')
+            digits[last++] = *p;
+    while (first < last && digits[first] == '0')
+        first++;
+    while (last > first && digits[last - 1] == '0')
+        last--;
+    return last - first <= precision - 1;
+}
+
+
+int main(int argc, const char * argv[])
+{
+    (void)argc;
+    (void)argv;
+    cw_pack_context pc;
+    unsigned long ul;
+    int i;
+
+    printf("CWPack json test started.\n");
+
+    /*******************   TEST scalars and containers  *******************************/
+
+    cw_pack_context_init (&pc, TEST_area, sizeof(TEST_area), NULL);
+    cw_pack_map_size (&pc, 3);
+    cw_pack_str (&pc, "a", 1);
+    cw_pack_array_size (&pc, 9);
+    cw_pack_unsigned (&pc, 1);
+    cw_pack_signed (&pc, -2);
+    cw_pack_double (&pc, 3.5);
+    cw_pack_boolean (&pc, true);
+    cw_pack_boolean (&pc, false);
+    cw_pack_nil (&pc);
+    cw_pack_str (&pc, "x\xc3\xa9\xf0\x9f\x98\x80\n\"/", 10);
+    cw_pack_unsigned (&pc, 18446744073709551615ULL);
+    cw_pack_double (&pc, -1e-7);
+    cw_pack_str (&pc, "b", 1);
+    cw_pack_map_size (&pc, 0);
+    cw_pack_str (&pc, "", 0);
+    cw_pack_array_size (&pc, 0);
+    check_transcode (" {\"a\" : [1,-2, 3.5 ,true,false,null,\"x\\u00e9\\ud83d\\ude00\\n\\\"\\/\", 18446744073709551615, -1E-7],\n"
+                     "  \"b\":{}, \"\": [ ]}\n", TEST_area, (unsigned long)(pc.current - pc.start));
+
+    /* header lengths */
+    static char json[500000];
+    for (ul = 0, i = 0; i < 70000; i++)
+        ul += (unsigned long)sprintf (json + ul, "%s%d", i ? "," : "[", i % 10);
+    strcpy (json + ul, "]");
+    cw_pack_context_init (&pc, TEST_area, sizeof(TEST_area), NULL);
+    cw_pack_array_size (&pc, 70000);
+    for (i = 0; i < 70000 && !pc.return_code; i++)
+        cw_pack_unsigned (&pc, (uint64_t)(i % 10));
+    check_transcode (json, TEST_area, (unsigned long)(pc.current - pc.start));
+    json[40] = ']';
+    json[41] = 0;
+    cw_pack_context_init (&pc, TEST_area, sizeof(TEST_area), NULL);
+    cw_pack_array_size (&pc, 20);
+    for (i = 0; i < 20; i++)
+        cw_pack_unsigned (&pc, (uint64_t)(i % 10));
+    check_transcode (json, TEST_area, (unsigned long)(pc.current - pc.start));
+
+
+    /*******************   TEST scanning  *********************************************/
+
+    static const uint8_t scan_bytes[] = "ab\"\\\n\t \r\x01\x1f\x20\x7f\x80\xc3\xa9\xff";
+    srand (17);
+    for (i = 0; i < 1000; i++)
+        TEST_area[i] = (i % 97 < 60) ? ' ' : (i % 7) ? 'x' : (char)scan_bytes[rand () % (sizeof(scan_bytes) - 1)];
+    check_scan ((const uint8_t*)TEST_area, 1000);
+    for (i = 0; i < 1000; i++)
+        TEST_area[i] = (char)scan_bytes[rand () % (sizeof(scan_bytes) - 1)];
+    check_scan ((const uint8_t*)TEST_area, 1000);
+
+    check_utf8 ("plain", true);
+    check_utf8 ("\xc3\xa9\xe4\xb8\xad\xf0\x9f\x98\x80", true);
+    check_utf8 ("\xf4\x8f\xbf\xbf", true);
+    check_utf8 ("\xc0\xaf", false);             /* overlong */
+    check_utf8 ("\xe0\x9f\xbf", false);         /* overlong */
+    check_utf8 ("\xed\xa0\x80", false);         /* surrogate */
+    check_utf8 ("\xf4\x90\x80\x80", false);     /* beyond U+10FFFF */
+    check_utf8 ("\xe4\xb8", false);             /* truncated */
+    check_utf8 ("\x80", false);
+    check_utf8 ("\xff", false);
+    check_malformed ("[\"ok\", \"\xc3\x28\"]", 11);
+
+    /*******************   TEST malformed input  **************************************/
+
+    check_malformed ("[1,]", 3);
+    check_malformed ("{\"a\" 1}", 5);
+    check_malformed ("\"abc", 4);
+    check_malformed ("tru", 3);
+    check_malformed ("01", 2);
+    check_malformed ("[1 2]", 3);
+    check_malformed ("\"\\ud800x\"", 2);
+    check_malformed ("{1:2}", 1);
+    check_malformed ("\"a\tb\"", 2);
+    check_malformed ("[", 1);
+
+    /*******************   TEST streaming from and to files  **************************/
+
+    int in = temp_file (), out = temp_file ();
+    FILE *f = fdopen (dup (in), "w");
+    fprintf (f, "[");
+    for (i = 0; i < FILE_ITEMS; i++)
+        fprintf (f, "%s\n  {\"id\": %d, \"name\": \"item \\\"%d\\\"\", \"tags\": [%s]}", i ? "," : "", i, i,
+                 i % 3 == 0 ? "" : i % 3 == 1 ? "\"a\"" : "\"a\", \"b\", 1.25");
+    fprintf (f, "]\n{\"next\": \"text\"}\n");
+    fclose (f);
+    lseek (in, 0, SEEK_SET);
+
+    json_transcoder jt;
+    init_json_transcoder (&jt, in, out, 33);
+    for (i = 0; i < 2; i++)
+        if (json_transcode_next (&jt))
+            ERROR1("In file transcode, rc = ", jt.return_code);
+    if (json_transcode_next (&jt) != CWP_RC_END_OF_INPUT)
+        ERROR1("Expected end of file input, rc = ", jt.return_code);
+    terminate_json_transcoder (&jt);
+
+    long length = pread (out, TEST_area, sizeof(TEST_area), 0);
+    if (length >= (long)sizeof(TEST_area) / 2)
+    {
+        static uint8_t file_area[1000000];
+        length = pread (out, file_area, sizeof(file_area), 0);
+        cw_unpack_context uc;
+        cw_unpack_context_init (&uc, file_area, (unsigned long)length, NULL);
+        cw_unpack_next (&uc);
+        if (uc.item.type != CWP_ITEM_ARRAY || uc.item.as.array.size != FILE_ITEMS)
+            ERROR("File array header");
+        for (i = 0; i < FILE_ITEMS && !uc.return_code; i++)
+        {
+            cw_unpack_next (&uc);
+            if (uc.item.type != CWP_ITEM_MAP || uc.item.as.map.size != 3)
+            {
+                ERROR1("File map header ", i);
+                break;
+            }
+            cw_skip_items (&uc, 1);
+            cw_unpack_next (&uc);
+            if (uc.item.type != CWP_ITEM_POSITIVE_INTEGER || uc.item.as.u64 != (uint64_t)i)
+                ERROR1("File id ", i);
+            cw_skip_items (&uc, 1);
+            cw_unpack_next (&uc);
+            sprintf (json, "item \"%d\"", i);
+            if (uc.item.type != CWP_ITEM_STR || uc.item.as.str.length != strlen (json) || memcmp (uc.item.as.str.start, json, strlen (json)))
+                ERROR1("File name ", i);
+            cw_skip_items (&uc, 1);
+            cw_unpack_next (&uc);
+            if (uc.item.type != CWP_ITEM_ARRAY || uc.item.as.array.size != (uint32_t)(i % 3 == 2 ? 3 : i % 3))
+                ERROR1("File tags ", i);
+            cw_skip_items (&uc, (long)uc.item.as.array.size);
+        }
+        cw_unpack_next (&uc);
+        if (uc.item.type != CWP_ITEM_MAP || uc.item.as.map.size != 1)
+            ERROR("File second text");
+        cw_skip_items (&uc, 2);
+        if (uc.return_code || uc.current != uc.end)
+            ERROR1("File trailing bytes, rc = ", uc.return_code);
+    }
+    else
+        ERROR1("File output length ", (int)length);
+    close (in);
+    close (out);
+
+    /* output after earlier content, with a header patched in the file */
+    out = temp_file ();
+    if (write (out, "\xc0", 1) != 1)
+        ERROR("Write first byte");
+    char *big = (char*)TEST_area;
+    big[0] = '[';
+    for (i = 0; i < 20000; i++)
+        memcpy (big + 1 + 2 * i, i < 19999 ? "0," : "0]", 2);
+    init_json_transcoder (&jt, -1, out, 64);
+    json_transcoder_set_input (&jt, big, 40001);
+    if (json_transcode_next (&jt))
+        ERROR1("Appended transcode, rc = ", jt.return_code);
+    terminate_json_transcoder (&jt);
+    uint8_t head[7];
+    if (pread (out, head, 7, 0) != 7 || memcmp (head, "\xc0\xdd\x00\x00\x4e\x20\x00", 7) ||
+        lseek (out, 0, SEEK_END) != 1 + 5 + 20000)
+        ERROR("Output after earlier content");
+    close (out);
+
+    out = temp_file ();
+    fcntl (out, F_SETFL, fcntl (out, F_GETFL) | O_APPEND);
+    init_json_transcoder (&jt, -1, out, 64);
+    if (jt.return_code != CWP_RC_ILLEGAL_CALL || json_transcode_next (&jt) != CWP_RC_ILLEGAL_CALL)
+        ERROR("Append mode output");
+    terminate_json_transcoder (&jt);
+    close (out);
+
+    /*******************   TEST writing JSON  ******************************************/
+
+    cw_pack_context_init (&pc, TEST_area, sizeof(TEST_area), NULL);
+    cw_pack_array_size (&pc, 12);
+    cw_pack_nil (&pc);
+    cw_pack_true (&pc);
+    cw_pack_false (&pc);
+    cw_pack_unsigned (&pc, 0);
+    cw_pack_unsigned (&pc, 18446744073709551615ULL);
+    cw_pack_signed (&pc, -1);
+    cw_pack_signed (&pc, INT64_MIN);
+    cw_pack_signed (&pc, 1234567890);
+    cw_pack_array_size (&pc, 0);
+    cw_pack_map_size (&pc, 0);
+    cw_pack_array_size (&pc, 1);
+    cw_pack_array_size (&pc, 0);
+    cw_pack_map_size (&pc, 1);
+    cw_pack_str (&pc, "k", 1);
+    cw_pack_nil (&pc);
+    cw_pack_unsigned (&pc, 7);
+    check_json (pc.current, "[null,true,false,0,18446744073709551615,-1,-9223372036854775808,1234567890,[],{},[[]],{\"k\":null}]\n7\n");
+
+    cw_pack_context_init (&pc, TEST_area, sizeof(TEST_area), NULL);
+    cw_pack_array_size (&pc, 14);
+    cw_pack_double (&pc, 0.1);
+    cw_pack_float (&pc, 0.1f);
+    cw_pack_double (&pc, 0.1f);
+    cw_pack_double (&pc, 1.5);
+    cw_pack_double (&pc, 123456.0);
+    cw_pack_double (&pc, -0.0);
+    cw_pack_double (&pc, 1e21);
+    cw_pack_double (&pc, 1e-7);
+    cw_pack_double (&pc, 0.000123);
+    cw_pack_double (&pc, 5e-324);
+    cw_pack_double (&pc, 1.7976931348623157e308);
+    cw_pack_float (&pc, 3.4028235e38f);
+    cw_pack_double (&pc, NAN);
+    cw_pack_float (&pc, -INFINITY);
+    check_json (pc.current, "[0.1,0.1,0.10000000149011612,1.5,123456.0,-0.0,1e21,1e-7,0.000123,5e-324,"
+                            "1.7976931348623157e308,3.4028235e38,null,null]\n");
+
+    cw_pack_context_init (&pc, TEST_area, sizeof(TEST_area), NULL);
+    cw_pack_array_size (&pc, 5);
+    cw_pack_str (&pc, "a\"b\\c\n\t\x01\x1f/\xc3\xa9", 12);
+    cw_pack_str (&pc, "x\xc3\x28y\xe4\xb8", 6);
+    cw_pack_bin (&pc, "\x00\xff\x10", 3);
+    cw_pack_bin (&pc, "ab", 2);
+    cw_pack_bin (&pc, "a", 1);
+    cw_pack_time (&pc, 1589999999, 500000000);
+    cw_pack_time (&pc, -1, 0);
+    cw_pack_ext (&pc, 5, "abc", 3);
+    cw_pack_ext (&pc, -100, "", 0);
+    check_json (pc.current, "[\"a\\\"b\\\\c\\n\\t\\u0001\\u001f/\xc3\xa9\",\"x\xef\xbf\xbd(y\xef\xbf\xbd\xef\xbf\xbd\","
+                            "\"AP8Q\",\"YWI=\",\"YQ==\"]\n\"2020-05-20T18:39:59.5Z\"\n\"1969-12-31T23:59:59Z\"\n"
+                            "{\"ext\":5,\"data\":\"YWJj\"}\n{\"ext\":-100,\"data\":\"\"}\n");
+
+    cw_pack_context_init (&pc, TEST_area, sizeof(TEST_area), NULL);
+    cw_pack_map_size (&pc, 5);
+    cw_pack_unsigned (&pc, 1);
+    cw_pack_str (&pc, "one", 3);
+    cw_pack_array_size (&pc, 2);
+    cw_pack_str (&pc, "x\"", 2);
+    cw_pack_nil (&pc);
+    cw_pack_map_size (&pc, 0);
+    cw_pack_time (&pc, 0, 0);
+    cw_pack_bin (&pc, "a", 1);
+    cw_pack_bin (&pc, "a", 1);
+    cw_pack_nil (&pc);
+    cw_pack_nil (&pc);
+    cw_pack_map_size (&pc, 1);
+    cw_pack_boolean (&pc, true);
+    cw_pack_array_size (&pc, 1);
+    cw_pack_array_size (&pc, 0);
+    check_json (pc.current, "{\"1\":\"one\",\"[\\\"x\\\\\\\"\\\",null]\":{},\"1970-01-01T00:00:00Z\":\"YQ==\",\"YQ==\":null,"
+                            "\"null\":{\"true\":[[]]}}\n");
+
+    {
+        cw_unpack_context uc;
+        json_writer jw;
+        cw_pack_context_init (&pc, TEST_area, sizeof(TEST_area), NULL);
+        cw_pack_array_size (&pc, 3);
+        cw_pack_nil (&pc);
+        cw_unpack_context_init (&uc, TEST_area, (unsigned long)(pc.current - pc.start), NULL);
+        init_json_writer (&jw, -1, 64);
+        if (json_write_item (&jw, &uc) != CWP_RC_MALFORMED_INPUT)
+            ERROR("Truncated item");
+        terminate_json_writer (&jw);
+    }
+
+    /*******************   TEST shortest doubles  *************************************/
+
+    srand (7);
+    int shortest = 0;
+    for (i = 0; i < 100000; i++)
+    {
+        uint64_t bits = (uint64_t)rand () << 42 ^ (uint64_t)rand () << 21 ^ (uint64_t)rand ();
+        double d;
+        memcpy (&d, &bits, 8);
+        if (isfinite (d))
+            shortest += check_double (d);
+        else
+            shortest++;
+    }
+    if (shortest < 99000)
+        ERROR1("Shortest doubles ", shortest);
+    shortest = 0;
+    for (i = 1; i < 100000; i++)
+        shortest += check_double (i / 1000.0) + check_double ((double)i * 1e300) + check_double (1.0 / i);
+    if (shortest < 297000)
+        ERROR1("Shortest doubles ", shortest);
+    for (i = 0; i < 100000; i++)
+    {
+        uint32_t bits = (uint32_t)rand () << 16 ^ (uint32_t)rand ();
+        float f;
+        char text[32];
+        memcpy (&f, &bits, 4);
+        if (!isfinite (f))
+            continue;
+        text[json_format_float (f, text)] = 0;
+        if (strtof (text, NULL) != f)
+            printf("ERROR: %s doesn't read back as %.9g\n", text, (double)f), error_count++;
+    }
+
+    /*******************   TEST round trip  *******************************************/
+
+    {
+        const char *json = "{\"a\":[1,-2,3.5,true,false,null,\"x\xc3\xa9\\n\\u0001\",1e-7,0.0,18446744073709551615],\"b\":{},\"c\":[]}\n";
+        json_transcoder jt;
+        init_json_transcoder (&jt, -1, -1, 64);
+        json_transcoder_set_input (&jt, json, strlen (json));
+        if (json_transcode_next (&jt) || json_transcode_next (&jt) != CWP_RC_END_OF_INPUT)
+            ERROR("Round trip transcode");
+        ul = (unsigned long)(jt.pc.current - jt.pc.start);
+        memcpy (TEST_area, jt.pc.start, ul);
+        terminate_json_transcoder (&jt);
+        check_json ((uint8_t*)TEST_area + ul, json);
+    }
+
+    /*******************   TEST writing to a file  ************************************/
+
+    int fd = temp_file ();
+    json_writer jw;
+    init_json_writer (&jw, fd, 64);
+    cw_pack_context_init (&pc, TEST_area, sizeof(TEST_area), NULL);
+    for (i = 0; i < 500; i++)
+    {
+        cw_pack_map_size (&pc, 1);
+        cw_pack_array_size (&pc, 2);
+        cw_pack_signed (&pc, -i);
+        cw_pack_str (&pc, "0123456789012345678901234567890123456789012345678901234567890123456789", 70);
+        cw_pack_double (&pc, i + 0.25);
+    }
+    cw_unpack_context uc;
+    cw_unpack_context_init (&uc, TEST_area, (unsigned long)(pc.current - pc.start), NULL);
+    while (!json_write_item (&jw, &uc));
+    terminate_json_writer (&jw);
+    length = pread (fd, TEST_area + 100000, 100000, 0);
+    const char *line = TEST_area + 100000;
+    for (i = 0; i < 500 && line < TEST_area + 100000 + length; i++)
+    {
+        char expected[200];
+        int n = snprintf (expected, sizeof(expected), "{\"[%d,\\\"0123456789012345678901234567890123456789012345678901234567890123456789\\\"]\":%d.25}\n", -i, i);
+        if (memcmp (line, expected, (unsigned long)n))
+            ERROR1("File line ", i);
+        line += n;
+    }
+    if (i != 500 || line != TEST_area + 100000 + length)
+        ERROR1("File length ", (int)length);
+    close (fd);
+
+    /*************************************************************/
+
+    printf("CWPack json test completed, ");
+    switch (error_count)
+    {
+        case 0:
+            printf("no errors detected\n");
+            break;
+
+        case 1:
+            printf("1 error detected\n");
+            break;
+
+        default:
+            printf("%d errors detected\n", error_count);
+            break;
+    }
+
+    return error_count;
+}
@@ -0,0 +1,3 @@
+clang -I ../../src/ -o jsonTest *.c ../../src/cwpack.c
+./jsonTest
+rm -f *.o jsonTest
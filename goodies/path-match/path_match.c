@@ -0,0 +1,400 @@
+/*      CWPack/goodies - path_match.c   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "path_match.h"
+
+
+/*
+ * The paths are a trie. A node is a place in the item; its steps lead to places one
+ * level down, and if a path ends at the node it is a match.
+ */
+
+typedef enum
+{
+    STEP_KEY,
+    STEP_INDEX,
+    STEP_ANY
+} step_kind;
+
+struct path_step
+{
+    step_kind       kind;
+    unsigned long   key;                /* offset in keys */
+    uint32_t        length;             /* key length, or array index */
+    unsigned        to;                 /* node */
+    int             next;               /* the next step from the same node, -1 = last */
+    unsigned long   visit;              /* when the step was last taken */
+    uint64_t        tail;               /* key_tail of the key */
+};
+
+struct path_node
+{
+    int             first_step;         /* -1 = none */
+    int             path;               /* the path that ends here, -1 = none */
+    unsigned        key_steps;          /* steps to keys and indexes */
+    int             any;                /* the wildcard step, -1 = none */
+    uint64_t        key_filter;         /* key_bit of the keys of the steps */
+};
+
+
+
+/*****************************************  COMPILE  ******************************************/
+
+
+static int add_node (path_matcher* pm)
+{
+    if (pm->node_count == pm->node_capacity)
+    {
+        unsigned capacity = 2 * pm->node_capacity;
+        path_node *nodes = realloc (pm->nodes, capacity * sizeof(path_node));
+        if (!nodes)
+            return CWP_RC_MALLOC_ERROR;
+        pm->nodes = nodes;
+        pm->node_capacity = capacity;
+    }
+    path_node *node = pm->nodes + pm->node_count;
+    node->first_step = -1;
+    node->path = -1;
+    node->key_steps = 0;
+    node->any = -1;
+    node->key_filter = 0;
+    return (int)pm->node_count++;
+}
+
+
+/* The last 8 bytes of a key, or all bytes of a shorter key */
+static uint64_t key_tail (const char* key, uint32_t length)
+{
+    uint64_t tail = 0;
+    if (length >= 8)
+        memcpy (&tail, key + length - 8, 8);
+    else if (length)
+        memcpy (&tail, key, length);
+    return tail;
+}
+
+
+/* One of 64 bits for a key, used to reject most keys without comparing them */
+static uint64_t key_bit (uint64_t tail, uint32_t length)
+{
+    return 1ull << (((tail + length) * 0x9e3779b97f4a7c15ull) >> 58);
+}
+
+
+/* The node after the step from node, added if it isn't there */
+static int step_to (path_matcher* pm, unsigned node, step_kind kind, const char* key, uint32_t length)
+{
+    int s;
+    for (s = pm->nodes[node].first_step; s >= 0; s = pm->steps[s].next)
+    {
+        path_step *step = pm->steps + s;
+        if (step->kind == kind && (kind == STEP_ANY || (step->length == length &&
+            (kind == STEP_INDEX || !memcmp (pm->keys + step->key, key, length)))))
+            return (int)step->to;
+    }
+
+    if (pm->step_count == pm->step_capacity)
+    {
+        unsigned capacity = 2 * pm->step_capacity;
+        path_step *steps = realloc (pm->steps, capacity * sizeof(path_step));
+        if (!steps)
+            return CWP_RC_MALLOC_ERROR;
+        pm->steps = steps;
+        pm->step_capacity = capacity;
+    }
+    if (kind == STEP_KEY && pm->keys_length + length > pm->keys_capacity)
+    {
+        unsigned long capacity = 2 * pm->keys_capacity;
+        while (capacity < pm->keys_length + length)
+            capacity *= 2;
+        char *keys = realloc (pm->keys, capacity);
+        if (!keys)
+            return CWP_RC_MALLOC_ERROR;
+        pm->keys = keys;
+        pm->keys_capacity = capacity;
+    }
+    int to = add_node (pm);
+    if (to < 0)
+        return to;
+
+    path_step *step = pm->steps + pm->step_count;
+    step->kind = kind;
+    step->key = pm->keys_length;
+    step->length = length;
+    step->to = (unsigned)to;
+    step->next = pm->nodes[node].first_step;
+    step->visit = 0;
+    step->tail = kind == STEP_KEY ? key_tail (key, length) : 0;
+    pm->nodes[node].first_step = (int)pm->step_count++;
+    if (kind == STEP_KEY)
+    {
+        memcpy (pm->keys + pm->keys_length, key, length);
+        pm->keys_length += length;
+    }
+    if (kind == STEP_ANY)
+        pm->nodes[node].any = pm->nodes[node].first_step;
+    else
+        pm->nodes[node].key_steps++;
+    if (kind == STEP_KEY)
+        pm->nodes[node].key_filter |= key_bit (step->tail, length);
+    return to;
+}
+
+
+int init_path_matcher (path_matcher* pm, path_match_handler handler, void* user_data)
+{
+    memset (pm, 0, sizeof(path_matcher));
+    pm->node_capacity = 16;
+    pm->step_capacity = 16;
+    pm->keys_capacity = 256;
+    pm->nodes = malloc (pm->node_capacity * sizeof(path_node));
+    pm->steps = malloc (pm->step_capacity * sizeof(path_step));
+    pm->keys = malloc (pm->keys_capacity);
+    pm->handler = handler;
+    pm->user_data = user_data;
+    if (!pm->nodes || !pm->steps || !pm->keys)
+    {
+        terminate_path_matcher (pm);
+        return CWP_RC_MALLOC_ERROR;
+    }
+    return add_node (pm);       /* the root, 0 */
+}
+
+
+int path_matcher_add (path_matcher* pm, const char* path)
+{
+    const char *p = path;
+    int node = 0;
+    if (*p == '$')
+        p++;
+
+    while (*p && node >= 0)
+    {
+        const char *key = NULL;
+        unsigned long length = 0;
+        if (p[0] == '.' && p[1] == '*')
+        {
+            node = step_to (pm, (unsigned)node, STEP_ANY, NULL, 0);
+            p += 2;
+        }
+        else if (*p == '.')
+        {
+            key = ++p;
+            while (*p && *p != '.' && *p != '[')
+                p++;
+            length = (unsigned long)(p - key);
+            if (!length)
+                return CWP_RC_MALFORMED_INPUT;
+        }
+        else if (p[0] == '[' && p[1] == '*' && p[2] == ']')
+        {
+            node = step_to (pm, (unsigned)node, STEP_ANY, NULL, 0);
+            p += 3;
+        }
+        else if (p[0] == '[' && p[1] == '"')
+        {
+            key = p += 2;
+            while (*p && *p != '"')
+                p++;
+            length = (unsigned long)(p - key);
+            if (p[0] != '"' || p[1] != ']')
+                return CWP_RC_MALFORMED_INPUT;
+            p += 2;
+        }
+        else if (p[0] == '[' && p[1] >= '0' && p[1] <= '9')
+        {
+            char *end;
+            unsigned long n = strtoul (p + 1, &end, 10);
+            if (*end != ']' || n > UINT32_MAX)
+                return CWP_RC_MALFORMED_INPUT;
+            node = step_to (pm, (unsigned)node, STEP_INDEX, NULL, (uint32_t)n);
+            p = end + 1;
+        }
+        else
+            return CWP_RC_MALFORMED_INPUT;
+
+        if (key)
+        {
+            if (length > UINT32_MAX)
+                return CWP_RC_MALFORMED_INPUT;
+            node = step_to (pm, (unsigned)node, STEP_KEY, key, (uint32_t)length);
+        }
+    }
+    if (node < 0)
+        return node;
+    if (pm->nodes[node].path >= 0)
+        return pm->nodes[node].path;
+    return pm->nodes[node].path = pm->path_count++;
+}
+
+
+void terminate_path_matcher (path_matcher* pm)
+{
+    free (pm->nodes);
+    free (pm->steps);
+    free (pm->keys);
+    pm->nodes = NULL;
+    pm->steps = NULL;
+    pm->keys = NULL;
+}
+
+
+
+/*****************************************  MATCH  ********************************************/
+
+
+/*
+ * The step from node that the key takes, -1 if none. Most keys are rejected by the filter
+ * and as keys often share a prefix, the tails are compared first.
+ */
+static int key_step (const path_matcher* pm, const path_node* node, const cwpack_item* key)
+{
+    if (key->type != CWP_ITEM_STR)
+        return node->any;
+    uint32_t length = key->as.str.length;
+    uint64_t tail = key_tail ((const char*)key->as.str.start, length);
+    if (!(node->key_filter & key_bit (tail, length)))
+        return node->any;
+
+    int s;
+    for (s = node->first_step; s >= 0; s = pm->steps[s].next)
+    {
+        const path_step *step = pm->steps + s;
+        if (step->kind == STEP_KEY && step->tail == tail && step->length == length &&
+            (length <= 8 || !memcmp (pm->keys + step->key, key->as.str.start, length - 8)))
+            return s;
+    }
+    return node->any;
+}
+
+
+static int index_step (const path_matcher* pm, const path_node* node, uint32_t index)
+{
+    int s;
+    for (s = node->first_step; s >= 0; s = pm->steps[s].next)
+    {
+        const path_step *step = pm->steps + s;
+        if (step->kind == STEP_INDEX && step->length == index)
+            return s;
+    }
+    return node->any;
+}
+
+
+/* True the first time a key or index step is taken in a visit of its node */
+static bool take_step (path_matcher* pm, int s, unsigned long visit)
+{
+    path_step *step = pm->steps + s;
+    if (step->kind == STEP_ANY || step->visit == visit)
+        return false;
+    step->visit = visit;
+    return true;
+}
+
+
+/* The item at uc is at node. Recursion is bounded by the length of the paths */
+static int match_item (path_matcher* pm, unsigned n, cw_unpack_context* uc)
+{
+    const path_node *node = pm->nodes + n;
+    if (node->path >= 0)
+        return pm->handler (pm->user_data, node->path, uc);
+
+    cw_unpack_next (uc);
+    if (uc->return_code)
+        return uc->return_code;
+
+    /* when all keys or indexes are found and there is no wildcard the rest is skipped at once */
+    unsigned long visit = ++pm->visits;
+    unsigned found = 0;
+    long remains;
+    int rc, s;
+    if (uc->item.type == CWP_ITEM_ARRAY)
+    {
+        uint32_t i, size = uc->item.as.array.size;
+        for (i = 0; i < size; i++)
+        {
+            if (found == node->key_steps && node->any < 0)
+            {
+                cw_skip_items (uc, (long)(size - i));
+                break;
+            }
+            s = index_step (pm, node, i);
+            if (s < 0)
+                cw_skip_items (uc, 1);
+            else
+            {
+                found += take_step (pm, s, visit);
+                if ((rc = match_item (pm, pm->steps[s].to, uc)))
+                    return rc;
+            }
+            if (uc->return_code)
+                return uc->return_code;
+        }
+    }
+    else if (uc->item.type == CWP_ITEM_MAP)
+    {
+        remains = uc->item.as.map.size;
+        for (; remains; remains--)
+        {
+            if (found == node->key_steps && node->any < 0)
+            {
+                cw_skip_items (uc, 2 * remains);
+                break;
+            }
+            cw_unpack_next (uc);
+            if (uc->return_code)
+                return uc->return_code;
+            s = key_step (pm, node, &uc->item);
+            if (uc->item.type == CWP_ITEM_ARRAY)
+                cw_skip_items (uc, (long)uc->item.as.array.size);
+            else if (uc->item.type == CWP_ITEM_MAP)
+                cw_skip_items (uc, 2 * (long)uc->item.as.map.size);
+
+            if (s < 0)
+                cw_skip_items (uc, 1);
+            else
+            {
+                found += take_step (pm, s, visit);
+                if ((rc = match_item (pm, pm->steps[s].to, uc)))
+                    return rc;
+            }
+            if (uc->return_code)
+                return uc->return_code;
+        }
+    }
+    return uc->return_code;
+}
+
+
+int path_match_next (path_matcher* pm, cw_unpack_context* uc)
+{
+    if (uc->return_code)
+        return uc->return_code;
+    if (pm->nodes[0].path < 0 && pm->nodes[0].first_step < 0)
+    {
+        cw_skip_items (uc, 1);
+        return uc->return_code;
+    }
+    return match_item (pm, 0, uc);
+}
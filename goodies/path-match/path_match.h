@@ -0,0 +1,86 @@
+/*      CWPack/goodies - path_match.h   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef path_match_h
+#define path_match_h
+
+#include "cwpack.h"
+
+
+/*
+ * Paths are compiled to a matcher that finds them in one forward pass over an unpack
+ * context, memory or streaming. Everything off the paths is skipped with cw_skip_items.
+ *
+ *      $               the item
+ *      .key ["key"]    the value of a string key in a map
+ *      [3]             an array element
+ *      .* [*]          every value of a map, every element of an array
+ *
+ * When a key or index is on one path and a wildcard on another at the same place, the
+ * item follows the key or index.
+ */
+
+/*
+ * Called with the context positioned at a matched item. The callback must consume the
+ * item, e.g. with cw_unpack_next (and the children of a container) or cw_skip_items.
+ * Paths below a matched item are therefore not matched inside it. A non-zero return
+ * stops the pass and is returned by path_match_next.
+ */
+typedef int (*path_match_handler)(void* user_data, int path, cw_unpack_context* uc);
+
+typedef struct path_node path_node;
+typedef struct path_step path_step;
+
+typedef struct
+{
+    path_node           *nodes;
+    unsigned            node_count;
+    unsigned            node_capacity;
+    path_step           *steps;
+    unsigned            step_count;
+    unsigned            step_capacity;
+    char                *keys;
+    unsigned long       keys_length;
+    unsigned long       keys_capacity;
+    int                 path_count;
+    unsigned long       visits;
+    path_match_handler  handler;
+    void                *user_data;
+} path_matcher;
+
+
+int init_path_matcher (path_matcher* pm, path_match_handler handler, void* user_data);
+
+/* Returns the number of the path, counted from 0, or CWP_RC_MALFORMED_INPUT if it can't be parsed */
+int path_matcher_add (path_matcher* pm, const char* path);
+
+/* Matches the paths in the next item of uc */
+int path_match_next (path_matcher* pm, cw_unpack_context* uc);
+
+void terminate_path_matcher (path_matcher* pm);
+
+
+
+/*****************************************  E P I L O G U E  **********************************/
+
+
+#endif /* path_match_h */
@@ -0,0 +1,264 @@
+/*      CWPack/goodies - path_match_test.c   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cwpack.h"
+#include "basic_contexts.h"
+#include "path_match.h"
+
+
+#define MESSAGES 3000
+
+int error_count;
+char match_log[1000];
+
+static void ERROR(const char* msg)
+{
+    error_count++;
+    printf("ERROR: %s\n", msg);
+}
+
+
+static void ERROR1(const char* msg, int i)
+{
+    error_count++;
+    printf("ERROR: %s%d\n", msg, i);
+}
+
+
+/* Logs "path:value " for scalars and strings, "path:[n] " for containers */
+static int log_match (void* user_data, int path, cw_unpack_context* uc)
+{
+    char *log = match_log + strlen (match_log);
+    (void)user_data;
+    cw_unpack_next (uc);
+    switch (uc->item.type)
+    {
+        case CWP_ITEM_POSITIVE_INTEGER:
+            sprintf (log, "%d:%d ", path, (int)uc->item.as.u64);
+            break;
+
+        case CWP_ITEM_DOUBLE:
+            sprintf (log, "%d:%g ", path, uc->item.as.long_real);
+            break;
+
+        case CWP_ITEM_STR:
+            sprintf (log, "%d:%.*s ", path, (int)uc->item.as.str.length, (const char*)uc->item.as.str.start);
+            break;
+
+        case CWP_ITEM_ARRAY:
+            sprintf (log, "%d:[%d] ", path, (int)uc->item.as.array.size);
+            cw_skip_items (uc, (long)uc->item.as.array.size);
+            break;
+
+        case CWP_ITEM_MAP:
+            sprintf (log, "%d:{%d} ", path, (int)uc->item.as.map.size);
+            cw_skip_items (uc, 2 * (long)uc->item.as.map.size);
+            break;
+
+        default:
+            sprintf (log, "%d:? ", path);
+    }
+    return path == 99 ? CWP_RC_STOPPED : CWP_RC_OK;
+}
+
+
+/* {"user": {"id": i, "name": "n"}, "items": [{"price": 1.5, "qty": 2}, {"price": 2.5}, {"qty": 1}],
+    "tags": ["a", "b", "c", "d"], "with.dot": 5, "a": 1, "a": 2} */
+static void pack_message (cw_pack_context* pc, int i)
+{
+    cw_pack_map_size (pc, 6);
+    cw_pack_str (pc, "user", 4);
+    cw_pack_map_size (pc, 2);
+    cw_pack_str (pc, "id", 2);
+    cw_pack_unsigned (pc, (uint64_t)i);
+    cw_pack_str (pc, "name", 4);
+    cw_pack_str (pc, "n", 1);
+    cw_pack_str (pc, "items", 5);
+    cw_pack_array_size (pc, 3);
+    cw_pack_map_size (pc, 2);
+    cw_pack_str (pc, "price", 5);
+    cw_pack_double (pc, 1.5);
+    cw_pack_str (pc, "qty", 3);
+    cw_pack_unsigned (pc, 2);
+    cw_pack_map_size (pc, 1);
+    cw_pack_str (pc, "price", 5);
+    cw_pack_double (pc, 2.5);
+    cw_pack_map_size (pc, 1);
+    cw_pack_str (pc, "qty", 3);
+    cw_pack_unsigned (pc, 1);
+    cw_pack_str (pc, "tags", 4);
+    cw_pack_array_size (pc, 4);
+    cw_pack_str (pc, "a", 1);
+    cw_pack_str (pc, "b", 1);
+    cw_pack_str (pc, "c", 1);
+    cw_pack_str (pc, "d", 1);
+    cw_pack_str (pc, "with.dot", 8);
+    cw_pack_unsigned (pc, 5);
+    cw_pack_str (pc, "a", 1);
+    cw_pack_unsigned (pc, 1);
+    cw_pack_str (pc, "a", 1);
+    cw_pack_unsigned (pc, 2);
+}
+
+
+/* Matches the paths in one message followed by a sentinel and compares the log */
+static void check_paths (const char** paths, const char* expected)
+{
+    static uint8_t buffer[1000];
+    path_matcher pm;
+    cw_pack_context pc;
+    cw_unpack_context uc;
+    int i;
+
+    cw_pack_context_init (&pc, buffer, sizeof(buffer), 0);
+    pack_message (&pc, 7);
+    cw_pack_unsigned (&pc, 4711);
+    init_path_matcher (&pm, log_match, NULL);
+    for (i = 0; paths[i]; i++)
+        if (path_matcher_add (&pm, paths[i]) != i)
+            printf("ERROR: path %s\n", paths[i]), error_count++;
+
+    match_log[0] = 0;
+    cw_unpack_context_init (&uc, buffer, (unsigned long)(pc.current - pc.start), 0);
+    if (path_match_next (&pm, &uc) || strcmp (match_log, expected))
+        printf("ERROR: matched \"%s\" expected \"%s\"\n", match_log, expected), error_count++;
+    cw_unpack_next (&uc);
+    if (uc.return_code || uc.item.as.u64 != 4711)
+        printf("ERROR: context after %s\n", paths[0]), error_count++;
+    terminate_path_matcher (&pm);
+}
+
+
+static int sum_ids (void* user_data, int path, cw_unpack_context* uc)
+{
+    long *sums = (long*)user_data;
+    sums[path] += (long)cw_look_ahead (uc) == CWP_ITEM_STR ? 1000000 : 0;
+    cw_unpack_next (uc);
+    if (uc->item.type == CWP_ITEM_POSITIVE_INTEGER)
+        sums[path] += (long)uc->item.as.u64;
+    else if (uc->item.type == CWP_ITEM_DOUBLE)
+        sums[path] += (long)(uc->item.as.long_real * 2);
+    return CWP_RC_OK;
+}
+
+
+int main(int argc, const char * argv[])
+{
+    (void)argc; (void)argv;
+    printf("CWPack path match test started.\n");
+    error_count = 0;
+
+    const char *p1[] = {"$.user.id", "$.items[*].price", "$.tags[3]", NULL};
+    check_paths (p1, "0:7 1:1.5 1:2.5 2:d ");
+    const char *p2[] = {"$[\"with.dot\"]", "$.a", "$.user", "$.missing.x", "$.tags.x", "$.user.id.x", NULL};
+    check_paths (p2, "2:{2} 0:5 1:1 1:2 ");
+    const char *p3[] = {"$.items[*].price", "$.items[0].qty", "$.tags[0]", "$.tags[2]", "$.tags[7]", NULL};
+    check_paths (p3, "1:2 0:2.5 2:a 3:c ");
+    const char *p4[] = {"$.*", NULL};
+    check_paths (p4, "0:{2} 0:[3] 0:[4] 0:5 0:1 0:2 ");
+    const char *p5[] = {"$.items[*].*", "$.user.name", NULL};
+    check_paths (p5, "1:n 0:1.5 0:2 0:2.5 0:1 ");
+    const char *p6[] = {"$", NULL};
+    check_paths (p6, "0:{6} ");
+    const char *p7[] = {NULL};
+    check_paths (p7, "");
+
+    path_matcher pm;
+    init_path_matcher (&pm, log_match, NULL);
+    if (path_matcher_add (&pm, "$.") != CWP_RC_MALFORMED_INPUT || path_matcher_add (&pm, "$[x]") != CWP_RC_MALFORMED_INPUT ||
+        path_matcher_add (&pm, "$[\"a]") != CWP_RC_MALFORMED_INPUT || path_matcher_add (&pm, "$..a") != CWP_RC_MALFORMED_INPUT ||
+        path_matcher_add (&pm, "a") != CWP_RC_MALFORMED_INPUT || path_matcher_add (&pm, "$[-1]") != CWP_RC_MALFORMED_INPUT)
+        ERROR("Malformed paths");
+    if (path_matcher_add (&pm, "$.a.b") != 0 || path_matcher_add (&pm, "$.a[\"b\"]") != 0 || path_matcher_add (&pm, "$.a") != 1)
+        ERROR("Path numbers");
+    terminate_path_matcher (&pm);
+
+    /* a stop from the handler */
+    {
+        static uint8_t buffer[1000];
+        cw_pack_context pc;
+        cw_unpack_context uc;
+        cw_pack_context_init (&pc, buffer, sizeof(buffer), 0);
+        pack_message (&pc, 1);
+        init_path_matcher (&pm, log_match, NULL);
+        pm.path_count = 99;
+        path_matcher_add (&pm, "$.user.id");
+        match_log[0] = 0;
+        cw_unpack_context_init (&uc, buffer, (unsigned long)(pc.current - pc.start), 0);
+        if (path_match_next (&pm, &uc) != CWP_RC_STOPPED || strcmp (match_log, "99:1 "))
+            ERROR("Stop");
+        terminate_path_matcher (&pm);
+    }
+
+    /* streaming from a file through a small buffer */
+    {
+        char path[] = "/tmp/cwpack_path_match_XXXXXX";
+        int fd = mkstemp (path);
+        unlink (path);
+        file_pack_context fpc;
+        file_unpack_context fuc;
+        long sums[3] = {0, 0, 0};
+        int i;
+
+        init_file_pack_context (&fpc, 64, fd);
+        for (i = 0; i < MESSAGES; i++)
+            pack_message (&fpc.pc, i);
+        terminate_file_pack_context (&fpc);
+        lseek (fd, 0, SEEK_SET);
+
+        init_path_matcher (&pm, sum_ids, sums);
+        path_matcher_add (&pm, "$.user.id");
+        path_matcher_add (&pm, "$.items[*].price");
+        path_matcher_add (&pm, "$.user.name");
+        init_file_unpack_context (&fuc, 16, fd);
+        for (i = 0; !path_match_next (&pm, &fuc.uc); i++);
+        if (i != MESSAGES || fuc.uc.return_code != CWP_RC_END_OF_INPUT)
+            ERROR1("Streamed messages ", i);
+        if (sums[0] != (long)MESSAGES * (MESSAGES - 1) / 2 || sums[1] != 8 * MESSAGES || sums[2] != 1000000L * MESSAGES)
+            ERROR("Streamed matches");
+        terminate_file_unpack_context (&fuc);
+        terminate_path_matcher (&pm);
+        close (fd);
+    }
+
+    printf("CWPack path match test completed, ");
+    switch (error_count)
+    {
+        case 0:
+            printf("no errors detected\n");
+            break;
+
+        case 1:
+            printf("1 error detected\n");
+            break;
+
+        default:
+            printf("%d errors detected\n", error_count);
+            break;
+    }
+
+    return error_count;
+}
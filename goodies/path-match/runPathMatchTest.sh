@@ -0,0 +1,3 @@
+clang -I ../../src/ -I ../basic-contexts/ -o pathMatchTest *.c ../../src/cwpack.c ../basic-contexts/basic_contexts.c
+./pathMatchTest
+rm -f *.o pathMatchTest
@@ -0,0 +1,188 @@
+/*      CWPack/goodies - projection.c   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "cwpack_utils.h"
+#include "projection.h"
+
+
+struct projection_field
+{
+    projection_type     type;
+    size_t              offset;
+    size_t              size;
+    unsigned long       decode;         /* the last decode that set the field */
+};
+
+
+static const size_t type_sizes[] =
+{
+    sizeof(bool),
+    sizeof(int8_t), sizeof(int16_t), sizeof(int32_t), sizeof(int64_t),
+    sizeof(uint8_t), sizeof(uint16_t), sizeof(uint32_t), sizeof(uint64_t),
+    sizeof(float), sizeof(double), sizeof(double),
+    sizeof(cwpack_blob),
+    0                                   /* any size > 0 */
+};
+
+
+/*******************************   D E C O D E   ******************************/
+
+
+#define STORE(ctype, getter)                                \
+    {                                                       \
+        ctype v = getter (uc);                              \
+        if (uc->return_code)                                \
+            return uc->return_code;                         \
+        *(ctype*)member = v;                                \
+    }                                                       \
+    break
+
+static int decode_field (void* user_data, int path, cw_unpack_context* uc)
+{
+    projection *pr = (projection*)user_data;
+    projection_field *field = pr->fields + path;
+    char *member = pr->record + field->offset;
+
+    if (cw_look_ahead (uc) == CWP_ITEM_NIL)
+    {
+        cw_skip_items (uc, 1);
+        return uc->return_code;
+    }
+    switch (field->type)
+    {
+        case PROJECTION_BOOLEAN:        STORE (bool, cw_unpack_next_boolean);
+        case PROJECTION_INT8:           STORE (int8_t, cw_unpack_next_signed8);
+        case PROJECTION_INT16:          STORE (int16_t, cw_unpack_next_signed16);
+        case PROJECTION_INT32:          STORE (int32_t, cw_unpack_next_signed32);
+        case PROJECTION_INT64:          STORE (int64_t, cw_unpack_next_signed64);
+        case PROJECTION_UINT8:          STORE (uint8_t, cw_unpack_next_unsigned8);
+        case PROJECTION_UINT16:         STORE (uint16_t, cw_unpack_next_unsigned16);
+        case PROJECTION_UINT32:         STORE (uint32_t, cw_unpack_next_unsigned32);
+        case PROJECTION_UINT64:         STORE (uint64_t, cw_unpack_next_unsigned64);
+        case PROJECTION_FLOAT:          STORE (float, cw_unpack_next_float);
+        case PROJECTION_DOUBLE:         STORE (double, cw_unpack_next_double);
+        case PROJECTION_TIME_INTERVAL:  STORE (double, cw_unpack_next_time_interval);
+
+        case PROJECTION_BLOB:
+            cw_unpack_next (uc);
+            if (uc->return_code)
+                return uc->return_code;
+            if (uc->item.type == CWP_ITEM_STR)
+                *(cwpack_blob*)member = uc->item.as.str;
+            else if (uc->item.type == CWP_ITEM_BIN)
+                *(cwpack_blob*)member = uc->item.as.bin;
+            else
+                return uc->return_code = CWP_RC_TYPE_ERROR;
+            break;
+
+        case PROJECTION_CSTR:
+        {
+            unsigned int length = cw_unpack_next_str_lengh (uc);
+            if (uc->return_code)
+                return uc->return_code;
+            if (length >= field->size)
+                return uc->return_code = CWP_RC_VALUE_ERROR;
+            memcpy (member, uc->item.as.str.start, length);
+            member[length] = 0;
+            break;
+        }
+    }
+    field->decode = pr->decodes;
+    return 0;
+}
+
+
+int projection_decode (projection* pr, cw_unpack_context* uc, void* record)
+{
+    pr->record = (char*)record;
+    pr->decodes++;
+    return path_match_next (&pr->matcher, uc);
+}
+
+
+bool projection_found (const projection* pr, int field)
+{
+    return field >= 0 && field < pr->field_count && pr->fields[field].decode == pr->decodes;
+}
+
+
+/*******************************   S E T U P   ********************************/
+
+
+int init_projection (projection* pr)
+{
+    memset (pr, 0, sizeof(projection));
+    pr->field_capacity = 8;
+    pr->fields = malloc ((size_t)pr->field_capacity * sizeof(projection_field));
+    if (!pr->fields)
+        return CWP_RC_MALLOC_ERROR;
+    int rc = init_path_matcher (&pr->matcher, decode_field, pr);
+    if (rc < 0)
+    {
+        free (pr->fields);
+        pr->fields = NULL;
+        return rc;
+    }
+    return 0;
+}
+
+
+int projection_add (projection* pr, const char* path, projection_type type, size_t offset, size_t size)
+{
+    if (type < PROJECTION_BOOLEAN || type > PROJECTION_CSTR)
+        return CWP_RC_ILLEGAL_CALL;
+    if (type_sizes[type] ? size != type_sizes[type] : !size)
+        return CWP_RC_ILLEGAL_CALL;
+
+    if (pr->field_count == pr->field_capacity)
+    {
+        int capacity = 2 * pr->field_capacity;
+        projection_field *fields = realloc (pr->fields, (size_t)capacity * sizeof(projection_field));
+        if (!fields)
+            return CWP_RC_MALLOC_ERROR;
+        pr->fields = fields;
+        pr->field_capacity = capacity;
+    }
+    int n = path_matcher_add (&pr->matcher, path);
+    if (n < 0)
+        return n;
+    if (n < pr->field_count)
+        return CWP_RC_ILLEGAL_CALL;
+
+    projection_field *field = pr->fields + pr->field_count;
+    field->type = type;
+    field->offset = offset;
+    field->size = size;
+    field->decode = 0;
+    return pr->field_count++;
+}
+
+
+void terminate_projection (projection* pr)
+{
+    terminate_path_matcher (&pr->matcher);
+    free (pr->fields);
+    pr->fields = NULL;
+    pr->field_count = 0;
+}
@@ -0,0 +1,98 @@
+/*      CWPack/goodies - projection.h   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef projection_h
+#define projection_h
+
+#include <stddef.h>
+
+#include "cwpack.h"
+#include "path_match.h"
+
+
+/*
+ * A projection decodes a few fields of each message directly into a C struct. The fields
+ * are given as key paths (see path_match.h) with the offset and type of their member;
+ * everything else in the message is skipped without being decoded.
+ */
+
+typedef enum
+{
+    PROJECTION_BOOLEAN,         /* bool */
+    PROJECTION_INT8,
+    PROJECTION_INT16,
+    PROJECTION_INT32,
+    PROJECTION_INT64,
+    PROJECTION_UINT8,
+    PROJECTION_UINT16,
+    PROJECTION_UINT32,
+    PROJECTION_UINT64,
+    PROJECTION_FLOAT,
+    PROJECTION_DOUBLE,
+    PROJECTION_TIME_INTERVAL,   /* double, seconds since epoch, from a timestamp */
+    PROJECTION_BLOB,            /* cwpack_blob referring to a str or bin in the context's buffer */
+    PROJECTION_CSTR             /* char array, the str is copied and terminated with NUL */
+} projection_type;
+
+typedef struct projection_field projection_field;
+
+typedef struct
+{
+    path_matcher        matcher;
+    projection_field    *fields;
+    int                 field_count;
+    int                 field_capacity;
+    unsigned long       decodes;
+    char                *record;
+} projection;
+
+
+int init_projection (projection* pr);
+
+/*
+ * Returns the number of the field, counted from 0. The size is the size of the member;
+ * CWP_RC_ILLEGAL_CALL is returned if it doesn't fit the type, or if the path is already
+ * in the projection. CWP_RC_MALFORMED_INPUT is returned if the path can't be parsed.
+ */
+int projection_add (projection* pr, const char* path, projection_type type, size_t offset, size_t size);
+
+#define projection_add_member(pr, path, type, struct_type, member) \
+    projection_add ((pr), (path), (type), offsetof(struct_type, member), sizeof(((struct_type*)0)->member))
+
+/*
+ * Decodes the next item of uc into record. Members whose paths aren't in the item, or
+ * have the value nil, are left as they are. A value of another type gives CWP_RC_TYPE_ERROR
+ * and one that is out of range for its member CWP_RC_VALUE_ERROR, and ends the decode.
+ */
+int projection_decode (projection* pr, cw_unpack_context* uc, void* record);
+
+/* If the field was set by the last decode */
+bool projection_found (const projection* pr, int field);
+
+void terminate_projection (projection* pr);
+
+
+
+/*****************************************  E P I L O G U E  **********************************/
+
+
+#endif /* projection_h */
@@ -0,0 +1,279 @@
+/*      CWPack/goodies - projection_test.c   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cwpack.h"
+#include "cwpack_utils.h"
+#include "basic_contexts.h"
+#include "projection.h"
+
+
+#define MESSAGES 3000
+#define FILLER_FIELDS 40
+
+int error_count;
+
+static void ERROR(const char* msg)
+{
+    error_count++;
+    printf("ERROR: %s\n", msg);
+}
+
+
+static void ERROR1(const char* msg, int i)
+{
+    error_count++;
+    printf("ERROR: %s%d\n", msg, i);
+}
+
+
+typedef struct
+{
+    int64_t         id;
+    char            user[8];
+    double          price;
+    uint16_t        qty;
+    bool            paid;
+    double          time;
+    float           lat;
+    cwpack_blob     payload;
+    int8_t          level;
+} event;
+
+
+/* An event with filler fields around the wanted ones. The note is nil and "geo" has no "lat" when i is odd */
+static void pack_event (cw_pack_context* pc, int i)
+{
+    char key[16];
+    int f;
+    cw_pack_map_size (pc, FILLER_FIELDS + 9);
+    for (f = 0; f < FILLER_FIELDS; f++)
+    {
+        sprintf (key, "filler_%d", f);
+        cw_pack_cstr (pc, key);
+        if (f % 3)
+            cw_pack_signed (pc, -f);
+        else
+        {
+            cw_pack_array_size (pc, 2);
+            cw_pack_cstr (pc, "id");
+            cw_pack_double (pc, f);
+        }
+        if (f == FILLER_FIELDS / 2)
+        {
+            cw_pack_cstr (pc, "id");
+            cw_pack_signed (pc, -i);
+            cw_pack_cstr (pc, "user");
+            cw_pack_cstr (pc, i % 2 ? "bob" : "alice");
+        }
+    }
+    cw_pack_cstr (pc, "price");
+    cw_pack_double (pc, i + 0.5);
+    cw_pack_cstr (pc, "qty");
+    cw_pack_unsigned (pc, (uint64_t)i % 100);
+    cw_pack_cstr (pc, "paid");
+    cw_pack_boolean (pc, i % 2 == 0);
+    cw_pack_cstr (pc, "time");
+    cw_pack_time (pc, 1000 + i, 500000000);
+    cw_pack_cstr (pc, "geo");
+    cw_pack_map_size (pc, i % 2 ? 1 : 2);
+    cw_pack_cstr (pc, "lon");
+    cw_pack_float (pc, 2.5f);
+    if (i % 2 == 0)
+    {
+        cw_pack_cstr (pc, "lat");
+        cw_pack_float (pc, (float)i);
+    }
+    cw_pack_cstr (pc, "payload");
+    cw_pack_bin (pc, "\1\2\3", 3);
+    cw_pack_cstr (pc, "note");
+    if (i % 2)
+        cw_pack_nil (pc);
+    else
+        cw_pack_cstr (pc, "x");
+}
+
+
+static void init_event_projection (projection* pr)
+{
+    init_projection (pr);
+    if (projection_add_member (pr, "$.id", PROJECTION_INT64, event, id) != 0 ||
+        projection_add_member (pr, "$.user", PROJECTION_CSTR, event, user) != 1 ||
+        projection_add_member (pr, "$.price", PROJECTION_DOUBLE, event, price) != 2 ||
+        projection_add_member (pr, "$.qty", PROJECTION_UINT16, event, qty) != 3 ||
+        projection_add_member (pr, "$.paid", PROJECTION_BOOLEAN, event, paid) != 4 ||
+        projection_add_member (pr, "$.time", PROJECTION_TIME_INTERVAL, event, time) != 5 ||
+        projection_add_member (pr, "$.geo.lat", PROJECTION_FLOAT, event, lat) != 6 ||
+        projection_add_member (pr, "$.payload", PROJECTION_BLOB, event, payload) != 7 ||
+        projection_add_member (pr, "$.note", PROJECTION_BLOB, event, payload) != 8)
+        ERROR("Adding members");
+}
+
+
+/* Decodes a single {key: value} map packed by pack into a fresh event */
+static int decode_one (projection* pr, void (*pack)(cw_pack_context*), event* e)
+{
+    static uint8_t buffer[100];
+    cw_pack_context pc;
+    cw_unpack_context uc;
+    cw_pack_context_init (&pc, buffer, sizeof(buffer), 0);
+    pack (&pc);
+    memset (e, 0, sizeof(event));
+    cw_unpack_context_init (&uc, buffer, (unsigned long)(pc.current - pc.start), 0);
+    return projection_decode (pr, &uc, e);
+}
+
+static void pack_string_id (cw_pack_context* pc)    { cw_pack_map_size (pc, 1); cw_pack_cstr (pc, "id"); cw_pack_cstr (pc, "7"); }
+static void pack_big_qty (cw_pack_context* pc)      { cw_pack_map_size (pc, 1); cw_pack_cstr (pc, "qty"); cw_pack_unsigned (pc, 70000); }
+static void pack_long_user (cw_pack_context* pc)    { cw_pack_map_size (pc, 1); cw_pack_cstr (pc, "user"); cw_pack_cstr (pc, "12345678"); }
+static void pack_short_user (cw_pack_context* pc)   { cw_pack_map_size (pc, 1); cw_pack_cstr (pc, "user"); cw_pack_cstr (pc, "1234567"); }
+static void pack_int_price (cw_pack_context* pc)    { cw_pack_map_size (pc, 1); cw_pack_cstr (pc, "price"); cw_pack_signed (pc, -3); }
+static void pack_array (cw_pack_context* pc)        { cw_pack_array_size (pc, 1); cw_pack_cstr (pc, "id"); }
+
+
+int main(int argc, const char * argv[])
+{
+    (void)argc; (void)argv;
+    printf("CWPack projection test started.\n");
+    error_count = 0;
+
+    projection pr;
+    event e;
+    int i;
+
+    /* one event in memory */
+    {
+        static uint8_t buffer[2000];
+        cw_pack_context pc;
+        cw_unpack_context uc;
+        cw_pack_context_init (&pc, buffer, sizeof(buffer), 0);
+        pack_event (&pc, 4);
+        pack_event (&pc, 5);
+        cw_pack_unsigned (&pc, 4711);
+
+        init_event_projection (&pr);
+        cw_unpack_context_init (&uc, buffer, (unsigned long)(pc.current - pc.start), 0);
+        memset (&e, 0, sizeof(event));
+        if (projection_decode (&pr, &uc, &e))
+            ERROR("Decode");
+        if (e.id != -4 || strcmp (e.user, "alice") || e.price != 4.5 || e.qty != 4 || !e.paid ||
+            e.time != 1004.5 || e.lat != 4.0f || e.payload.length != 1 || memcmp (e.payload.start, "x", 1))
+            ERROR("Decoded values");
+        for (i = 0; i < 9; i++)
+            if (!projection_found (&pr, i))
+                ERROR1("Found ", i);
+
+        e.level = 17;
+        e.lat = 99;
+        if (projection_decode (&pr, &uc, &e))
+            ERROR("Decode 2");
+        if (e.id != -5 || strcmp (e.user, "bob") || e.paid || e.lat != 99 || e.level != 17 ||
+            e.payload.length != 3 || memcmp (e.payload.start, "\1\2\3", 3))
+            ERROR("Decoded values 2");
+        if (projection_found (&pr, 6) || projection_found (&pr, 8) || !projection_found (&pr, 7) || projection_found (&pr, 9))
+            ERROR("Missing and nil");
+        if (cw_unpack_next_unsigned32 (&uc) != 4711 || uc.return_code)
+            ERROR("Context after decode");
+        terminate_projection (&pr);
+    }
+
+    /* values that don't fit */
+    init_event_projection (&pr);
+    if (decode_one (&pr, pack_string_id, &e) != CWP_RC_TYPE_ERROR || e.id)
+        ERROR("String to integer");
+    if (decode_one (&pr, pack_big_qty, &e) != CWP_RC_VALUE_ERROR || e.qty)
+        ERROR("Integer out of range");
+    if (decode_one (&pr, pack_long_user, &e) != CWP_RC_VALUE_ERROR || e.user[0])
+        ERROR("String too long");
+    if (decode_one (&pr, pack_short_user, &e) || strcmp (e.user, "1234567"))
+        ERROR("String that fits");
+    if (decode_one (&pr, pack_int_price, &e) || e.price != -3)
+        ERROR("Integer to double");
+    if (decode_one (&pr, pack_array, &e) || projection_found (&pr, 0))
+        ERROR("Not a map");
+
+    if (projection_add (&pr, "$.qty", PROJECTION_UINT32, 0, sizeof(uint32_t)) != CWP_RC_ILLEGAL_CALL ||
+        projection_add (&pr, "$[\"qty\"]", PROJECTION_UINT32, 0, sizeof(uint32_t)) != CWP_RC_ILLEGAL_CALL)
+        ERROR("Duplicate path");
+    if (projection_add (&pr, "$.x", PROJECTION_UINT32, 0, sizeof(uint16_t)) != CWP_RC_ILLEGAL_CALL ||
+        projection_add (&pr, "$.x", PROJECTION_CSTR, 0, 0) != CWP_RC_ILLEGAL_CALL ||
+        projection_add (&pr, "$.x", (projection_type)99, 0, 1) != CWP_RC_ILLEGAL_CALL)
+        ERROR("Member size");
+    if (projection_add (&pr, "$.", PROJECTION_UINT32, 0, sizeof(uint32_t)) != CWP_RC_MALFORMED_INPUT)
+        ERROR("Malformed path");
+    if (projection_add_member (&pr, "$.level", PROJECTION_INT8, event, level) != 9)
+        ERROR("Field number after errors");
+    terminate_projection (&pr);
+
+    /* streaming from a file through a small buffer */
+    {
+        char path[] = "/tmp/cwpack_projection_XXXXXX";
+        int fd = mkstemp (path);
+        unlink (path);
+        file_pack_context fpc;
+        file_unpack_context fuc;
+        long ids = 0, bobs = 0, lats = 0;
+
+        init_file_pack_context (&fpc, 64, fd);
+        for (i = 0; i < MESSAGES; i++)
+            pack_event (&fpc.pc, i);
+        terminate_file_pack_context (&fpc);
+        lseek (fd, 0, SEEK_SET);
+
+        init_event_projection (&pr);
+        init_file_unpack_context (&fuc, 32, fd);
+        for (i = 0; !projection_decode (&pr, &fuc.uc, &e); i++)
+        {
+            ids -= e.id;
+            bobs += !strcmp (e.user, "bob");
+            lats += projection_found (&pr, 6);
+        }
+        if (i != MESSAGES || fuc.uc.return_code != CWP_RC_END_OF_INPUT)
+            ERROR1("Streamed messages ", i);
+        if (ids != (long)MESSAGES * (MESSAGES - 1) / 2 || bobs != MESSAGES / 2 || lats != MESSAGES / 2)
+            ERROR("Streamed values");
+        terminate_file_unpack_context (&fuc);
+        terminate_projection (&pr);
+        close (fd);
+    }
+
+    printf("CWPack projection test completed, ");
+    switch (error_count)
+    {
+        case 0:
+            printf("no errors detected\n");
+            break;
+
+        case 1:
+            printf("1 error detected\n");
+            break;
+
+        default:
+            printf("%d errors detected\n", error_count);
+            break;
+    }
+
+    return error_count;
+}
@@ -0,0 +1,3 @@
+clang -I ../../src/ -I ../basic-contexts/ -I ../path-match/ -I ../utils/ -o projectionTest *.c ../../src/cwpack.c ../basic-contexts/basic_contexts.c ../path-match/path_match.c ../utils/cwpack_utils.c
+./projectionTest
+rm -f *.o projectionTest
@@ -0,0 +1,330 @@
+/*      CWPack/goodies - record_log.c   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#include "record_log.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <nmmintrin.h>
+#define CRC32C_X86
+#elif defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define CRC32C_ARM
+#endif
+
+
+
+/*****************************************  CRC32C  *******************************************/
+
+
+static uint32_t crc32c_table[256];
+
+static uint32_t crc32c_bytes (uint32_t crc, const uint8_t* p, unsigned long length)
+{
+    while (length--)
+        crc = crc32c_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    return crc;
+}
+
+#ifdef CRC32C_X86
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42 (uint32_t crc, const uint8_t* p, unsigned long length)
+{
+    uint64_t c = crc;
+    for (; length >= 8; length -= 8, p += 8)
+    {
+        uint64_t w;
+        memcpy (&w, p, 8);
+        c = _mm_crc32_u64 (c, w);
+    }
+    crc = (uint32_t)c;
+    while (length--)
+        crc = _mm_crc32_u8 (crc, *p++);
+    return crc;
+}
+#endif
+
+#ifdef CRC32C_ARM
+static uint32_t crc32c_arm (uint32_t crc, const uint8_t* p, unsigned long length)
+{
+    for (; length >= 8; length -= 8, p += 8)
+    {
+        uint64_t w;
+        memcpy (&w, p, 8);
+        crc = __crc32cd (crc, w);
+    }
+    while (length--)
+        crc = __crc32cb (crc, *p++);
+    return crc;
+}
+#endif
+
+static uint32_t crc32c_select (uint32_t crc, const uint8_t* p, unsigned long length);
+static uint32_t (*crc32c_update)(uint32_t crc, const uint8_t* p, unsigned long length) = crc32c_select;
+
+static uint32_t crc32c_select (uint32_t crc, const uint8_t* p, unsigned long length)
+{
+    uint32_t i, k;
+    for (i = 0; i < 256; i++)
+    {
+        uint32_t c = i;
+        for (k = 0; k < 8; k++)
+            c = c & 1 ? (c >> 1) ^ 0x82f63b78 : c >> 1;
+        crc32c_table[i] = c;
+    }
+    crc32c_update = crc32c_bytes;
+#ifdef CRC32C_X86
+    if (__builtin_cpu_supports ("sse4.2"))
+        crc32c_update = crc32c_sse42;
+#endif
+#ifdef CRC32C_ARM
+    crc32c_update = crc32c_arm;
+#endif
+    return crc32c_update (crc, p, length);
+}
+
+
+uint32_t record_log_crc32c (uint32_t crc, const void* data, unsigned long length)
+{
+    return ~crc32c_update (~crc, (const uint8_t*)data, length);
+}
+
+
+static uint32_t frame_crc (const uint8_t* frame, unsigned long length)
+{
+    uint32_t crc = crc32c_update (0xffffffff, frame + 1, 5);
+    return ~crc32c_update (crc, frame + RECORD_LOG_FRAME_LENGTH, length);
+}
+
+
+static uint32_t get_be32 (const uint8_t* p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+
+static void put_be32 (uint8_t* p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+
+
+/*****************************************  RECORD LOG PACK CONTEXT  **************************/
+
+
+void init_record_log_pack_context (record_log_pack_context* rlpc, unsigned long initial_buffer_length, int fileDescriptor)
+{
+    init_file_pack_context (&rlpc->fpc, initial_buffer_length, fileDescriptor);
+    rlpc->sync_policy = RECORD_LOG_SYNC_NONE;
+    rlpc->group_records = 0;
+    rlpc->group_interval_ms = 0;
+    rlpc->unsynced_records = 0;
+    clock_gettime (CLOCK_MONOTONIC, &rlpc->last_sync);
+}
+
+
+void record_log_pack_context_set_sync_policy (record_log_pack_context* rlpc, record_log_sync_policy policy,
+                                              unsigned long group_records, unsigned long group_interval_ms)
+{
+    rlpc->sync_policy = policy;
+    rlpc->group_records = group_records;
+    rlpc->group_interval_ms = group_interval_ms;
+}
+
+
+void record_log_pack_context_begin_record (record_log_pack_context* rlpc, uint8_t flags)
+{
+    cw_pack_context* pc = (cw_pack_context*)rlpc;
+    uint8_t frame[RECORD_LOG_FRAME_LENGTH] = {RECORD_LOG_MARK};
+    frame[1] = flags;
+    if (pc->return_code)
+        return;
+
+    /* the frame is kept in the buffer until end_record has filled it in */
+    file_pack_context_set_barrier (&rlpc->fpc);
+    cw_pack_insert (pc, frame, RECORD_LOG_FRAME_LENGTH);
+}
+
+
+int record_log_pack_context_sync (record_log_pack_context* rlpc)
+{
+    cw_pack_context* pc = (cw_pack_context*)rlpc;
+    cw_pack_flush (pc);
+    if (pc->return_code)
+        return pc->return_code;
+
+#if defined(__linux__)
+    if (fdatasync (rlpc->fpc.fileDescriptor))
+#elif defined(__APPLE__)
+    if (fcntl (rlpc->fpc.fileDescriptor, F_FULLFSYNC) && fsync (rlpc->fpc.fileDescriptor))
+#else
+    if (fsync (rlpc->fpc.fileDescriptor))
+#endif
+    {
+        pc->err_no = errno;
+        return pc->return_code = CWP_RC_ERROR_IN_HANDLER;
+    }
+    rlpc->unsynced_records = 0;
+    clock_gettime (CLOCK_MONOTONIC, &rlpc->last_sync);
+    return CWP_RC_OK;
+}
+
+
+void record_log_pack_context_end_record (record_log_pack_context* rlpc)
+{
+    cw_pack_context* pc = (cw_pack_context*)rlpc;
+    uint8_t *frame = rlpc->fpc.barrier;
+    if (pc->return_code || !frame)
+        return;
+
+    unsigned long length = (unsigned long)(pc->current - frame) - RECORD_LOG_FRAME_LENGTH;
+    if (length > 0xffffffffUL)
+    {
+        pc->return_code = CWP_RC_VALUE_ERROR;
+        return;
+    }
+    put_be32 (frame + 2, (uint32_t)length);
+    put_be32 (frame + 6, frame_crc (frame, length));
+    file_pack_context_release_barrier (&rlpc->fpc);
+
+    rlpc->unsynced_records++;
+    if (rlpc->sync_policy == RECORD_LOG_SYNC_EVERY_RECORD)
+        record_log_pack_context_sync (rlpc);
+    else if (rlpc->sync_policy == RECORD_LOG_SYNC_GROUP)
+    {
+        struct timespec now;
+        clock_gettime (CLOCK_MONOTONIC, &now);
+        long elapsed_ms = (long)(now.tv_sec - rlpc->last_sync.tv_sec) * 1000 + (now.tv_nsec - rlpc->last_sync.tv_nsec) / 1000000L;
+        if ((rlpc->group_records && rlpc->unsynced_records >= rlpc->group_records) ||
+            (rlpc->group_interval_ms && elapsed_ms >= (long)rlpc->group_interval_ms))
+            record_log_pack_context_sync (rlpc);
+    }
+}
+
+
+void terminate_record_log_pack_context (record_log_pack_context* rlpc)
+{
+    /* an unfinished record is dropped */
+    if (rlpc->fpc.barrier)
+        rlpc->fpc.pc.current = rlpc->fpc.barrier;
+    rlpc->fpc.barrier = NULL;
+    if (rlpc->sync_policy != RECORD_LOG_SYNC_NONE && rlpc->unsynced_records)
+        record_log_pack_context_sync (rlpc);
+    terminate_file_pack_context (&rlpc->fpc);
+}
+
+
+
+/*****************************************  RECORD LOG UNPACK CONTEXT  ************************/
+
+/*
+ * The file unpack context is only used as a read buffer. A frame and its payload are
+ * made available in the buffer and checked before the record is handed out in uc.
+ * A frame that doesn't check out is passed one byte at a time until the next mark.
+ */
+
+static int make_available (cw_unpack_context* fuc, unsigned long n)
+{
+    if ((unsigned long)(fuc->end - fuc->current) >= n)
+        return CWP_RC_OK;
+    return fuc->handle_unpack_underflow (fuc, n);
+}
+
+
+void init_record_log_unpack_context (record_log_unpack_context* rluc, unsigned long initial_buffer_length, int fileDescriptor)
+{
+    off_t offset = lseek (fileDescriptor, 0, SEEK_CUR);
+    init_file_unpack_context (&rluc->fuc, initial_buffer_length, fileDescriptor);
+    rluc->flags = 0;
+    rluc->max_record_length = 64UL * 1024 * 1024;
+    rluc->offset = rluc->valid_end = offset > 0 ? (unsigned long long)offset : 0;
+    rluc->skipped_bytes = 0;
+    cw_unpack_context_init (&rluc->uc, rluc->fuc.uc.start, 0, 0);
+    if (rluc->fuc.uc.return_code)
+        rluc->uc.return_code = rluc->fuc.uc.return_code;
+}
+
+
+int record_log_unpack_context_next_record (record_log_unpack_context* rluc)
+{
+    cw_unpack_context *fuc = &rluc->fuc.uc;
+    if (rluc->uc.return_code == CWP_RC_MALLOC_ERROR)
+        return CWP_RC_MALLOC_ERROR;
+
+    /* skip the current record */
+    unsigned long current_length = (unsigned long)(rluc->uc.end - rluc->uc.start);
+    if (current_length || rluc->valid_end > rluc->offset)
+    {
+        fuc->current += RECORD_LOG_FRAME_LENGTH + current_length;
+        rluc->offset += RECORD_LOG_FRAME_LENGTH + current_length;
+    }
+    rluc->uc.start = rluc->uc.current = rluc->uc.end = fuc->current;
+
+    for (;;)
+    {
+        int rc = make_available (fuc, RECORD_LOG_FRAME_LENGTH);
+        if (rc == CWP_RC_OK && *fuc->current == RECORD_LOG_MARK)
+        {
+            uint32_t length = get_be32 (fuc->current + 2);
+            if (length <= rluc->max_record_length)
+            {
+                rc = make_available (fuc, RECORD_LOG_FRAME_LENGTH + length);
+                if (rc == CWP_RC_OK && get_be32 (fuc->current + 6) == frame_crc (fuc->current, length))
+                {
+                    rluc->flags = fuc->current[1];
+                    rluc->valid_end = rluc->offset + RECORD_LOG_FRAME_LENGTH + length;
+                    cw_unpack_context_init (&rluc->uc, fuc->current + RECORD_LOG_FRAME_LENGTH, length, 0);
+                    return CWP_RC_OK;
+                }
+            }
+        }
+        if (rc == CWP_RC_END_OF_INPUT && fuc->current == fuc->end)
+            return rluc->uc.return_code = CWP_RC_END_OF_INPUT;
+        if (rc != CWP_RC_OK && rc != CWP_RC_END_OF_INPUT)
+        {
+            rluc->uc.err_no = fuc->err_no;
+            return rluc->uc.return_code = rc;
+        }
+
+        /* corrupt or torn frame, resync on the next mark */
+        uint8_t *next = fuc->current + 1 < fuc->end ? memchr (fuc->current + 1, RECORD_LOG_MARK, (size_t)(fuc->end - fuc->current - 1)) : NULL;
+        unsigned long passed = (unsigned long)((next ? next : fuc->end) - fuc->current);
+        fuc->current += passed;
+        rluc->offset += passed;
+        rluc->skipped_bytes += passed;
+        rluc->uc.start = rluc->uc.current = rluc->uc.end = fuc->current;
+    }
+}
+
+
+void terminate_record_log_unpack_context (record_log_unpack_context* rluc)
+{
+    terminate_file_unpack_context (&rluc->fuc);
+}
@@ -0,0 +1,110 @@
+/*      CWPack/goodies - record_log.h   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef record_log_h
+#define record_log_h
+
+#include <time.h>
+
+#include "cwpack.h"
+#include "basic_contexts.h"
+
+
+/*
+ * A record log is a sequence of frames, each holding one record:
+ *
+ *      0xc1  flags  length (4 bytes)  crc32c (4 bytes)  payload (length bytes)
+ *
+ * 0xc1 is never used by msgpack. Length and crc are big endian and the crc32c covers
+ * flags, length and payload. The payload is any msgpack sequence.
+ */
+
+
+#define RECORD_LOG_MARK             0xc1
+#define RECORD_LOG_FRAME_LENGTH     10
+
+uint32_t record_log_crc32c (uint32_t crc, const void* data, unsigned long length);
+
+
+
+/*****************************************  RECORD LOG PACK CONTEXT  **************************/
+
+typedef enum
+{
+    RECORD_LOG_SYNC_NONE,                   /* leave it to the OS */
+    RECORD_LOG_SYNC_EVERY_RECORD,
+    RECORD_LOG_SYNC_GROUP                   /* after group_records records or group_interval_ms */
+} record_log_sync_policy;
+
+typedef struct
+{
+    file_pack_context       fpc;
+    record_log_sync_policy  sync_policy;
+    unsigned long           group_records;
+    unsigned long           group_interval_ms;
+    unsigned long           unsynced_records;
+    struct timespec         last_sync;
+} record_log_pack_context;
+
+
+void init_record_log_pack_context (record_log_pack_context* rlpc, unsigned long initial_buffer_length, int fileDescriptor);
+
+void record_log_pack_context_set_sync_policy (record_log_pack_context* rlpc, record_log_sync_policy policy,
+                                              unsigned long group_records, unsigned long group_interval_ms);
+
+void record_log_pack_context_begin_record (record_log_pack_context* rlpc, uint8_t flags);
+void record_log_pack_context_end_record (record_log_pack_context* rlpc);
+
+/* Writes and syncs everything written so far */
+int record_log_pack_context_sync (record_log_pack_context* rlpc);
+
+void terminate_record_log_pack_context (record_log_pack_context* rlpc);
+
+
+
+/*****************************************  RECORD LOG UNPACK CONTEXT  ************************/
+
+typedef struct
+{
+    cw_unpack_context       uc;             /* the current record */
+    file_unpack_context     fuc;
+    uint8_t                 flags;          /* of the current record */
+    unsigned long           max_record_length;
+    unsigned long long      offset;         /* of the current record frame */
+    unsigned long long      valid_end;      /* offset after the last valid record */
+    unsigned long long      skipped_bytes;  /* corrupt bytes passed over */
+} record_log_unpack_context;
+
+
+void init_record_log_unpack_context (record_log_unpack_context* rluc, unsigned long initial_buffer_length, int fileDescriptor);
+
+/* Skips the current record and validates the next. Returns CWP_RC_OK, CWP_RC_END_OF_INPUT or an error */
+int record_log_unpack_context_next_record (record_log_unpack_context* rluc);
+
+void terminate_record_log_unpack_context (record_log_unpack_context* rluc);
+
+
+
+/*****************************************  E P I L O G U E  **********************************/
+
+
+#endif /* record_log_h */
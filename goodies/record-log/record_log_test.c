@@ -0,0 +1,168 @@
+/*      CWPack/goodies - record_log_test.c   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "cwpack.h"
+#include "record_log.h"
+
+
+#define RECORDS 1000
+
+int error_count;
+
+static void ERROR(const char* msg)
+{
+    error_count++;
+    printf("ERROR: %s\n", msg);
+}
+
+
+static void ERROR1(const char* msg, int i)
+{
+    error_count++;
+    printf("ERROR: %s%d\n", msg, i);
+}
+
+
+static int temp_file (void)
+{
+    char name[] = "/tmp/cwpack_record_log_XXXXXX";
+    int fd = mkstemp (name);
+    unlink (name);
+    return fd;
+}
+
+
+static void write_records (int fd, record_log_sync_policy policy)
+{
+    record_log_pack_context rlpc;
+    char text[300];
+    int i;
+    memset (text, 'x', sizeof(text));
+    init_record_log_pack_context (&rlpc, 64, fd);
+    record_log_pack_context_set_sync_policy (&rlpc, policy, 100, 0);
+    for (i = 0; i < RECORDS; i++)
+    {
+        record_log_pack_context_begin_record (&rlpc, (uint8_t)(i & 3));
+        cw_pack_array_size ((cw_pack_context*)&rlpc, 2);
+        cw_pack_unsigned ((cw_pack_context*)&rlpc, (uint64_t)i);
+        cw_pack_str ((cw_pack_context*)&rlpc, text, (uint32_t)(i % 300));
+        record_log_pack_context_end_record (&rlpc);
+    }
+    if (rlpc.fpc.pc.return_code)
+        ERROR1("Write records rc: ", rlpc.fpc.pc.return_code);
+    terminate_record_log_pack_context (&rlpc);
+}
+
+
+/* returns number of records read, checking they come in order, missing ones allowed */
+static int read_records (int fd, unsigned long long* skipped, unsigned long long* valid_end)
+{
+    record_log_unpack_context rluc;
+    int count = 0, last = -1;
+    lseek (fd, 0, SEEK_SET);
+    init_record_log_unpack_context (&rluc, 32, fd);
+    while (record_log_unpack_context_next_record (&rluc) == CWP_RC_OK)
+    {
+        cw_unpack_next (&rluc.uc);
+        cw_unpack_next (&rluc.uc);
+        int i = (int)rluc.uc.item.as.u64;
+        cw_unpack_next (&rluc.uc);
+        if (rluc.uc.return_code || i <= last || rluc.uc.item.as.str.length != (uint32_t)(i % 300) || rluc.flags != (i & 3))
+            ERROR1("Read record ", i);
+        last = i;
+        count++;
+        if (count % 3)
+            continue;
+        cw_unpack_next (&rluc.uc);
+        if (rluc.uc.return_code != CWP_RC_END_OF_INPUT)
+            ERROR1("Record not limited: ", i);
+    }
+    if (rluc.uc.return_code != CWP_RC_END_OF_INPUT)
+        ERROR1("Read records rc: ", rluc.uc.return_code);
+    *skipped = rluc.skipped_bytes;
+    *valid_end = rluc.valid_end;
+    terminate_record_log_unpack_context (&rluc);
+    return count;
+}
+
+
+int main(int argc, const char * argv[])
+{
+    unsigned long long skipped, valid_end;
+    uint8_t byte;
+    (void)argc; (void)argv;
+    printf("CWPack record log test started.\n");
+    error_count = 0;
+
+    if (record_log_crc32c (0, "123456789", 9) != 0xe3069283)
+        ERROR("crc32c check value");
+
+    int fd = temp_file ();
+    write_records (fd, RECORD_LOG_SYNC_GROUP);
+    off_t file_length = lseek (fd, 0, SEEK_END);
+    if (read_records (fd, &skipped, &valid_end) != RECORDS || skipped || valid_end != (unsigned long long)file_length)
+        ERROR("Clean read");
+
+    /* corrupt a payload byte in the middle */
+    pread (fd, &byte, 1, file_length / 2);
+    byte ^= 0x10;
+    pwrite (fd, &byte, 1, file_length / 2);
+    if (read_records (fd, &skipped, &valid_end) != RECORDS - 1 || !skipped)
+        ERROR("Corrupt payload");
+
+    /* torn tail */
+    ftruncate (fd, file_length - 7);
+    if (read_records (fd, &skipped, &valid_end) != RECORDS - 2 || valid_end >= (unsigned long long)file_length - 7)
+        ERROR("Torn tail");
+    close (fd);
+
+    /* garbage between records */
+    fd = temp_file ();
+    write (fd, "\xc1\xc1garbage", 9);
+    write_records (fd, RECORD_LOG_SYNC_EVERY_RECORD);
+    if (read_records (fd, &skipped, &valid_end) != RECORDS || skipped != 9)
+        ERROR("Leading garbage");
+    close (fd);
+
+    printf("CWPack record log test completed, ");
+    switch (error_count)
+    {
+        case 0:
+            printf("no errors detected\n");
+            break;
+
+        case 1:
+            printf("1 error detected\n");
+            break;
+
+        default:
+            printf("%d errors detected\n", error_count);
+            break;
+    }
+
+    return error_count;
+}
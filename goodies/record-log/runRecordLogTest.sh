@@ -0,0 +1,3 @@
+clang -I ../../src/ -I ../basic-contexts/ -o recordLogTest *.c ../../src/cwpack.c ../basic-contexts/basic_contexts.c
+./recordLogTest
+rm -f *.o recordLogTest
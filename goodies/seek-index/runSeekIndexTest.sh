@@ -0,0 +1,3 @@
+clang -I ../../src/ -I ../basic-contexts/ -o seekIndexTest *.c ../../src/cwpack.c ../basic-contexts/basic_contexts.c
+./seekIndexTest
+rm -f *.o seekIndexTest
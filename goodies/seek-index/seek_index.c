@@ -0,0 +1,375 @@
+/*      CWPack/goodies - seek_index.c   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "seek_index.h"
+
+
+#define SEEK_INDEX_MAGIC            "CWIX"
+#define SEEK_INDEX_VERSION          1
+#define SEEK_INDEX_HEADER_LENGTH    16
+#define SEEK_INDEX_ENTRY_LENGTH     24
+
+
+static uint64_t get_be64 (const uint8_t* p)
+{
+    uint64_t v = 0;
+    int i;
+    for (i = 0; i < 8; i++)
+        v = v << 8 | p[i];
+    return v;
+}
+
+
+static void put_be64 (uint8_t* p, uint64_t v)
+{
+    int i;
+    for (i = 7; i >= 0; i--, v >>= 8)
+        p[i] = (uint8_t)v;
+}
+
+
+static uint32_t get_be32 (const uint8_t* p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+
+static void put_be32 (uint8_t* p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+
+
+/*****************************************  SEEK INDEX PACK CONTEXT  **************************/
+
+
+void init_seek_index_pack_context (seek_index_pack_context* sipc, unsigned long initial_buffer_length, int fileDescriptor, unsigned long interval)
+{
+    init_file_pack_context (&sipc->fpc, initial_buffer_length, fileDescriptor);
+    sipc->interval = interval ? interval : 1;
+    sipc->record_count = 0;
+    sipc->flags = 0;
+    sipc->entries = NULL;
+    sipc->entry_count = 0;
+    sipc->entry_capacity = 0;
+}
+
+
+void seek_index_pack_context_next_keyed_record (seek_index_pack_context* sipc, int64_t key)
+{
+    cw_pack_context* pc = (cw_pack_context*)sipc;
+    if (pc->return_code)
+        return;
+
+    if (sipc->record_count % sipc->interval == 0)
+    {
+        /* everything before the buffer is in the file */
+        off_t position = lseek (sipc->fpc.fileDescriptor, 0, SEEK_CUR);
+        if (position < 0)
+        {
+            pc->err_no = errno;
+            pc->return_code = CWP_RC_ERROR_IN_HANDLER;
+            return;
+        }
+        if (sipc->entry_count == sipc->entry_capacity)
+        {
+            unsigned long capacity = sipc->entry_capacity ? 2 * sipc->entry_capacity : 64;
+            seek_index_entry *entries = realloc (sipc->entries, capacity * sizeof(seek_index_entry));
+            if (!entries)
+            {
+                pc->return_code = CWP_RC_MALLOC_ERROR;
+                return;
+            }
+            sipc->entries = entries;
+            sipc->entry_capacity = capacity;
+        }
+        seek_index_entry *entry = sipc->entries + sipc->entry_count++;
+        entry->record = sipc->record_count;
+        entry->offset = (uint64_t)position + (uint64_t)(pc->current - pc->start);
+        entry->key = key;
+    }
+    sipc->record_count++;
+}
+
+
+void seek_index_pack_context_next_record (seek_index_pack_context* sipc)
+{
+    seek_index_pack_context_next_keyed_record (sipc, 0);
+}
+
+
+static void pack_footer (seek_index_pack_context* sipc)
+{
+    cw_pack_context* pc = (cw_pack_context*)sipc;
+    cw_pack_flush (pc);
+    off_t index_offset = lseek (sipc->fpc.fileDescriptor, 0, SEEK_CUR);
+    if (pc->return_code)
+        return;
+    if (index_offset < 0)
+    {
+        pc->err_no = errno;
+        pc->return_code = CWP_RC_ERROR_IN_HANDLER;
+        return;
+    }
+
+    unsigned long length = SEEK_INDEX_HEADER_LENGTH + sipc->entry_count * SEEK_INDEX_ENTRY_LENGTH;
+    if (length > 0xffffffffUL)
+    {
+        pc->return_code = CWP_RC_VALUE_ERROR;
+        return;
+    }
+    uint8_t *block = malloc (length);
+    if (!block)
+    {
+        pc->return_code = CWP_RC_MALLOC_ERROR;
+        return;
+    }
+    put_be32 (block, (uint32_t)sipc->interval);
+    put_be32 (block + 4, sipc->flags);
+    put_be64 (block + 8, sipc->record_count);
+    uint8_t *p = block + SEEK_INDEX_HEADER_LENGTH;
+    unsigned long i;
+    for (i = 0; i < sipc->entry_count; i++, p += SEEK_INDEX_ENTRY_LENGTH)
+    {
+        put_be64 (p, sipc->entries[i].record);
+        put_be64 (p + 8, sipc->entries[i].offset);
+        put_be64 (p + 16, (uint64_t)sipc->entries[i].key);
+    }
+    cw_pack_ext (pc, SEEK_INDEX_EXT_TYPE, block, (uint32_t)length);
+    free (block);
+
+    uint8_t trailer[16];
+    memcpy (trailer, SEEK_INDEX_MAGIC, 4);
+    put_be32 (trailer + 4, SEEK_INDEX_VERSION);
+    put_be64 (trailer + 8, (uint64_t)index_offset);
+    cw_pack_ext (pc, SEEK_INDEX_EXT_TYPE, trailer, 16);
+}
+
+
+void terminate_seek_index_pack_context (seek_index_pack_context* sipc)
+{
+    if (!sipc->fpc.pc.return_code)
+        pack_footer (sipc);
+    terminate_file_pack_context (&sipc->fpc);
+    free (sipc->entries);
+    sipc->entries = NULL;
+}
+
+
+
+/*****************************************  SEEK INDEX  ***************************************/
+
+
+static int check_trailer (seek_index* si, const uint8_t* trailer)
+{
+    if (trailer[0] != 0xd8 || trailer[1] != SEEK_INDEX_EXT_TYPE ||
+        memcmp (trailer + 2, SEEK_INDEX_MAGIC, 4) || get_be32 (trailer + 6) != SEEK_INDEX_VERSION)
+        return CWP_RC_MALFORMED_INPUT;
+    si->index_offset = get_be64 (trailer + 10);
+    return CWP_RC_OK;
+}
+
+
+static int parse_index_block (seek_index* si, const uint8_t* block, unsigned long length)
+{
+    cw_unpack_context uc;
+    cw_unpack_context_init (&uc, block, length, 0);
+    cw_unpack_next (&uc);
+    if (uc.return_code || uc.item.type != SEEK_INDEX_EXT_TYPE || uc.current != uc.end ||
+        uc.item.as.ext.length < SEEK_INDEX_HEADER_LENGTH ||
+        (uc.item.as.ext.length - SEEK_INDEX_HEADER_LENGTH) % SEEK_INDEX_ENTRY_LENGTH)
+        return CWP_RC_MALFORMED_INPUT;
+
+    const uint8_t *p = (const uint8_t*)uc.item.as.ext.start;
+    si->interval = get_be32 (p);
+    si->flags = get_be32 (p + 4);
+    si->record_count = get_be64 (p + 8);
+    si->entry_count = (uc.item.as.ext.length - SEEK_INDEX_HEADER_LENGTH) / SEEK_INDEX_ENTRY_LENGTH;
+    if (!si->interval || si->entry_count != (si->record_count + si->interval - 1) / si->interval)
+        return CWP_RC_MALFORMED_INPUT;
+
+    si->entries = malloc (si->entry_count * sizeof(seek_index_entry) + 1);
+    if (!si->entries)
+        return CWP_RC_MALLOC_ERROR;
+    unsigned long i;
+    for (i = 0, p += SEEK_INDEX_HEADER_LENGTH; i < si->entry_count; i++, p += SEEK_INDEX_ENTRY_LENGTH)
+    {
+        si->entries[i].record = get_be64 (p);
+        si->entries[i].offset = get_be64 (p + 8);
+        si->entries[i].key = (int64_t)get_be64 (p + 16);
+    }
+    return CWP_RC_OK;
+}
+
+
+int seek_index_load_memory (seek_index* si, const void* data, unsigned long length)
+{
+    const uint8_t *d = (const uint8_t*)data;
+    memset (si, 0, sizeof(seek_index));
+    if (length < SEEK_INDEX_TRAILER_LENGTH || check_trailer (si, d + length - SEEK_INDEX_TRAILER_LENGTH) ||
+        si->index_offset > length - SEEK_INDEX_TRAILER_LENGTH)
+        return CWP_RC_MALFORMED_INPUT;
+
+    return parse_index_block (si, d + si->index_offset, length - SEEK_INDEX_TRAILER_LENGTH - (unsigned long)si->index_offset);
+}
+
+
+int seek_index_load (seek_index* si, int fileDescriptor)
+{
+    uint8_t trailer[SEEK_INDEX_TRAILER_LENGTH];
+    struct stat st;
+    memset (si, 0, sizeof(seek_index));
+    if (fstat (fileDescriptor, &st))
+    {
+        si->err_no = errno;
+        return CWP_RC_ERROR_IN_HANDLER;
+    }
+    uint64_t length = (uint64_t)st.st_size;
+    if (length < SEEK_INDEX_TRAILER_LENGTH ||
+        pread (fileDescriptor, trailer, SEEK_INDEX_TRAILER_LENGTH, (off_t)(length - SEEK_INDEX_TRAILER_LENGTH)) != SEEK_INDEX_TRAILER_LENGTH ||
+        check_trailer (si, trailer) || si->index_offset > length - SEEK_INDEX_TRAILER_LENGTH)
+        return CWP_RC_MALFORMED_INPUT;
+
+    unsigned long block_length = (unsigned long)(length - SEEK_INDEX_TRAILER_LENGTH - si->index_offset);
+    uint8_t *block = malloc (block_length + 1);
+    if (!block)
+        return CWP_RC_MALLOC_ERROR;
+    int rc = CWP_RC_MALFORMED_INPUT;
+    if (pread (fileDescriptor, block, block_length, (off_t)si->index_offset) == (long)block_length)
+        rc = parse_index_block (si, block, block_length);
+    free (block);
+    return rc;
+}
+
+
+void seek_index_free (seek_index* si)
+{
+    free (si->entries);
+    si->entries = NULL;
+    si->entry_count = 0;
+}
+
+
+const seek_index_entry* seek_index_find_record (const seek_index* si, uint64_t n)
+{
+    if (!si->entry_count)
+        return NULL;
+    uint64_t i = n / si->interval;
+    return si->entries + (i < si->entry_count ? i : si->entry_count - 1);
+}
+
+
+const seek_index_entry* seek_index_find_offset (const seek_index* si, uint64_t offset)
+{
+    unsigned long low = 0, high = si->entry_count;
+    while (low < high)
+    {
+        unsigned long mid = low + (high - low) / 2;
+        if (si->entries[mid].offset <= offset)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low ? si->entries + low - 1 : NULL;
+}
+
+
+const seek_index_entry* seek_index_find_key (const seek_index* si, int64_t key)
+{
+    unsigned long low = 0, high = si->entry_count;
+    while (low < high)
+    {
+        unsigned long mid = low + (high - low) / 2;
+        if (si->entries[mid].key <= key)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low ? si->entries + low - 1 : NULL;
+}
+
+
+/* offset of the indexed record before n and the number of records to skip from there */
+static uint64_t start_offset (const seek_index* si, uint64_t n, uint64_t* skip)
+{
+    const seek_index_entry *entry = seek_index_find_record (si, n);
+    if (!entry)
+    {
+        *skip = 0;
+        return si->index_offset;
+    }
+    *skip = n - entry->record;
+    return entry->offset;
+}
+
+
+void seek_index_seek_record (const seek_index* si, file_unpack_context* fuc, uint64_t n)
+{
+    cw_unpack_context* uc = (cw_unpack_context*)fuc;
+    uint64_t skip;
+    if (uc->return_code == CWP_RC_MALLOC_ERROR)
+        return;
+    if (n > si->record_count)
+    {
+        uc->return_code = CWP_RC_VALUE_ERROR;
+        return;
+    }
+
+    uint64_t offset = start_offset (si, n, &skip);
+    fuc->barrier = NULL;
+    uc->current = uc->end = uc->start;
+    uc->return_code = CWP_RC_OK;
+    if (lseek (fuc->fileDescriptor, (off_t)offset, SEEK_SET) < 0)
+    {
+        uc->err_no = errno;
+        uc->return_code = CWP_RC_ERROR_IN_HANDLER;
+        return;
+    }
+    cw_skip_items (uc, (long)skip);
+}
+
+
+void seek_index_seek_record_memory (const seek_index* si, cw_unpack_context* uc, const void* data, uint64_t n)
+{
+    uint64_t skip;
+    if (n > si->record_count)
+    {
+        uc->return_code = CWP_RC_VALUE_ERROR;
+        return;
+    }
+
+    uint64_t offset = start_offset (si, n, &skip);
+    uc->start = (uint8_t*)data;
+    uc->end = uc->start + si->index_offset;
+    uc->current = uc->start + offset;
+    uc->return_code = CWP_RC_OK;
+    cw_skip_items (uc, (long)skip);
+}
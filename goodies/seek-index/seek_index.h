@@ -0,0 +1,112 @@
+/*      CWPack/goodies - seek_index.h   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef seek_index_h
+#define seek_index_h
+
+#include "cwpack.h"
+#include "basic_contexts.h"
+
+
+/*
+ * A file with a seek index is a sequence of msgpack records followed by a footer of
+ * two ext items:
+ *
+ *      index block     ext (SEEK_INDEX_EXT_TYPE): interval(4) flags(4) record_count(8)
+ *                      then per entry record(8) offset(8) key(8)
+ *      trailer         fixext16 (SEEK_INDEX_EXT_TYPE): "CWIX" version(4) index_offset(8)
+ *
+ * All numbers are big endian. An entry is written for every interval:th record.
+ */
+
+#define SEEK_INDEX_EXT_TYPE         0x58
+#define SEEK_INDEX_TRAILER_LENGTH   18
+#define SEEK_INDEX_HAS_KEYS         1
+
+
+
+/*****************************************  SEEK INDEX PACK CONTEXT  **************************/
+
+typedef struct
+{
+    uint64_t        record;                 /* record number, from 0 */
+    uint64_t        offset;                 /* of the record in the file */
+    int64_t         key;
+} seek_index_entry;
+
+typedef struct
+{
+    file_pack_context   fpc;
+    unsigned long       interval;
+    uint64_t            record_count;
+    uint32_t            flags;
+    seek_index_entry    *entries;
+    unsigned long       entry_count;
+    unsigned long       entry_capacity;
+} seek_index_pack_context;
+
+
+void init_seek_index_pack_context (seek_index_pack_context* sipc, unsigned long initial_buffer_length, int fileDescriptor, unsigned long interval);
+
+/* Call before each record is packed */
+void seek_index_pack_context_next_record (seek_index_pack_context* sipc);
+void seek_index_pack_context_next_keyed_record (seek_index_pack_context* sipc, int64_t key);
+
+/* Writes the footer */
+void terminate_seek_index_pack_context (seek_index_pack_context* sipc);
+
+
+
+/*****************************************  SEEK INDEX  ***************************************/
+
+typedef struct
+{
+    unsigned long       interval;
+    uint32_t            flags;
+    uint64_t            record_count;
+    uint64_t            index_offset;       /* = end of the records */
+    seek_index_entry    *entries;
+    unsigned long       entry_count;
+    int                 err_no;
+} seek_index;
+
+
+/* Reads the footer. Returns CWP_RC_MALFORMED_INPUT when the file has none */
+int seek_index_load (seek_index* si, int fileDescriptor);
+int seek_index_load_memory (seek_index* si, const void* data, unsigned long length);
+void seek_index_free (seek_index* si);
+
+/* The last indexed entry at or before record n, byte offset or key. NULL if none */
+const seek_index_entry* seek_index_find_record (const seek_index* si, uint64_t n);
+const seek_index_entry* seek_index_find_offset (const seek_index* si, uint64_t offset);
+const seek_index_entry* seek_index_find_key (const seek_index* si, int64_t key);
+
+/* Position a context at the start of record n */
+void seek_index_seek_record (const seek_index* si, file_unpack_context* fuc, uint64_t n);
+void seek_index_seek_record_memory (const seek_index* si, cw_unpack_context* uc, const void* data, uint64_t n);
+
+
+
+/*****************************************  E P I L O G U E  **********************************/
+
+
+#endif /* seek_index_h */
@@ -0,0 +1,164 @@
+/*      CWPack/goodies - seek_index_test.c   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include "cwpack.h"
+#include "seek_index.h"
+
+
+#define RECORDS     10000
+#define INTERVAL    64
+
+int error_count;
+
+static void ERROR(const char* msg)
+{
+    error_count++;
+    printf("ERROR: %s\n", msg);
+}
+
+
+static void ERROR1(const char* msg, int i)
+{
+    error_count++;
+    printf("ERROR: %s%d\n", msg, i);
+}
+
+
+static int temp_file (void)
+{
+    char name[] = "/tmp/cwpack_seek_index_XXXXXX";
+    int fd = mkstemp (name);
+    unlink (name);
+    return fd;
+}
+
+
+/* record i is [i, "xxx..." (i % 50)] and has key 10*i */
+static void check_record (cw_unpack_context* uc, uint64_t i)
+{
+    cw_unpack_next (uc);
+    if (uc->item.type != CWP_ITEM_ARRAY || uc->item.as.array.size != 2)
+        ERROR1("Record array ", (int)i);
+    cw_unpack_next (uc);
+    if (uc->item.as.u64 != i)
+        ERROR1("Record number ", (int)i);
+    cw_unpack_next (uc);
+    if (uc->return_code || uc->item.as.str.length != i % 50)
+        ERROR1("Record string ", (int)i);
+}
+
+
+int main(int argc, const char * argv[])
+{
+    seek_index si;
+    uint64_t i;
+    char text[50];
+    (void)argc; (void)argv;
+    printf("CWPack seek index test started.\n");
+    error_count = 0;
+    memset (text, 'x', sizeof(text));
+
+    int fd = temp_file ();
+    seek_index_pack_context sipc;
+    init_seek_index_pack_context (&sipc, 100, fd, INTERVAL);
+    for (i = 0; i < RECORDS; i++)
+    {
+        seek_index_pack_context_next_keyed_record (&sipc, (int64_t)(10 * i));
+        cw_pack_array_size ((cw_pack_context*)&sipc, 2);
+        cw_pack_unsigned ((cw_pack_context*)&sipc, i);
+        cw_pack_str ((cw_pack_context*)&sipc, text, (uint32_t)(i % 50));
+    }
+    if (sipc.fpc.pc.return_code)
+        ERROR1("Pack rc: ", sipc.fpc.pc.return_code);
+    terminate_seek_index_pack_context (&sipc);
+
+    if (seek_index_load (&si, fd) || si.record_count != RECORDS || si.entry_count != (RECORDS + INTERVAL - 1) / INTERVAL)
+        ERROR("Load index");
+
+    file_unpack_context fuc;
+    init_file_unpack_context (&fuc, 64, fd);
+    for (i = 0; i < RECORDS; i += 997)
+    {
+        seek_index_seek_record (&si, &fuc, i);
+        check_record ((cw_unpack_context*)&fuc, i);
+        check_record ((cw_unpack_context*)&fuc, i + 1);
+    }
+    seek_index_seek_record (&si, &fuc, RECORDS + 1);
+    if (fuc.uc.return_code != CWP_RC_VALUE_ERROR)
+        ERROR("Seek beyond end");
+    terminate_file_unpack_context (&fuc);
+
+    const seek_index_entry *entry = seek_index_find_key (&si, 10 * 5000 + 5);
+    if (!entry || entry->record != 5000 / INTERVAL * INTERVAL)
+        ERROR("Find key");
+    if (seek_index_find_key (&si, -1))
+        ERROR("Find key before first");
+    entry = seek_index_find_offset (&si, si.entries[3].offset + 1);
+    if (!entry || entry->record != 3 * INTERVAL)
+        ERROR("Find offset");
+
+    off_t length = lseek (fd, 0, SEEK_END);
+    void *map = mmap (NULL, (size_t)length, PROT_READ, MAP_SHARED, fd, 0);
+    seek_index msi;
+    if (seek_index_load_memory (&msi, map, (unsigned long)length) || msi.index_offset != si.index_offset)
+        ERROR("Load index from memory");
+    cw_unpack_context uc;
+    cw_unpack_context_init (&uc, map, (unsigned long)length, 0);
+    seek_index_seek_record_memory (&msi, &uc, map, RECORDS - 1);
+    check_record (&uc, RECORDS - 1);
+    cw_unpack_next (&uc);
+    if (uc.return_code != CWP_RC_END_OF_INPUT)
+        ERROR("Memory context not limited to the records");
+    munmap (map, (size_t)length);
+    seek_index_free (&msi);
+    seek_index_free (&si);
+
+    /* no footer */
+    ftruncate (fd, length - 1);
+    if (seek_index_load (&si, fd) != CWP_RC_MALFORMED_INPUT)
+        ERROR("Missing footer");
+    close (fd);
+
+    printf("CWPack seek index test completed, ");
+    switch (error_count)
+    {
+        case 0:
+            printf("no errors detected\n");
+            break;
+
+        case 1:
+            printf("1 error detected\n");
+            break;
+
+        default:
+            printf("%d errors detected\n", error_count);
+            break;
+    }
+
+    return error_count;
+}
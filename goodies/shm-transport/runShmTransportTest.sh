@@ -0,0 +1,3 @@
+clang -I ../../src/ -o shmTransportTest *.c ../../src/cwpack.c
+./shmTransportTest
+rm -f *.o shmTransportTest
@@ -0,0 +1,425 @@
+/*      CWPack/goodies - shm_transport.c   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifdef __linux__
+#define _GNU_SOURCE     /* syscall */
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include "shm_transport.h"
+
+
+/*
+ * The ring lives in POSIX shared memory: one page with the header followed by the data,
+ * which is mapped twice back-to-back so every record is contiguous. Positions grow
+ * monotonically and are masked with the capacity, a power of two.
+ *
+ * A record is a 4 byte state word, 4 unused bytes and the payload padded to 8 bytes.
+ * The state word is zero until the producer commits the record. The consumer zeroes a
+ * record when it is released, so a stale state word is never seen after a wrap.
+ */
+
+#define SHM_MAGIC               0x43575348UL
+#define SHM_VERSION             1
+
+#define RECORD_HEADER           8
+#define RECORD_COMMITTED        0x80000000UL
+#define RECORD_PADDING          0x40000000UL
+#define RECORD_LENGTH_MASK      0x3fffffffUL
+#define RECORD_SIZE(l)          (RECORD_HEADER + (((uint64_t)(l) + 7) & ~(uint64_t)7))
+
+#define SPIN_COUNT              200
+
+#define ring_at(st,position)    ((st)->data + ((position) & ((st)->capacity - 1)))
+
+
+
+/*******************************   W A I T I N G   ****************************/
+
+
+static void futex_wait (uint32_t* word, int timeout_ms)
+{
+#ifdef __linux__
+    struct timespec ts;
+    ts.tv_sec = timeout_ms / 1000;
+    ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+    syscall (SYS_futex, word, FUTEX_WAIT, 1, timeout_ms < 0 ? NULL : &ts, NULL, 0);
+#else
+    (void)word;
+    usleep (timeout_ms < 0 || timeout_ms > 1 ? 1000 : (unsigned)timeout_ms * 1000);
+#endif
+}
+
+
+static void futex_wake (uint32_t* word)
+{
+    if (__atomic_load_n (word, __ATOMIC_SEQ_CST) && __atomic_exchange_n (word, 0, __ATOMIC_SEQ_CST))
+    {
+#ifdef __linux__
+        syscall (SYS_futex, word, FUTEX_WAKE, 0x7fffffff, NULL, NULL, 0);
+#endif
+    }
+}
+
+
+static long elapsed_ms (const struct timespec* since)
+{
+    struct timespec now;
+    clock_gettime (CLOCK_MONOTONIC, &now);
+    return (long)(now.tv_sec - since->tv_sec) * 1000 + (now.tv_nsec - since->tv_nsec) / 1000000L;
+}
+
+
+/* Wait until the consumer has released everything before tail_needed */
+static bool wait_for_tail (shm_transport* st, uint64_t tail_needed)
+{
+    shm_ring_header *h = st->header;
+    int spins = 0;
+    while (__atomic_load_n (&h->tail, __ATOMIC_ACQUIRE) < tail_needed)
+    {
+        if (__atomic_load_n (&h->shutdown, __ATOMIC_RELAXED))
+            return false;
+        if (++spins < SPIN_COUNT)
+            continue;
+
+        __atomic_store_n (&h->producers_waiting, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n (&h->tail, __ATOMIC_SEQ_CST) < tail_needed)
+            futex_wait (&h->producers_waiting, 100);
+    }
+    return true;
+}
+
+
+
+/*******************************   T R A N S P O R T   ************************/
+
+
+static int map_transport (shm_transport* st, int fd, unsigned long capacity)
+{
+    unsigned long page_size = (unsigned long)sysconf (_SC_PAGESIZE);
+    void *header = mmap (NULL, page_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    void *area = mmap (NULL, 2 * capacity, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (header == MAP_FAILED || area == MAP_FAILED ||
+        mmap (area, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, (off_t)page_size) == MAP_FAILED ||
+        mmap ((uint8_t*)area + capacity, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, (off_t)page_size) == MAP_FAILED)
+    {
+        st->err_no = errno;
+        if (header != MAP_FAILED)
+            munmap (header, page_size);
+        if (area != MAP_FAILED)
+            munmap (area, 2 * capacity);
+        return CWP_RC_ERROR_IN_HANDLER;
+    }
+    st->header = (shm_ring_header*)header;
+    st->data = (uint8_t*)area;
+    st->capacity = capacity;
+    st->mapped_length = 2 * capacity;
+    return CWP_RC_OK;
+}
+
+
+int shm_transport_create (shm_transport* st, const char* name, unsigned long capacity)
+{
+    unsigned long page_size = (unsigned long)sysconf (_SC_PAGESIZE);
+    unsigned long ring_length = page_size;
+    while (ring_length < capacity)
+        ring_length = 2 * ring_length;
+
+    st->err_no = 0;
+    int fd = shm_open (name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0)
+    {
+        st->err_no = errno;
+        return CWP_RC_ERROR_IN_HANDLER;
+    }
+    int rc = CWP_RC_ERROR_IN_HANDLER;
+    if (ftruncate (fd, (off_t)(page_size + ring_length)))
+        st->err_no = errno;
+    else
+        rc = map_transport (st, fd, ring_length);
+    close (fd);
+    if (rc != CWP_RC_OK)
+    {
+        shm_unlink (name);
+        return rc;
+    }
+
+    st->header->capacity = ring_length;
+    st->header->version = SHM_VERSION;
+    __atomic_store_n (&st->header->magic, SHM_MAGIC, __ATOMIC_RELEASE);
+    return CWP_RC_OK;
+}
+
+
+int shm_transport_open (shm_transport* st, const char* name)
+{
+    st->err_no = 0;
+    int fd = shm_open (name, O_RDWR, 0600);
+    if (fd < 0)
+    {
+        st->err_no = errno;
+        return CWP_RC_ERROR_IN_HANDLER;
+    }
+
+    shm_ring_header header;
+    int rc = CWP_RC_MALFORMED_INPUT;
+    if (pread (fd, &header, sizeof(header), 0) == sizeof(header) &&
+        header.magic == SHM_MAGIC && header.version == SHM_VERSION)
+        rc = map_transport (st, fd, (unsigned long)header.capacity);
+    close (fd);
+    return rc;
+}
+
+
+void shm_transport_shutdown (shm_transport* st)
+{
+    __atomic_store_n (&st->header->shutdown, 1, __ATOMIC_SEQ_CST);
+    futex_wake (&st->header->consumer_waiting);
+    futex_wake (&st->header->producers_waiting);
+}
+
+
+void shm_transport_close (shm_transport* st)
+{
+    munmap (st->header, (unsigned long)sysconf (_SC_PAGESIZE));
+    munmap (st->data, st->mapped_length);
+    st->header = NULL;
+    st->data = NULL;
+}
+
+
+
+/*****************************************  SHARED MEMORY PACK CONTEXT  ************************/
+
+/*
+ * The single producer reserves all free space and packs in place; the record can grow
+ * until it fills the ring. With several producers, each reserves room for its largest
+ * message with a compare-and-swap on head and turns what is left into a padding record.
+ */
+
+static int handle_shm_pack_overflow(struct cw_pack_context* pc, unsigned long more)
+{
+    shm_pack_context* spc = (shm_pack_context*)pc;
+    shm_transport *st = spc->transport;
+    uint64_t needed = RECORD_SIZE(pc->current - pc->start + more);
+    if (spc->max_message_length || needed > st->capacity)
+        return CWP_RC_BUFFER_OVERFLOW;
+
+    if (!wait_for_tail (st, spc->position + needed - st->capacity))
+        return CWP_RC_END_OF_INPUT;
+
+    spc->reserved = st->capacity - (spc->position - __atomic_load_n (&st->header->tail, __ATOMIC_ACQUIRE));
+    pc->end = ring_at(st, spc->position) + spc->reserved;
+    return CWP_RC_OK;
+}
+
+
+void init_shm_pack_context (shm_pack_context* spc, shm_transport* st, unsigned long max_message_length)
+{
+    spc->transport = st;
+    spc->max_message_length = max_message_length;
+    spc->position = 0;
+    spc->reserved = 0;
+    cw_pack_context_init((cw_pack_context*)spc, st->data, 0, &handle_shm_pack_overflow);
+    if (max_message_length > RECORD_LENGTH_MASK || RECORD_SIZE(max_message_length) > st->capacity)
+        spc->pc.return_code = CWP_RC_ILLEGAL_CALL;
+}
+
+
+/*
+ * A failed message is dropped. A reservation shared with other producers is committed as
+ * padding, which the consumer skips. The single producer hasn't published anything, but
+ * clears what it wrote so no stale state word turns up in a later record.
+ */
+static void drop_message (shm_pack_context* spc)
+{
+    cw_pack_context* pc = (cw_pack_context*)spc;
+    shm_transport *st = spc->transport;
+    uint8_t *record = ring_at(st, spc->position);
+    if (spc->max_message_length)
+    {
+        __atomic_store_n ((uint32_t*)record, (uint32_t)(RECORD_COMMITTED | RECORD_PADDING | (spc->reserved - RECORD_HEADER)), __ATOMIC_SEQ_CST);
+        futex_wake (&st->header->consumer_waiting);
+    }
+    else
+        memset (record, 0, (unsigned long)(pc->current - record));
+    pc->start = pc->current = pc->end;
+}
+
+
+void shm_pack_context_begin_message (shm_pack_context* spc)
+{
+    cw_pack_context* pc = (cw_pack_context*)spc;
+    shm_transport *st = spc->transport;
+    shm_ring_header *h = st->header;
+    if (pc->return_code && pc->return_code != CWP_RC_END_OF_INPUT && pc->return_code != CWP_RC_ILLEGAL_CALL)
+    {
+        if (pc->start != pc->end)               /* end_message wasn't called */
+            drop_message (spc);
+        pc->return_code = CWP_RC_OK;            /* the error belonged to the last message */
+    }
+    if (pc->return_code)
+        return;
+
+    uint64_t head = __atomic_load_n (&h->head, __ATOMIC_RELAXED);
+    if (spc->max_message_length)
+    {
+        spc->reserved = RECORD_SIZE(spc->max_message_length);
+        do
+        {
+            if (head + spc->reserved > st->capacity && !wait_for_tail (st, head + spc->reserved - st->capacity))
+            {
+                pc->return_code = CWP_RC_END_OF_INPUT;
+                return;
+            }
+        } while (!__atomic_compare_exchange_n (&h->head, &head, head + spc->reserved, true, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+    }
+    else
+    {
+        if (head + RECORD_SIZE(8) > st->capacity && !wait_for_tail (st, head + RECORD_SIZE(8) - st->capacity))
+        {
+            pc->return_code = CWP_RC_END_OF_INPUT;
+            return;
+        }
+        spc->reserved = st->capacity - (head - __atomic_load_n (&h->tail, __ATOMIC_ACQUIRE));
+    }
+
+    spc->position = head;
+    pc->start = pc->current = ring_at(st, head) + RECORD_HEADER;
+    pc->end = ring_at(st, head) + spc->reserved;
+}
+
+
+void shm_pack_context_end_message (shm_pack_context* spc)
+{
+    cw_pack_context* pc = (cw_pack_context*)spc;
+    shm_transport *st = spc->transport;
+    shm_ring_header *h = st->header;
+    uint64_t length = (uint64_t)(pc->current - pc->start);
+    uint64_t size = RECORD_SIZE(length);
+    if (!pc->return_code && length > RECORD_LENGTH_MASK)
+        pc->return_code = CWP_RC_BUFFER_OVERFLOW;
+    if (pc->return_code)
+    {
+        if (pc->start != pc->end)
+            drop_message (spc);
+        return;
+    }
+
+    uint8_t *record = ring_at(st, spc->position);
+    if (spc->max_message_length)
+    {
+        if (size < spc->reserved)
+            __atomic_store_n ((uint32_t*)(record + size), (uint32_t)(RECORD_COMMITTED | RECORD_PADDING | (spc->reserved - size - RECORD_HEADER)), __ATOMIC_RELEASE);
+    }
+    else
+        __atomic_store_n (&h->head, spc->position + size, __ATOMIC_RELAXED);
+
+    __atomic_store_n ((uint32_t*)record, (uint32_t)(RECORD_COMMITTED | length), __ATOMIC_SEQ_CST);
+    futex_wake (&h->consumer_waiting);
+    pc->start = pc->current = pc->end;
+}
+
+
+
+/*****************************************  SHARED MEMORY UNPACK CONTEXT  **********************/
+
+
+void init_shm_unpack_context (shm_unpack_context* suc, shm_transport* st)
+{
+    suc->transport = st;
+    suc->message_end = 0;
+    cw_unpack_context_init((cw_unpack_context*)suc, st->data, 0, 0);
+}
+
+
+void shm_unpack_context_release_message (shm_unpack_context* suc)
+{
+    shm_transport *st = suc->transport;
+    shm_ring_header *h = st->header;
+    uint64_t tail = __atomic_load_n (&h->tail, __ATOMIC_RELAXED);
+    if (suc->message_end <= tail)
+        return;
+
+    memset (ring_at(st, tail), 0, suc->message_end - tail);
+    __atomic_store_n (&h->tail, suc->message_end, __ATOMIC_SEQ_CST);
+    futex_wake (&h->producers_waiting);
+}
+
+
+/* Returns CWP_RC_OK with the context set to the next message, CWP_RC_WOULD_BLOCK at timeout
+   and CWP_RC_END_OF_INPUT when the transport is shut down and empty. timeout_ms < 0 waits forever. */
+int shm_unpack_context_next_message (shm_unpack_context* suc, int timeout_ms)
+{
+    cw_unpack_context* uc = (cw_unpack_context*)suc;
+    shm_transport *st = suc->transport;
+    shm_ring_header *h = st->header;
+    struct timespec started;
+    int spins = 0;
+
+    shm_unpack_context_release_message (suc);
+    clock_gettime (CLOCK_MONOTONIC, &started);
+    for (;;)
+    {
+        uint64_t tail = __atomic_load_n (&h->tail, __ATOMIC_RELAXED);
+        uint32_t *state = (uint32_t*)ring_at(st, tail);
+        uint32_t s = __atomic_load_n (state, __ATOMIC_ACQUIRE);
+        if (s & RECORD_COMMITTED)
+        {
+            suc->message_end = tail + RECORD_SIZE(s & RECORD_LENGTH_MASK);
+            if (s & RECORD_PADDING)
+            {
+                shm_unpack_context_release_message (suc);
+                continue;
+            }
+            uc->start = uc->current = (uint8_t*)state + RECORD_HEADER;
+            uc->end = uc->start + (s & RECORD_LENGTH_MASK);
+            uc->return_code = CWP_RC_OK;
+            return CWP_RC_OK;
+        }
+
+        if (__atomic_load_n (&h->shutdown, __ATOMIC_ACQUIRE) && __atomic_load_n (&h->head, __ATOMIC_ACQUIRE) == tail)
+            return uc->return_code = CWP_RC_END_OF_INPUT;
+        if (++spins < SPIN_COUNT)
+            continue;
+
+        long remains = -1;
+        if (timeout_ms >= 0)
+        {
+            remains = timeout_ms - elapsed_ms (&started);
+            if (remains <= 0)
+                return uc->return_code = CWP_RC_WOULD_BLOCK;
+        }
+        __atomic_store_n (&h->consumer_waiting, 1, __ATOMIC_SEQ_CST);
+        if (!(__atomic_load_n (state, __ATOMIC_SEQ_CST) & RECORD_COMMITTED) && !__atomic_load_n (&h->shutdown, __ATOMIC_SEQ_CST))
+            futex_wait (&h->consumer_waiting, remains < 0 || remains > 100 ? 100 : (int)remains);
+    }
+}
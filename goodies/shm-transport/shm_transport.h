@@ -0,0 +1,102 @@
+/*      CWPack/goodies - shm_transport.h   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef shm_transport_h
+#define shm_transport_h
+
+#include "cwpack.h"
+
+
+/*****************************************  SHARED MEMORY TRANSPORT  **************************/
+
+typedef struct
+{
+    uint32_t        magic;
+    uint32_t        version;
+    uint64_t        capacity;
+    uint32_t        shutdown;
+    uint8_t         pad1[44];
+    uint64_t        head;                   /* next position to reserve, producers */
+    uint32_t        producers_waiting;      /* futex */
+    uint8_t         pad2[52];
+    uint64_t        tail;                   /* next position to consume, consumer */
+    uint32_t        consumer_waiting;       /* futex */
+    uint8_t         pad3[52];
+} shm_ring_header;
+
+typedef struct
+{
+    shm_ring_header *header;
+    uint8_t         *data;                  /* ring, mapped twice back-to-back */
+    unsigned long   capacity;
+    unsigned long   mapped_length;
+    int             err_no;
+} shm_transport;
+
+
+int shm_transport_create (shm_transport* st, const char* name, unsigned long capacity);
+int shm_transport_open (shm_transport* st, const char* name);
+void shm_transport_shutdown (shm_transport* st);
+void shm_transport_close (shm_transport* st);
+
+
+
+/*****************************************  SHARED MEMORY PACK CONTEXT  ************************/
+
+typedef struct
+{
+    cw_pack_context pc;
+    shm_transport   *transport;
+    unsigned long   max_message_length;     /* 0 = single producer */
+    uint64_t        position;               /* of the reserved record */
+    uint64_t        reserved;               /* bytes reserved from position */
+} shm_pack_context;
+
+
+void init_shm_pack_context (shm_pack_context* spc, shm_transport* st, unsigned long max_message_length);
+
+void shm_pack_context_begin_message (shm_pack_context* spc);
+void shm_pack_context_end_message (shm_pack_context* spc);
+
+
+
+/*****************************************  SHARED MEMORY UNPACK CONTEXT  **********************/
+
+typedef struct
+{
+    cw_unpack_context   uc;
+    shm_transport       *transport;
+    uint64_t            message_end;        /* position after the message being decoded */
+} shm_unpack_context;
+
+
+void init_shm_unpack_context (shm_unpack_context* suc, shm_transport* st);
+
+int shm_unpack_context_next_message (shm_unpack_context* suc, int timeout_ms);
+void shm_unpack_context_release_message (shm_unpack_context* suc);
+
+
+
+/*****************************************  E P I L O G U E  **********************************/
+
+
+#endif /* shm_transport_h */
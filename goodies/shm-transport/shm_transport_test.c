@@ -0,0 +1,328 @@
+/*      CWPack/goodies - shm_transport_test.c   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "cwpack.h"
+#include "shm_transport.h"
+
+
+#define MESSAGES        20000
+#define PRODUCERS       3
+#define TIMEOUT_MS      10000
+
+int error_count;
+
+static void ERROR(const char* msg)
+{
+    error_count++;
+    printf("ERROR: %s\n", msg);
+}
+
+
+static void ERROR1(const char* msg, int i)
+{
+    error_count++;
+    printf("ERROR: %s%d\n", msg, i);
+}
+
+
+static char shm_name[64];
+
+
+/* Runs in a child process, opens the transport by name and exits with 0 when all went well */
+static void producer (unsigned producer_id, unsigned long max_message_length, unsigned count, int shutdown)
+{
+    shm_transport st;
+    shm_pack_context spc;
+    uint8_t blob[500];
+    unsigned i, j;
+    if (shm_transport_open (&st, shm_name))
+        _exit (2);
+
+    init_shm_pack_context (&spc, &st, max_message_length);
+    for (i = 0; i < count; i++)
+    {
+        shm_pack_context_begin_message (&spc);
+        cw_pack_array_size (&spc.pc, 3);
+        cw_pack_unsigned (&spc.pc, producer_id);
+        cw_pack_unsigned (&spc.pc, i);
+        if (max_message_length)
+            cw_pack_str (&spc.pc, "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMN", i % 40);
+        else
+        {
+            for (j = 0; j < i % 500; j++)
+                blob[j] = (uint8_t)(i + j);
+            cw_pack_bin (&spc.pc, blob, i % 500);
+        }
+        shm_pack_context_end_message (&spc);
+    }
+    int rc = spc.pc.return_code;
+    if (shutdown)
+        shm_transport_shutdown (&st);
+    shm_transport_close (&st);
+    _exit (rc ? 1 : 0);
+}
+
+
+static pid_t start_producer (unsigned producer_id, unsigned long max_message_length, unsigned count, int shutdown)
+{
+    pid_t pid = fork ();
+    if (pid == 0)
+        producer (producer_id, max_message_length, count, shutdown);
+    return pid;
+}
+
+
+static void wait_for_producer (pid_t pid)
+{
+    int status;
+    if (pid < 0 || waitpid (pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status))
+        ERROR1("Producer failed, pid: ", (int)pid);
+}
+
+
+static unsigned long next_unsigned (cw_unpack_context* uc)
+{
+    cw_unpack_next (uc);
+    return uc->return_code || uc->item.type != CWP_ITEM_POSITIVE_INTEGER ? 0xffffffffUL : (unsigned long)uc->item.as.u64;
+}
+
+
+/* Unpacks [producer, sequence, payload]; returns the producer or -1 */
+static int check_message (shm_unpack_context* suc, unsigned* sequences)
+{
+    cw_unpack_context* uc = (cw_unpack_context*)suc;
+    unsigned producer_id, i, j;
+    cw_unpack_next (uc);
+    if (uc->item.type != CWP_ITEM_ARRAY || uc->item.as.array.size != 3)
+        return -1;
+    cw_unpack_next (uc);
+    producer_id = (unsigned)uc->item.as.u64;
+    if (uc->item.type != CWP_ITEM_POSITIVE_INTEGER || producer_id >= PRODUCERS)
+        return -1;
+    cw_unpack_next (uc);
+    i = (unsigned)uc->item.as.u64;
+    if (uc->item.type != CWP_ITEM_POSITIVE_INTEGER || i != sequences[producer_id]++)
+        return -1;
+    cw_unpack_next (uc);
+    if (uc->item.type == CWP_ITEM_STR)
+    {
+        if (uc->item.as.str.length != i % 40 || memcmp (uc->item.as.str.start, "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMN", i % 40))
+            return -1;
+    }
+    else
+    {
+        if (uc->item.type != CWP_ITEM_BIN || uc->item.as.bin.length != i % 500)
+            return -1;
+        for (j = 0; j < i % 500; j++)
+            if (((const uint8_t*)uc->item.as.bin.start)[j] != (uint8_t)(i + j))
+                return -1;
+    }
+    if (uc->return_code || uc->current != uc->end)
+        return -1;
+    return (int)producer_id;
+}
+
+
+int main(int argc, const char * argv[])
+{
+    shm_transport st;
+    shm_unpack_context suc;
+    unsigned sequences[PRODUCERS];
+    unsigned i, wrapped = 0;
+    int rc;
+    pid_t pids[PRODUCERS];
+
+    /* single producer in another process, messages wrap the ring */
+    sprintf (shm_name, "/cwpack_shm_test_%d", (int)getpid ());
+    if (shm_transport_create (&st, shm_name, 4096))
+    {
+        ERROR1("Create transport, errno: ", st.err_no);
+        return error_count;
+    }
+    memset (sequences, 0, sizeof(sequences));
+    pids[0] = start_producer (0, 0, MESSAGES, 1);
+    init_shm_unpack_context (&suc, &st);
+    for (i = 0; i < MESSAGES; i++)
+    {
+        rc = shm_unpack_context_next_message (&suc, TIMEOUT_MS);
+        if (rc)
+        {
+            ERROR1("Single producer next message, rc: ", rc);
+            break;
+        }
+        if (suc.uc.start < st.data + st.capacity && suc.uc.end > st.data + st.capacity)
+            wrapped++;
+        if (check_message (&suc, sequences))
+        {
+            ERROR1("Single producer message ", (int)i);
+            break;
+        }
+    }
+    if (shm_unpack_context_next_message (&suc, TIMEOUT_MS) != CWP_RC_END_OF_INPUT)
+        ERROR("Single producer shutdown");
+    wait_for_producer (pids[0]);
+    if (!wrapped || st.header->tail < 100 * (uint64_t)st.capacity)
+        ERROR1("Ring wrap, messages across the end: ", (int)wrapped);
+    shm_transport_close (&st);
+    shm_unlink (shm_name);
+
+    /* a message as large as the ring */
+    if (shm_transport_create (&st, shm_name, 4096))
+        ERROR1("Create transport, errno: ", st.err_no);
+    else
+    {
+        shm_pack_context spc;
+        uint8_t blob[4096 - 16];
+        memset (blob, 0x5a, sizeof(blob));
+        init_shm_pack_context (&spc, &st, 0);
+        init_shm_unpack_context (&suc, &st);
+        for (i = 0; i < 3; i++)
+        {
+            shm_unpack_context_release_message (&suc);      /* the ring has room for one */
+            shm_pack_context_begin_message (&spc);
+            cw_pack_bin (&spc.pc, blob, (uint32_t)(st.capacity - 16));
+            shm_pack_context_end_message (&spc);
+            if (spc.pc.return_code || shm_unpack_context_next_message (&suc, 0))
+            {
+                ERROR1("Ring sized message ", (int)i);
+                break;
+            }
+            cw_unpack_next (&suc.uc);
+            if (suc.uc.item.type != CWP_ITEM_BIN || suc.uc.item.as.bin.length != st.capacity - 16 ||
+                memcmp (suc.uc.item.as.bin.start, blob, st.capacity - 16))
+                ERROR1("Ring sized message content ", (int)i);
+        }
+        shm_unpack_context_release_message (&suc);
+        shm_pack_context_begin_message (&spc);
+        cw_pack_bin (&spc.pc, blob, (uint32_t)st.capacity);
+        if (spc.pc.return_code != CWP_RC_BUFFER_OVERFLOW)
+            ERROR("Message larger than the ring");
+        shm_pack_context_end_message (&spc);
+
+        /* the dropped message must not leave anything a later record could mistake for a state word */
+        memset (blob, 0xff, sizeof(blob));
+        shm_pack_context_begin_message (&spc);
+        cw_pack_bin (&spc.pc, blob, 200);
+        cw_pack_bin (&spc.pc, blob, (uint32_t)st.capacity);
+        shm_pack_context_end_message (&spc);
+        shm_pack_context_begin_message (&spc);
+        cw_pack_unsigned (&spc.pc, 7);
+        shm_pack_context_end_message (&spc);
+        if (spc.pc.return_code || shm_unpack_context_next_message (&suc, 0) || next_unsigned (&suc.uc) != 7 ||
+            shm_unpack_context_next_message (&suc, 0) != CWP_RC_WOULD_BLOCK)
+            ERROR("Single producer after a dropped message");
+        shm_transport_close (&st);
+        shm_unlink (shm_name);
+    }
+
+    /* a producer whose message is too large for its reservation doesn't block the others */
+    if (shm_transport_create (&st, shm_name, 4096))
+        ERROR1("Create transport, errno: ", st.err_no);
+    else
+    {
+        shm_pack_context a, b;
+        init_shm_pack_context (&a, &st, 64);
+        init_shm_pack_context (&b, &st, 64);
+        init_shm_unpack_context (&suc, &st);
+        shm_pack_context_begin_message (&a);
+        cw_pack_str (&a.pc, "abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuv", 100);
+        shm_pack_context_end_message (&a);
+        if (a.pc.return_code != CWP_RC_BUFFER_OVERFLOW)
+            ERROR1("Message larger than the reservation, rc: ", a.pc.return_code);
+        shm_pack_context_begin_message (&b);
+        cw_pack_unsigned (&b.pc, 7);
+        shm_pack_context_end_message (&b);
+        if (shm_unpack_context_next_message (&suc, 300) || next_unsigned (&suc.uc) != 7)
+            ERROR("Message after a dropped reservation");
+        shm_pack_context_begin_message (&a);
+        cw_pack_unsigned (&a.pc, 8);
+        shm_pack_context_end_message (&a);
+        if (a.pc.return_code || shm_unpack_context_next_message (&suc, 300) || next_unsigned (&suc.uc) != 8)
+            ERROR("Producer after its dropped message");
+        shm_unpack_context_release_message (&suc);
+        shm_transport_close (&st);
+        shm_unlink (shm_name);
+    }
+
+    /* several producers in other processes share the ring */
+    if (shm_transport_create (&st, shm_name, 4096))
+    {
+        ERROR1("Create transport, errno: ", st.err_no);
+        return error_count;
+    }
+    memset (sequences, 0, sizeof(sequences));
+    for (i = 0; i < PRODUCERS; i++)
+        pids[i] = start_producer (i, 64, MESSAGES / PRODUCERS, 0);
+    init_shm_unpack_context (&suc, &st);
+    for (i = 0; i < PRODUCERS * (MESSAGES / PRODUCERS); i++)
+    {
+        rc = shm_unpack_context_next_message (&suc, TIMEOUT_MS);
+        if (rc)
+        {
+            ERROR1("Multi producer next message, rc: ", rc);
+            break;
+        }
+        if (check_message (&suc, sequences) < 0)
+        {
+            ERROR1("Multi producer message ", (int)i);
+            break;
+        }
+    }
+    shm_unpack_context_release_message (&suc);
+    for (i = 0; i < PRODUCERS; i++)
+    {
+        wait_for_producer (pids[i]);
+        if (sequences[i] != MESSAGES / PRODUCERS)
+            ERROR1("Messages lost from producer ", (int)i);
+    }
+    if (shm_unpack_context_next_message (&suc, 0) != CWP_RC_WOULD_BLOCK)
+        ERROR("Empty ring");
+    shm_transport_shutdown (&st);
+    if (shm_unpack_context_next_message (&suc, 0) != CWP_RC_END_OF_INPUT)
+        ERROR("Multi producer shutdown");
+    shm_transport_close (&st);
+    shm_unlink (shm_name);
+
+    printf("CWPack shared memory transport test completed, ");
+    switch (error_count)
+    {
+        case 0:
+            printf("no errors detected\n");
+            break;
+
+        case 1:
+            printf("1 error detected\n");
+            break;
+
+        default:
+            printf("%d errors detected\n", error_count);
+            break;
+    }
+
+    return error_count;
+}
@@ -0,0 +1,3 @@
+clang -I ../../src/ -o structIndexTest *.c ../../src/cwpack.c
+./structIndexTest
+rm -f *.o structIndexTest
@@ -0,0 +1,389 @@
+/*      CWPack/goodies - struct_index.c   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "struct_index.h"
+
+
+/*
+ * The sidecar file is a 64 byte header followed by the items exactly as they are in
+ * memory, so it can be mapped and used in place. It is only valid on machines with the
+ * same byte order, which the header records.
+ */
+
+#define SIDECAR_MAGIC           "CWSI"
+#define SIDECAR_VERSION         1
+#define SIDECAR_BYTE_ORDER      0x01020304
+
+typedef struct
+{
+    char        magic[4];
+    uint32_t    version;
+    uint32_t    byte_order;
+    uint32_t    item_length;
+    uint64_t    item_count;
+    uint64_t    source_length;
+    uint64_t    source_checksum;
+    uint64_t    index_checksum;
+    uint8_t     pad[16];
+} sidecar_header;
+
+
+
+/*****************************************  CHECKSUM  *****************************************/
+
+#define P1  0x9e3779b185ebca87ULL
+#define P2  0xc2b2ae3d27d4eb4fULL
+
+static uint64_t rotl (uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+
+static uint64_t mix (uint64_t h, uint64_t w)
+{
+    return rotl (h ^ (w * P2), 31) * P1;
+}
+
+
+/* Four independent lanes over 32 byte blocks, so it runs at memory speed */
+uint64_t struct_index_checksum (const void* data, unsigned long length)
+{
+    const uint8_t *p = (const uint8_t*)data;
+    uint64_t h[4] = {P1, P2, ~P1, ~P2};
+    uint64_t w[4];
+    unsigned long n = length;
+    int i;
+
+    for (; n >= 32; n -= 32, p += 32)
+    {
+        memcpy (w, p, 32);
+        for (i = 0; i < 4; i++)
+            h[i] = mix (h[i], w[i]);
+    }
+    uint64_t r = rotl (h[0], 1) + rotl (h[1], 7) + rotl (h[2], 12) + rotl (h[3], 18) + length;
+    for (; n >= 8; n -= 8, p += 8)
+    {
+        memcpy (w, p, 8);
+        r = mix (r, w[0]);
+    }
+    for (; n; n--)
+        r = mix (r, *p++);
+
+    r ^= r >> 33;
+    r *= P2;
+    r ^= r >> 29;
+    return r;
+}
+
+
+
+/*****************************************  BUILD  ********************************************/
+
+typedef struct
+{
+    uint64_t    item;
+    uint64_t    remains;                    /* children not yet indexed */
+} open_container;
+
+
+int struct_index_build (struct_index* si, const void* data, unsigned long length)
+{
+    cw_unpack_context uc;
+    open_container *stack = NULL;
+    unsigned long depth = 0, stack_capacity = 0;
+    uint64_t capacity = 1024;
+
+    memset (si, 0, sizeof(struct_index));
+    si->items = malloc (capacity * sizeof(struct_index_item));
+    if (!si->items)
+        return CWP_RC_MALLOC_ERROR;
+    si->source_length = length;
+    si->source_checksum = struct_index_checksum (data, length);
+
+    cw_unpack_context_init (&uc, data, length, 0);
+    while (uc.current < uc.end)
+    {
+        uint8_t *start = uc.current;
+        cw_unpack_next (&uc);
+        if (uc.return_code)
+            break;
+
+        if (si->item_count == capacity)
+        {
+            struct_index_item *items = realloc (si->items, 2 * capacity * sizeof(struct_index_item));
+            if (!items)
+            {
+                uc.return_code = CWP_RC_MALLOC_ERROR;
+                break;
+            }
+            si->items = items;
+            capacity *= 2;
+        }
+        uint64_t i = si->item_count++;
+        struct_index_item *item = si->items + i;
+        item->offset = (uint64_t)(start - (uint8_t*)data);
+        item->type = uc.item.type;
+        item->size = 0;
+
+        uint64_t children = 0;
+        if (uc.item.type == CWP_ITEM_ARRAY)
+            children = item->size = uc.item.as.array.size;
+        else if (uc.item.type == CWP_ITEM_MAP)
+        {
+            item->size = uc.item.as.map.size;
+            children = 2 * (uint64_t)item->size;
+        }
+
+        if (children)
+        {
+            if (depth == stack_capacity)
+            {
+                stack_capacity = stack_capacity ? 2 * stack_capacity : 64;
+                open_container *s = realloc (stack, stack_capacity * sizeof(open_container));
+                if (!s)
+                {
+                    uc.return_code = CWP_RC_MALLOC_ERROR;
+                    break;
+                }
+                stack = s;
+            }
+            stack[depth].item = i;
+            stack[depth++].remains = children;
+            continue;
+        }
+
+        /* a leaf closes every container it completes */
+        item->end = (uint64_t)(uc.current - (uint8_t*)data);
+        item->next = i + 1;
+        while (depth && --stack[depth - 1].remains == 0)
+        {
+            struct_index_item *container = si->items + stack[--depth].item;
+            container->end = item->end;
+            container->next = si->item_count;
+        }
+    }
+    free (stack);
+
+    if (uc.return_code == CWP_RC_OK && depth)
+        uc.return_code = CWP_RC_END_OF_INPUT;
+    if (uc.return_code != CWP_RC_OK)
+    {
+        struct_index_free (si);
+        return uc.return_code;
+    }
+    return CWP_RC_OK;
+}
+
+
+
+/*****************************************  SIDECAR FILE  *************************************/
+
+
+int struct_index_save (const struct_index* si, const char* path)
+{
+    sidecar_header header;
+    char temp_path[4096];
+    unsigned long items_length = (unsigned long)si->item_count * sizeof(struct_index_item);
+
+    memset (&header, 0, sizeof(header));
+    memcpy (header.magic, SIDECAR_MAGIC, 4);
+    header.version = SIDECAR_VERSION;
+    header.byte_order = SIDECAR_BYTE_ORDER;
+    header.item_length = sizeof(struct_index_item);
+    header.item_count = si->item_count;
+    header.source_length = si->source_length;
+    header.source_checksum = si->source_checksum;
+    header.index_checksum = struct_index_checksum (si->items, items_length);
+
+    /* written aside and renamed, so a reader never maps a half written index */
+    if (snprintf (temp_path, sizeof(temp_path), "%s.%ld.tmp", path, (long)getpid()) >= (int)sizeof(temp_path))
+        return CWP_RC_VALUE_ERROR;
+    int fd = open (temp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return CWP_RC_ERROR_IN_HANDLER;
+
+    const uint8_t *p = (const uint8_t*)si->items;
+    unsigned long remains = items_length;
+    bool ok = write (fd, &header, sizeof(header)) == (long)sizeof(header);
+    while (ok && remains)
+    {
+        long l = write (fd, p, remains);
+        ok = l > 0;
+        if (ok)
+        {
+            p += l;
+            remains -= (unsigned long)l;
+        }
+    }
+    if (close (fd))
+        ok = false;
+    if (!ok || rename (temp_path, path))
+    {
+        unlink (temp_path);
+        return CWP_RC_ERROR_IN_HANDLER;
+    }
+    return CWP_RC_OK;
+}
+
+
+static int check_sidecar (const sidecar_header* header, unsigned long file_length, const void* data, unsigned long length, int verify)
+{
+    if (memcmp (header->magic, SIDECAR_MAGIC, 4) || header->version != SIDECAR_VERSION ||
+        header->byte_order != SIDECAR_BYTE_ORDER || header->item_length != sizeof(struct_index_item) ||
+        file_length != sizeof(sidecar_header) + header->item_count * sizeof(struct_index_item) ||
+        header->source_length != length)
+        return CWP_RC_MALFORMED_INPUT;
+
+    const struct_index_item *items = (const struct_index_item*)(header + 1);
+    if (header->item_count && items[header->item_count - 1].end > length)
+        return CWP_RC_MALFORMED_INPUT;
+    if ((verify & STRUCT_INDEX_VERIFY_INDEX) &&
+        struct_index_checksum (items, file_length - sizeof(sidecar_header)) != header->index_checksum)
+        return CWP_RC_MALFORMED_INPUT;
+    if ((verify & STRUCT_INDEX_VERIFY_SOURCE) && struct_index_checksum (data, length) != header->source_checksum)
+        return CWP_RC_MALFORMED_INPUT;
+    return CWP_RC_OK;
+}
+
+
+int struct_index_map (struct_index* si, const char* path, const void* data, unsigned long length, int verify)
+{
+    struct stat st;
+    memset (si, 0, sizeof(struct_index));
+    int fd = open (path, O_RDONLY);
+    if (fd < 0 || fstat (fd, &st))
+    {
+        si->err_no = errno;
+        if (fd >= 0)
+            close (fd);
+        return CWP_RC_ERROR_IN_HANDLER;
+    }
+    unsigned long file_length = (unsigned long)st.st_size;
+    if (file_length < sizeof(sidecar_header))
+    {
+        close (fd);
+        return CWP_RC_MALFORMED_INPUT;
+    }
+
+    void *mapping = mmap (NULL, file_length, PROT_READ, MAP_SHARED, fd, 0);
+    close (fd);
+    if (mapping == MAP_FAILED)
+    {
+        si->err_no = errno;
+        return CWP_RC_ERROR_IN_HANDLER;
+    }
+
+    const sidecar_header *header = (const sidecar_header*)mapping;
+    int rc = check_sidecar (header, file_length, data, length, verify);
+    if (rc != CWP_RC_OK)
+    {
+        munmap (mapping, file_length);
+        return rc;
+    }
+    si->items = (struct_index_item*)(header + 1);
+    si->item_count = header->item_count;
+    si->source_length = header->source_length;
+    si->source_checksum = header->source_checksum;
+    si->mapping = mapping;
+    si->mapping_length = file_length;
+    return CWP_RC_OK;
+}
+
+
+void struct_index_free (struct_index* si)
+{
+    if (si->mapping)
+        munmap (si->mapping, si->mapping_length);
+    else
+        free (si->items);
+    si->items = NULL;
+    si->mapping = NULL;
+    si->item_count = 0;
+}
+
+
+
+/*****************************************  NAVIGATION  ***************************************/
+
+
+long struct_index_child (const struct_index* si, long item, uint32_t n)
+{
+    if (item < 0 || (uint64_t)item >= si->item_count)
+        return -1;
+    const struct_index_item *container = si->items + item;
+    uint64_t children = container->type == CWP_ITEM_MAP ? 2 * (uint64_t)container->size :
+                        container->type == CWP_ITEM_ARRAY ? container->size : 0;
+    if (n >= children)
+        return -1;
+
+    uint64_t child = (uint64_t)item + 1;
+    while (n--)
+        child = si->items[child].next;
+    return (long)child;
+}
+
+
+long struct_index_map_find (const struct_index* si, const void* data, long map_item, const char* key, uint32_t key_length)
+{
+    if (map_item < 0 || (uint64_t)map_item >= si->item_count || si->items[map_item].type != CWP_ITEM_MAP)
+        return -1;
+
+    uint64_t child = (uint64_t)map_item + 1;
+    uint32_t i;
+    for (i = 0; i < si->items[map_item].size; i++)
+    {
+        const struct_index_item *k = si->items + child;
+        uint64_t value = k->next;
+        if (k->type == CWP_ITEM_STR && k->end - k->offset > key_length)
+        {
+            cw_unpack_context uc;
+            cw_unpack_context_init (&uc, (const uint8_t*)data + k->offset, (unsigned long)(k->end - k->offset), 0);
+            cw_unpack_next (&uc);
+            if (uc.item.as.str.length == key_length && !memcmp (uc.item.as.str.start, key, key_length))
+                return (long)value;
+        }
+        child = si->items[value].next;
+    }
+    return -1;
+}
+
+
+void struct_index_unpack_item (const struct_index* si, const void* data, long item, cw_unpack_context* uc)
+{
+    if (item < 0 || (uint64_t)item >= si->item_count)
+    {
+        cw_unpack_context_init (uc, data, 0, 0);
+        uc->return_code = CWP_RC_VALUE_ERROR;
+        return;
+    }
+    const uint8_t *d = (const uint8_t*)data;
+    cw_unpack_context_init (uc, d + si->items[item].offset, (unsigned long)(si->items[item].end - si->items[item].offset), 0);
+}
@@ -0,0 +1,88 @@
+/*      CWPack/goodies - struct_index.h   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef struct_index_h
+#define struct_index_h
+
+#include "cwpack.h"
+
+
+/*****************************************  STRUCTURAL INDEX  *********************************/
+
+/*
+ * A structural index lists the items of a msgpack document in preorder. For each item it
+ * keeps where it starts, where its subtree ends and the index of the item after the
+ * subtree, so containers can be navigated without decoding anything.
+ */
+
+typedef struct
+{
+    uint64_t        offset;                 /* of the item in the document */
+    uint64_t        end;                    /* offset after the item and its children */
+    uint64_t        next;                   /* index of the item after the subtree */
+    int32_t         type;                   /* cwpack_item_types */
+    uint32_t        size;                   /* array/map size */
+} struct_index_item;
+
+typedef struct
+{
+    struct_index_item   *items;
+    uint64_t            item_count;
+    uint64_t            source_length;
+    uint64_t            source_checksum;
+    void                *mapping;           /* when mapped from a sidecar file */
+    unsigned long       mapping_length;
+    int                 err_no;
+} struct_index;
+
+
+#define STRUCT_INDEX_VERIFY_SOURCE  1       /* checksum the document */
+#define STRUCT_INDEX_VERIFY_INDEX   2       /* checksum the mapped index */
+
+uint64_t struct_index_checksum (const void* data, unsigned long length);
+
+/* Indexes all top level items of the document */
+int struct_index_build (struct_index* si, const void* data, unsigned long length);
+
+/* Sidecar files. The document must be the one the index was built from. */
+int struct_index_save (const struct_index* si, const char* path);
+int struct_index_map (struct_index* si, const char* path, const void* data, unsigned long length, int verify);
+
+void struct_index_free (struct_index* si);
+
+
+
+/*****************************************  NAVIGATION  ***************************************/
+
+/* Items are identified by their index, -1 = not found */
+long struct_index_child (const struct_index* si, long item, uint32_t n);
+long struct_index_map_find (const struct_index* si, const void* data, long map_item, const char* key, uint32_t key_length);
+
+/* Sets up uc to unpack the item and its children */
+void struct_index_unpack_item (const struct_index* si, const void* data, long item, cw_unpack_context* uc);
+
+
+
+/*****************************************  E P I L O G U E  **********************************/
+
+
+#endif /* struct_index_h */
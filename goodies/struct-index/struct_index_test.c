@@ -0,0 +1,174 @@
+/*      CWPack/goodies - struct_index_test.c   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cwpack.h"
+#include "struct_index.h"
+
+
+#define RECORDS 2000
+
+int error_count;
+
+static void ERROR(const char* msg)
+{
+    error_count++;
+    printf("ERROR: %s\n", msg);
+}
+
+
+static void ERROR1(const char* msg, int i)
+{
+    error_count++;
+    printf("ERROR: %s%d\n", msg, i);
+}
+
+
+/* [{"id": i, "tags": [0 .. i%5-1], "nested": {"a": {"b": -i}}}, ...] */
+static unsigned long pack_document (uint8_t* buffer, unsigned long length)
+{
+    cw_pack_context pc;
+    int i, k;
+    cw_pack_context_init (&pc, buffer, length, 0);
+    cw_pack_array_size (&pc, RECORDS);
+    for (i = 0; i < RECORDS; i++)
+    {
+        cw_pack_map_size (&pc, 3);
+        cw_pack_str (&pc, "id", 2);
+        cw_pack_unsigned (&pc, (uint64_t)i);
+        cw_pack_str (&pc, "tags", 4);
+        cw_pack_array_size (&pc, (uint32_t)(i % 5));
+        for (k = 0; k < i % 5; k++)
+            cw_pack_unsigned (&pc, (uint64_t)k);
+        cw_pack_str (&pc, "nested", 6);
+        cw_pack_map_size (&pc, 1);
+        cw_pack_str (&pc, "a", 1);
+        cw_pack_map_size (&pc, 1);
+        cw_pack_str (&pc, "b", 1);
+        cw_pack_signed (&pc, -i);
+    }
+    return pc.return_code ? 0 : (unsigned long)(pc.current - pc.start);
+}
+
+
+static void check_queries (const struct_index* si, const uint8_t* document)
+{
+    cw_unpack_context uc;
+    int i;
+    for (i = 0; i < RECORDS; i += 7)
+    {
+        long record = struct_index_child (si, 0, (uint32_t)i);
+        long id = struct_index_map_find (si, document, record, "id", 2);
+        struct_index_unpack_item (si, document, id, &uc);
+        cw_unpack_next (&uc);
+        if (uc.return_code || uc.item.as.u64 != (uint64_t)i)
+            ERROR1("Find id ", i);
+
+        long tags = struct_index_map_find (si, document, record, "tags", 4);
+        if (tags < 0 || si->items[tags].size != (uint32_t)(i % 5) || struct_index_child (si, tags, (uint32_t)(i % 5)) != -1)
+            ERROR1("Find tags ", i);
+
+        long b = struct_index_map_find (si, document, struct_index_map_find (si, document,
+                 struct_index_map_find (si, document, record, "nested", 6), "a", 1), "b", 1);
+        struct_index_unpack_item (si, document, b, &uc);
+        cw_unpack_next (&uc);
+        if (uc.return_code || uc.item.as.i64 != -i)
+            ERROR1("Find nested ", i);
+
+        if (struct_index_map_find (si, document, record, "idx", 3) != -1)
+            ERROR1("Find missing key ", i);
+    }
+
+    struct_index_unpack_item (si, document, struct_index_child (si, 0, 3), &uc);
+    cw_skip_items (&uc, 1);
+    if (uc.return_code || uc.current != uc.end)
+        ERROR("Item extent");
+}
+
+
+int main(int argc, const char * argv[])
+{
+    static uint8_t document[200000];
+    struct_index si, msi;
+    (void)argc; (void)argv;
+    printf("CWPack structural index test started.\n");
+    error_count = 0;
+
+    unsigned long length = pack_document (document, sizeof(document));
+    if (struct_index_build (&si, document, length) || si.item_count != 1 + RECORDS * 11 + RECORDS / 5 * 10 ||
+        si.items[0].next != si.item_count || si.items[0].end != length)
+        ERROR("Build index");
+    check_queries (&si, document);
+
+    char path[] = "/tmp/cwpack_struct_index_XXXXXX";
+    close (mkstemp (path));
+    if (struct_index_save (&si, path))
+        ERROR("Save sidecar");
+    if (struct_index_map (&msi, path, document, length, STRUCT_INDEX_VERIFY_SOURCE | STRUCT_INDEX_VERIFY_INDEX) ||
+        msi.item_count != si.item_count || !msi.mapping)
+        ERROR("Map sidecar");
+    check_queries (&msi, document);
+    struct_index_free (&msi);
+
+    if (struct_index_map (&msi, path, document, length - 1, 0) != CWP_RC_MALFORMED_INPUT)
+        ERROR("Sidecar for other length");
+    document[length - 1] ^= 1;
+    if (struct_index_map (&msi, path, document, length, STRUCT_INDEX_VERIFY_SOURCE) != CWP_RC_MALFORMED_INPUT)
+        ERROR("Sidecar for changed document");
+    if (struct_index_map (&msi, path, document, length, 0) != CWP_RC_OK)
+        ERROR("Unverified sidecar");
+    struct_index_free (&msi);
+    document[length - 1] ^= 1;
+
+    FILE *f = fopen (path, "r+b");
+    fseek (f, 100, SEEK_SET);
+    fputc (0x55, f);
+    fclose (f);
+    if (struct_index_map (&msi, path, document, length, STRUCT_INDEX_VERIFY_INDEX) != CWP_RC_MALFORMED_INPUT)
+        ERROR("Corrupt sidecar");
+    unlink (path);
+    struct_index_free (&si);
+
+    if (struct_index_build (&si, document, length - 1) == CWP_RC_OK)
+        ERROR("Build truncated document");
+
+    printf("CWPack structural index test completed, ");
+    switch (error_count)
+    {
+        case 0:
+            printf("no errors detected\n");
+            break;
+
+        case 1:
+            printf("1 error detected\n");
+            break;
+
+        default:
+            printf("%d errors detected\n", error_count);
+            break;
+    }
+
+    return error_count;
+}
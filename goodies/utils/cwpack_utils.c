@@ -22,6 +22,7 @@
 
 
 #include <math.h>
+#include <string.h>
 #include "cwpack_utils.h"
 
 
@@ -392,3 +393,29 @@ unsigned int cw_unpack_next_map_size(cw_unpack_context* unpack_context)
     return 0;
 }
 
+
+bool cw_map_find (cw_unpack_context* unpack_context, const char* key, uint32_t key_length)
+{
+    unsigned int size = cw_unpack_next_map_size (unpack_context);
+    cwpack_item* item = &unpack_context->item;
+    unsigned int i;
+
+    for (i = 0; i < size; i++)
+    {
+        cw_unpack_next (unpack_context);
+        if (unpack_context->return_code)        return false;
+
+        if (item->type == CWP_ITEM_STR)
+        {
+            if (item->as.str.length == key_length && !memcmp (item->as.str.start, key, key_length))
+                return true;
+        }
+        else if (item->type == CWP_ITEM_ARRAY)
+            cw_skip_items (unpack_context, (long)item->as.array.size);
+        else if (item->type == CWP_ITEM_MAP)
+            cw_skip_items (unpack_context, 2 * (long)item->as.map.size);
+
+        cw_skip_items (unpack_context, 1);      /* the value */
+    }
+    return false;
+}
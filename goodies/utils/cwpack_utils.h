@@ -28,7 +28,7 @@
 
 /*******************************   P A C K   **********************************/
 
-#define cw_pack_cstr(context,string) cw_pack_str (context, string, (uint32)strlen(string))
+#define cw_pack_cstr(context,string) cw_pack_str (context, string, (uint32_t)strlen(string))
 
 void cw_pack_float_opt (cw_pack_context* pack_context, float f);    /* Pack as signed if precision isn't destroyed */
 void cw_pack_double_opt (cw_pack_context* pack_context, double d);  /* Pack as signed or float if precision isn't destroyed */
@@ -64,5 +64,8 @@ unsigned int cw_unpack_next_bin_lengh (cw_unpack_context* unpack_context);
 unsigned int cw_unpack_next_array_size(cw_unpack_context* unpack_context);
 unsigned int cw_unpack_next_map_size(cw_unpack_context* unpack_context);
 
+/* Next item is a map. Positions the context at the value of the string key, or after the map if not found */
+bool cw_map_find (cw_unpack_context* unpack_context, const char* key, uint32_t key_length);
+
 #endif  /* CWPack_utils_H__ */
 
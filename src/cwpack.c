@@ -434,6 +434,67 @@ void cw_pack_insert (cw_pack_context* pack_context, const void* v, uint32_t l)
 }
 
 
+void cw_pack_str_begin (cw_pack_context* pack_context, uint32_t l)
+{
+    if (pack_context->return_code)
+        return;
+
+    if (l < 32)
+        tryMove0(0xa0 | l);
+
+    if (l < 256 && !pack_context->be_compatible)
+        tryMove1(0xd9, l);
+
+    if (l < 65536)
+        tryMove2(0xda, l);
+
+    tryMove4(0xdb, l);
+}
+
+
+void cw_pack_bin_begin (cw_pack_context* pack_context, uint32_t l)
+{
+    if (pack_context->return_code)
+        return;
+
+    if (pack_context->be_compatible)
+    {
+        cw_pack_str_begin (pack_context, l);
+        return;
+    }
+
+    if (l < 256)
+        tryMove1(0xc4, l);
+
+    if (l < 65536)
+        tryMove2(0xc5, l);
+
+    tryMove4(0xc6, l);
+}
+
+
+/* The chunk is moved in pieces that fit the buffer, so the overflow handler is never asked to grow it */
+void cw_pack_blob_chunk (cw_pack_context* pack_context, const void* v, uint32_t l)
+{
+    if (pack_context->return_code)
+        return;
+
+    const uint8_t *src = (const uint8_t*)v;
+    while (l)
+    {
+        if (pack_context->current == pack_context->end)
+            cw_pack_new_buffer(1)
+
+        uint32_t space = (uint32_t)(pack_context->end - pack_context->current);
+        uint32_t n = l < space ? l : space;
+        memcpy(pack_context->current, src, n);
+        pack_context->current += n;
+        src += n;
+        l -= n;
+    }
+}
+
+
 void cw_pack_flush (cw_pack_context* pack_context)
 {
     if (pack_context->return_code == CWP_RC_OK)
@@ -813,4 +874,100 @@ cwpack_item_types cw_look_ahead (cw_unpack_context* unpack_context)
     }
 }
 
+
+void cw_unpack_blob_begin (cw_unpack_context* unpack_context)
+{
+    if (unpack_context->return_code)
+        return;
+
+    uint32_t    tmpu32;
+    uint16_t    tmpu16;
+    uint8_t*    p;
+
+#undef buffer_end_return_code
+#define buffer_end_return_code  CWP_RC_END_OF_INPUT;
+    cw_unpack_assert_space(1);
+    uint8_t c = *p;
+#undef buffer_end_return_code
+#define buffer_end_return_code  CWP_RC_BUFFER_UNDERFLOW;
+    switch (c)
+    {
+        case 0xa0: case 0xa1: case 0xa2: case 0xa3: case 0xa4: case 0xa5: case 0xa6: case 0xa7:
+        case 0xa8: case 0xa9: case 0xaa: case 0xab: case 0xac: case 0xad: case 0xae: case 0xaf:
+        case 0xb0: case 0xb1: case 0xb2: case 0xb3: case 0xb4: case 0xb5: case 0xb6: case 0xb7:
+        case 0xb8: case 0xb9: case 0xba: case 0xbb: case 0xbc: case 0xbd: case 0xbe: case 0xbf:
+                    getDDItem(CWP_ITEM_STR, str.length, c & 0x1f);      break;  // fixraw
+        case 0xd9:  getDDItem1(CWP_ITEM_STR, str.length, uint8_t);      break;  // str 8
+        case 0xda:  getDDItem2(CWP_ITEM_STR, str.length, uint16_t);     break;  // str 16
+        case 0xdb:  getDDItem4(CWP_ITEM_STR, str.length, uint32_t);     break;  // str 32
+        case 0xc4:  getDDItem1(CWP_ITEM_BIN, bin.length, uint8_t);      break;  // bin 8
+        case 0xc5:  getDDItem2(CWP_ITEM_BIN, bin.length, uint16_t);     break;  // bin 16
+        case 0xc6:  getDDItem4(CWP_ITEM_BIN, bin.length, uint32_t);     break;  // bin 32
+        case 0xc7:  unpack_context->current -= 1;                               // ext 8
+                    cw_unpack_assert_space(3);
+                    if ((cwpack_item_types)*(int8_t*)(p+2) == CWP_ITEM_TIMESTAMP)
+                    {
+                        unpack_context->current -= 3;           // timestamps are values, not blobs
+                        cw_unpack_next (unpack_context);
+                        return;
+                    }
+                    unpack_context->item.type = (cwpack_item_types)*(int8_t*)(p+2);
+                    unpack_context->item.as.ext.length = p[1];
+                    break;
+        case 0xc8:  getDDItem2(CWP_ITEM_EXT, ext.length, uint16_t);             // ext 16
+                    cw_unpack_assert_space(1);
+                    unpack_context->item.type = (cwpack_item_types)*(int8_t*)p;
+                    break;
+        case 0xd4: case 0xd5: case 0xd6: case 0xd7: case 0xd8:                  // fixext
+                    unpack_context->current -= 1;
+                    cw_unpack_assert_space(2);
+                    if ((cwpack_item_types)*(int8_t*)(p+1) == CWP_ITEM_TIMESTAMP)
+                    {
+                        unpack_context->current -= 2;
+                        cw_unpack_next (unpack_context);
+                        return;
+                    }
+                    unpack_context->item.type = (cwpack_item_types)*(int8_t*)(p+1);
+                    unpack_context->item.as.ext.length = 1u << (c - 0xd4);
+                    break;
+        case 0xc9:  getDDItem4(CWP_ITEM_EXT, ext.length, uint32_t);             // ext 32
+                    cw_unpack_assert_space(1);
+                    unpack_context->item.type = (cwpack_item_types)*(int8_t*)p;
+                    break;
+        default:                                        // not a large blob, unpack as usual
+                    unpack_context->current -= 1;
+                    cw_unpack_next (unpack_context);
+                    return;
+    }
+    unpack_context->item.as.bin.start = NULL;           // str, bin and ext share layout; NULL: payload left in input
+}
+
+
+/* Moves the buffered input and then asks the underflow handler for a refill, never for more */
+void cw_unpack_blob_read (cw_unpack_context* unpack_context, void* dst, unsigned long n)
+{
+    if (unpack_context->return_code)
+        return;
+
+    uint8_t *d = (uint8_t*)dst;
+    while (n)
+    {
+        unsigned long available = (unsigned long)(unpack_context->end - unpack_context->current);
+        if (!available)
+        {
+            if (!unpack_context->handle_unpack_underflow)
+                UNPACK_ERROR(CWP_RC_BUFFER_UNDERFLOW)
+            int rc = unpack_context->handle_unpack_underflow (unpack_context, 1);
+            if (rc != CWP_RC_OK)
+                UNPACK_ERROR(rc == CWP_RC_END_OF_INPUT ? CWP_RC_BUFFER_UNDERFLOW : rc)
+            continue;
+        }
+        unsigned long l = n < available ? n : available;
+        memcpy(d, unpack_context->current, l);
+        unpack_context->current += l;
+        d += l;
+        n -= l;
+    }
+}
+
 /* end cwpack.c */
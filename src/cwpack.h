@@ -45,6 +45,7 @@
 #define CWP_RC_TYPE_ERROR               -10
 #define CWP_RC_VALUE_ERROR              -11
 #define CWP_RC_WRONG_TIMESTAMP_LENGTH   -12
+#define CWP_RC_WOULD_BLOCK              -13
 
 
 
@@ -94,6 +95,11 @@ void cw_pack_time (cw_pack_context* pack_context, int64_t sec, uint32_t nsec);
 
 void cw_pack_insert (cw_pack_context* pack_context, const void* v, uint32_t l);
 
+/* Large blobs: pack the header, then the payload in chunks of any size */
+void cw_pack_str_begin (cw_pack_context* pack_context, uint32_t l);
+void cw_pack_bin_begin (cw_pack_context* pack_context, uint32_t l);
+void cw_pack_blob_chunk (cw_pack_context* pack_context, const void* v, uint32_t l);
+
 
 /*****************************   U N P A C K   ********************************/
 
@@ -306,5 +312,13 @@ void cw_unpack_next (cw_unpack_context* unpack_context);
 void cw_skip_items (cw_unpack_context* unpack_context, long item_count);
 cwpack_item_types cw_look_ahead (cw_unpack_context* unpack_context);
 
+/*
+ * Large blobs: as cw_unpack_next, but the payload of str, bin and ext items is left in input
+ * to be moved with cw_unpack_blob_read. item.as.str/bin/ext.start is then NULL. Timestamps and
+ * all other items are unpacked as by cw_unpack_next.
+ */
+void cw_unpack_blob_begin (cw_unpack_context* unpack_context);
+void cw_unpack_blob_read (cw_unpack_context* unpack_context, void* dst, unsigned long n);
+
 
 #endif  /* CWPack_H__ */
@@ -0,0 +1,812 @@
+/*      CWPack/test - basic_contexts_test.c   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <pthread.h>
+
+#include "cwpack.h"
+#include "basic_contexts.h"
+#include "compressed_contexts.h"
+
+
+char TEST_area[70000];
+
+int error_count;
+
+static void ERROR(const char* msg)
+{
+    error_count++;
+    printf("ERROR: %s\n", msg);
+}
+
+
+static void ERROR1(const char* msg, int i)
+{
+    error_count++;
+    printf("ERROR: %s%d\n", msg, i);
+}
+
+
+static uint64_t next_unsigned (cw_unpack_context* uc)
+{
+    cw_unpack_next (uc);
+    return uc->item.type == CWP_ITEM_POSITIVE_INTEGER ? uc->item.as.u64 : (uint64_t)-1;
+}
+
+
+static int temp_file (void)
+{
+    char name[] = "/tmp/cwpack_test_XXXXXX";
+    int fd = mkstemp (name);
+    if (fd < 0)
+    {
+        ERROR("Couldn't create temp file");
+        exit(1);
+    }
+    unlink (name);
+    return fd;
+}
+
+
+/* Writes a sequence of items where blobs of varying length makes them straddle any buffer boundary */
+
+#define TEST_ITEMS 2000
+
+static void pack_test_items (cw_pack_context* pc)
+{
+    int i;
+    for (i = 0; i < TEST_ITEMS; i++)
+    {
+        cw_pack_array_size (pc, 2);
+        cw_pack_unsigned (pc, (uint64_t)i);
+        cw_pack_bin (pc, TEST_area + i, (uint32_t)((i * 37) % 5000));
+    }
+}
+
+
+static void check_test_items (cw_unpack_context* uc)
+{
+    int i;
+    for (i = 0; i < TEST_ITEMS; i++)
+    {
+        cw_unpack_next (uc);
+        if (uc->item.type != CWP_ITEM_ARRAY || uc->item.as.array.size != 2)
+        {
+            ERROR1("Wrong array at item ", i);
+            return;
+        }
+        cw_unpack_next (uc);
+        if (uc->item.type != CWP_ITEM_POSITIVE_INTEGER || uc->item.as.u64 != (uint64_t)i)
+        {
+            ERROR1("Wrong integer at item ", i);
+            return;
+        }
+        cw_unpack_next (uc);
+        if (uc->item.type != CWP_ITEM_BIN || uc->item.as.bin.length != (uint32_t)((i * 37) % 5000) ||
+            memcmp (uc->item.as.bin.start, TEST_area + i, uc->item.as.bin.length))
+        {
+            ERROR1("Wrong blob at item ", i);
+            return;
+        }
+    }
+    cw_unpack_next (uc);
+    if (uc->return_code != CWP_RC_END_OF_INPUT)
+        ERROR1("Expected end of input, rc = ", uc->return_code);
+}
+
+
+static int file_with_test_items (void)
+{
+    int fd = temp_file ();
+    file_pack_context fpc;
+    init_file_pack_context (&fpc, 1000, fd);
+    pack_test_items (&fpc.pc);
+    terminate_file_pack_context (&fpc);
+    if (fpc.pc.return_code)
+        ERROR1("In file pack, rc = ", fpc.pc.return_code);
+    lseek (fd, 0, SEEK_SET);
+    return fd;
+}
+
+
+#define SHARED_THREADS  8
+#define SHARED_RECORDS  3000
+
+static shared_file_writer shared_writer;
+
+/* Each thread writes records [thread, n, bin] with increasing n */
+static void* shared_file_thread (void* arg)
+{
+    shared_file_pack_context sfpc;
+    uint64_t thread = (uint64_t)(unsigned long)arg;
+    int i;
+    init_shared_file_pack_context (&sfpc, 4096, &shared_writer);
+    for (i = 0; i < SHARED_RECORDS; i++)
+    {
+        cw_pack_array_size (&sfpc.pc, 3);
+        cw_pack_unsigned (&sfpc.pc, thread);
+        cw_pack_unsigned (&sfpc.pc, (uint64_t)i);
+        cw_pack_bin (&sfpc.pc, TEST_area + i, (uint32_t)((i * 53) % 7000));
+        shared_file_pack_context_end_record (&sfpc);
+    }
+    if (sfpc.pc.return_code)
+        ERROR1("In shared file pack, rc = ", sfpc.pc.return_code);
+    terminate_shared_file_pack_context (&sfpc);
+    return NULL;
+}
+
+
+static uint8_t pipe_received[70000];
+static unsigned long pipe_received_length;
+
+static void* pipe_reader_thread (void* arg)
+{
+    int fd = ((int*)arg)[0];
+    long n;
+    pipe_received_length = 0;
+    while ((n = read (fd, pipe_received + pipe_received_length, sizeof(pipe_received) - pipe_received_length)) > 0)
+        pipe_received_length += (unsigned long)n;
+    return NULL;
+}
+
+
+static void* tail_writer_thread (void* arg)
+{
+    static const uint8_t items[] = {0x92, 0x01, 0xa3, 'a', 'b', 'c', 0xcd, 0x01, 0x00};
+    int fd = *(int*)arg;
+    unsigned i;
+    for (i = 0; i < sizeof(items); i++)
+    {
+        usleep (2000);
+        if (write (fd, items + i, 1) != 1)
+            ERROR("Tail write");
+    }
+    return NULL;
+}
+
+
+static void check_codec (const cw_block_codec* codec, const uint8_t* data, unsigned long length)
+{
+    static uint8_t compressed[80000], decompressed[80000];
+    long l = codec->compress (codec, data, length, compressed, sizeof(compressed));
+    if (l < 0 || codec->decompress (codec, compressed, (unsigned long)l, decompressed, length) != (long)length ||
+        memcmp (data, decompressed, length))
+        ERROR1("Codec round trip, length ", (int)length);
+    if (length && l > 0 && codec->decompress (codec, compressed, (unsigned long)l - 1, decompressed, length) == (long)length)
+        ERROR1("Codec accepts truncated block, length ", (int)length);
+}
+
+
+static void pack_text (cw_pack_context* pc, const char* text)
+{
+    cw_pack_str (pc, text, (uint32_t)strlen (text));
+}
+
+
+static void pack_message (cw_pack_context* pc, unsigned i)
+{
+    static const char* levels[] = {"debug", "info", "warning", "error"};
+    static const char* services[] = {"gateway", "billing", "inventory", "search", "accounts"};
+    char text[80];
+    unsigned j;
+    cw_pack_map_size (pc, 7);
+    pack_text (pc, "timestamp");
+    cw_pack_unsigned (pc, 1700000000000ULL + i * 37);
+    pack_text (pc, "level");
+    pack_text (pc, levels[i % 4]);
+    pack_text (pc, "service");
+    pack_text (pc, services[i % 5]);
+    pack_text (pc, "request_id");
+    sprintf (text, "req-%08x-%04x", i * 2654435761U, i % 9973);
+    pack_text (pc, text);
+    pack_text (pc, "latency_ms");
+    cw_pack_float (pc, (float)(i % 1000) / 7);
+    pack_text (pc, "message");
+    sprintf (text, "request completed for customer %u with status %u after %u retries", i % 577, 200 + i % 3, i % 4);
+    pack_text (pc, text);
+    pack_text (pc, "tags");
+    cw_pack_array_size (pc, 1 + i % 5);
+    for (j = 0; j <= i % 5; j++)
+        pack_text (pc, services[(i + j) % 5]);
+}
+
+
+static bool same_file_content (int fd1, int fd2, off_t offset2)
+{
+    off_t length = lseek (fd1, 0, SEEK_END);
+    if (lseek (fd2, 0, SEEK_END) != length + offset2)
+        return false;
+    uint8_t *b1 = malloc ((size_t)length), *b2 = malloc ((size_t)length);
+    bool same = pread (fd1, b1, (size_t)length, 0) == length && pread (fd2, b2, (size_t)length, offset2) == length &&
+                !memcmp (b1, b2, (size_t)length);
+    free (b1);
+    free (b2);
+    return same;
+}
+
+
+
+int main(int argc, const char * argv[])
+{
+    (void)argc;(void)argv;
+
+    printf("CWPack basic contexts test started.\n");
+    error_count = 0;
+
+    unsigned int ui;
+    for (ui=0; ui<70000; ui++)
+    {
+        TEST_area[ui] = ui & 0x7fUL;
+    }
+    int fd;
+
+
+    /*******************   TEST ring buffer unpack context  ****************************/
+
+    ring_buffer_unpack_context rbuc;
+    fd = file_with_test_items ();
+    init_ring_buffer_unpack_context (&rbuc, 1, fd);     /* one page, forces wrap and growth */
+    if (rbuc.uc.return_code)
+        ERROR1("In ring buffer init, rc = ", rbuc.uc.return_code);
+    else
+    {
+        check_test_items (&rbuc.uc);
+        terminate_ring_buffer_unpack_context (&rbuc);
+    }
+    close (fd);
+
+    /*******************   TEST scatter unpack context  ****************************/
+
+    dynamic_memory_pack_context dmpc;
+    init_dynamic_memory_pack_context (&dmpc, 1000);
+    pack_test_items (&dmpc.pc);
+    if (dmpc.pc.return_code)
+        ERROR1("In dynamic memory pack, rc = ", dmpc.pc.return_code);
+    else
+    {
+        struct iovec fragments[1000];
+        unsigned long length = (unsigned long)(dmpc.pc.current - dmpc.pc.start);
+        unsigned long offset = 0;
+        int count = 0;
+        while (offset < length && count < 999)
+        {
+            unsigned long l = (unsigned long)(count * 7919) % 6000;    /* includes empty and tiny fragments */
+            if (l > length - offset)
+                l = length - offset;
+            fragments[count].iov_base = dmpc.pc.start + offset;
+            fragments[count++].iov_len = l;
+            offset += l;
+        }
+        fragments[count].iov_base = dmpc.pc.start + offset;
+        fragments[count++].iov_len = length - offset;
+
+        scatter_unpack_context scuc;
+        init_scatter_unpack_context (&scuc, fragments, count);
+        check_test_items (&scuc.uc);
+        terminate_scatter_unpack_context (&scuc);
+    }
+    free_dynamic_memory_pack_context (&dmpc);
+
+    /*******************   TEST large blobs in bounded buffers  ****************************/
+
+    fd = temp_file ();
+    stream_pack_context spc;
+    FILE* file = fdopen (fd, "w+");
+    init_stream_pack_context (&spc, 4096, file);
+    cw_pack_bin_begin (&spc.pc, 1000000);
+    for (ui = 0; ui < 1000000; ui += 60000)
+        cw_pack_blob_chunk (&spc.pc, TEST_area + ui % 7, ui + 60000 <= 1000000 ? 60000 : 1000000 - ui);
+    cw_pack_unsigned (&spc.pc, 17);
+    if (spc.pc.end - spc.pc.start != 4096)
+        ERROR("Stream pack buffer has grown");
+    terminate_stream_pack_context (&spc);
+    if (spc.pc.return_code)
+        ERROR1("In stream pack, rc = ", spc.pc.return_code);
+
+    rewind (file);
+    stream_unpack_context suc;
+    init_stream_unpack_context (&suc, 1024, file);
+    cw_unpack_blob_begin (&suc.uc);
+    if (suc.uc.item.type != CWP_ITEM_BIN || suc.uc.item.as.bin.length != 1000000)
+        ERROR("Wrong blob header");
+    for (ui = 0; ui < 1000000; ui += 60000)
+    {
+        unsigned long l = ui + 60000 <= 1000000 ? 60000 : 1000000 - ui;
+        cw_unpack_blob_read (&suc.uc, TEST_area + 65536 - l, l);
+        if (memcmp (TEST_area + 65536 - l, TEST_area + ui % 7, 1000))
+            ERROR("Wrong blob content");
+    }
+    cw_unpack_next (&suc.uc);
+    if (suc.uc.item.type != CWP_ITEM_POSITIVE_INTEGER || suc.uc.item.as.u64 != 17)
+        ERROR("Wrong item after blob");
+    if (suc.buffer_length != 1024)
+        ERROR("Stream unpack buffer has grown");
+    terminate_stream_unpack_context (&suc);
+    fclose (file);
+
+    fd = temp_file ();
+    file_pack_context fpc;
+    init_file_pack_context (&fpc, 4096, fd);
+    cw_pack_bin_begin (&fpc.pc, 60000);
+    file_pack_context_blob_chunk (&fpc, TEST_area, 30000);
+    file_pack_context_blob_chunk (&fpc, TEST_area + 30000, 30000);
+    cw_pack_unsigned (&fpc.pc, 17);
+    terminate_file_pack_context (&fpc);
+    if (fpc.pc.return_code)
+        ERROR1("In file pack, rc = ", fpc.pc.return_code);
+
+    lseek (fd, 0, SEEK_SET);
+    file_unpack_context fuc;
+    init_file_unpack_context (&fuc, 1024, fd);
+    cw_unpack_blob_begin (&fuc.uc);
+    if (fuc.uc.item.type != CWP_ITEM_BIN || fuc.uc.item.as.bin.length != 60000)
+        ERROR("Wrong blob header");
+    char *blob = malloc (60000);
+    file_unpack_context_blob_read (&fuc, blob, 10);
+    file_unpack_context_blob_read (&fuc, blob + 10, 59990);
+    if (memcmp (blob, TEST_area, 60000))
+        ERROR("Wrong blob content");
+    free (blob);
+    cw_unpack_next (&fuc.uc);
+    if (fuc.uc.item.type != CWP_ITEM_POSITIVE_INTEGER || fuc.uc.item.as.u64 != 17)
+        ERROR("Wrong item after blob");
+    if (fuc.buffer_length != 1024)
+        ERROR("File unpack buffer has grown");
+    terminate_file_unpack_context (&fuc);
+    close (fd);
+
+    /*******************   TEST bin from fd  ****************************/
+
+    int source = temp_file ();
+    if (write (source, TEST_area, 70000) != 70000)
+        ERROR("Couldn't write source file");
+    fd = temp_file ();
+    init_file_pack_context (&fpc, 4096, fd);
+    cw_pack_unsigned (&fpc.pc, 16);
+    file_pack_context_bin_from_fd (&fpc, source, 100, 65536);
+    cw_pack_unsigned (&fpc.pc, 17);
+    fpc.pc.err_no = EIO;
+    file_pack_context_bin_from_fd (&fpc, source, 69990, 20);     /* source too short */
+    if (fpc.pc.return_code != CWP_RC_ERROR_IN_HANDLER || fpc.pc.err_no)
+        ERROR1("Expected error in handler without errno, rc = ", fpc.pc.return_code);
+    fpc.pc.return_code = CWP_RC_OK;
+    terminate_file_pack_context (&fpc);
+
+    /* a pipe takes the blob a part at a time */
+    int blob_pipe[2];
+    pthread_t pipe_reader;
+    if (pipe (blob_pipe))
+        ERROR("Couldn't create pipe");
+    pthread_create (&pipe_reader, NULL, pipe_reader_thread, blob_pipe);
+    init_file_pack_context (&fpc, 4096, blob_pipe[1]);
+    file_pack_context_bin_from_fd (&fpc, source, 100, 65536);
+    cw_pack_unsigned (&fpc.pc, 18);
+    if (fpc.pc.return_code)
+        ERROR1("In blob to pipe, rc = ", fpc.pc.return_code);
+    terminate_file_pack_context (&fpc);
+    close (blob_pipe[1]);
+    pthread_join (pipe_reader, NULL);
+    close (blob_pipe[0]);
+    cw_unpack_context pipe_uc;
+    cw_unpack_context_init (&pipe_uc, pipe_received, pipe_received_length, 0);
+    cw_unpack_next (&pipe_uc);
+    if (pipe_uc.item.type != CWP_ITEM_BIN || pipe_uc.item.as.bin.length != 65536 ||
+        memcmp (pipe_uc.item.as.bin.start, TEST_area + 100, 65536) || next_unsigned (&pipe_uc) != 18)
+        ERROR("Wrong blob from pipe");
+    close (source);
+
+    lseek (fd, 0, SEEK_SET);
+    init_file_unpack_context (&fuc, 1024, fd);
+    if (next_unsigned (&fuc.uc) != 16)
+        ERROR("Wrong item before blob");
+    cw_unpack_next (&fuc.uc);
+    if (fuc.uc.item.type != CWP_ITEM_BIN || fuc.uc.item.as.bin.length != 65536 ||
+        memcmp (fuc.uc.item.as.bin.start, TEST_area + 100, 65536))
+        ERROR("Wrong blob from fd");
+    if (next_unsigned (&fuc.uc) != 17)
+        ERROR("Wrong item after blob");
+    terminate_file_unpack_context (&fuc);
+    close (fd);
+
+    /*******************   TEST socket contexts  ****************************/
+
+    int sockets[2];
+    if (socketpair (AF_UNIX, SOCK_STREAM, 0, sockets))
+        ERROR("Couldn't create socket pair");
+    fcntl (sockets[0], F_SETFL, O_NONBLOCK);
+    fcntl (sockets[1], F_SETFL, O_NONBLOCK);
+
+    socket_pack_context skpc;
+    socket_unpack_context skuc;
+    init_socket_pack_context (&skpc, 4096, sockets[0]);
+    init_socket_unpack_context (&skuc, 1024, sockets[1]);
+    pack_test_items (&skpc.pc);                            /* far more than the socket buffer */
+    if (skpc.pc.return_code)
+        ERROR1("In socket pack, rc = ", skpc.pc.return_code);
+    if (socket_pack_context_flush (&skpc) != CWP_RC_WOULD_BLOCK)
+        ERROR("Expected socket pack to block");
+
+    int blocked = 0;
+    for (ui = 0; ui < TEST_ITEMS && !error_count; )
+    {
+        socket_unpack_context_set_barrier (&skuc);
+        cw_unpack_next (&skuc.uc);
+        cw_unpack_next (&skuc.uc);
+        unsigned long n = skuc.uc.item.as.u64;
+        cw_unpack_next (&skuc.uc);
+        if (skuc.uc.return_code == CWP_RC_WOULD_BLOCK)
+        {
+            blocked++;
+            int rc = socket_pack_context_flush (&skpc);
+            if (rc != CWP_RC_OK && rc != CWP_RC_WOULD_BLOCK)
+                ERROR1("In socket flush, rc = ", rc);
+            socket_unpack_context_resume (&skuc);
+            continue;
+        }
+        if (skuc.uc.return_code || n != ui || skuc.uc.item.type != CWP_ITEM_BIN ||
+            memcmp (skuc.uc.item.as.bin.start, TEST_area + ui, skuc.uc.item.as.bin.length))
+            ERROR1("Wrong item from socket ", (int)ui);
+        socket_unpack_context_release_barrier (&skuc);
+        ui++;
+    }
+    if (!blocked)
+        ERROR("Socket unpack never blocked");
+    if (skpc.pending || skpc.chunk_count)
+        ERROR("Socket pack context not drained");
+    terminate_socket_pack_context (&skpc);
+    close (sockets[0]);
+    cw_unpack_next (&skuc.uc);
+    if (skuc.uc.return_code != CWP_RC_END_OF_INPUT)
+        ERROR1("Expected end of input, rc = ", skuc.uc.return_code);
+    terminate_socket_unpack_context (&skuc);
+    close (sockets[1]);
+
+    /* at max_pending the context stops before the item and a flush that makes room resumes it */
+    if (socketpair (AF_UNIX, SOCK_STREAM, 0, sockets))
+        ERROR("Couldn't create socket pair");
+    fcntl (sockets[0], F_SETFL, O_NONBLOCK);
+    fcntl (sockets[1], F_SETFL, O_NONBLOCK);
+    init_socket_pack_context (&skpc, 4096, sockets[0]);
+    socket_pack_context_set_max_pending (&skpc, 16384);
+    init_socket_unpack_context (&skuc, 1024, sockets[1]);
+    unsigned packed = 0, received = 0, stops = 0;
+    while (received < 2000 && !error_count)
+    {
+        if (packed < 2000 && !skpc.pc.return_code)
+        {
+            cw_pack_bin (&skpc.pc, TEST_area + packed % 1000, 1000);
+            if (!skpc.pc.return_code)
+                packed++;
+            else if (skpc.pc.return_code == CWP_RC_WOULD_BLOCK)
+                stops++;
+            else
+                ERROR1("In limited socket pack, rc = ", skpc.pc.return_code);
+            continue;
+        }
+        int rc = socket_pack_context_flush (&skpc);
+        if (rc != CWP_RC_OK && rc != CWP_RC_WOULD_BLOCK)
+            ERROR1("In limited socket flush, rc = ", rc);
+        if (skpc.pending > 16384 + 4096)
+            ERROR1("Socket pending above limit: ", (int)skpc.pending);
+        socket_unpack_context_set_barrier (&skuc);
+        cw_unpack_next (&skuc.uc);
+        if (skuc.uc.return_code == CWP_RC_WOULD_BLOCK)
+        {
+            socket_unpack_context_resume (&skuc);
+            continue;
+        }
+        if (skuc.uc.return_code || skuc.uc.item.type != CWP_ITEM_BIN || skuc.uc.item.as.bin.length != 1000 ||
+            memcmp (skuc.uc.item.as.bin.start, TEST_area + received % 1000, 1000))
+            ERROR1("Wrong item from limited socket ", (int)received);
+        socket_unpack_context_release_barrier (&skuc);
+        received++;
+    }
+    if (!stops)
+        ERROR("Socket pack never reached max pending");
+    terminate_socket_pack_context (&skpc);
+    close (sockets[0]);
+    terminate_socket_unpack_context (&skuc);
+    close (sockets[1]);
+
+    /*******************   TEST direct file contexts  ****************************/
+
+    int reference_fd = file_with_test_items ();
+
+    /* aligned start, carry-over at every overflow */
+    direct_file_pack_context dfpc;
+    fd = temp_file ();
+    init_direct_file_pack_context (&dfpc, 5000, fd);
+    pack_test_items (&dfpc.pc);
+    terminate_direct_file_pack_context (&dfpc);
+    if (dfpc.pc.return_code)
+        ERROR1("In direct file pack, rc = ", dfpc.pc.return_code);
+    if (!same_file_content (reference_fd, fd, 0))
+        ERROR("Direct file pack content");
+
+    direct_file_unpack_context dfuc;
+    lseek (fd, 0, SEEK_SET);
+    init_direct_file_unpack_context (&dfuc, 1, fd);
+    direct_file_unpack_context_set_barrier (&dfuc);
+    cw_skip_items (&dfuc.uc, 100);
+    direct_file_unpack_context_rescan_from_barrier (&dfuc);
+    direct_file_unpack_context_release_barrier (&dfuc);
+    check_test_items (&dfuc.uc);
+    terminate_direct_file_unpack_context (&dfuc);
+    close (fd);
+
+    /* unaligned start, flush of a partial block and everything behind the barrier */
+    fd = temp_file ();
+    if (write (fd, "\x01\x02\x03", 3) != 3)
+        ERROR("Write head");
+    init_direct_file_pack_context (&dfpc, 1, fd);
+    cw_pack_flush (&dfpc.pc);
+    direct_file_pack_context_set_barrier (&dfpc);
+    pack_test_items (&dfpc.pc);
+    direct_file_pack_context_release_barrier (&dfpc);
+    terminate_direct_file_pack_context (&dfpc);
+    if (dfpc.pc.return_code)
+        ERROR1("In direct file pack with barrier, rc = ", dfpc.pc.return_code);
+    if (!same_file_content (reference_fd, fd, 3))
+        ERROR("Direct file pack content after head");
+
+    lseek (fd, 3, SEEK_SET);
+    init_direct_file_unpack_context (&dfuc, 10000, fd);
+    check_test_items (&dfuc.uc);
+    terminate_direct_file_unpack_context (&dfuc);
+    lseek (fd, 0, SEEK_SET);
+    init_direct_file_unpack_context (&dfuc, 0, fd);
+    if (next_unsigned (&dfuc.uc) != 1 || next_unsigned (&dfuc.uc) != 2 || next_unsigned (&dfuc.uc) != 3)
+        ERROR("Direct file unpack head");
+    check_test_items (&dfuc.uc);
+    terminate_direct_file_unpack_context (&dfuc);
+    close (fd);
+    close (reference_fd);
+
+    /*******************   TEST shared file pack context  ****************************/
+
+    pthread_t threads[SHARED_THREADS];
+    fd = temp_file ();
+    init_shared_file_writer (&shared_writer, fd);
+    for (ui = 0; ui < SHARED_THREADS; ui++)
+        pthread_create (threads + ui, NULL, shared_file_thread, (void*)(unsigned long)ui);
+    for (ui = 0; ui < SHARED_THREADS; ui++)
+        pthread_join (threads[ui], NULL);
+
+    uint64_t expected[SHARED_THREADS] = {0};
+    lseek (fd, 0, SEEK_SET);
+    init_file_unpack_context (&fuc, 4096, fd);
+    for (ui = 0; ui < SHARED_THREADS * SHARED_RECORDS; ui++)
+    {
+        cw_unpack_next (&fuc.uc);
+        uint64_t thread = next_unsigned (&fuc.uc);
+        uint64_t n = next_unsigned (&fuc.uc);
+        cw_unpack_next (&fuc.uc);
+        if (fuc.uc.return_code || thread >= SHARED_THREADS || n != expected[thread] ||
+            fuc.uc.item.as.bin.length != (uint32_t)((n * 53) % 7000) || memcmp (fuc.uc.item.as.bin.start, TEST_area + n, fuc.uc.item.as.bin.length))
+        {
+            ERROR1("Wrong shared file record ", (int)ui);
+            break;
+        }
+        expected[thread]++;
+    }
+    cw_unpack_next (&fuc.uc);
+    if (fuc.uc.return_code != CWP_RC_END_OF_INPUT)
+        ERROR1("Expected end of shared file, rc = ", fuc.uc.return_code);
+    terminate_file_unpack_context (&fuc);
+    close (fd);
+
+    /*******************   TEST tail file unpack context  ****************************/
+
+    tail_file_unpack_context tfuc;
+    pthread_t tail_writer;
+    char tail_path[] = "/tmp/cwpack_tail_XXXXXX";
+    fd = mkstemp (tail_path);
+    int tail_fd = open (tail_path, O_RDONLY);
+    init_tail_file_unpack_context (&tfuc, 4, tail_fd, 2000);
+    pthread_create (&tail_writer, NULL, tail_writer_thread, &fd);
+    cw_unpack_next (&tfuc.fuc.uc);
+    if (tfuc.fuc.uc.item.type != CWP_ITEM_ARRAY || tfuc.fuc.uc.item.as.array.size != 2 || next_unsigned (&tfuc.fuc.uc) != 1)
+        ERROR("Tail array");
+    cw_unpack_next (&tfuc.fuc.uc);
+    if (tfuc.fuc.uc.item.type != CWP_ITEM_STR || tfuc.fuc.uc.item.as.str.length != 3 || memcmp (tfuc.fuc.uc.item.as.str.start, "abc", 3))
+        ERROR("Tail string");
+    if (next_unsigned (&tfuc.fuc.uc) != 256)
+        ERROR("Tail integer");
+    pthread_join (tail_writer, NULL);
+
+    tfuc.timeout = 20;
+    file_unpack_context_set_barrier (&tfuc.fuc);
+    cw_unpack_next (&tfuc.fuc.uc);
+    if (tfuc.fuc.uc.return_code != CWP_RC_WOULD_BLOCK)
+        ERROR1("Expected tail timeout, rc = ", tfuc.fuc.uc.return_code);
+    cw_pack_context tail_pc;
+    cw_pack_context_init (&tail_pc, TEST_area, 10, NULL);
+    cw_pack_signed (&tail_pc, -1000);
+    if (write (fd, TEST_area, 3) != 3)
+        ERROR("Tail write");
+    tail_file_unpack_context_resume (&tfuc);
+    cw_unpack_next (&tfuc.fuc.uc);
+    if (tfuc.fuc.uc.item.type != CWP_ITEM_NEGATIVE_INTEGER || tfuc.fuc.uc.item.as.i64 != -1000)
+        ERROR("Tail after resume");
+    unlink (tail_path);
+    cw_unpack_next (&tfuc.fuc.uc);
+    if (tfuc.fuc.uc.return_code != CWP_RC_END_OF_INPUT)
+        ERROR1("Expected tail end of input, rc = ", tfuc.fuc.uc.return_code);
+    terminate_tail_file_unpack_context (&tfuc);
+    close (tail_fd);
+    close (fd);
+
+    /* a pipe at end of file is done, there is nothing to wait for */
+    int tail_pipe[2];
+    if (pipe (tail_pipe) || write (tail_pipe[1], "\x01\x02", 2) != 2)
+        ERROR("Tail pipe");
+    close (tail_pipe[1]);
+    init_tail_file_unpack_context (&tfuc, 4, tail_pipe[0], 500);
+    if (next_unsigned (&tfuc.fuc.uc) != 1 || next_unsigned (&tfuc.fuc.uc) != 2)
+        ERROR("Tail pipe items");
+    cw_unpack_next (&tfuc.fuc.uc);
+    if (tfuc.fuc.uc.return_code != CWP_RC_END_OF_INPUT)
+        ERROR1("Expected tail pipe end of input, rc = ", tfuc.fuc.uc.return_code);
+    terminate_tail_file_unpack_context (&tfuc);
+    close (tail_pipe[0]);
+
+    /*******************   TEST compressed file contexts  ****************************/
+
+    static uint8_t codec_data[70000];
+    for (ui = 0; ui < sizeof(codec_data); ui++)
+        codec_data[ui] = (uint8_t)(ui < 20000 ? (ui * 7919) >> 5 : ui < 40000 ? ui % 3 : ui % 251 < 100 ? 'a' : ui / 97);
+    for (ui = 0; ui < 300; ui++)
+        check_codec (&cw_lz_codec, codec_data + ui * 13, ui);
+    check_codec (&cw_lz_codec, codec_data, sizeof(codec_data));
+    check_codec (&cw_lz_codec, codec_data + 20000, 20000);
+
+    const cw_block_codec *codecs[2] = {NULL, &cw_lz_codec};
+    for (ui = 0; ui < 2; ui++)
+    {
+        compressed_file_pack_context cfpc;
+        fd = temp_file ();
+        init_compressed_file_pack_context (&cfpc, 5000, fd, codecs[ui]);
+        pack_test_items (&cfpc.pc);
+        terminate_compressed_file_pack_context (&cfpc);
+        if (cfpc.pc.return_code)
+            ERROR1("In compressed file pack, rc = ", cfpc.pc.return_code);
+
+        compressed_file_unpack_context cfuc;
+        lseek (fd, 0, SEEK_SET);
+        init_compressed_file_unpack_context (&cfuc, fd, NULL);
+        check_test_items (&cfuc.uc);
+        terminate_compressed_file_unpack_context (&cfuc);
+        close (fd);
+    }
+
+    /*******************   TEST dictionary compression  ******************************/
+
+    dynamic_memory_pack_context sample_pc;
+    unsigned long sample_lengths[300];
+    init_dynamic_memory_pack_context (&sample_pc, 65536);
+    for (ui = 0; ui < 300; ui++)
+    {
+        uint8_t *before = sample_pc.pc.current;
+        pack_message (&sample_pc.pc, (unsigned)ui);
+        sample_lengths[ui] = (unsigned long)(sample_pc.pc.current - before);
+    }
+    cw_dictionary dictionary;
+    if (cw_dictionary_train (&dictionary, 0, sample_pc.pc.start, sample_lengths, 300, 4096))
+        ERROR("Dictionary training");
+    free_dynamic_memory_pack_context (&sample_pc);
+    if (dictionary.length > 4096 || dictionary.length < 1024 || !dictionary.id)
+        ERROR1("Dictionary length ", (int)dictionary.length);
+
+    dictionary_pack_context dpc;
+    dictionary_unpack_context duc;
+    unsigned long raw_total = 0, compressed_total = 0;
+    init_dictionary_pack_context (&dpc, 64, &dictionary);
+    init_dictionary_unpack_context (&duc, &dictionary, 1);
+    for (ui = 1000; ui < 1500; ui++)
+    {
+        dictionary_pack_context_reset (&dpc);
+        pack_message (&dpc.pc, (unsigned)ui);
+        if (dictionary_pack_context_finish (&dpc))
+            ERROR1("In dictionary pack, rc = ", dpc.pc.return_code);
+        unsigned long raw_length = (unsigned long)(dpc.pc.current - dpc.pc.start);
+        raw_total += raw_length;
+        compressed_total += dpc.message_length;
+        if (dictionary_unpack_context_set_message (&duc, dpc.message, dpc.message_length) ||
+            (unsigned long)(duc.uc.end - duc.uc.start) != raw_length ||
+            memcmp (duc.uc.start, dpc.pc.start, raw_length))
+        {
+            ERROR1("Dictionary round trip ", (int)ui);
+            break;
+        }
+        cw_skip_items (&duc.uc, 1);
+        if (duc.uc.return_code || duc.uc.current != duc.uc.end)
+            ERROR1("Dictionary message items ", (int)ui);
+    }
+    if (compressed_total * 2 > raw_total)
+        ERROR1("Dictionary compression too weak, percent ", (int)(100 * compressed_total / raw_total));
+
+    /* the table is restored after each message, so a used context compresses like a fresh one */
+    dictionary_pack_context fresh;
+    init_dictionary_pack_context (&fresh, 64, &dictionary);
+    pack_message (&fresh.pc, 1000);
+    dictionary_pack_context_reset (&dpc);
+    pack_message (&dpc.pc, 1000);
+    if (dictionary_pack_context_finish (&fresh) || dictionary_pack_context_finish (&dpc) ||
+        fresh.message_length != dpc.message_length || memcmp (fresh.message, dpc.message, dpc.message_length))
+        ERROR("Dictionary table not restored");
+    terminate_dictionary_pack_context (&fresh);
+
+    dictionary_pack_context_reset (&dpc);
+    cw_pack_unsigned (&dpc.pc, 17);
+    dictionary_pack_context_finish (&dpc);
+    if (dpc.message_length != 1 || dictionary_unpack_context_set_message (&duc, dpc.message, dpc.message_length) ||
+        next_unsigned (&duc.uc) != 17)
+        ERROR("Plain dictionary message");
+    terminate_dictionary_unpack_context (&duc);
+
+    dictionary_pack_context_reset (&dpc);
+    pack_message (&dpc.pc, 77);
+    dictionary_pack_context_finish (&dpc);
+    init_dictionary_unpack_context (&duc, NULL, 0);
+    if (dictionary_unpack_context_set_message (&duc, dpc.message, dpc.message_length) != CWP_RC_MALFORMED_INPUT)
+        ERROR("Unknown dictionary accepted");
+    terminate_dictionary_unpack_context (&duc);
+    terminate_dictionary_pack_context (&dpc);
+    cw_dictionary_free (&dictionary);
+
+    uint8_t small_samples[1000];
+    unsigned long small_lengths[10];
+    for (ui = 0; ui < 1000; ui++)
+        small_samples[ui] = (uint8_t)(ui % 100 < 50 ? ui % 7 : ui * 31);
+    for (ui = 0; ui < 10; ui++)
+        small_lengths[ui] = 100;
+    if (cw_dictionary_train (&dictionary, 0, small_samples, small_lengths, 10, 32) || dictionary.length > 32)
+        ERROR("Small dictionary training");
+    cw_dictionary_free (&dictionary);
+
+    /*************************************************************/
+
+    printf("CWPack basic contexts test completed, ");
+    switch (error_count)
+    {
+        case 0:
+            printf("no errors detected\n");
+            break;
+
+        case 1:
+            printf("1 error detected\n");
+            break;
+
+        default:
+            printf("%d errors detected\n", error_count);
+            break;
+    }
+
+    return error_count;
+}
@@ -299,6 +299,17 @@ int main(int argc, const char * argv[])
     TESTP_AREA(bin,65535,"c5ffff");
     TESTP_AREA(bin,65536,"c600010000");
 
+    // TESTP large blobs in chunks
+    pack_ctx.current = outbuffer;
+    cw_pack_bin_begin (&pack_ctx, 65536);
+    for (ui = 0; ui < 65536; ui += 1000)
+        cw_pack_blob_chunk (&pack_ctx, TEST_area + ui, ui + 1000 <= 65536 ? 1000 : 65536 - ui);
+    check_pack_result("c600010000", 65536);
+    pack_ctx.current = outbuffer;
+    cw_pack_str_begin (&pack_ctx, 31);
+    cw_pack_blob_chunk (&pack_ctx, TEST_area, 31);
+    check_pack_result("bf", 31);
+
 #define TESTP_EXT(call,type,len,header)                 \
     pack_ctx.current = outbuffer;                        \
     cw_pack_##call (&pack_ctx, type, TEST_area, len);    \
@@ -459,6 +470,50 @@ int main(int argc, const char * argv[])
 
 
 
+    // TESTUP large blobs in chunks
+    cw_unpack_context_init (&unpack_ctx, outbuffer, 65536 + 5, 0);
+    outbuffer[0] = 0xc6; outbuffer[1] = 0; outbuffer[2] = 1; outbuffer[3] = 0; outbuffer[4] = 0;
+    memcpy (outbuffer + 5, TEST_area, 65536);
+    cw_unpack_blob_begin (&unpack_ctx);
+    if (unpack_ctx.item.type != CWP_ITEM_BIN || unpack_ctx.item.as.bin.length != 65536)
+        ERROR("In blob begin");
+    for (ui = 0; ui < 65536; ui += 4096)
+    {
+        cw_unpack_blob_read (&unpack_ctx, inputbuf, 30);
+        if (memcmp (inputbuf, TEST_area + ui, 30))
+            ERROR("In blob read, value error");
+        cw_unpack_blob_read (&unpack_ctx, outbuffer + 70000 - 4096, 4096 - 30);
+    }
+    if (unpack_ctx.return_code || unpack_ctx.current != unpack_ctx.end)
+        ERROR("In blob read");
+    cw_unpack_blob_read (&unpack_ctx, inputbuf, 1);
+    if (unpack_ctx.return_code != CWP_RC_BUFFER_UNDERFLOW)
+        ERROR("In blob read past end");
+
+    cw_unpack_context_init (&unpack_ctx, "\xc7\x03\x11" "abc" "\xd5\x05" "de" "\xd6\xff\x00\x00\x00\x2a", 16, 0);
+    cw_unpack_blob_begin (&unpack_ctx);
+    if (unpack_ctx.item.type != 0x11 || unpack_ctx.item.as.ext.length != 3 || unpack_ctx.item.as.ext.start)
+        ERROR("In blob begin, ext 8");
+    cw_unpack_blob_read (&unpack_ctx, inputbuf, 3);
+    if (memcmp (inputbuf, "abc", 3))
+        ERROR("In blob read, ext 8");
+    cw_unpack_blob_begin (&unpack_ctx);
+    if (unpack_ctx.item.type != 5 || unpack_ctx.item.as.ext.length != 2 || unpack_ctx.item.as.ext.start)
+        ERROR("In blob begin, fixext");
+    cw_unpack_blob_read (&unpack_ctx, inputbuf, 2);
+    if (memcmp (inputbuf, "de", 2))
+        ERROR("In blob read, fixext");
+    cw_unpack_blob_begin (&unpack_ctx);
+    if (unpack_ctx.item.type != CWP_ITEM_TIMESTAMP || unpack_ctx.item.as.time.tv_sec != 42 ||
+        unpack_ctx.return_code || unpack_ctx.current != unpack_ctx.end)
+        ERROR("In blob begin, timestamp");
+
+    cw_unpack_context_init (&unpack_ctx, "\x92", 1, 0);
+    cw_unpack_blob_begin (&unpack_ctx);
+    if (unpack_ctx.item.type != CWP_ITEM_ARRAY || unpack_ctx.item.as.array.size != 2)
+        ERROR("In blob begin, non-blob item");
+
+
     //*******************   TEST skip   ***************************
 
     cw_pack_context_init (&pack_ctx, outbuffer, 100, 0);
@@ -480,6 +535,49 @@ int main(int argc, const char * argv[])
     }
 
 
+    //*******************   TEST map find   ***********************
+
+    cw_pack_context_init (&pack_ctx, outbuffer, 100, 0);
+    cw_pack_map_size(&pack_ctx,4);
+    cw_pack_unsigned(&pack_ctx,1);          //non-string key
+    cw_pack_str(&pack_ctx,"one",3);
+    cw_pack_array_size(&pack_ctx,1);        //container key
+    cw_pack_str(&pack_ctx,"key",3);
+    cw_pack_str(&pack_ctx,"key",3);
+    cw_pack_str(&pack_ctx,"keys",4);
+    cw_pack_map_size(&pack_ctx,1);          //container value
+    cw_pack_str(&pack_ctx,"key",3);
+    cw_pack_unsigned(&pack_ctx,0x952);
+    cw_pack_str(&pack_ctx,"key",3);
+    cw_pack_unsigned(&pack_ctx,0x68357);
+    cw_pack_unsigned(&pack_ctx,0x12);       //first item after map
+    if(pack_ctx.return_code)
+    {
+        ERROR("Couldn't generate testdata for map_find");
+    }
+    else
+    {
+        cw_unpack_context_init (&unpack_ctx, pack_ctx.start, (unsigned long)(pack_ctx.current-pack_ctx.start), 0);
+        if (!cw_map_find (&unpack_ctx, "key", 3))
+            ERROR("Map find");
+        check_unpack (0x68357, CWP_RC_OK);
+        check_unpack (0x12, CWP_RC_OK);
+
+        cw_unpack_context_init (&unpack_ctx, pack_ctx.start, (unsigned long)(pack_ctx.current-pack_ctx.start), 0);
+        if (cw_map_find (&unpack_ctx, "ke", 2) || unpack_ctx.return_code)
+            ERROR("Map find missing key");
+        check_unpack (0x12, CWP_RC_OK);
+
+        cw_unpack_context_init (&unpack_ctx, pack_ctx.start, (unsigned long)(pack_ctx.current-pack_ctx.start - 2), 0);
+        if (cw_map_find (&unpack_ctx, "ke", 2) || unpack_ctx.return_code != CWP_RC_BUFFER_UNDERFLOW)
+            ERROR("Map find in truncated map");
+
+        cw_unpack_context_init (&unpack_ctx, pack_ctx.current - 1, 1, 0);
+        if (cw_map_find (&unpack_ctx, "key", 3) || unpack_ctx.return_code != CWP_RC_TYPE_ERROR)
+            ERROR("Map find in non-map");
+    }
+
+
     //*************************************************************
 
     printf("CWPack module test completed, ");
@@ -0,0 +1,3 @@
+clang -O3 -I ../src/ -I ../goodies/basic-contexts/ -o basicContextsTest basic_contexts_test.c ../src/cwpack.c ../goodies/basic-contexts/*.c -lpthread
+./basicContextsTest
+rm -f *.o basicContextsTest